@@ -1 +1,17 @@
 from ._cairo import *  # noqa: F401,F403
+from . import _cairo
+
+# Types of rarely used backends get added to _cairo on first access, so
+# they aren't part of the star import above.
+__all__ = [n for n in dir(_cairo) if not n.startswith("_")]
+
+
+def __getattr__(name):
+    # only called on a miss, so keep it for the next lookup
+    value = getattr(_cairo, name)
+    globals()[name] = value
+    return value
+
+
+def __dir__():
+    return sorted(set(globals()) | set(dir(_cairo)))
@@ -124,6 +124,100 @@ buffer_proxy_dealloc(PyObject* obj)
 }
 #endif
 
+/* Exports the rectangles of a cairo_rectangle_list_t as a read-only Nx4
+ * float64 buffer and destroys the list once the last view is gone. */
+
+typedef struct {
+    PyObject_HEAD
+    cairo_rectangle_list_t *list;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} Pycairo_RectangleBuffer;
+
+static PyTypeObject Pycairo_RectangleBufferType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "cairo._RectangleBuffer",
+    sizeof(Pycairo_RectangleBuffer),
+};
+
+static int
+rectangle_buffer_getbuffer(PyObject *exporter, Py_buffer *view, int flags)
+{
+    Pycairo_RectangleBuffer *self = (Pycairo_RectangleBuffer *)exporter;
+
+    if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+        PyErr_SetString (PyExc_BufferError, "buffer is read-only");
+        view->obj = NULL;
+        return -1;
+    }
+
+    /* an empty list has no rectangles, but the buffer can't be NULL */
+    view->buf = self->list->rectangles ? (void *)self->list->rectangles :
+        (void *)self->strides;
+    view->obj = exporter;
+    Py_INCREF (exporter);
+    view->len = self->shape[0] * self->strides[0];
+    view->readonly = 1;
+    view->itemsize = sizeof (double);
+    view->format = (flags & PyBUF_FORMAT) ? "d" : NULL;
+    view->ndim = 2;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ?
+        self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyBufferProcs Pycairo_RectangleBuffer_as_buffer = {
+#if PY_MAJOR_VERSION < 3
+    (readbufferproc)0,
+    (writebufferproc)0,
+    (segcountproc)0,
+    (charbufferproc)0,
+#endif
+    (getbufferproc)rectangle_buffer_getbuffer,
+    (releasebufferproc)0,
+};
+
+static void
+rectangle_buffer_dealloc(PyObject* obj)
+{
+    Pycairo_RectangleBuffer *self = (Pycairo_RectangleBuffer *)obj;
+
+    if (self->list != NULL) {
+        cairo_rectangle_list_destroy (self->list);
+        self->list = NULL;
+    }
+
+    Py_TYPE(obj)->tp_free(obj);
+}
+
+/* Takes ownership of list and returns a memoryview of its rectangles */
+PyObject *
+rectangle_buffer_create_view(cairo_rectangle_list_t *list) {
+    PyObject *memoryview;
+    Pycairo_RectangleBuffer *self;
+
+    self = PyObject_New(Pycairo_RectangleBuffer,
+                        &Pycairo_RectangleBufferType);
+    if (self == NULL) {
+        cairo_rectangle_list_destroy (list);
+        return NULL;
+    }
+
+    self->list = list;
+    self->shape[0] = list->num_rectangles;
+    self->shape[1] = 4;
+    self->strides[0] = sizeof (cairo_rectangle_t);
+    self->strides[1] = sizeof (double);
+
+    memoryview = PyMemoryView_FromObject ((PyObject *)self);
+    Py_DECREF(self);
+
+    return memoryview;
+}
+
 int
 init_buffer_proxy (void) {
 #if PY_MAJOR_VERSION >= 3
@@ -136,5 +230,19 @@ init_buffer_proxy (void) {
     if (PyType_Ready(&Pycairo_BufferProxyType) < 0)
         return -1;
 #endif
+
+    Pycairo_RectangleBufferType.tp_as_buffer =
+        &Pycairo_RectangleBuffer_as_buffer;
+    Pycairo_RectangleBufferType.tp_dealloc = &rectangle_buffer_dealloc;
+#if PY_MAJOR_VERSION < 3
+    Pycairo_RectangleBufferType.tp_flags =
+        Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER;
+#else
+    Pycairo_RectangleBufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+#endif
+
+    if (PyType_Ready(&Pycairo_RectangleBufferType) < 0)
+        return -1;
+
     return 0;
 }
@@ -32,6 +32,8 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
+#include <string.h>
+
 #include "config.h"
 #include "private.h"
 
@@ -76,7 +78,7 @@ _Pycairo_Get_Error(void) {
  */
 static Pycairo_CAPI_t CAPI = {
   &PycairoContext_Type,
-  PycairoContext_FromContext,
+  _PycairoContext_FromForeignContext,
 
   &PycairoFontFace_Type,
   &PycairoToyFontFace_Type,
@@ -154,8 +156,203 @@ static Pycairo_CAPI_t CAPI = {
 #else
   0,
 #endif
+
+  _PycairoContext_Get,
 };
 
+/* Types of rarely used backends, together with their enums, get readied
+ * and added to the module on first attribute access through the module
+ * __getattr__ instead of on import. Pythons without module __getattr__
+ * support get all of them on import, as do builds with
+ * PYCAIRO_EAGER_TYPES defined, for comparing import times. */
+#if PY_VERSION_HEX >= 0x03070000 && !defined(PYCAIRO_EAGER_TYPES)
+#define PYCAIRO_LAZY_TYPES
+#endif
+
+typedef struct {
+  const char *name;
+  PyTypeObject *type;
+} lazy_type_t;
+
+typedef struct {
+  /* NULL terminated */
+  lazy_type_t types[3];
+  int (*init_enums) (PyObject *module);
+  /* the module attributes added by init_enums, NULL terminated */
+  const char *const *enum_names;
+  int ready;
+} lazy_group_t;
+
+static lazy_group_t lazy_groups[] = {
+#ifdef CAIRO_HAS_PDF_SURFACE
+  {{{"PDFSurface", &PycairoPDFSurface_Type}}, init_pdf_enums,
+   pdf_enum_names},
+#endif
+#ifdef CAIRO_HAS_PS_SURFACE
+  {{{"PSSurface", &PycairoPSSurface_Type}}, init_ps_enums,
+   ps_enum_names},
+#endif
+#ifdef CAIRO_HAS_SVG_SURFACE
+  {{{"SVGSurface", &PycairoSVGSurface_Type}}, init_svg_enums,
+   svg_enum_names},
+#endif
+#ifdef CAIRO_HAS_SCRIPT_SURFACE
+  {{{"ScriptDevice", &PycairoScriptDevice_Type},
+    {"ScriptSurface", &PycairoScriptSurface_Type}}, init_script_enums,
+   script_enum_names},
+#endif
+#ifdef CAIRO_HAS_TEE_SURFACE
+  {{{"TeeSurface", &PycairoTeeSurface_Type}}},
+#endif
+  {{{"RasterSourcePattern", &PycairoRasterSourcePattern_Type}}},
+};
+
+#define N_LAZY_GROUPS (sizeof (lazy_groups) / sizeof (lazy_groups[0]))
+
+static int
+lazy_group_ready (lazy_group_t *group, PyObject *module) {
+  const lazy_type_t *t;
+
+  if (group->ready)
+    return 0;
+
+  for (t = group->types; t->type != NULL; t++) {
+    if (PyType_Ready (t->type) < 0)
+      return -1;
+    Py_INCREF (t->type);
+    if (PyModule_AddObject (module, t->name, (PyObject *)t->type) < 0) {
+      Py_DECREF (t->type);
+      return -1;
+    }
+  }
+
+  if (group->init_enums != NULL && group->init_enums (module) < 0)
+    return -1;
+
+  group->ready = 1;
+  return 0;
+}
+
+/* Makes sure type is ready before instances of it get created from C, in
+ * case it belongs to a backend which hasn't been accessed through the
+ * module yet. Returns -1 and sets an exception on error. */
+int
+_Pycairo_Lazy_Type_Ready (PyTypeObject *type) {
+#ifdef PYCAIRO_LAZY_TYPES
+  PyObject *module;
+  const lazy_type_t *t;
+  size_t i;
+
+  if (type->tp_flags & Py_TPFLAGS_READY)
+    return 0;
+
+  module = PyState_FindModule (&cairomoduledef);
+  if (module == NULL) {
+    PyErr_SetString (PyExc_RuntimeError, "cairo module not initialized");
+    return -1;
+  }
+
+  for (i = 0; i < N_LAZY_GROUPS; i++) {
+    for (t = lazy_groups[i].types; t->type != NULL; t++) {
+      if (t->type == type)
+        return lazy_group_ready (&lazy_groups[i], module);
+    }
+  }
+#endif
+
+  return PyType_Ready (type);
+}
+
+#ifdef PYCAIRO_LAZY_TYPES
+
+static int
+lazy_group_has_name (const lazy_group_t *group, const char *name) {
+  const lazy_type_t *t;
+  const char *const *n;
+
+  for (t = group->types; t->type != NULL; t++) {
+    if (strcmp (t->name, name) == 0)
+      return 1;
+  }
+  for (n = group->enum_names; n != NULL && *n != NULL; n++) {
+    if (strcmp (*n, name) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+static PyObject *
+pycairo_getattr (PyObject *self, PyObject *name) {
+  const char *str;
+  PyObject *value;
+  size_t i;
+
+  str = PyUnicode_AsUTF8 (name);
+  if (str == NULL)
+    return NULL;
+
+  for (i = 0; i < N_LAZY_GROUPS; i++) {
+    if (lazy_groups[i].ready || !lazy_group_has_name (&lazy_groups[i], str))
+      continue;
+    if (lazy_group_ready (&lazy_groups[i], self) < 0)
+      return NULL;
+    value = PyDict_GetItem (PyModule_GetDict (self), name);
+    if (value != NULL) {
+      Py_INCREF (value);
+      return value;
+    }
+    break;
+  }
+
+  PyErr_Format (PyExc_AttributeError,
+                "module 'cairo' has no attribute '%U'", name);
+  return NULL;
+}
+
+static PyObject *
+pycairo_dir (PyObject *self) {
+  PyObject *names, *name;
+  const lazy_type_t *t;
+  const char *const *n;
+  size_t i;
+
+  names = PyDict_Keys (PyModule_GetDict (self));
+  if (names == NULL)
+    return NULL;
+
+  for (i = 0; i < N_LAZY_GROUPS; i++) {
+    if (lazy_groups[i].ready)
+      continue;
+    for (t = lazy_groups[i].types; t->type != NULL; t++) {
+      name = PyUnicode_FromString (t->name);
+      if (name == NULL || PyList_Append (names, name) < 0) {
+        Py_XDECREF (name);
+        Py_DECREF (names);
+        return NULL;
+      }
+      Py_DECREF (name);
+    }
+    for (n = lazy_groups[i].enum_names; n != NULL && *n != NULL; n++) {
+      name = PyUnicode_FromString (*n);
+      if (name == NULL || PyList_Append (names, name) < 0) {
+        Py_XDECREF (name);
+        Py_DECREF (names);
+        return NULL;
+      }
+      Py_DECREF (name);
+    }
+  }
+
+  if (PyList_Sort (names) < 0) {
+    Py_DECREF (names);
+    return NULL;
+  }
+
+  return names;
+}
+
+#endif
+
 static PyObject *
 pycairo_cairo_version (PyObject *self) {
   return PYCAIRO_PyLong_FromLong (cairo_version());
@@ -170,6 +367,17 @@ static PyMethodDef cairo_functions[] = {
   {"cairo_version",    (PyCFunction)pycairo_cairo_version, METH_NOARGS},
   {"cairo_version_string", (PyCFunction)pycairo_cairo_version_string,
    METH_NOARGS},
+  {"decimate_m4", (PyCFunction)decimate_m4, METH_VARARGS | METH_KEYWORDS},
+  {"simplify_polyline", (PyCFunction)simplify_polyline,
+   METH_VARARGS | METH_KEYWORDS},
+#if defined(CAIRO_HAS_RECORDING_SURFACE) && defined(CAIRO_HAS_PNG_FUNCTIONS)
+  {"render_tile_pyramid", (PyCFunction)render_tile_pyramid,
+   METH_VARARGS | METH_KEYWORDS},
+#endif
+#ifdef PYCAIRO_LAZY_TYPES
+  {"__getattr__", (PyCFunction)pycairo_getattr, METH_O},
+  {"__dir__", (PyCFunction)pycairo_dir, METH_NOARGS},
+#endif
   {NULL, NULL, 0, NULL},
 };
 
@@ -236,8 +444,6 @@ PYCAIRO_MOD_INIT(_cairo)
     return PYCAIRO_MOD_ERROR_VAL;
   if (PyType_Ready(&PycairoMeshPattern_Type) < 0)
     return PYCAIRO_MOD_ERROR_VAL;
-  if (PyType_Ready(&PycairoRasterSourcePattern_Type) < 0)
-    return PYCAIRO_MOD_ERROR_VAL;
 
   if (PyType_Ready(&PycairoRectangleInt_Type) < 0)
     return PYCAIRO_MOD_ERROR_VAL;
@@ -261,14 +467,17 @@ PYCAIRO_MOD_INIT(_cairo)
   if (PyType_Ready(&PycairoTextExtents_Type) < 0)
     return PYCAIRO_MOD_ERROR_VAL;
 
-#ifdef CAIRO_HAS_SCRIPT_SURFACE
-  if (PyType_Ready(&PycairoScriptDevice_Type) < 0)
+
+  if (PyType_Ready(&PycairoRegion_Type) < 0)
     return PYCAIRO_MOD_ERROR_VAL;
-  if (PyType_Ready(&PycairoScriptSurface_Type) < 0)
+
+  if (PyType_Ready(&PycairoHitIndex_Type) < 0)
     return PYCAIRO_MOD_ERROR_VAL;
-#endif
 
-  if (PyType_Ready(&PycairoRegion_Type) < 0)
+  if (PyType_Ready(&PycairoStyle_Type) < 0)
+    return PYCAIRO_MOD_ERROR_VAL;
+
+  if (PyType_Ready(&PycairoCancelToken_Type) < 0)
     return PYCAIRO_MOD_ERROR_VAL;
 
   if (PyType_Ready(&PycairoScaledFont_Type) < 0)
@@ -282,20 +491,16 @@ PYCAIRO_MOD_INIT(_cairo)
   if (PyType_Ready(&PycairoMappedImageSurface_Type) < 0)
     return PYCAIRO_MOD_ERROR_VAL;
 #endif
-#ifdef CAIRO_HAS_PDF_SURFACE
-  if (PyType_Ready(&PycairoPDFSurface_Type) < 0)
-    return PYCAIRO_MOD_ERROR_VAL;
-#endif
-#ifdef CAIRO_HAS_PS_SURFACE
-  if (PyType_Ready(&PycairoPSSurface_Type) < 0)
-    return PYCAIRO_MOD_ERROR_VAL;
-#endif
 #ifdef CAIRO_HAS_RECORDING_SURFACE
   if (PyType_Ready(&PycairoRecordingSurface_Type) < 0)
     return PYCAIRO_MOD_ERROR_VAL;
-#endif
-#ifdef CAIRO_HAS_SVG_SURFACE
-  if (PyType_Ready(&PycairoSVGSurface_Type) < 0)
+  if (PyType_Ready(&PycairoIndexedRecordingSurface_Type) < 0)
+    return PYCAIRO_MOD_ERROR_VAL;
+  if (PyType_Ready(&PycairoRasterCache_Type) < 0)
+    return PYCAIRO_MOD_ERROR_VAL;
+  if (PyType_Ready(&PycairoTiledSurface_Type) < 0)
+    return PYCAIRO_MOD_ERROR_VAL;
+  if (PyType_Ready(&PycairoProgressiveRenderer_Type) < 0)
     return PYCAIRO_MOD_ERROR_VAL;
 #endif
 #ifdef CAIRO_HAS_WIN32_SURFACE
@@ -312,10 +517,6 @@ PYCAIRO_MOD_INIT(_cairo)
   if (PyType_Ready(&PycairoXlibSurface_Type) < 0)
     return PYCAIRO_MOD_ERROR_VAL;
 #endif
-#ifdef CAIRO_HAS_TEE_SURFACE
-  if (PyType_Ready(&PycairoTeeSurface_Type) < 0)
-    return PYCAIRO_MOD_ERROR_VAL;
-#endif
 
 #if PY_MAJOR_VERSION < 3
   m = Py_InitModule("cairo._cairo", cairo_functions);
@@ -372,9 +573,6 @@ PYCAIRO_MOD_INIT(_cairo)
   Py_INCREF(&PycairoRadialGradient_Type);
   PyModule_AddObject(m, "MeshPattern",
                      (PyObject *)&PycairoMeshPattern_Type);
-  Py_INCREF(&PycairoRasterSourcePattern_Type);
-  PyModule_AddObject(m, "RasterSourcePattern",
-                     (PyObject *)&PycairoRasterSourcePattern_Type);
 
   Py_INCREF(&PycairoRectangleInt_Type);
   PyModule_AddObject(m, "RectangleInt",  (PyObject *)&PycairoRectangleInt_Type);
@@ -382,6 +580,15 @@ PYCAIRO_MOD_INIT(_cairo)
   Py_INCREF(&PycairoRegion_Type);
   PyModule_AddObject(m, "Region",  (PyObject *)&PycairoRegion_Type);
 
+  Py_INCREF(&PycairoHitIndex_Type);
+  PyModule_AddObject(m, "HitIndex",  (PyObject *)&PycairoHitIndex_Type);
+
+  Py_INCREF(&PycairoStyle_Type);
+  PyModule_AddObject(m, "Style",  (PyObject *)&PycairoStyle_Type);
+
+  Py_INCREF(&PycairoCancelToken_Type);
+  PyModule_AddObject(m, "CancelToken",  (PyObject *)&PycairoCancelToken_Type);
+
   Py_INCREF(&PycairoScaledFont_Type);
   PyModule_AddObject(m, "ScaledFont", (PyObject *)&PycairoScaledFont_Type);
 
@@ -406,38 +613,26 @@ PYCAIRO_MOD_INIT(_cairo)
   Py_INCREF(&PycairoPath_Type);
   PyModule_AddObject(m, "Path", (PyObject *)&PycairoPath_Type);
 
-#ifdef CAIRO_HAS_SCRIPT_SURFACE
-  Py_INCREF(&PycairoScriptDevice_Type);
-  PyModule_AddObject(m, "ScriptDevice", (PyObject *)&PycairoScriptDevice_Type);
-  Py_INCREF(&PycairoScriptSurface_Type);
-  PyModule_AddObject(m, "ScriptSurface", (PyObject *)&PycairoScriptSurface_Type);
-#endif
-
 #ifdef CAIRO_HAS_IMAGE_SURFACE
   Py_INCREF(&PycairoImageSurface_Type);
   PyModule_AddObject(m, "ImageSurface",
 		     (PyObject *)&PycairoImageSurface_Type);
 #endif
 
-#ifdef CAIRO_HAS_PDF_SURFACE
-  Py_INCREF(&PycairoPDFSurface_Type);
-  PyModule_AddObject(m, "PDFSurface", (PyObject *)&PycairoPDFSurface_Type);
-#endif
-
-#ifdef CAIRO_HAS_PS_SURFACE
-  Py_INCREF(&PycairoPSSurface_Type);
-  PyModule_AddObject(m, "PSSurface", (PyObject *)&PycairoPSSurface_Type);
-#endif
-
 #ifdef CAIRO_HAS_RECORDING_SURFACE
   Py_INCREF(&PycairoRecordingSurface_Type);
   PyModule_AddObject(m, "RecordingSurface",
 		     (PyObject *)&PycairoRecordingSurface_Type);
-#endif
-
-#ifdef CAIRO_HAS_SVG_SURFACE
-  Py_INCREF(&PycairoSVGSurface_Type);
-  PyModule_AddObject(m, "SVGSurface", (PyObject *)&PycairoSVGSurface_Type);
+  Py_INCREF(&PycairoIndexedRecordingSurface_Type);
+  PyModule_AddObject(m, "IndexedRecordingSurface",
+		     (PyObject *)&PycairoIndexedRecordingSurface_Type);
+  Py_INCREF(&PycairoRasterCache_Type);
+  PyModule_AddObject(m, "RasterCache", (PyObject *)&PycairoRasterCache_Type);
+  Py_INCREF(&PycairoTiledSurface_Type);
+  PyModule_AddObject(m, "TiledSurface", (PyObject *)&PycairoTiledSurface_Type);
+  Py_INCREF(&PycairoProgressiveRenderer_Type);
+  PyModule_AddObject(m, "ProgressiveRenderer",
+		     (PyObject *)&PycairoProgressiveRenderer_Type);
 #endif
 
 #ifdef CAIRO_HAS_WIN32_SURFACE
@@ -461,12 +656,6 @@ PYCAIRO_MOD_INIT(_cairo)
 		     (PyObject *)&PycairoXlibSurface_Type);
 #endif
 
-#ifdef CAIRO_HAS_TEE_SURFACE
-  Py_INCREF(&PycairoTeeSurface_Type);
-  PyModule_AddObject(m, "TeeSurface",
-		     (PyObject *)&PycairoTeeSurface_Type);
-#endif
-
   /* Add 'cairo.Error' to the module */
   error = error_get_type();
   if (error == NULL)
@@ -487,6 +676,20 @@ PYCAIRO_MOD_INIT(_cairo)
   if (PyModule_AddObject(m, "CairoError", error) < 0)
     return PYCAIRO_MOD_ERROR_VAL;
 
+  if (error_add_cancel_types (m, error) < 0)
+    return PYCAIRO_MOD_ERROR_VAL;
+
+#ifndef PYCAIRO_LAZY_TYPES
+  {
+    size_t i;
+
+    for (i = 0; i < N_LAZY_GROUPS; i++) {
+      if (lazy_group_ready (&lazy_groups[i], m) < 0)
+        return PYCAIRO_MOD_ERROR_VAL;
+    }
+  }
+#endif
+
     /* constants */
 #if CAIRO_HAS_ATSUI_FONT
   PyModule_AddIntConstant(m, "HAS_ATSUI_FONT", 1);
@@ -0,0 +1,331 @@
+/* -*- mode: C; c-basic-offset: 2 -*-
+ *
+ * Pycairo - Python bindings for cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ */
+
+/* Cooperative cancellation. A CancelToken gets activated for the current
+ * thread with a with statement, long running native code picks it up
+ * while holding the GIL and polls it without the GIL. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "config.h"
+#include "private.h"
+
+struct _cancel_state {
+  volatile int cancelled;
+  double deadline;  /* monotonic seconds, 0 for none */
+};
+
+typedef struct {
+  PyObject_HEAD
+  cancel_state_t state;
+} PycairoCancelToken;
+
+/* key in the thread state dict, holding the stack of active tokens */
+static const char *cancel_stack_key = "cairo.cancel_tokens";
+
+/* Seconds from an arbitrary starting point, for measuring durations.
+ * Doesn't need the GIL. */
+double
+monotonic_time (void) {
+#ifdef _WIN32
+  return GetTickCount64 () / 1000.0;
+#else
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static int
+_set_timeout (PycairoCancelToken *o, PyObject *timeout) {
+  double seconds;
+
+  if (timeout == Py_None) {
+    o->state.deadline = 0;
+    return 0;
+  }
+
+  seconds = PyFloat_AsDouble (timeout);
+  if (seconds == -1 && PyErr_Occurred ())
+    return -1;
+  if (!(seconds >= 0)) {
+    PyErr_SetString (PyExc_ValueError, "timeout must not be negative");
+    return -1;
+  }
+  o->state.deadline = monotonic_time () + seconds;
+  if (o->state.deadline == 0)
+    o->state.deadline = 1e-9;
+  return 0;
+}
+
+/* Returns CAIRO_STATUS_SUCCESS or one of the PYCAIRO_STATUS_ pseudo
+ * statuses. state can be NULL. Doesn't need the GIL. */
+cairo_status_t
+cancel_state_check (cancel_state_t *state) {
+  if (state == NULL)
+    return CAIRO_STATUS_SUCCESS;
+  if (state->cancelled)
+    return PYCAIRO_STATUS_CANCELLED;
+  if (state->deadline != 0 && monotonic_time () >= state->deadline)
+    return PYCAIRO_STATUS_DEADLINE_EXCEEDED;
+  return CAIRO_STATUS_SUCCESS;
+}
+
+/* A standalone state for native code cancelling its own work. Returns
+ * NULL if out of memory. Doesn't need the GIL. */
+cancel_state_t *
+cancel_state_new (void) {
+  return calloc (1, sizeof (cancel_state_t));
+}
+
+void
+cancel_state_free (cancel_state_t *state) {
+  free (state);
+}
+
+/* Can be called from any thread. */
+void
+cancel_state_cancel (cancel_state_t *state) {
+  state->cancelled = 1;
+}
+
+static PyObject *
+_get_stack (int create) {
+  PyObject *dict, *stack;
+
+  dict = PyThreadState_GetDict ();
+  if (dict == NULL)
+    return NULL;
+
+  stack = PyDict_GetItemString (dict, cancel_stack_key);
+  if (stack == NULL && create) {
+    stack = PyList_New (0);
+    if (stack == NULL)
+      return NULL;
+    if (PyDict_SetItemString (dict, cancel_stack_key, stack) < 0) {
+      Py_DECREF (stack);
+      return NULL;
+    }
+    Py_DECREF (stack);
+  }
+  return stack;
+}
+
+/* Returns a new reference to the token active in the current thread and
+ * sets state to its state, or returns NULL and sets state to NULL if there
+ * is none. Keep the reference while using state. Needs the GIL, doesn't
+ * raise. */
+PyObject *
+cancel_token_acquire (cancel_state_t **state) {
+  PyObject *stack = _get_stack (0), *token;
+
+  *state = NULL;
+  if (stack == NULL || PyList_GET_SIZE (stack) == 0)
+    return NULL;
+
+  token = PyList_GET_ITEM (stack, PyList_GET_SIZE (stack) - 1);
+  Py_INCREF (token);
+  *state = &((PycairoCancelToken *)token)->state;
+  return token;
+}
+
+/* Checks the token active in the current thread. Needs the GIL. */
+cairo_status_t
+cancel_token_check_current (void) {
+  cancel_state_t *state;
+  PyObject *token = cancel_token_acquire (&state);
+  cairo_status_t status = cancel_state_check (state);
+
+  Py_XDECREF (token);
+  return status;
+}
+
+static PyObject *
+cancel_token_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"timeout", NULL};
+  PyObject *timeout = Py_None;
+  PycairoCancelToken *o;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "|O:CancelToken.__new__",
+				    kwlist, &timeout))
+    return NULL;
+
+  o = (PycairoCancelToken *)type->tp_alloc (type, 0);
+  if (o == NULL)
+    return NULL;
+
+  if (_set_timeout (o, timeout) < 0) {
+    Py_DECREF (o);
+    return NULL;
+  }
+
+  return (PyObject *)o;
+}
+
+static PyObject *
+cancel_token_cancel (PycairoCancelToken *o) {
+  o->state.cancelled = 1;
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+cancel_token_reset (PycairoCancelToken *o) {
+  o->state.cancelled = 0;
+  o->state.deadline = 0;
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+cancel_token_set_timeout (PycairoCancelToken *o, PyObject *args) {
+  PyObject *timeout;
+
+  if (!PyArg_ParseTuple (args, "O:CancelToken.set_timeout", &timeout))
+    return NULL;
+
+  if (_set_timeout (o, timeout) < 0)
+    return NULL;
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+cancel_token_check (PycairoCancelToken *o) {
+  if (Pycairo_Check_Status (cancel_state_check (&o->state)))
+    return NULL;
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+cancel_token_enter (PycairoCancelToken *o) {
+  PyObject *stack = _get_stack (1);
+
+  if (stack == NULL) {
+    if (!PyErr_Occurred ())
+      PyErr_SetString (PyExc_RuntimeError, "no thread state");
+    return NULL;
+  }
+
+  if (PyList_Append (stack, (PyObject *)o) < 0)
+    return NULL;
+
+  Py_INCREF (o);
+  return (PyObject *)o;
+}
+
+static PyObject *
+cancel_token_exit (PycairoCancelToken *o, PyObject *args) {
+  PyObject *stack = _get_stack (0);
+  Py_ssize_t i;
+
+  /* remove the innermost activation of this token */
+  if (stack != NULL) {
+    for (i = PyList_GET_SIZE (stack) - 1; i >= 0; i--) {
+      if (PyList_GET_ITEM (stack, i) == (PyObject *)o) {
+	if (PySequence_DelItem (stack, i) < 0)
+	  return NULL;
+	break;
+      }
+    }
+  }
+
+  Py_RETURN_FALSE;
+}
+
+static PyObject *
+cancel_token_get_cancelled (PycairoCancelToken *o, void *closure) {
+  return PyBool_FromLong (cancel_state_check (&o->state) !=
+			  CAIRO_STATUS_SUCCESS);
+}
+
+static PyGetSetDef cancel_token_getset[] = {
+  {"cancelled", (getter)cancel_token_get_cancelled},
+  {NULL,},
+};
+
+static PyMethodDef cancel_token_methods[] = {
+  {"cancel",      (PyCFunction)cancel_token_cancel,      METH_NOARGS},
+  {"check",       (PyCFunction)cancel_token_check,       METH_NOARGS},
+  {"reset",       (PyCFunction)cancel_token_reset,       METH_NOARGS},
+  {"set_timeout", (PyCFunction)cancel_token_set_timeout, METH_VARARGS},
+  {"__enter__",   (PyCFunction)cancel_token_enter,       METH_NOARGS},
+  {"__exit__",    (PyCFunction)cancel_token_exit,        METH_VARARGS},
+  {NULL, NULL, 0, NULL},
+};
+
+PyTypeObject PycairoCancelToken_Type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "cairo.CancelToken",                /* tp_name */
+  sizeof(PycairoCancelToken),         /* tp_basicsize */
+  0,                                  /* tp_itemsize */
+  0,                                  /* tp_dealloc */
+  0,                                  /* tp_print */
+  0,                                  /* tp_getattr */
+  0,                                  /* tp_setattr */
+  0,                                  /* tp_compare */
+  0,                                  /* tp_repr */
+  0,                                  /* tp_as_number */
+  0,                                  /* tp_as_sequence */
+  0,                                  /* tp_as_mapping */
+  0,                                  /* tp_hash */
+  0,                                  /* tp_call */
+  0,                                  /* tp_str */
+  0,                                  /* tp_getattro */
+  0,                                  /* tp_setattro */
+  0,                                  /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+  0,                                  /* tp_doc */
+  0,                                  /* tp_traverse */
+  0,                                  /* tp_clear */
+  0,                                  /* tp_richcompare */
+  0,                                  /* tp_weaklistoffset */
+  0,                                  /* tp_iter */
+  0,                                  /* tp_iternext */
+  cancel_token_methods,               /* tp_methods */
+  0,                                  /* tp_members */
+  cancel_token_getset,                /* tp_getset */
+  0,                                  /* tp_base */
+  0,                                  /* tp_dict */
+  0,                                  /* tp_descr_get */
+  0,                                  /* tp_descr_set */
+  0,                                  /* tp_dictoffset */
+  0,                                  /* tp_init */
+  0,                                  /* tp_alloc */
+  (newfunc)cancel_token_new,          /* tp_new */
+  0,                                  /* tp_free */
+  0,                                  /* tp_is_gc */
+  0,                                  /* tp_bases */
+};
@@ -31,6 +31,9 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
+#include <limits.h>
+#include <math.h>
+
 #include "config.h"
 #include "private.h"
 
@@ -56,6 +59,43 @@ PycairoContext_FromContext(cairo_t *ctx, PyTypeObject *type, PyObject *base) {
   return o;
 }
 
+/* The C API hands the cairo_t of a context to other extensions, which can
+ * draw with it directly. A display list can't capture that, so the list of
+ * the target stops indexing and replays fall back to the whole recording. */
+static void
+_context_mark_foreign (cairo_t *ctx) {
+  display_list_t *dl = display_list_from_surface (cairo_get_target (ctx));
+
+  if (dl != NULL)
+    display_list_invalidate (dl);
+}
+
+PyObject *
+_PycairoContext_FromForeignContext (cairo_t *ctx, PyTypeObject *type,
+                                    PyObject *base) {
+  PyObject *o = PycairoContext_FromContext (ctx, type, base);
+
+  if (o != NULL)
+    _context_mark_foreign (ctx);
+  return o;
+}
+
+cairo_t *
+_PycairoContext_Get (PyObject *obj) {
+  cairo_t *ctx = ((PycairoContext *)obj)->ctx;
+
+  _context_mark_foreign (ctx);
+  return ctx;
+}
+
+/* Drawing calls start with this instead of display_list_begin(), parallel
+ * tees need to know about surface sources on every drawing call. */
+static display_list_t *
+_context_draw_begin (cairo_t *ctx) {
+  tee_fanout_note_pattern (ctx, cairo_get_source (ctx));
+  return display_list_begin (ctx);
+}
+
 static void
 pycairo_dealloc(PycairoContext *o) {
   if (o->ctx) {
@@ -75,18 +115,356 @@ pycairo_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
   return PycairoContext_FromContext (cairo_create (s->surface), type, NULL);
 }
 
+/* Culling for append_path. Segments which can't touch the clip extents
+ * (grown by the stroke extent) get replaced by lines along the border of
+ * the grown box which wind around it the same way, so the winding number
+ * of every pixel in the clip stays the same for fills, and strokes of the
+ * replacement don't reach it either. All coordinates are in device
+ * space. */
+
+typedef struct {
+  cairo_t *ctx;
+  cairo_matrix_t ctm;
+  double x0, y0, x1, y1;
+  double last_x, last_y;  /* last point added to the path */
+  double pending_x, pending_y;
+  int has_pending;
+} cull_t;
+
+/* Regions around the box, corners having odd numbers, indexed by column
+ * and row */
+static const int cull_region_from_code[3][3] = {
+  {1, 0, 7},
+  {2, -1, 6},
+  {3, 4, 5},
+};
+
+static int
+_cull_region (cull_t *c, double x, double y) {
+  int col = x < c->x0 ? 0 : (x > c->x1 ? 2 : 1);
+  int row = y < c->y0 ? 0 : (y > c->y1 ? 2 : 1);
+  return cull_region_from_code[col][row];
+}
+
+static void
+_cull_emit (cull_t *c, double x, double y) {
+  double ux = x, uy = y;
+  cairo_device_to_user (c->ctx, &ux, &uy);
+  cairo_line_to (c->ctx, ux, uy);
+  c->last_x = x;
+  c->last_y = y;
+}
+
+static int
+_cull_on_common_edge (cull_t *c, double ax, double ay, double bx, double by,
+		      double px, double py) {
+  return ((ax == c->x0 || ax == c->x1) && ax == bx && bx == px) ||
+    ((ay == c->y0 || ay == c->y1) && ay == by && by == py);
+}
+
+/* Adds a point on the border, merging runs along the same edge */
+static void
+_cull_add (cull_t *c, double x, double y) {
+  if (c->has_pending) {
+    if (x == c->pending_x && y == c->pending_y)
+      return;
+    if (!_cull_on_common_edge (c, c->last_x, c->last_y,
+			       c->pending_x, c->pending_y, x, y))
+      _cull_emit (c, c->pending_x, c->pending_y);
+  }
+  c->pending_x = x;
+  c->pending_y = y;
+  c->has_pending = 1;
+}
+
+static void
+_cull_flush (cull_t *c) {
+  if (c->has_pending)
+    _cull_emit (c, c->pending_x, c->pending_y);
+  c->has_pending = 0;
+}
+
+static void
+_cull_add_clamped (cull_t *c, double x, double y) {
+  _cull_add (c, x < c->x0 ? c->x0 : (x > c->x1 ? c->x1 : x),
+	     y < c->y0 ? c->y0 : (y > c->y1 ? c->y1 : y));
+}
+
+/* Replaces the invisible segment a-b, a being the current point, by going
+ * through the corners of the regions it passes */
+static void
+_cull_segment (cull_t *c, double ax, double ay, double bx, double by) {
+  double lines[4], from[4], to[4], t[6], tmp;
+  int i, j, n_t = 0, region;
+
+  lines[0] = c->x0;
+  lines[1] = c->x1;
+  lines[2] = c->y0;
+  lines[3] = c->y1;
+  from[0] = from[1] = ax;
+  from[2] = from[3] = ay;
+  to[0] = to[1] = bx;
+  to[2] = to[3] = by;
+
+  t[n_t++] = 0;
+  t[n_t++] = 1;
+  for (i = 0; i < 4; i++) {
+    if ((from[i] < lines[i]) != (to[i] < lines[i])) {
+      tmp = (lines[i] - from[i]) / (to[i] - from[i]);
+      for (j = n_t; j > 0 && t[j - 1] > tmp; j--)
+	t[j] = t[j - 1];
+      t[j] = tmp;
+      n_t++;
+    }
+  }
+
+  _cull_add_clamped (c, ax, ay);
+  for (i = 0; i + 1 < n_t; i++) {
+    tmp = (t[i] + t[i + 1]) / 2;
+    region = _cull_region (c, ax + tmp * (bx - ax), ay + tmp * (by - ay));
+    if (region % 2 == 1)
+      _cull_add (c, (region == 1 || region == 7) ? c->x0 : c->x1,
+		 (region == 1 || region == 3) ? c->y0 : c->y1);
+  }
+  _cull_add_clamped (c, bx, by);
+}
+
+static int
+_cull_is_line_visible (cull_t *c, double ax, double ay, double bx, double by) {
+  double dx = bx - ax, dy = by - ay;
+  double s[4];
+  int i;
+
+  if ((ax < c->x0 && bx < c->x0) || (ax > c->x1 && bx > c->x1) ||
+      (ay < c->y0 && by < c->y0) || (ay > c->y1 && by > c->y1))
+    return 0;
+
+  /* the box is outside if all its corners are on the same side */
+  s[0] = dx * (c->y0 - ay) - dy * (c->x0 - ax);
+  s[1] = dx * (c->y0 - ay) - dy * (c->x1 - ax);
+  s[2] = dx * (c->y1 - ay) - dy * (c->x0 - ax);
+  s[3] = dx * (c->y1 - ay) - dy * (c->x1 - ax);
+  for (i = 1; i < 4; i++) {
+    if ((s[i] > 0) != (s[0] > 0) || s[i] == 0)
+      return 1;
+  }
+  return s[0] == 0;
+}
+
+static int
+_cull_is_curve_visible (cull_t *c, const double *px, const double *py) {
+  int i, left = 1, right = 1, above = 1, below = 1;
+
+  for (i = 0; i < 4; i++) {
+    left &= px[i] < c->x0;
+    right &= px[i] > c->x1;
+    above &= py[i] < c->y0;
+    below &= py[i] > c->y1;
+  }
+  return !(left || right || above || below);
+}
+
+/* Returns the number of culled segments. Doesn't need the GIL. */
+static Py_ssize_t
+_append_path_culled (cairo_t *ctx, cairo_path_t *path) {
+  cull_t c;
+  cairo_matrix_t inverse;
+  cairo_path_data_t *data;
+  double margin, dx, dy, miter;
+  double cur_x = 0, cur_y = 0, cur_ux = 0, cur_uy = 0;
+  double start_x = 0, start_y = 0;
+  double px[4], py[4];
+  Py_ssize_t culled = 0;
+  int i, j, in_run = 0, have_current = 0, have_start = 0;
+
+  cairo_get_matrix (ctx, &c.ctm);
+  inverse = c.ctm;
+  if (cairo_get_dash_count (ctx) > 0 ||
+      cairo_matrix_invert (&inverse) != CAIRO_STATUS_SUCCESS) {
+    cairo_append_path (ctx, path);
+    return 0;
+  }
+
+  cairo_save (ctx);
+  cairo_identity_matrix (ctx);
+  cairo_clip_extents (ctx, &c.x0, &c.y0, &c.x1, &c.y1);
+  cairo_restore (ctx);
+
+  /* how far a stroke can reach from the path, plus antialiasing */
+  dx = cairo_get_line_width (ctx);
+  dy = 0;
+  cairo_user_to_device_distance (ctx, &dx, &dy);
+  margin = sqrt (dx * dx + dy * dy);
+  dx = 0;
+  dy = cairo_get_line_width (ctx);
+  cairo_user_to_device_distance (ctx, &dx, &dy);
+  if (sqrt (dx * dx + dy * dy) > margin)
+    margin = sqrt (dx * dx + dy * dy);
+  miter = cairo_get_miter_limit (ctx);
+  if (miter < sqrt (2.0))
+    miter = sqrt (2.0);
+  margin = margin / 2 * miter + 1;
+
+  c.ctx = ctx;
+  c.x0 -= margin;
+  c.y0 -= margin;
+  c.x1 += margin;
+  c.y1 += margin;
+  c.has_pending = 0;
+  c.last_x = c.last_y = 0;
+
+  if (cairo_has_current_point (ctx)) {
+    cairo_get_current_point (ctx, &cur_ux, &cur_uy);
+    cur_x = cur_ux;
+    cur_y = cur_uy;
+    cairo_matrix_transform_point (&c.ctm, &cur_x, &cur_y);
+    start_x = c.last_x = cur_x;
+    start_y = c.last_y = cur_y;
+    have_current = 1;
+  }
+
+  for (i = 0; i < path->num_data; i += path->data[i].header.length) {
+    data = &path->data[i];
+
+    if (data->header.type == CAIRO_PATH_MOVE_TO ||
+	data->header.type == CAIRO_PATH_CLOSE_PATH) {
+      int close = data->header.type == CAIRO_PATH_CLOSE_PATH;
+
+      if (close && in_run && have_start &&
+	  !_cull_is_line_visible (&c, cur_x, cur_y, start_x, start_y)) {
+	_cull_segment (&c, cur_x, cur_y, start_x, start_y);
+	_cull_flush (&c);
+	in_run = 0;
+      }
+      if (in_run) {
+	_cull_flush (&c);
+	cairo_line_to (ctx, cur_ux, cur_uy);
+	in_run = 0;
+      }
+
+      if (close) {
+	cairo_close_path (ctx);
+	cairo_get_current_point (ctx, &cur_ux, &cur_uy);
+	cur_x = cur_ux;
+	cur_y = cur_uy;
+	cairo_matrix_transform_point (&c.ctm, &cur_x, &cur_y);
+	start_x = cur_x;
+	start_y = cur_y;
+	have_start = 1;
+      } else {
+	cur_ux = data[1].point.x;
+	cur_uy = data[1].point.y;
+	cairo_move_to (ctx, cur_ux, cur_uy);
+	cur_x = cur_ux;
+	cur_y = cur_uy;
+	cairo_matrix_transform_point (&c.ctm, &cur_x, &cur_y);
+	start_x = cur_x;
+	start_y = cur_y;
+	have_current = have_start = 1;
+      }
+      c.last_x = cur_x;
+      c.last_y = cur_y;
+      continue;
+    }
+
+    if (!have_current) {
+      /* like cairo, a segment without current point starts a subpath */
+      cairo_move_to (ctx, data[1].point.x, data[1].point.y);
+      cur_ux = data[1].point.x;
+      cur_uy = data[1].point.y;
+      cur_x = cur_ux;
+      cur_y = cur_uy;
+      cairo_matrix_transform_point (&c.ctm, &cur_x, &cur_y);
+      start_x = c.last_x = cur_x;
+      start_y = c.last_y = cur_y;
+      have_current = have_start = 1;
+    }
+
+    px[0] = cur_x;
+    py[0] = cur_y;
+    for (j = 1; j < data->header.length; j++) {
+      px[j] = data[j].point.x;
+      py[j] = data[j].point.y;
+      cairo_matrix_transform_point (&c.ctm, &px[j], &py[j]);
+    }
+    j = data->header.length - 1;
+
+    if ((data->header.type == CAIRO_PATH_LINE_TO &&
+	 !_cull_is_line_visible (&c, px[0], py[0], px[1], py[1])) ||
+	(data->header.type == CAIRO_PATH_CURVE_TO &&
+	 !_cull_is_curve_visible (&c, px, py))) {
+      _cull_segment (&c, px[0], py[0], px[j], py[j]);
+      in_run = 1;
+      culled++;
+    } else {
+      if (in_run) {
+	_cull_flush (&c);
+	cairo_line_to (ctx, cur_ux, cur_uy);
+	in_run = 0;
+      }
+      if (data->header.type == CAIRO_PATH_LINE_TO)
+	cairo_line_to (ctx, data[1].point.x, data[1].point.y);
+      else
+	cairo_curve_to (ctx, data[1].point.x, data[1].point.y,
+			data[2].point.x, data[2].point.y,
+			data[3].point.x, data[3].point.y);
+      c.last_x = px[j];
+      c.last_y = py[j];
+    }
+
+    cur_x = px[j];
+    cur_y = py[j];
+    cur_ux = data[j].point.x;
+    cur_uy = data[j].point.y;
+  }
+
+  if (in_run) {
+    _cull_flush (&c);
+    cairo_line_to (ctx, cur_ux, cur_uy);
+  }
+
+  return culled;
+}
+
 static PyObject *
-pycairo_append_path (PycairoContext *o, PyObject *args) {
+pycairo_append_path (PycairoContext *o, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"path", "cull", NULL};
   PycairoPath *p;
+  PyObject *cull_obj = Py_False;
+  Py_ssize_t culled = 0;
+  int cull;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "O!|O:Context.append_path",
+				    kwlist, &PycairoPath_Type, &p, &cull_obj))
+    return NULL;
 
-  if (!PyArg_ParseTuple(args, "O!:Context.append_path",
-			&PycairoPath_Type, &p))
+  cull = PyObject_IsTrue (cull_obj);
+  if (cull < 0)
     return NULL;
 
   Py_BEGIN_ALLOW_THREADS;
-  cairo_append_path (o->ctx, p->path);
+  if (cull)
+    culled = _append_path_culled (o->ctx, p->path);
+  else
+    cairo_append_path (o->ctx, p->path);
   Py_END_ALLOW_THREADS;
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+
+  if (cull)
+    return PYCAIRO_PyLong_FromLong ((long)culled);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+pycairo_apply_style (PycairoContext *o, PyObject *args) {
+  PyObject *style;
+
+  if (!PyArg_ParseTuple (args, "O!:Context.apply_style",
+			 &PycairoStyle_Type, &style))
+    return NULL;
+
+  style_apply (style, o->ctx);
+  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
 
@@ -99,7 +477,7 @@ pycairo_arc (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_arc (o->ctx, xc, yc, radius, angle1, angle2);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -112,6 +490,17 @@ pycairo_arc_negative (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_arc_negative (o->ctx, xc, yc, radius, angle1, angle2);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+pycairo_capture_style (PycairoContext *o) {
+  return style_capture (o->ctx);
+}
+
+static PyObject *
+pycairo_check (PycairoContext *o) {
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -162,10 +551,27 @@ pycairo_close_path (PycairoContext *o) {
   Py_BEGIN_ALLOW_THREADS;
   cairo_close_path (o->ctx);
   Py_END_ALLOW_THREADS;
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
+static PyObject *
+pycairo_copy_clip_rectangle_buffer (PycairoContext *o) {
+  cairo_rectangle_list_t *rlist;
+
+  Py_BEGIN_ALLOW_THREADS;
+  rlist = cairo_copy_clip_rectangle_list (o->ctx);
+  Py_END_ALLOW_THREADS;
+
+  if (rlist->status != CAIRO_STATUS_SUCCESS) {
+    Pycairo_Check_Status (rlist->status);
+    cairo_rectangle_list_destroy (rlist);
+    return NULL;
+  }
+
+  return rectangle_buffer_create_view (rlist);
+}
+
 static PyObject *
 pycairo_copy_clip_rectangle_list (PycairoContext *o) {
   int i;
@@ -203,11 +609,68 @@ pycairo_copy_clip_rectangle_list (PycairoContext *o) {
   return rv;
 }
 
+static PyObject *
+pycairo_copy_clip_region (PycairoContext *o) {
+  cairo_rectangle_list_t *rlist;
+  cairo_rectangle_int_t *rects;
+  cairo_region_t *region;
+  cairo_rectangle_t *r;
+  int i;
+
+  Py_BEGIN_ALLOW_THREADS;
+  rlist = cairo_copy_clip_rectangle_list (o->ctx);
+  Py_END_ALLOW_THREADS;
+
+  if (rlist->status != CAIRO_STATUS_SUCCESS) {
+    Pycairo_Check_Status (rlist->status);
+    cairo_rectangle_list_destroy (rlist);
+    return NULL;
+  }
+
+  rects = PyMem_Malloc (sizeof (cairo_rectangle_int_t) *
+			(rlist->num_rectangles > 0 ? rlist->num_rectangles : 1));
+  if (rects == NULL) {
+    cairo_rectangle_list_destroy (rlist);
+    return PyErr_NoMemory ();
+  }
+
+  for (i = 0, r = rlist->rectangles; i < rlist->num_rectangles; i++, r++) {
+    if (r->x != floor (r->x) || r->y != floor (r->y) ||
+	r->width != floor (r->width) || r->height != floor (r->height) ||
+	r->x < INT_MIN || r->x + r->width > INT_MAX ||
+	r->y < INT_MIN || r->y + r->height > INT_MAX) {
+      PyMem_Free (rects);
+      cairo_rectangle_list_destroy (rlist);
+      PyErr_SetString (PyExc_ValueError,
+		       "clip is not aligned to integer coordinates");
+      return NULL;
+    }
+    rects[i].x = (int)r->x;
+    rects[i].y = (int)r->y;
+    rects[i].width = (int)r->width;
+    rects[i].height = (int)r->height;
+  }
+
+  region = cairo_region_create_rectangles (rects, rlist->num_rectangles);
+  PyMem_Free (rects);
+  cairo_rectangle_list_destroy (rlist);
+
+  return PycairoRegion_FromRegion (region);
+}
+
 static PyObject *
 pycairo_copy_page (PycairoContext *o) {
+  cairo_surface_t *target = cairo_get_target (o->ctx);
+  PyObject *token;
+
+  if (tee_fanout_check_page (target) < 0)
+    return NULL;
+
+  token = surface_file_writer_begin (target);
   Py_BEGIN_ALLOW_THREADS;
   cairo_copy_page (o->ctx);
   Py_END_ALLOW_THREADS;
+  surface_file_writer_end (target, token);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -239,7 +702,7 @@ pycairo_curve_to (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_curve_to (o->ctx, x1, y1, x2, y2, x3, y3);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -270,9 +733,17 @@ pycairo_device_to_user_distance (PycairoContext *o, PyObject *args) {
 
 static PyObject *
 pycairo_fill (PycairoContext *o) {
+  display_list_t *dl = _context_draw_begin (o->ctx);
+
+  if (display_list_capture_fill (dl, o->ctx) < 0) {
+    display_list_end (dl);
+    return NULL;
+  }
+
   Py_BEGIN_ALLOW_THREADS;
   cairo_fill (o->ctx);
   Py_END_ALLOW_THREADS;
+  display_list_end (dl);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -285,11 +756,267 @@ pycairo_fill_extents (PycairoContext *o) {
   return Py_BuildValue("(dddd)", x1, y1, x2, y2);
 }
 
+
+/* Draws path once for every row of transforms, which are either (x0, y0)
+ * translations or (xx, yx, xy, yy, x0, y0) matrices applied on top of the
+ * current transformation. Capturing into dl (from display_list_begin(), can
+ * be NULL) needs the GIL. Returns -1 with an exception set if capturing
+ * failed. */
+static int
+_draw_instances_loop (cairo_t *ctx, cairo_path_t *path,
+		      const double *transforms, Py_ssize_t n_transforms,
+		      int cols, const double *colors, int stroke,
+		      display_list_t *dl) {
+  cairo_matrix_t base, matrix;
+  Py_ssize_t i;
+
+  cairo_get_matrix (ctx, &base);
+  for (i = 0; i < n_transforms; i++) {
+    const double *t = transforms + i * cols;
+
+    if (cols == 2)
+      cairo_matrix_init_translate (&matrix, t[0], t[1]);
+    else
+      cairo_matrix_init (&matrix, t[0], t[1], t[2], t[3], t[4], t[5]);
+    cairo_matrix_multiply (&matrix, &matrix, &base);
+    cairo_set_matrix (ctx, &matrix);
+    cairo_append_path (ctx, path);
+    if (colors != NULL) {
+      const double *c = colors + i * 4;
+      cairo_set_source_rgba (ctx, c[0], c[1], c[2], c[3]);
+    }
+
+    if (dl != NULL && (stroke ? display_list_capture_stroke (dl, ctx) :
+		       display_list_capture_fill (dl, ctx)) < 0)
+      return -1;
+
+    if (stroke)
+      cairo_stroke (ctx);
+    else
+      cairo_fill (ctx);
+    if (cairo_status (ctx) != CAIRO_STATUS_SUCCESS)
+      break;
+  }
+
+  return 0;
+}
+
+static PyObject *
+_draw_instances (PycairoContext *o, PyObject *args, PyObject *kwds,
+		 const char *format, int stroke) {
+  static char *kwlist[] = {"path", "transforms", "colors", NULL};
+  PycairoPath *p;
+  PyObject *transforms_obj, *colors_obj = Py_None;
+  double *transforms, *colors = NULL;
+  Py_ssize_t n_transforms, n_colors;
+  int cols, color_cols, res;
+  display_list_t *dl;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, format, kwlist,
+				    &PycairoPath_Type, &p, &transforms_obj,
+				    &colors_obj))
+    return NULL;
+
+  transforms = _Pycairo_AsDoubleArray (transforms_obj, "transforms", 2, 6,
+				       &n_transforms, &cols);
+  if (transforms == NULL)
+    return NULL;
+
+  if (colors_obj != Py_None) {
+    colors = _Pycairo_AsDoubleArray (colors_obj, "colors", 4, 0,
+				     &n_colors, &color_cols);
+    if (colors == NULL) {
+      PyMem_Free (transforms);
+      return NULL;
+    }
+    if (n_colors != n_transforms) {
+      PyMem_Free (transforms);
+      PyMem_Free (colors);
+      PyErr_SetString (PyExc_ValueError,
+		       "colors must have as many rows as transforms");
+      return NULL;
+    }
+  }
+
+  cairo_save (o->ctx);
+  cairo_new_path (o->ctx);
+  dl = _context_draw_begin (o->ctx);
+  if (dl != NULL) {
+    /* indexed recordings need every instance captured */
+    res = _draw_instances_loop (o->ctx, p->path, transforms, n_transforms,
+				cols, colors, stroke, dl);
+  } else {
+    Py_BEGIN_ALLOW_THREADS;
+    res = _draw_instances_loop (o->ctx, p->path, transforms, n_transforms,
+				cols, colors, stroke, NULL);
+    Py_END_ALLOW_THREADS;
+  }
+  display_list_end (dl);
+  cairo_new_path (o->ctx);
+  cairo_restore (o->ctx);
+
+  PyMem_Free (transforms);
+  PyMem_Free (colors);
+
+  if (res < 0)
+    return NULL;
+  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+pycairo_fill_instances (PycairoContext *o, PyObject *args, PyObject *kwds) {
+  return _draw_instances (o, args, kwds, "O!O|O:Context.fill_instances", 0);
+}
+
 static PyObject *
 pycairo_fill_preserve (PycairoContext *o) {
+  display_list_t *dl = _context_draw_begin (o->ctx);
+
+  if (display_list_capture_fill (dl, o->ctx) < 0) {
+    display_list_end (dl);
+    return NULL;
+  }
+
   Py_BEGIN_ALLOW_THREADS;
   cairo_fill_preserve (o->ctx);
   Py_END_ALLOW_THREADS;
+  display_list_end (dl);
+  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  Py_RETURN_NONE;
+}
+
+/* Fills rects, (x, y, width, height) rows, grouping runs of rectangles with
+ * the same opaque color into one path. Capturing into dl (from
+ * display_list_begin(), can be NULL) needs the GIL. Returns -1 with an
+ * exception set if capturing failed. */
+static int
+_fill_rectangles_loop (cairo_t *ctx, const double *rects, Py_ssize_t n_rects,
+		       const double *colors, display_list_t *dl) {
+  cairo_antialias_t antialias = cairo_get_antialias (ctx);
+  cairo_surface_t *target = cairo_get_group_target (ctx);
+  cairo_matrix_t ctm, device;
+  Py_ssize_t i, j;
+  int translation, over, merge;
+  double alpha;
+
+  /* with an integer translation to target pixels aligned rectangles cover
+   * whole pixels */
+  cairo_matrix_init_identity (&device);
+  cairo_surface_get_device_scale (target, &device.xx, &device.yy);
+  cairo_surface_get_device_offset (target, &device.x0, &device.y0);
+  cairo_get_matrix (ctx, &ctm);
+  cairo_matrix_multiply (&ctm, &ctm, &device);
+  translation = ctm.xx == 1 && ctm.yx == 0 && ctm.xy == 0 && ctm.yy == 1 &&
+    ctm.x0 == floor (ctm.x0) && ctm.y0 == floor (ctm.y0);
+
+  /* Filling overlapping rectangles at once only gives the same result as
+   * filling them one after the other if the color is opaque and gets drawn
+   * over what's there. */
+  over = cairo_get_operator (ctx) == CAIRO_OPERATOR_OVER;
+  merge = over && colors == NULL &&
+    cairo_pattern_get_rgba (cairo_get_source (ctx), NULL, NULL, NULL,
+			    &alpha) == CAIRO_STATUS_SUCCESS && alpha >= 1.0;
+
+  /* the rectangles of a run may overlap, so make sure they don't cancel */
+  cairo_set_fill_rule (ctx, CAIRO_FILL_RULE_WINDING);
+
+  for (i = 0; i < n_rects; i = j) {
+    int aligned = translation;
+
+    if (colors != NULL)
+      merge = over && colors[i * 4 + 3] >= 1.0;
+
+    for (j = i; j < n_rects; j++) {
+      const double *r = rects + j * 4;
+      double x = r[0], y = r[1], width = r[2], height = r[3];
+
+      if (j > i && (!merge || (colors != NULL &&
+	  memcmp (colors + j * 4, colors + i * 4, sizeof (double) * 4) != 0)))
+	break;
+
+      if (width < 0) {
+	x += width;
+	width = -width;
+      }
+      if (height < 0) {
+	y += height;
+	height = -height;
+      }
+      aligned = aligned && x == floor (x) && y == floor (y) &&
+	width == floor (width) && height == floor (height);
+      cairo_rectangle (ctx, x, y, width, height);
+    }
+
+    if (colors != NULL) {
+      const double *c = colors + i * 4;
+      cairo_set_source_rgba (ctx, c[0], c[1], c[2], c[3]);
+    }
+    /* skips computing coverage, the result is the same */
+    cairo_set_antialias (ctx, aligned ? CAIRO_ANTIALIAS_NONE : antialias);
+
+    if (dl != NULL && display_list_capture_fill (dl, ctx) < 0)
+      return -1;
+    cairo_fill (ctx);
+    if (cairo_status (ctx) != CAIRO_STATUS_SUCCESS)
+      break;
+  }
+
+  return 0;
+}
+
+static PyObject *
+pycairo_fill_rectangles (PycairoContext *o, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"rects", "colors", NULL};
+  PyObject *rects_obj, *colors_obj = Py_None;
+  double *rects, *colors = NULL;
+  Py_ssize_t n_rects, n_colors;
+  int cols, res;
+  display_list_t *dl;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "O|O:Context.fill_rectangles",
+				    kwlist, &rects_obj, &colors_obj))
+    return NULL;
+
+  rects = _Pycairo_AsDoubleArray (rects_obj, "rects", 4, 0, &n_rects, &cols);
+  if (rects == NULL)
+    return NULL;
+
+  if (colors_obj != Py_None) {
+    colors = _Pycairo_AsDoubleArray (colors_obj, "colors", 4, 0,
+				     &n_colors, &cols);
+    if (colors == NULL) {
+      PyMem_Free (rects);
+      return NULL;
+    }
+    if (n_colors != n_rects) {
+      PyMem_Free (rects);
+      PyMem_Free (colors);
+      PyErr_SetString (PyExc_ValueError,
+		       "colors must have as many rows as rects");
+      return NULL;
+    }
+  }
+
+  cairo_save (o->ctx);
+  cairo_new_path (o->ctx);
+  dl = _context_draw_begin (o->ctx);
+  if (dl != NULL) {
+    res = _fill_rectangles_loop (o->ctx, rects, n_rects, colors, dl);
+  } else {
+    Py_BEGIN_ALLOW_THREADS;
+    res = _fill_rectangles_loop (o->ctx, rects, n_rects, colors, NULL);
+    Py_END_ALLOW_THREADS;
+  }
+  display_list_end (dl);
+  cairo_new_path (o->ctx);
+  cairo_restore (o->ctx);
+
+  PyMem_Free (rects);
+  PyMem_Free (colors);
+
+  if (res < 0)
+    return NULL;
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -351,6 +1078,11 @@ pycairo_get_dash_count (PycairoContext *o) {
   return PYCAIRO_PyLong_FromLong (cairo_get_dash_count (o->ctx));
 }
 
+static PyObject *
+pycairo_get_defer_errors (PycairoContext *o) {
+  return PyBool_FromLong (o->defer_errors);
+}
+
 static PyObject *
 pycairo_get_fill_rule (PycairoContext *o) {
   RETURN_INT_ENUM(FillRule, cairo_get_fill_rule (o->ctx));
@@ -494,7 +1226,7 @@ pycairo_has_current_point (PycairoContext *o) {
 static PyObject *
 pycairo_identity_matrix (PycairoContext *o) {
   cairo_identity_matrix (o->ctx);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -534,20 +1266,29 @@ pycairo_line_to (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_line_to (o->ctx, x, y);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
 static PyObject *
 pycairo_mask (PycairoContext *o, PyObject *args) {
   PycairoPattern *p;
+  display_list_t *dl;
 
   if (!PyArg_ParseTuple(args, "O!:Context.mask", &PycairoPattern_Type, &p))
     return NULL;
 
+  dl = _context_draw_begin (o->ctx);
+  if (display_list_capture_mask (dl, o->ctx, p->pattern) < 0) {
+    display_list_end (dl);
+    return NULL;
+  }
+  tee_fanout_note_pattern (o->ctx, p->pattern);
+
   Py_BEGIN_ALLOW_THREADS;
   cairo_mask (o->ctx, p->pattern);
   Py_END_ALLOW_THREADS;
+  display_list_end (dl);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -556,14 +1297,35 @@ static PyObject *
 pycairo_mask_surface (PycairoContext *o, PyObject *args) {
   PycairoSurface *s;
   double surface_x = 0.0, surface_y = 0.0;
+  cairo_pattern_t *mask;
+  cairo_matrix_t matrix;
+  display_list_t *dl;
+  int res;
 
   if (!PyArg_ParseTuple (args, "O!|dd:Context.mask_surface",
 			 &PycairoSurface_Type, &s, &surface_x, &surface_y))
     return NULL;
 
+  dl = _context_draw_begin (o->ctx);
+  if (dl != NULL) {
+    /* same pattern cairo_mask_surface() creates */
+    mask = cairo_pattern_create_for_surface (s->surface);
+    cairo_matrix_init_translate (&matrix, -surface_x, -surface_y);
+    cairo_pattern_set_matrix (mask, &matrix);
+    res = display_list_capture_mask (dl, o->ctx, mask);
+    cairo_pattern_destroy (mask);
+    if (res < 0) {
+      display_list_end (dl);
+      return NULL;
+    }
+  }
+
+  tee_fanout_note_surface (o->ctx);
+
   Py_BEGIN_ALLOW_THREADS;
   cairo_mask_surface (o->ctx, s->surface, surface_x, surface_y);
   Py_END_ALLOW_THREADS;
+  display_list_end (dl);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -576,43 +1338,59 @@ pycairo_move_to (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_move_to (o->ctx, x, y);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
 static PyObject *
 pycairo_new_path (PycairoContext *o) {
   cairo_new_path (o->ctx);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
 static PyObject *
 pycairo_new_sub_path (PycairoContext *o) {
   cairo_new_sub_path (o->ctx);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
 static PyObject *
 pycairo_paint (PycairoContext *o) {
+  display_list_t *dl = _context_draw_begin (o->ctx);
+
+  if (display_list_capture_paint (dl, o->ctx, 1.0) < 0) {
+    display_list_end (dl);
+    return NULL;
+  }
+
   Py_BEGIN_ALLOW_THREADS;
   cairo_paint (o->ctx);
   Py_END_ALLOW_THREADS;
+  display_list_end (dl);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
 
 static PyObject *
 pycairo_paint_with_alpha (PycairoContext *o, PyObject *args) {
+  display_list_t *dl;
   double alpha;
 
   if (!PyArg_ParseTuple (args, "d:Context.paint_with_alpha", &alpha))
     return NULL;
 
+  dl = _context_draw_begin (o->ctx);
+  if (display_list_capture_paint (dl, o->ctx, alpha) < 0) {
+    display_list_end (dl);
+    return NULL;
+  }
+
   Py_BEGIN_ALLOW_THREADS;
   cairo_paint_with_alpha (o->ctx, alpha);
   Py_END_ALLOW_THREADS;
+  display_list_end (dl);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -627,18 +1405,24 @@ pycairo_path_extents (PycairoContext *o) {
 
 static PyObject *
 pycairo_pop_group (PycairoContext *o) {
-  return PycairoPattern_FromPattern (cairo_pop_group (o->ctx), NULL);
+  cairo_pattern_t *pattern = cairo_pop_group (o->ctx);
+
+  display_list_note_restore (o->ctx);
+  return PycairoPattern_FromPattern (pattern, NULL);
 }
 
 static PyObject *
 pycairo_pop_group_to_source (PycairoContext *o) {
   cairo_pop_group_to_source (o->ctx);
+  display_list_note_restore (o->ctx);
+  display_list_note_source (o->ctx);
   Py_RETURN_NONE;
 }
 
 static PyObject *
 pycairo_push_group (PycairoContext *o) {
   cairo_push_group (o->ctx);
+  display_list_note_save (o->ctx);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -651,6 +1435,7 @@ pycairo_push_group_with_content (PycairoContext *o, PyObject *args) {
 			&content))
     return NULL;
   cairo_push_group_with_content (o->ctx, content);
+  display_list_note_save (o->ctx);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -664,7 +1449,7 @@ pycairo_rectangle (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_rectangle (o->ctx, x, y, width, height);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -677,7 +1462,7 @@ pycairo_rel_curve_to (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_rel_curve_to (o->ctx, dx1, dy1, dx2, dy2, dx3, dy3);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -689,7 +1474,7 @@ pycairo_rel_line_to (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_rel_line_to (o->ctx, dx, dy);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -701,7 +1486,7 @@ pycairo_rel_move_to (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_rel_move_to (o->ctx, dx, dy);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -715,7 +1500,8 @@ pycairo_reset_clip (PycairoContext *o) {
 static PyObject *
 pycairo_restore (PycairoContext *o) {
   cairo_restore (o->ctx);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  display_list_note_restore (o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -727,14 +1513,15 @@ pycairo_rotate (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_rotate (o->ctx, angle);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
 static PyObject *
 pycairo_save (PycairoContext *o) {
   cairo_save (o->ctx);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  display_list_note_save (o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -746,7 +1533,7 @@ pycairo_scale (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_scale (o->ctx, sx, sy);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -774,7 +1561,7 @@ pycairo_set_antialias (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_antialias (o->ctx, antialias);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -814,6 +1601,26 @@ pycairo_set_dash (PycairoContext *o, PyObject *args) {
   Py_RETURN_NONE;
 }
 
+static PyObject *
+pycairo_set_defer_errors (PycairoContext *o, PyObject *args) {
+  PyObject *defer;
+  int value;
+
+  if (!PyArg_ParseTuple (args, "O:Context.set_defer_errors", &defer))
+    return NULL;
+
+  value = PyObject_IsTrue (defer);
+  if (value < 0)
+    return NULL;
+
+  /* don't let an error from before get attributed to later calls */
+  if (value && !o->defer_errors)
+    RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+
+  o->defer_errors = value;
+  Py_RETURN_NONE;
+}
+
 static PyObject *
 pycairo_set_fill_rule (PycairoContext *o, PyObject *args) {
   cairo_fill_rule_t fill_rule;
@@ -822,7 +1629,7 @@ pycairo_set_fill_rule (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_fill_rule (o->ctx, fill_rule);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -888,7 +1695,7 @@ pycairo_set_line_cap (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_line_cap (o->ctx, line_cap);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -900,7 +1707,7 @@ pycairo_set_line_join (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_line_join (o->ctx, line_join);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -912,7 +1719,7 @@ pycairo_set_line_width (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_line_width (o->ctx, width);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -925,7 +1732,7 @@ pycairo_set_matrix (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_matrix (o->ctx, &matrix->matrix);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -937,7 +1744,7 @@ pycairo_set_miter_limit (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_miter_limit (o->ctx, limit);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -949,7 +1756,7 @@ pycairo_set_operator(PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_operator(o->ctx, op);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -974,6 +1781,7 @@ pycairo_set_source (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_source (o->ctx, p->pattern);
+  display_list_note_source (o->ctx);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -987,7 +1795,7 @@ pycairo_set_source_rgb (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_source_rgb (o->ctx, red, green, blue);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -1001,7 +1809,7 @@ pycairo_set_source_rgba (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_source_rgba (o->ctx, red, green, blue, alpha);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -1015,6 +1823,7 @@ pycairo_set_source_surface (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_set_source_surface (o->ctx, surface->surface, x, y);
+  display_list_note_source (o->ctx);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -1025,7 +1834,7 @@ pycairo_set_tolerance (PycairoContext *o, PyObject *args) {
   if (!PyArg_ParseTuple (args, "d:Context.set_tolerance", &tolerance))
     return NULL;
   cairo_set_tolerance (o->ctx, tolerance);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -1034,6 +1843,7 @@ pycairo_show_glyphs (PycairoContext *o, PyObject *args) {
   int num_glyphs = -1;
   cairo_glyph_t *glyphs;
   PyObject *py_object;
+  display_list_t *dl;
 
   if (!PyArg_ParseTuple (args, "O|i:Context.show_glyphs",
 			 &py_object, &num_glyphs))
@@ -1042,9 +1852,16 @@ pycairo_show_glyphs (PycairoContext *o, PyObject *args) {
   glyphs = _PycairoGlyphs_AsGlyphs (py_object, &num_glyphs);
   if (glyphs == NULL)
     return NULL;
+  dl = _context_draw_begin (o->ctx);
+  if (display_list_capture_glyphs (dl, o->ctx, glyphs, num_glyphs) < 0) {
+    display_list_end (dl);
+    PyMem_Free (glyphs);
+    return NULL;
+  }
   Py_BEGIN_ALLOW_THREADS;
   cairo_show_glyphs (o->ctx, glyphs, num_glyphs);
   Py_END_ALLOW_THREADS;
+  display_list_end (dl);
   PyMem_Free (glyphs);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
@@ -1052,9 +1869,17 @@ pycairo_show_glyphs (PycairoContext *o, PyObject *args) {
 
 static PyObject *
 pycairo_show_page (PycairoContext *o) {
+  cairo_surface_t *target = cairo_get_target (o->ctx);
+  PyObject *token;
+
+  if (tee_fanout_check_page (target) < 0)
+    return NULL;
+
+  token = surface_file_writer_begin (target);
   Py_BEGIN_ALLOW_THREADS;
   cairo_show_page (o->ctx);
   Py_END_ALLOW_THREADS;
+  surface_file_writer_end (target, token);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -1062,24 +1887,447 @@ pycairo_show_page (PycairoContext *o) {
 static PyObject *
 pycairo_show_text (PycairoContext *o, PyObject *args) {
   const char *utf8;
+  display_list_t *dl;
 
   if (!PyArg_ParseTuple (args, PYCAIRO_ENC_TEXT_FORMAT ":Context.show_text", "utf-8", &utf8))
     return NULL;
 
+  dl = _context_draw_begin (o->ctx);
+  if (display_list_capture_text (dl, o->ctx, utf8) < 0) {
+    display_list_end (dl);
+    PyMem_Free((void *)utf8);
+    return NULL;
+  }
+
   Py_BEGIN_ALLOW_THREADS;
   cairo_show_text (o->ctx, utf8);
   Py_END_ALLOW_THREADS;
+  display_list_end (dl);
 
   PyMem_Free((void *)utf8);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
 
+/* Shapes all strings with the scaled font, moving each one by align times
+ * its advance, into one newly allocated glyph array. Doesn't need the
+ * GIL. */
+static cairo_status_t
+_shape_texts (cairo_scaled_font_t *scaled_font, char **strings,
+	      const double *positions, Py_ssize_t n_strings, double align,
+	      cairo_glyph_t **result, int *n_result) {
+  cairo_glyph_t *all = NULL, *glyphs;
+  cairo_text_extents_t extents;
+  cairo_status_t status = CAIRO_STATUS_SUCCESS;
+  size_t n_all = 0, size_all = 0;
+  Py_ssize_t i;
+  int n_glyphs, j;
+
+  for (i = 0; i < n_strings; i++) {
+    glyphs = NULL;
+    status = cairo_scaled_font_text_to_glyphs (
+      scaled_font, positions[i * 2], positions[i * 2 + 1], strings[i], -1,
+      &glyphs, &n_glyphs, NULL, NULL, NULL);
+    if (status != CAIRO_STATUS_SUCCESS)
+      break;
+
+    if (align != 0 && n_glyphs > 0) {
+      cairo_scaled_font_glyph_extents (scaled_font, glyphs, n_glyphs,
+				       &extents);
+      for (j = 0; j < n_glyphs; j++) {
+	glyphs[j].x -= align * extents.x_advance;
+	glyphs[j].y -= align * extents.y_advance;
+      }
+    }
+
+    if (n_all + n_glyphs > size_all) {
+      size_t size = size_all ? size_all : 256;
+      cairo_glyph_t *tmp;
+
+      while (size < n_all + n_glyphs)
+	size *= 2;
+      tmp = realloc (all, size * sizeof (cairo_glyph_t));
+      if (tmp == NULL) {
+	cairo_glyph_free (glyphs);
+	status = CAIRO_STATUS_NO_MEMORY;
+	break;
+      }
+      all = tmp;
+      size_all = size;
+    }
+    if (n_glyphs > 0)
+      memcpy (all + n_all, glyphs, n_glyphs * sizeof (cairo_glyph_t));
+    n_all += n_glyphs;
+    cairo_glyph_free (glyphs);
+
+    if (n_all > INT_MAX) {
+      status = CAIRO_STATUS_NO_MEMORY;
+      break;
+    }
+  }
+
+  if (status != CAIRO_STATUS_SUCCESS) {
+    free (all);
+    return status;
+  }
+
+  *result = all;
+  *n_result = (int)n_all;
+  return CAIRO_STATUS_SUCCESS;
+}
+
+static PyObject *
+pycairo_show_texts (PycairoContext *o, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"strings", "positions", "align", NULL};
+  PyObject *strings_obj, *positions_obj, *seq, *result = NULL;
+  double *positions, align = 0.0;
+  char **strings = NULL;
+  Py_ssize_t n_strings = 0, n_positions, i;
+  cairo_scaled_font_t *scaled_font;
+  cairo_glyph_t *glyphs = NULL;
+  cairo_status_t status;
+  display_list_t *dl;
+  int cols, n_glyphs = 0;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OO|d:Context.show_texts",
+				    kwlist, &strings_obj, &positions_obj,
+				    &align))
+    return NULL;
+
+  seq = PySequence_Fast (strings_obj, "strings must be a sequence of text");
+  if (seq == NULL)
+    return NULL;
+
+  positions = _Pycairo_AsDoubleArray (positions_obj, "positions", 2, 0,
+				      &n_positions, &cols);
+  if (positions == NULL)
+    goto DONE;
+  if (n_positions != PySequence_Fast_GET_SIZE (seq)) {
+    PyErr_SetString (PyExc_ValueError,
+		     "positions must have as many rows as strings");
+    goto DONE;
+  }
+
+  strings = PyMem_Malloc (sizeof (char *) * (n_positions + 1));
+  if (strings == NULL) {
+    PyErr_NoMemory ();
+    goto DONE;
+  }
+  for (n_strings = 0; n_strings < n_positions; n_strings++) {
+    if (!PyArg_Parse (PySequence_Fast_GET_ITEM (seq, n_strings),
+		      PYCAIRO_ENC_TEXT_FORMAT ";strings must be a sequence of "
+		      "text", "utf-8", &strings[n_strings]))
+      goto DONE;
+  }
+
+  scaled_font = cairo_scaled_font_reference (cairo_get_scaled_font (o->ctx));
+  Py_BEGIN_ALLOW_THREADS;
+  status = _shape_texts (scaled_font, strings, positions, n_strings, align,
+			 &glyphs, &n_glyphs);
+  Py_END_ALLOW_THREADS;
+  cairo_scaled_font_destroy (scaled_font);
+  if (Pycairo_Check_Status (status))
+    goto DONE;
+
+  dl = _context_draw_begin (o->ctx);
+  if (display_list_capture_glyphs (dl, o->ctx, glyphs, n_glyphs) < 0) {
+    display_list_end (dl);
+    goto DONE;
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  cairo_show_glyphs (o->ctx, glyphs, n_glyphs);
+  Py_END_ALLOW_THREADS;
+  display_list_end (dl);
+  if (Pycairo_Check_Status (cairo_status (o->ctx)))
+    goto DONE;
+
+  Py_INCREF (Py_None);
+  result = Py_None;
+
+DONE:
+  for (i = 0; i < n_strings; i++)
+    PyMem_Free (strings[i]);
+  PyMem_Free (strings);
+  PyMem_Free (positions);
+  free (glyphs);
+  Py_DECREF (seq);
+  return result;
+}
+
+/* Path markers get rasterized once per subpixel phase, positions are
+ * rounded to multiples of 1/STAMP_SUBPIXEL device pixels. */
+#define STAMP_SUBPIXEL 4
+
+typedef struct {
+  cairo_t *ctx;
+  cairo_path_t *path;        /* NULL when stamping a surface */
+  cairo_surface_t *surface;
+  cairo_matrix_t ctm;
+  int ox, oy, width, height; /* sprite area relative to the position */
+  cairo_surface_t *sprites[STAMP_SUBPIXEL * STAMP_SUBPIXEL];
+} stamp_t;
+
+/* Returns 0 if the path has nothing to fill. */
+static int
+_stamp_init_path (stamp_t *st) {
+  cairo_surface_t *scratch;
+  cairo_matrix_t linear = st->ctm;
+  double x1, y1, x2, y2;
+  cairo_t *cr;
+
+  linear.x0 = linear.y0 = 0;
+  scratch = cairo_image_surface_create (CAIRO_FORMAT_A8, 0, 0);
+  cr = cairo_create (scratch);
+  cairo_set_matrix (cr, &linear);
+  cairo_append_path (cr, st->path);
+  cairo_identity_matrix (cr);
+  cairo_set_fill_rule (cr, cairo_get_fill_rule (st->ctx));
+  cairo_fill_extents (cr, &x1, &y1, &x2, &y2);
+  cairo_destroy (cr);
+  cairo_surface_destroy (scratch);
+
+  if (x1 >= x2 || y1 >= y2)
+    return 0;
+
+  /* one pixel for antialiasing on each side, one for the phase shift */
+  st->ox = (int)floor (x1) - 1;
+  st->oy = (int)floor (y1) - 1;
+  st->width = (int)ceil (x2) + 2 - st->ox;
+  st->height = (int)ceil (y2) + 2 - st->oy;
+  return 1;
+}
+
+/* Surface markers get filled as rectangles covering their ink, painting
+ * them would touch the whole clip with unbounded operators. Returns 0 if the
+ * surface has nothing to draw. */
+static int
+_stamp_init_surface (stamp_t *st) {
+  cairo_surface_t *scratch;
+  double x, y, width, height;
+  cairo_t *cr;
+
+  scratch = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, NULL);
+  cr = cairo_create (scratch);
+  cairo_set_source_surface (cr, st->surface, 0, 0);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+  cairo_recording_surface_ink_extents (scratch, &x, &y, &width, &height);
+  cairo_surface_destroy (scratch);
+
+  if (!(width > 0 && height > 0) || width > INT_MAX || height > INT_MAX)
+    return 0;
+
+  st->ox = (int)floor (x);
+  st->oy = (int)floor (y);
+  st->width = (int)ceil (x + width) - st->ox;
+  st->height = (int)ceil (y + height) - st->oy;
+  return 1;
+}
+
+static cairo_surface_t *
+_stamp_get_sprite (stamp_t *st, int fx, int fy) {
+  cairo_surface_t **sprite = &st->sprites[fy * STAMP_SUBPIXEL + fx];
+  cairo_matrix_t linear = st->ctm;
+  cairo_t *cr;
+
+  if (*sprite != NULL)
+    return *sprite;
+
+  linear.x0 = linear.y0 = 0;
+  *sprite = cairo_image_surface_create (CAIRO_FORMAT_A8,
+                                        st->width, st->height);
+  cr = cairo_create (*sprite);
+  cairo_set_antialias (cr, cairo_get_antialias (st->ctx));
+  cairo_set_tolerance (cr, cairo_get_tolerance (st->ctx));
+  cairo_set_fill_rule (cr, cairo_get_fill_rule (st->ctx));
+  cairo_translate (cr, -st->ox + (double)fx / STAMP_SUBPIXEL,
+                   -st->oy + (double)fy / STAMP_SUBPIXEL);
+  cairo_transform (cr, &linear);
+  cairo_append_path (cr, st->path);
+  cairo_fill (cr);
+  cairo_destroy (cr);
+  return *sprite;
+}
+
+/* Composites the marker at all positions in device space. Capturing into
+ * dl (from display_list_begin(), can be NULL) needs the GIL. Returns -1
+ * with an exception set if capturing failed. */
+static int
+_stamp_loop (stamp_t *st, const double *positions, Py_ssize_t n_positions,
+             const double *colors, display_list_t *dl) {
+  cairo_t *ctx = st->ctx;
+  cairo_pattern_t *pattern;
+  cairo_matrix_t matrix;
+  cairo_path_t *user_path = NULL;
+  Py_ssize_t i;
+  int res = 0;
+
+  cairo_identity_matrix (ctx);
+  if (st->path == NULL && colors == NULL) {
+    /* filling replaces the current path */
+    user_path = cairo_copy_path (ctx);
+    cairo_new_path (ctx);
+  }
+
+  for (i = 0; i < n_positions; i++) {
+    double x = positions[i * 2], y = positions[i * 2 + 1];
+    cairo_surface_t *sprite;
+    double ix, iy;
+
+    cairo_matrix_transform_point (&st->ctm, &x, &y);
+    /* also skips NaN */
+    if (!(fabs (x) < 1e9 && fabs (y) < 1e9))
+      continue;
+
+    if (colors != NULL) {
+      const double *c = colors + i * 4;
+      cairo_set_source_rgba (ctx, c[0], c[1], c[2], c[3]);
+    }
+
+    if (st->path != NULL) {
+      double qx = floor (x * STAMP_SUBPIXEL + 0.5);
+      double qy = floor (y * STAMP_SUBPIXEL + 0.5);
+
+      ix = floor (qx / STAMP_SUBPIXEL);
+      iy = floor (qy / STAMP_SUBPIXEL);
+      sprite = _stamp_get_sprite (st, (int)(qx - ix * STAMP_SUBPIXEL),
+                                  (int)(qy - iy * STAMP_SUBPIXEL));
+      ix += st->ox;
+      iy += st->oy;
+    } else {
+      sprite = st->surface;
+      ix = floor (x + 0.5);
+      iy = floor (y + 0.5);
+    }
+
+    pattern = cairo_pattern_create_for_surface (sprite);
+    cairo_matrix_init_translate (&matrix, -ix, -iy);
+    cairo_pattern_set_matrix (pattern, &matrix);
+
+    if (st->path != NULL || colors != NULL) {
+      if (dl != NULL && display_list_capture_mask (dl, ctx, pattern) < 0)
+        res = -1;
+      else
+        cairo_mask (ctx, pattern);
+    } else {
+      cairo_set_source (ctx, pattern);
+      if (dl != NULL)
+        display_list_note_source (ctx);
+      cairo_rectangle (ctx, ix + st->ox, iy + st->oy,
+                       st->width, st->height);
+      if (dl != NULL && display_list_capture_fill (dl, ctx) < 0)
+        res = -1;
+      else
+        cairo_fill (ctx);
+    }
+    cairo_pattern_destroy (pattern);
+
+    if (res < 0 || cairo_status (ctx) != CAIRO_STATUS_SUCCESS)
+      break;
+  }
+
+  if (user_path != NULL) {
+    cairo_new_path (ctx);
+    cairo_append_path (ctx, user_path);
+    cairo_path_destroy (user_path);
+  }
+
+  return res;
+}
+
+static PyObject *
+pycairo_stamp (PycairoContext *o, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"marker", "positions", "colors", NULL};
+  PyObject *marker, *positions_obj, *colors_obj = Py_None;
+  double *positions, *colors = NULL;
+  Py_ssize_t n_positions, n_colors;
+  int cols, res = 0, i;
+  display_list_t *dl;
+  stamp_t st;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OO|O:Context.stamp", kwlist,
+				    &marker, &positions_obj, &colors_obj))
+    return NULL;
+
+  memset (&st, 0, sizeof (stamp_t));
+  st.ctx = o->ctx;
+  if (PyObject_TypeCheck (marker, &PycairoPath_Type)) {
+    st.path = ((PycairoPath *)marker)->path;
+  } else if (PyObject_TypeCheck (marker, &PycairoSurface_Type)) {
+    st.surface = ((PycairoSurface *)marker)->surface;
+  } else {
+    PyErr_SetString (PyExc_TypeError,
+		     "marker must be a cairo.Path or a cairo.Surface");
+    return NULL;
+  }
+
+  positions = _Pycairo_AsDoubleArray (positions_obj, "positions", 2, 0,
+				      &n_positions, &cols);
+  if (positions == NULL)
+    return NULL;
+
+  if (colors_obj != Py_None) {
+    colors = _Pycairo_AsDoubleArray (colors_obj, "colors", 4, 0,
+				     &n_colors, &cols);
+    if (colors == NULL) {
+      PyMem_Free (positions);
+      return NULL;
+    }
+    if (n_colors != n_positions) {
+      PyMem_Free (positions);
+      PyMem_Free (colors);
+      PyErr_SetString (PyExc_ValueError,
+		       "colors must have as many rows as positions");
+      return NULL;
+    }
+  }
+
+  cairo_get_matrix (o->ctx, &st.ctm);
+  if (st.path != NULL ? _stamp_init_path (&st) :
+      colors != NULL || _stamp_init_surface (&st)) {
+    cairo_save (o->ctx);
+    /* markers are drawn from surfaces */
+    tee_fanout_note_surface (o->ctx);
+    dl = _context_draw_begin (o->ctx);
+    if (dl != NULL) {
+      /* indexed recordings need every stamp captured */
+      res = _stamp_loop (&st, positions, n_positions, colors, dl);
+    } else {
+      Py_BEGIN_ALLOW_THREADS;
+      res = _stamp_loop (&st, positions, n_positions, colors, NULL);
+      Py_END_ALLOW_THREADS;
+    }
+    display_list_end (dl);
+    cairo_restore (o->ctx);
+  }
+
+  for (i = 0; i < STAMP_SUBPIXEL * STAMP_SUBPIXEL; i++) {
+    if (st.sprites[i] != NULL)
+      cairo_surface_destroy (st.sprites[i]);
+  }
+  PyMem_Free (positions);
+  PyMem_Free (colors);
+
+  if (res < 0)
+    return NULL;
+  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  Py_RETURN_NONE;
+}
+
 static PyObject *
 pycairo_stroke (PycairoContext *o) {
+  display_list_t *dl = _context_draw_begin (o->ctx);
+
+  if (display_list_capture_stroke (dl, o->ctx) < 0) {
+    display_list_end (dl);
+    return NULL;
+  }
+
   Py_BEGIN_ALLOW_THREADS;
   cairo_stroke (o->ctx);
   Py_END_ALLOW_THREADS;
+  display_list_end (dl);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
@@ -1092,15 +2340,157 @@ pycairo_stroke_extents (PycairoContext *o) {
   return Py_BuildValue("(dddd)", x1, y1, x2, y2);
 }
 
+static PyObject *
+pycairo_stroke_instances (PycairoContext *o, PyObject *args, PyObject *kwds) {
+  return _draw_instances (o, args, kwds, "O!O|O:Context.stroke_instances", 1);
+}
+
 static PyObject *
 pycairo_stroke_preserve (PycairoContext *o) {
+  display_list_t *dl = _context_draw_begin (o->ctx);
+
+  if (display_list_capture_stroke (dl, o->ctx) < 0) {
+    display_list_end (dl);
+    return NULL;
+  }
+
   Py_BEGIN_ALLOW_THREADS;
   cairo_stroke_preserve (o->ctx);
   Py_END_ALLOW_THREADS;
+  display_list_end (dl);
   RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
   Py_RETURN_NONE;
 }
 
+/* Strokes segments, (x1, y1, x2, y2) rows, in order. Runs of consecutive
+ * segments with the same color and width get stroked together, but only
+ * with opaque colors and OVER: a translucent stroke covers the overlaps of
+ * its segments once where separate strokes blend them again, and unbounded
+ * operators would differ as well. Capturing into dl (from
+ * display_list_begin(), can be NULL) needs the GIL. Returns -1 with an
+ * exception set if capturing failed. */
+static int
+_stroke_segments_loop (cairo_t *ctx, const double *segments,
+		       Py_ssize_t n_segments, const double *colors,
+		       const double *widths, display_list_t *dl) {
+  Py_ssize_t i, j, k;
+  int merge;
+
+  merge = cairo_get_operator (ctx) == CAIRO_OPERATOR_OVER;
+  if (merge && colors == NULL) {
+    double red, green, blue, alpha;
+
+    merge = cairo_pattern_get_rgba (cairo_get_source (ctx), &red, &green,
+				    &blue, &alpha) == CAIRO_STATUS_SUCCESS &&
+	    alpha >= 1.0;
+  }
+
+  for (i = 0; i < n_segments; i = j) {
+    const double *color = colors != NULL ? colors + i * 4 : NULL;
+
+    j = i + 1;
+    if (merge && (color == NULL || color[3] >= 1.0)) {
+      while (j < n_segments &&
+	     (color == NULL ||
+	      memcmp (colors + j * 4, color, 4 * sizeof (double)) == 0) &&
+	     (widths == NULL || widths[j] == widths[i]))
+	j++;
+    }
+
+    for (k = i; k < j; k++) {
+      const double *s = segments + k * 4;
+      cairo_move_to (ctx, s[0], s[1]);
+      cairo_line_to (ctx, s[2], s[3]);
+    }
+
+    if (color != NULL)
+      cairo_set_source_rgba (ctx, color[0], color[1], color[2], color[3]);
+    if (widths != NULL)
+      cairo_set_line_width (ctx, widths[i]);
+
+    if (dl != NULL && display_list_capture_stroke (dl, ctx) < 0)
+      return -1;
+    cairo_stroke (ctx);
+    if (cairo_status (ctx) != CAIRO_STATUS_SUCCESS)
+      break;
+  }
+
+  return 0;
+}
+
+static PyObject *
+pycairo_stroke_segments (PycairoContext *o, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"segments", "colors", "widths", NULL};
+  PyObject *segments_obj, *colors_obj = Py_None, *widths_obj = Py_None;
+  double *segments, *colors = NULL, *widths = NULL;
+  Py_ssize_t n_segments, n_colors, n_widths;
+  PyObject *result = NULL;
+  display_list_t *dl;
+  int cols, res;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds,
+				    "O|OO:Context.stroke_segments", kwlist,
+				    &segments_obj, &colors_obj, &widths_obj))
+    return NULL;
+
+  segments = _Pycairo_AsDoubleArray (segments_obj, "segments", 4, 0,
+				     &n_segments, &cols);
+  if (segments == NULL)
+    return NULL;
+
+  if (colors_obj != Py_None) {
+    colors = _Pycairo_AsDoubleArray (colors_obj, "colors", 4, 0,
+				     &n_colors, &cols);
+    if (colors == NULL)
+      goto DONE;
+    if (n_colors != n_segments) {
+      PyErr_SetString (PyExc_ValueError,
+		       "colors must have as many rows as segments");
+      goto DONE;
+    }
+  }
+
+  if (widths_obj != Py_None) {
+    widths = _Pycairo_AsDoubleArray (widths_obj, "widths", 1, 0,
+				     &n_widths, &cols);
+    if (widths == NULL)
+      goto DONE;
+    if (n_widths != n_segments) {
+      PyErr_SetString (PyExc_ValueError,
+		       "widths must have as many items as segments");
+      goto DONE;
+    }
+  }
+
+  cairo_save (o->ctx);
+  cairo_new_path (o->ctx);
+  dl = _context_draw_begin (o->ctx);
+  if (dl != NULL) {
+    res = _stroke_segments_loop (o->ctx, segments, n_segments, colors,
+				 widths, dl);
+  } else {
+    Py_BEGIN_ALLOW_THREADS;
+    res = _stroke_segments_loop (o->ctx, segments, n_segments, colors,
+				 widths, NULL);
+    Py_END_ALLOW_THREADS;
+  }
+  display_list_end (dl);
+  cairo_new_path (o->ctx);
+  cairo_restore (o->ctx);
+
+  if (res < 0 || Pycairo_Check_Status (cairo_status (o->ctx)))
+    goto DONE;
+
+  Py_INCREF (Py_None);
+  result = Py_None;
+
+DONE:
+  PyMem_Free (segments);
+  PyMem_Free (colors);
+  PyMem_Free (widths);
+  return result;
+}
+
 static PyObject *
 pycairo_text_extents (PycairoContext *o, PyObject *args) {
   cairo_text_extents_t extents;
@@ -1143,7 +2533,7 @@ pycairo_transform (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_transform (o->ctx, &matrix->matrix);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -1155,7 +2545,7 @@ pycairo_translate (PycairoContext *o, PyObject *args) {
     return NULL;
 
   cairo_translate (o->ctx, tx, ty);
-  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR(o->ctx);
+  RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o);
   Py_RETURN_NONE;
 }
 
@@ -1195,6 +2585,7 @@ pycairo_show_text_glyphs (PycairoContext *o, PyObject *args) {
   cairo_glyph_t *glyphs = NULL;
   cairo_text_cluster_t *clusters = NULL;
   Py_ssize_t clusters_size, glyphs_size;
+  display_list_t *dl;
 
   if (!PyArg_ParseTuple (args,
       PYCAIRO_ENC_TEXT_FORMAT "OOi:Context.show_text_glyphs",
@@ -1234,11 +2625,19 @@ pycairo_show_text_glyphs (PycairoContext *o, PyObject *args) {
   }
   Py_CLEAR (clusters_seq);
 
+  dl = _context_draw_begin (o->ctx);
+  if (display_list_capture_glyphs (dl, o->ctx, glyphs,
+                                   (int)glyphs_size) < 0) {
+    display_list_end (dl);
+    goto error;
+  }
+
   Py_BEGIN_ALLOW_THREADS;
   cairo_show_text_glyphs (
     o->ctx, utf8, -1, glyphs, glyphs_size, clusters,
     clusters_size, cluster_flags);
   Py_END_ALLOW_THREADS;
+  display_list_end (dl);
 
   PyMem_Free ((void *)utf8);
   utf8 = NULL;
@@ -1267,15 +2666,22 @@ static PyMethodDef pycairo_methods[] = {
    * - not needed since Pycairo calls Pycairo_Check_Status() to check
    *   for errors and raise exceptions
    */
-  {"append_path",     (PyCFunction)pycairo_append_path,      METH_VARARGS},
+  {"append_path",     (PyCFunction)pycairo_append_path,
+   METH_VARARGS | METH_KEYWORDS},
+  {"apply_style",     (PyCFunction)pycairo_apply_style,      METH_VARARGS},
   {"arc",             (PyCFunction)pycairo_arc,              METH_VARARGS},
   {"arc_negative",    (PyCFunction)pycairo_arc_negative,     METH_VARARGS},
+  {"capture_style",   (PyCFunction)pycairo_capture_style,    METH_NOARGS},
+  {"check",           (PyCFunction)pycairo_check,            METH_NOARGS},
   {"clip",            (PyCFunction)pycairo_clip,             METH_NOARGS},
   {"clip_extents",    (PyCFunction)pycairo_clip_extents,     METH_NOARGS},
   {"clip_preserve",   (PyCFunction)pycairo_clip_preserve,    METH_NOARGS},
   {"close_path",      (PyCFunction)pycairo_close_path,       METH_NOARGS},
+  {"copy_clip_rectangle_buffer",
+   (PyCFunction)pycairo_copy_clip_rectangle_buffer, METH_NOARGS},
   {"copy_clip_rectangle_list", (PyCFunction)pycairo_copy_clip_rectangle_list,
    METH_NOARGS},
+  {"copy_clip_region", (PyCFunction)pycairo_copy_clip_region, METH_NOARGS},
   {"copy_page",       (PyCFunction)pycairo_copy_page,        METH_NOARGS},
   {"copy_path",       (PyCFunction)pycairo_copy_path,        METH_NOARGS},
   {"copy_path_flat",  (PyCFunction)pycairo_copy_path_flat,   METH_NOARGS},
@@ -1285,12 +2691,17 @@ static PyMethodDef pycairo_methods[] = {
    METH_VARARGS},
   {"fill",            (PyCFunction)pycairo_fill,             METH_NOARGS},
   {"fill_extents",    (PyCFunction)pycairo_fill_extents,     METH_NOARGS},
+  {"fill_instances",  (PyCFunction)pycairo_fill_instances,
+   METH_VARARGS | METH_KEYWORDS},
   {"fill_preserve",   (PyCFunction)pycairo_fill_preserve,    METH_NOARGS},
+  {"fill_rectangles", (PyCFunction)pycairo_fill_rectangles,
+   METH_VARARGS | METH_KEYWORDS},
   {"font_extents",    (PyCFunction)pycairo_font_extents,     METH_NOARGS},
   {"get_antialias",   (PyCFunction)pycairo_get_antialias,    METH_NOARGS},
   {"get_current_point",(PyCFunction)pycairo_get_current_point,METH_NOARGS},
   {"get_dash",        (PyCFunction)pycairo_get_dash,         METH_NOARGS},
   {"get_dash_count",  (PyCFunction)pycairo_get_dash_count,   METH_NOARGS},
+  {"get_defer_errors",(PyCFunction)pycairo_get_defer_errors, METH_NOARGS},
   {"get_fill_rule",   (PyCFunction)pycairo_get_fill_rule,    METH_NOARGS},
   {"get_font_face",   (PyCFunction)pycairo_get_font_face,    METH_NOARGS},
   {"get_font_matrix", (PyCFunction)pycairo_get_font_matrix,  METH_NOARGS},
@@ -1340,6 +2751,7 @@ static PyMethodDef pycairo_methods[] = {
   {"select_font_face",(PyCFunction)pycairo_select_font_face, METH_VARARGS},
   {"set_antialias",   (PyCFunction)pycairo_set_antialias,    METH_VARARGS},
   {"set_dash",        (PyCFunction)pycairo_set_dash,         METH_VARARGS},
+  {"set_defer_errors",(PyCFunction)pycairo_set_defer_errors, METH_VARARGS},
   {"set_fill_rule",   (PyCFunction)pycairo_set_fill_rule,    METH_VARARGS},
   {"set_font_face",   (PyCFunction)pycairo_set_font_face,    METH_O},
   {"set_font_matrix", (PyCFunction)pycairo_set_font_matrix,  METH_VARARGS},
@@ -1360,9 +2772,17 @@ static PyMethodDef pycairo_methods[] = {
   {"show_glyphs",     (PyCFunction)pycairo_show_glyphs,      METH_VARARGS},
   {"show_page",       (PyCFunction)pycairo_show_page,        METH_NOARGS},
   {"show_text",       (PyCFunction)pycairo_show_text,        METH_VARARGS},
+  {"show_texts",      (PyCFunction)pycairo_show_texts,
+   METH_VARARGS | METH_KEYWORDS},
+  {"stamp",           (PyCFunction)pycairo_stamp,
+   METH_VARARGS | METH_KEYWORDS},
   {"stroke",          (PyCFunction)pycairo_stroke,           METH_NOARGS},
   {"stroke_extents",  (PyCFunction)pycairo_stroke_extents,   METH_NOARGS},
+  {"stroke_instances", (PyCFunction)pycairo_stroke_instances,
+   METH_VARARGS | METH_KEYWORDS},
   {"stroke_preserve", (PyCFunction)pycairo_stroke_preserve,  METH_NOARGS},
+  {"stroke_segments", (PyCFunction)pycairo_stroke_segments,
+   METH_VARARGS | METH_KEYWORDS},
   {"text_extents",    (PyCFunction)pycairo_text_extents,     METH_VARARGS},
   {"text_path",       (PyCFunction)pycairo_text_path,        METH_VARARGS},
   {"transform",       (PyCFunction)pycairo_transform,        METH_VARARGS},
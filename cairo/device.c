@@ -153,92 +153,382 @@ PyTypeObject PycairoDevice_Type = {
 #if CAIRO_HAS_SCRIPT_SURFACE
 #include <cairo-script.h>
 
-static const cairo_user_data_key_t device_base_object_key;
+#include <stdio.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
-static void
-_decref_destroy_func(void *user_data) {
-  PyGILState_STATE gstate = PyGILState_Ensure();
-  Py_DECREF(user_data);
-  PyGILState_Release(gstate);
+/* cairo emits scripts in lots of small fragments. Instead of taking the GIL
+ * and calling write() for each of them we collect them here and pass them on
+ * in large blocks, optionally deflating them on the way.
+ */
+#define SCRIPT_WRITER_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+    PyObject *file;     /* Python file object or NULL if writing to fp */
+    FILE *fp;
+    unsigned char *data;
+    size_t length;
+    int failed;
+    int finished;
+#ifdef HAVE_ZLIB
+    int compress;
+    z_stream zstream;
+#endif
+} script_writer_t;
+
+static const cairo_user_data_key_t script_writer_key;
+
+static cairo_status_t
+_script_writer_write_out (script_writer_t *writer,
+                          const unsigned char *data, size_t length) {
+    PyGILState_STATE gstate;
+    PyObject *res;
+
+    if (writer->failed)
+        return CAIRO_STATUS_WRITE_ERROR;
+
+    if (length == 0)
+        return CAIRO_STATUS_SUCCESS;
+
+    if (writer->fp != NULL) {
+        if (fwrite (data, 1, length, writer->fp) != length)
+            writer->failed = 1;
+    } else {
+        gstate = PyGILState_Ensure ();
+        res = PyObject_CallMethod (
+            writer->file, "write", "(" PYCAIRO_DATA_FORMAT "#)",
+            data, (Py_ssize_t)length);
+        if (res == NULL) {
+            PyErr_Clear ();
+            /* an exception has occurred, it will be picked up later by
+             * Pycairo_Check_Status()
+             */
+            writer->failed = 1;
+        } else {
+            Py_DECREF (res);
+        }
+        PyGILState_Release (gstate);
+    }
+
+    return writer->failed ? CAIRO_STATUS_WRITE_ERROR : CAIRO_STATUS_SUCCESS;
 }
 
-static PyObject *
-_device_create_with_object(cairo_device_t *device, PyObject *base) {
-    PyObject *pydevice;
+static cairo_status_t
+_script_writer_drain (script_writer_t *writer) {
     cairo_status_t status;
 
-    pydevice = PycairoDevice_FromDevice(device);
-    if (pydevice == NULL)
-        return NULL;
+    status = _script_writer_write_out (writer, writer->data, writer->length);
+    writer->length = 0;
+    return status;
+}
 
-    if (base != NULL) {
-        status = cairo_device_set_user_data(
-            device, &device_base_object_key, base, _decref_destroy_func);
-        if (status != CAIRO_STATUS_SUCCESS)
-            Py_DECREF(pydevice);
-        RETURN_NULL_IF_CAIRO_ERROR(status);
-        Py_INCREF(base);
-    }
+#ifdef HAVE_ZLIB
+/* Feeds data through the deflate stream, draining the buffer whenever it
+ * fills up. flush is one of Z_NO_FLUSH, Z_SYNC_FLUSH or Z_FINISH. */
+static cairo_status_t
+_script_writer_deflate (script_writer_t *writer, const unsigned char *data,
+                        size_t length, int flush) {
+    z_stream *zs = &writer->zstream;
+    int ret;
+
+    zs->next_in = (Bytef *)data;
+    zs->avail_in = (uInt)length;
+
+    do {
+        zs->next_out = writer->data + writer->length;
+        zs->avail_out = (uInt)(SCRIPT_WRITER_BUFFER_SIZE - writer->length);
+        ret = deflate (zs, flush);
+        if (ret == Z_STREAM_ERROR) {
+            writer->failed = 1;
+            return CAIRO_STATUS_WRITE_ERROR;
+        }
+        writer->length = SCRIPT_WRITER_BUFFER_SIZE - zs->avail_out;
+        if (zs->avail_out == 0 &&
+                _script_writer_drain (writer) != CAIRO_STATUS_SUCCESS)
+            return CAIRO_STATUS_WRITE_ERROR;
+    } while (zs->avail_in != 0 || zs->avail_out == 0 ||
+             (flush == Z_FINISH && ret != Z_STREAM_END));
 
-    return pydevice;
+    return CAIRO_STATUS_SUCCESS;
 }
+#endif
 
 static cairo_status_t
-_write_func (void *closure, const unsigned char *data, unsigned int length) {
-    PyGILState_STATE gstate = PyGILState_Ensure();
-    PyObject *res = PyObject_CallMethod (
-        (PyObject *)closure, "write", "(" PYCAIRO_DATA_FORMAT "#)",
-        data, (Py_ssize_t)length);
-
-    if (res == NULL) {
-        PyErr_Clear();
-        /* an exception has occurred, it will be picked up later by
-         * Pycairo_Check_Status()
-         */
-        PyGILState_Release(gstate);
+_script_writer_write_func (void *closure, const unsigned char *data,
+                           unsigned int length) {
+    script_writer_t *writer = closure;
+
+    if (writer->failed || writer->finished)
         return CAIRO_STATUS_WRITE_ERROR;
+
+#ifdef HAVE_ZLIB
+    if (writer->compress)
+        return _script_writer_deflate (writer, data, length, Z_NO_FLUSH);
+#endif
+
+    if (writer->length + length > SCRIPT_WRITER_BUFFER_SIZE) {
+        if (_script_writer_drain (writer) != CAIRO_STATUS_SUCCESS)
+            return CAIRO_STATUS_WRITE_ERROR;
+        /* too large to be worth copying */
+        if (length >= SCRIPT_WRITER_BUFFER_SIZE)
+            return _script_writer_write_out (writer, data, length);
     }
 
-    Py_DECREF(res);
-    PyGILState_Release(gstate);
+    memcpy (writer->data + writer->length, data, length);
+    writer->length += length;
     return CAIRO_STATUS_SUCCESS;
 }
 
+/* Passes everything buffered so far on to the file. If finish is set the
+ * compressed stream gets terminated and no further writes are accepted. */
+static cairo_status_t
+_script_writer_flush (script_writer_t *writer, int finish) {
+    cairo_status_t status = CAIRO_STATUS_SUCCESS;
+
+    if (writer->finished)
+        return writer->failed ? CAIRO_STATUS_WRITE_ERROR : status;
+
+#ifdef HAVE_ZLIB
+    if (writer->compress && !writer->failed)
+        status = _script_writer_deflate (
+            writer, NULL, 0, finish ? Z_FINISH : Z_SYNC_FLUSH);
+#endif
+
+    if (status == CAIRO_STATUS_SUCCESS)
+        status = _script_writer_drain (writer);
+
+    if (status == CAIRO_STATUS_SUCCESS && writer->fp != NULL &&
+            fflush (writer->fp) != 0) {
+        writer->failed = 1;
+        status = CAIRO_STATUS_WRITE_ERROR;
+    }
+
+    if (finish) {
+        writer->finished = 1;
+#ifdef HAVE_ZLIB
+        if (writer->compress) {
+            deflateEnd (&writer->zstream);
+            writer->compress = 0;
+        }
+#endif
+        if (writer->fp != NULL && fclose (writer->fp) != 0) {
+            writer->failed = 1;
+            status = CAIRO_STATUS_WRITE_ERROR;
+        }
+        writer->fp = NULL;
+    }
+
+    return status;
+}
+
+static void
+_script_writer_destroy (void *user_data) {
+    script_writer_t *writer = user_data;
+    PyGILState_STATE gstate;
+
+    _script_writer_flush (writer, 1);
+
+#ifdef HAVE_ZLIB
+    /* in case the writer got marked finished before being flushed */
+    if (writer->compress)
+        deflateEnd (&writer->zstream);
+#endif
+
+    gstate = PyGILState_Ensure ();
+    Py_XDECREF (writer->file);
+    PyGILState_Release (gstate);
+
+    free (writer->data);
+    free (writer);
+}
+
+/* Returns a new writer for either a file object or a filename, or NULL
+ * with an exception set.
+ */
+static script_writer_t *
+_script_writer_new (PyObject *file, const char *name, int compress) {
+    script_writer_t *writer;
+
+#ifndef HAVE_ZLIB
+    if (compress) {
+        PyErr_SetString (PyExc_NotImplementedError,
+                         "pycairo was built without zlib support");
+        return NULL;
+    }
+#endif
+
+    writer = malloc (sizeof (script_writer_t));
+    if (writer == NULL) {
+        PyErr_NoMemory ();
+        return NULL;
+    }
+    memset (writer, 0, sizeof (script_writer_t));
+
+    writer->data = malloc (SCRIPT_WRITER_BUFFER_SIZE);
+    if (writer->data == NULL) {
+        free (writer);
+        PyErr_NoMemory ();
+        return NULL;
+    }
+
+#ifdef HAVE_ZLIB
+    if (compress) {
+        /* 16 + MAX_WBITS gives a gzip header, so the result can be read
+         * back with the gzip module or zcat */
+        if (deflateInit2 (&writer->zstream, Z_DEFAULT_COMPRESSION,
+                          Z_DEFLATED, 16 + MAX_WBITS, 8,
+                          Z_DEFAULT_STRATEGY) != Z_OK) {
+            free (writer->data);
+            free (writer);
+            PyErr_NoMemory ();
+            return NULL;
+        }
+        writer->compress = 1;
+    }
+#endif
+
+    if (name != NULL) {
+        Py_BEGIN_ALLOW_THREADS;
+        writer->fp = fopen (name, "wb");
+        Py_END_ALLOW_THREADS;
+        if (writer->fp == NULL) {
+            PyErr_SetFromErrnoWithFilename (PyExc_IOError, name);
+            writer->finished = 1;
+            _script_writer_destroy (writer);
+            return NULL;
+        }
+    } else {
+        Py_INCREF (file);
+        writer->file = file;
+    }
+
+    return writer;
+}
+
+static script_writer_t *
+_script_device_get_writer (cairo_device_t *device) {
+    return cairo_device_get_user_data (device, &script_writer_key);
+}
+
 static PyObject *
 script_device_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
     char *name = NULL;
-    PyObject *file;
+    PyObject *file, *pycompress = Py_False;
     cairo_device_t *device;
+    script_writer_t *writer;
+    cairo_status_t status;
+    int compress;
+    static char *kwlist[] = {"fobj", "compress", NULL};
 
-  if (!PyArg_ParseTuple (args, "O:ScriptDevice.__new__", &file))
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "O|O:ScriptDevice.__new__",
+                                    kwlist, &file, &pycompress))
+    return NULL;
+
+  compress = PyObject_IsTrue (pycompress);
+  if (compress < 0)
     return NULL;
 
   if (Pycairo_is_fspath (file)) {
-    if (!PyArg_ParseTuple (args, "O&:ScriptDevice.__new__",
-                           Pycairo_fspath_converter, &name))
+    if (!Pycairo_fspath_converter (file, &name))
       return NULL;
 
-    Py_BEGIN_ALLOW_THREADS;
-    device = cairo_script_create (name);
-    Py_END_ALLOW_THREADS;
+    if (!compress) {
+      /* cairo writes to the file itself, using buffered stdio */
+      Py_BEGIN_ALLOW_THREADS;
+      device = cairo_script_create (name);
+      Py_END_ALLOW_THREADS;
+      PyMem_Free (name);
+      return PycairoDevice_FromDevice (device);
+    }
+
+    writer = _script_writer_new (NULL, name, compress);
     PyMem_Free (name);
-    return PycairoDevice_FromDevice (device);
   } else {
-    if (PyArg_ParseTuple (args, "O&:ScriptDevice.__new__",
-                          Pycairo_writer_converter, &file)) {
+    if (!Pycairo_writer_converter (file, &file)) {
+      PyErr_Clear ();
+      PyErr_SetString (PyExc_TypeError,
+                       "ScriptDevice takes one argument which must be "
+                       "a filename, file object, or a file-like object "
+                       "which has a \"write\" method (like StringIO)");
+      return NULL;
+    }
+
+    writer = _script_writer_new (file, NULL, compress);
+  }
+
+  if (writer == NULL)
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS;
+  device = cairo_script_create_for_stream (_script_writer_write_func, writer);
+  Py_END_ALLOW_THREADS;
+
+  status = cairo_device_status (device);
+  if (status == CAIRO_STATUS_SUCCESS)
+    status = cairo_device_set_user_data (
+      device, &script_writer_key, writer, _script_writer_destroy);
+
+  if (status != CAIRO_STATUS_SUCCESS) {
+    cairo_device_destroy (device);
+    writer->finished = 1;
+    _script_writer_destroy (writer);
+    RETURN_NULL_IF_CAIRO_ERROR (status);
+  }
+
+  return PycairoDevice_FromDevice (device);
+}
+
+static PyObject *
+script_device_flush (PycairoDevice *obj) {
+    script_writer_t *writer;
+    cairo_status_t status;
+
+    cairo_device_flush (obj->device);
+    RETURN_NULL_IF_CAIRO_DEVICE_ERROR (obj->device);
+
+    writer = _script_device_get_writer (obj->device);
+    /* acquiring a finished device would put it into an error state */
+    if (writer == NULL || writer->finished)
+        Py_RETURN_NONE;
+
+    /* Other threads might be drawing into surfaces of this device */
+    Py_BEGIN_ALLOW_THREADS;
+    status = cairo_device_acquire (obj->device);
+    Py_END_ALLOW_THREADS;
+    RETURN_NULL_IF_CAIRO_ERROR (status);
+
+    status = _script_writer_flush (writer, 0);
+    cairo_device_release (obj->device);
+
+    RETURN_NULL_IF_CAIRO_ERROR (status);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+script_device_finish (PycairoDevice *obj) {
+    script_writer_t *writer;
+    cairo_status_t status;
+
+    writer = _script_device_get_writer (obj->device);
+    if (writer == NULL || writer->finished) {
+        cairo_device_finish (obj->device);
+    } else {
+        /* Other threads might be drawing into surfaces of this device */
         Py_BEGIN_ALLOW_THREADS;
-        device = cairo_script_create_for_stream (_write_func, file);
+        status = cairo_device_acquire (obj->device);
         Py_END_ALLOW_THREADS;
-        return _device_create_with_object (device, file);
-    } else {
-        PyErr_Clear ();
-        PyErr_SetString (PyExc_TypeError,
-                         "ScriptDevice takes one argument which must be "
-                         "a filename, file object, or a file-like object "
-                         "which has a \"write\" method (like StringIO)");
-        return NULL;
+        RETURN_NULL_IF_CAIRO_ERROR (status);
+
+        cairo_device_finish (obj->device);
+        status = _script_writer_flush (writer, 1);
+        cairo_device_release (obj->device);
+
+        RETURN_NULL_IF_CAIRO_ERROR (status);
     }
-  }
+
+    RETURN_NULL_IF_CAIRO_DEVICE_ERROR (obj->device);
+    Py_RETURN_NONE;
 }
 
 static PyObject *
@@ -296,6 +586,8 @@ script_device_from_recording_surface (PycairoDevice *obj, PyObject *args) {
 #endif
 
 static PyMethodDef script_device_methods[] = {
+    {"flush",         (PyCFunction)script_device_flush,          METH_NOARGS},
+    {"finish",        (PyCFunction)script_device_finish,         METH_NOARGS},
     {"get_mode",      (PyCFunction)script_device_get_mode,       METH_NOARGS},
     {"set_mode",      (PyCFunction)script_device_set_mode,       METH_VARARGS},
     {"write_comment", (PyCFunction)script_device_write_comment,  METH_VARARGS},
@@ -375,6 +667,11 @@ PycairoDevice_FromDevice (cairo_device_t *device) {
             break;
     }
 
+    if (_Pycairo_Lazy_Type_Ready (type) < 0) {
+        cairo_device_destroy (device);
+        return NULL;
+    }
+
     obj = type->tp_alloc (type, 0);
     if (obj) {
         ((PycairoDevice *)obj)->device = device;
@@ -0,0 +1,1318 @@
+/* -*- mode: C; c-basic-offset: 2 -*-
+ *
+ * Pycairo - Python bindings for cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ */
+
+/* Display lists keep a copy of every drawing operation done through a
+ * cairo.Context on a surface, together with the device space bounds of the
+ * operation in an R-tree. They are attached to the surface as user data and
+ * filled by the drawing methods in context.c, which lets us replay only the
+ * operations touching a given area without going through the whole
+ * recording.
+ *
+ * Operations which can't be represented (for example ones using a
+ * non-rectangular clip or a source set behind our back) mark the display
+ * list as not indexable, in which case replaying falls back to painting the
+ * surface itself. The same happens if the recording contains drawing
+ * outside of what we captured, for example by libraries drawing on the
+ * cairo_t directly.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "private.h"
+
+#define SQRT2 1.4142135623730951
+
+/* the coarsest tolerance used when replaying in draft quality */
+#define DRAFT_TOLERANCE 1.0
+
+/* device pixel rows painted at once when replaying a recording */
+#define REPLAY_BAND_HEIGHT 256
+
+typedef enum {
+  DISPLAY_PAINT,
+  DISPLAY_MASK,
+  DISPLAY_FILL,
+  DISPLAY_STROKE,
+  DISPLAY_GLYPHS
+} display_command_type_t;
+
+typedef struct {
+  display_command_type_t type;
+  pycairo_box_t extents;
+  cairo_matrix_t ctm;
+  cairo_matrix_t source_ctm; /* the CTM in effect when setting the source */
+  cairo_operator_t op;
+  cairo_antialias_t antialias;
+  double tolerance;
+  cairo_pattern_t *source;
+  cairo_rectangle_list_t *clip; /* in device space, NULL if unclipped */
+
+  /* paint */
+  double alpha;
+  /* mask */
+  cairo_pattern_t *mask;
+  /* fill and stroke */
+  cairo_path_t *path;
+  cairo_fill_rule_t fill_rule;
+  double line_width;
+  double miter_limit;
+  cairo_line_cap_t line_cap;
+  cairo_line_join_t line_join;
+  double *dashes;
+  int num_dashes;
+  double dash_offset;
+  /* glyphs */
+  cairo_scaled_font_t *scaled_font;
+  cairo_glyph_t *glyphs;
+  int num_glyphs;
+} display_command_t;
+
+struct _display_list {
+  cairo_surface_t *surface; /* borrowed, the surface owns us */
+  cairo_rectangle_t extents;
+  pycairo_box_t bounds;
+  display_command_t *commands;
+  size_t n_commands;
+  size_t size_commands;
+  rtree_t *tree;
+  int indexable;
+  pycairo_box_t ink; /* union of all command extents */
+  int verified;
+  PyThread_type_lock lock;
+};
+
+static const cairo_user_data_key_t display_list_key;
+
+/* cairo locks a source pattern to the user space in effect when setting it
+ * and doesn't tell us which one that was. The Context methods setting a
+ * source note it here, in a stack following save() and restore(), so
+ * commands using a non-solid source can be replayed in the right place. */
+typedef struct {
+  cairo_pattern_t *pattern; /* NULL if unknown */
+  cairo_matrix_t ctm;
+} source_state_t;
+
+typedef struct {
+  source_state_t current;
+  source_state_t *saved;
+  size_t n_saved;
+  size_t size_saved;
+  int broken;
+} source_tracker_t;
+
+static const cairo_user_data_key_t source_tracker_key;
+
+static void
+_display_command_fini (display_command_t *cmd) {
+  cairo_pattern_destroy (cmd->source);
+  if (cmd->clip != NULL)
+    cairo_rectangle_list_destroy (cmd->clip);
+  if (cmd->mask != NULL)
+    cairo_pattern_destroy (cmd->mask);
+  if (cmd->path != NULL)
+    cairo_path_destroy (cmd->path);
+  free (cmd->dashes);
+  if (cmd->scaled_font != NULL)
+    cairo_scaled_font_destroy (cmd->scaled_font);
+  free (cmd->glyphs);
+}
+
+static void
+_display_list_clear (display_list_t *dl) {
+  size_t i;
+
+  for (i = 0; i < dl->n_commands; i++)
+    _display_command_fini (&dl->commands[i]);
+  free (dl->commands);
+  dl->commands = NULL;
+  dl->n_commands = dl->size_commands = 0;
+  rtree_clear (dl->tree);
+  dl->ink.x1 = dl->ink.y1 = HUGE_VAL;
+  dl->ink.x2 = dl->ink.y2 = -HUGE_VAL;
+}
+
+static void
+_display_list_destroy (void *data) {
+  display_list_t *dl = data;
+
+  _display_list_clear (dl);
+  rtree_free (dl->tree);
+  PyThread_free_lock (dl->lock);
+  free (dl);
+}
+
+/* Creates a display list for the bounded area extents and attaches it to
+ * surface. Returns NULL and sets a Python exception on error. */
+display_list_t *
+display_list_attach (cairo_surface_t *surface,
+                     const cairo_rectangle_t *extents) {
+  display_list_t *dl;
+  cairo_status_t status;
+
+  dl = calloc (1, sizeof (display_list_t));
+  if (dl == NULL) {
+    PyErr_NoMemory ();
+    return NULL;
+  }
+
+  dl->surface = surface;
+  dl->extents = *extents;
+  dl->bounds.x1 = extents->x;
+  dl->bounds.y1 = extents->y;
+  dl->bounds.x2 = extents->x + extents->width;
+  dl->bounds.y2 = extents->y + extents->height;
+  dl->indexable = 1;
+  dl->ink.x1 = dl->ink.y1 = HUGE_VAL;
+  dl->ink.x2 = dl->ink.y2 = -HUGE_VAL;
+  dl->tree = rtree_new ();
+  dl->lock = PyThread_allocate_lock ();
+  if (dl->tree == NULL || dl->lock == NULL) {
+    rtree_free (dl->tree);
+    if (dl->lock != NULL)
+      PyThread_free_lock (dl->lock);
+    free (dl);
+    PyErr_NoMemory ();
+    return NULL;
+  }
+
+  status = cairo_surface_set_user_data (
+    surface, &display_list_key, dl, _display_list_destroy);
+  if (status != CAIRO_STATUS_SUCCESS) {
+    _display_list_destroy (dl);
+    Pycairo_Check_Status (status);
+    return NULL;
+  }
+
+  return dl;
+}
+
+display_list_t *
+display_list_from_surface (cairo_surface_t *surface) {
+  return cairo_surface_get_user_data (surface, &display_list_key);
+}
+
+static void
+_source_tracker_destroy (void *data) {
+  source_tracker_t *tracker = data;
+  size_t i;
+
+  if (tracker->current.pattern != NULL)
+    cairo_pattern_destroy (tracker->current.pattern);
+  for (i = 0; i < tracker->n_saved; i++) {
+    if (tracker->saved[i].pattern != NULL)
+      cairo_pattern_destroy (tracker->saved[i].pattern);
+  }
+  free (tracker->saved);
+  free (tracker);
+}
+
+/* Returns the tracker of ctx, creating it if ctx draws onto a display list.
+ * Returns NULL if there is nothing to track. */
+static source_tracker_t *
+_source_tracker_get (cairo_t *ctx) {
+  source_tracker_t *tracker;
+
+  tracker = cairo_get_user_data (ctx, &source_tracker_key);
+  if (tracker != NULL)
+    return tracker->broken ? NULL : tracker;
+
+  if (display_list_from_surface (cairo_get_target (ctx)) == NULL)
+    return NULL;
+
+  tracker = calloc (1, sizeof (source_tracker_t));
+  if (tracker == NULL)
+    return NULL;
+  if (cairo_set_user_data (ctx, &source_tracker_key, tracker,
+                           _source_tracker_destroy) != CAIRO_STATUS_SUCCESS) {
+    free (tracker);
+    return NULL;
+  }
+  return tracker;
+}
+
+/* Has to be called after setting a source on ctx. */
+void
+display_list_note_source (cairo_t *ctx) {
+  source_tracker_t *tracker = _source_tracker_get (ctx);
+
+  if (tracker == NULL)
+    return;
+
+  if (tracker->current.pattern != NULL)
+    cairo_pattern_destroy (tracker->current.pattern);
+  tracker->current.pattern = cairo_pattern_reference (cairo_get_source (ctx));
+  cairo_get_matrix (ctx, &tracker->current.ctm);
+}
+
+/* Has to be called after cairo_save() and cairo_push_group(). */
+void
+display_list_note_save (cairo_t *ctx) {
+  source_tracker_t *tracker = _source_tracker_get (ctx);
+  source_state_t *state;
+
+  if (tracker == NULL)
+    return;
+
+  if (tracker->n_saved == tracker->size_saved) {
+    size_t size = tracker->size_saved ? tracker->size_saved * 2 : 8;
+    source_state_t *saved;
+
+    saved = realloc (tracker->saved, size * sizeof (source_state_t));
+    if (saved == NULL) {
+      /* we lost track, sources will be unknown from now on */
+      tracker->broken = 1;
+      return;
+    }
+    tracker->saved = saved;
+    tracker->size_saved = size;
+  }
+
+  state = &tracker->saved[tracker->n_saved++];
+  *state = tracker->current;
+  if (state->pattern != NULL)
+    cairo_pattern_reference (state->pattern);
+}
+
+/* Has to be called after cairo_restore() and cairo_pop_group(). */
+void
+display_list_note_restore (cairo_t *ctx) {
+  source_tracker_t *tracker = _source_tracker_get (ctx);
+
+  if (tracker == NULL)
+    return;
+
+  if (tracker->current.pattern != NULL)
+    cairo_pattern_destroy (tracker->current.pattern);
+  if (tracker->n_saved > 0) {
+    tracker->current = tracker->saved[--tracker->n_saved];
+  } else {
+    /* restored to a state from before we started tracking */
+    tracker->current.pattern = NULL;
+  }
+}
+
+/* Sets ctm to the CTM the current source of ctx got set with. Returns 0 if
+ * it isn't known. */
+static int
+_source_get_ctm (cairo_t *ctx, cairo_matrix_t *ctm) {
+  cairo_pattern_t *source = cairo_get_source (ctx);
+  source_tracker_t *tracker;
+
+  /* the transformation doesn't matter for solid colors */
+  if (cairo_pattern_get_type (source) == CAIRO_PATTERN_TYPE_SOLID) {
+    cairo_get_matrix (ctx, ctm);
+    return 1;
+  }
+
+  tracker = cairo_get_user_data (ctx, &source_tracker_key);
+  if (tracker == NULL || tracker->broken ||
+      tracker->current.pattern != source)
+    return 0;
+
+  *ctm = tracker->current.ctm;
+  return 1;
+}
+
+static void
+_display_list_lock (display_list_t *dl) {
+  if (!PyThread_acquire_lock (dl->lock, NOWAIT_LOCK)) {
+    Py_BEGIN_ALLOW_THREADS;
+    PyThread_acquire_lock (dl->lock, WAIT_LOCK);
+    Py_END_ALLOW_THREADS;
+  }
+}
+
+static void
+_display_list_set_unindexable (display_list_t *dl) {
+  dl->indexable = 0;
+  _display_list_clear (dl);
+}
+
+/* Drops the index, everything drawn from now on is only replayed by
+ * painting the surface. */
+void
+display_list_invalidate (display_list_t *dl) {
+  _display_list_lock (dl);
+  _display_list_set_unindexable (dl);
+  PyThread_release_lock (dl->lock);
+}
+
+size_t
+display_list_get_size (display_list_t *dl) {
+  return dl->n_commands;
+}
+
+/* Drawing onto a display list surface has to happen between
+ * display_list_begin() and display_list_end(), so threads reading the
+ * recording never see it half way through an operation. Returns the display
+ * list ctx draws onto with its lock held, or NULL if there is none. Needs
+ * the GIL, which gets released while waiting for the lock. */
+display_list_t *
+display_list_begin (cairo_t *ctx) {
+  display_list_t *dl;
+
+  dl = display_list_from_surface (cairo_get_group_target (ctx));
+  if (dl != NULL)
+    _display_list_lock (dl);
+  return dl;
+}
+
+void
+display_list_end (display_list_t *dl) {
+  if (dl != NULL)
+    PyThread_release_lock (dl->lock);
+}
+
+/* Returns dl if the operation about to be drawn by ctx should be captured
+ * into it. */
+static display_list_t *
+_display_list_capturing (display_list_t *dl, cairo_t *ctx) {
+  if (dl == NULL || !dl->indexable ||
+      cairo_status (ctx) != CAIRO_STATUS_SUCCESS)
+    return NULL;
+  return dl;
+}
+
+static void
+_box_from_user_rectangle (pycairo_box_t *box, const cairo_matrix_t *ctm,
+                          double x1, double y1, double x2, double y2) {
+  double xs[4] = {x1, x2, x1, x2}, ys[4] = {y1, y1, y2, y2};
+  int i;
+
+  for (i = 0; i < 4; i++)
+    cairo_matrix_transform_point (ctm, &xs[i], &ys[i]);
+
+  box->x1 = box->x2 = xs[0];
+  box->y1 = box->y2 = ys[0];
+  for (i = 1; i < 4; i++) {
+    box->x1 = xs[i] < box->x1 ? xs[i] : box->x1;
+    box->x2 = xs[i] > box->x2 ? xs[i] : box->x2;
+    box->y1 = ys[i] < box->y1 ? ys[i] : box->y1;
+    box->y2 = ys[i] > box->y2 ? ys[i] : box->y2;
+  }
+}
+
+static int
+_box_intersect (pycairo_box_t *box, const pycairo_box_t *other) {
+  box->x1 = other->x1 > box->x1 ? other->x1 : box->x1;
+  box->y1 = other->y1 > box->y1 ? other->y1 : box->y1;
+  box->x2 = other->x2 < box->x2 ? other->x2 : box->x2;
+  box->y2 = other->y2 < box->y2 ? other->y2 : box->y2;
+  return box->x1 < box->x2 && box->y1 < box->y2;
+}
+
+static int
+_operator_is_unbounded (cairo_operator_t op) {
+  switch (op) {
+  case CAIRO_OPERATOR_IN:
+  case CAIRO_OPERATOR_OUT:
+  case CAIRO_OPERATOR_DEST_IN:
+  case CAIRO_OPERATOR_DEST_ATOP:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/* Returns the clip of ctx in device space. In user space a rotated
+ * transformation would make every clip non-representable. */
+static cairo_rectangle_list_t *
+_copy_device_clip (cairo_t *ctx, const cairo_matrix_t *ctm) {
+  cairo_rectangle_list_t *clip;
+  pycairo_box_t box;
+  int i;
+
+  if (ctm->xy != 0 || ctm->yx != 0) {
+    /* Only cairo knows the device space clip. Going through the identity
+     * matrix drops the cached scaled font of ctx, so only do that when the
+     * user space rectangles can't be transformed. */
+    cairo_identity_matrix (ctx);
+    clip = cairo_copy_clip_rectangle_list (ctx);
+    cairo_set_matrix (ctx, ctm);
+    return clip;
+  }
+
+  clip = cairo_copy_clip_rectangle_list (ctx);
+  if (clip->status != CAIRO_STATUS_SUCCESS)
+    return clip;
+
+  for (i = 0; i < clip->num_rectangles; i++) {
+    cairo_rectangle_t *r = &clip->rectangles[i];
+
+    _box_from_user_rectangle (&box, ctm, r->x, r->y,
+                              r->x + r->width, r->y + r->height);
+    r->x = box.x1;
+    r->y = box.y1;
+    r->width = box.x2 - box.x1;
+    r->height = box.y2 - box.y1;
+  }
+  return clip;
+}
+
+/* Fills in the state shared by all commands. Returns 1 if the command should
+ * be recorded, 0 if it can be skipped and -1 on error. */
+static int
+_display_command_init (display_list_t *dl, display_command_t *cmd,
+                       display_command_type_t type, cairo_t *ctx) {
+  cairo_rectangle_list_t *clip;
+  cairo_status_t status;
+  int i;
+
+  /* the recording changes, check it against the index again */
+  dl->verified = 0;
+
+  memset (cmd, 0, sizeof (display_command_t));
+  cmd->type = type;
+  cmd->op = cairo_get_operator (ctx);
+  cmd->antialias = cairo_get_antialias (ctx);
+  cmd->tolerance = cairo_get_tolerance (ctx);
+  cmd->alpha = 1.0;
+  cairo_get_matrix (ctx, &cmd->ctm);
+
+  if (!_source_get_ctm (ctx, &cmd->source_ctm)) {
+    /* we can't tell where the source would end up */
+    _display_list_set_unindexable (dl);
+    return 0;
+  }
+
+  clip = _copy_device_clip (ctx, &cmd->ctm);
+
+  status = clip->status;
+  if (status == CAIRO_STATUS_CLIP_NOT_REPRESENTABLE) {
+    cairo_rectangle_list_destroy (clip);
+    _display_list_set_unindexable (dl);
+    return 0;
+  } else if (status != CAIRO_STATUS_SUCCESS) {
+    cairo_rectangle_list_destroy (clip);
+    Pycairo_Check_Status (status);
+    return -1;
+  } else if (clip->num_rectangles == 0) {
+    cairo_rectangle_list_destroy (clip);
+    return 0;
+  }
+
+  /* the clip bounds the operation */
+  cmd->extents.x1 = cmd->extents.y1 = HUGE_VAL;
+  cmd->extents.x2 = cmd->extents.y2 = -HUGE_VAL;
+  for (i = 0; i < clip->num_rectangles; i++) {
+    cairo_rectangle_t *r = &clip->rectangles[i];
+    cmd->extents.x1 = r->x < cmd->extents.x1 ? r->x : cmd->extents.x1;
+    cmd->extents.y1 = r->y < cmd->extents.y1 ? r->y : cmd->extents.y1;
+    if (r->x + r->width > cmd->extents.x2)
+      cmd->extents.x2 = r->x + r->width;
+    if (r->y + r->height > cmd->extents.y2)
+      cmd->extents.y2 = r->y + r->height;
+  }
+
+  /* Without a user clip cairo reports the surface extents, rounded out to
+   * whole pixels. */
+  if (clip->num_rectangles == 1 &&
+      cmd->extents.x1 <= floor (dl->bounds.x1) &&
+      cmd->extents.y1 <= floor (dl->bounds.y1) &&
+      cmd->extents.x2 >= ceil (dl->bounds.x2) &&
+      cmd->extents.y2 >= ceil (dl->bounds.y2)) {
+    cairo_rectangle_list_destroy (clip);
+  } else {
+    cmd->clip = clip;
+  }
+
+  if (!_box_intersect (&cmd->extents, &dl->bounds)) {
+    if (cmd->clip != NULL)
+      cairo_rectangle_list_destroy (cmd->clip);
+    return 0;
+  }
+
+  cmd->source = cairo_pattern_reference (cairo_get_source (ctx));
+  return 1;
+}
+
+/* Takes ownership of cmd. shape are the device space bounds of what gets
+ * drawn, or NULL if only limited by the clip. */
+static int
+_display_list_append (display_list_t *dl, display_command_t *cmd,
+                      const pycairo_box_t *shape) {
+  if (shape != NULL && !_operator_is_unbounded (cmd->op)) {
+    /* antialiasing can touch one extra pixel */
+    pycairo_box_t box = *shape;
+    box.x1 -= 1; box.y1 -= 1; box.x2 += 1; box.y2 += 1;
+    if (!_box_intersect (&cmd->extents, &box)) {
+      _display_command_fini (cmd);
+      return 0;
+    }
+  }
+
+  if (dl->n_commands == dl->size_commands) {
+    size_t size = dl->size_commands ? dl->size_commands * 2 : 64;
+    display_command_t *commands;
+
+    commands = realloc (dl->commands, size * sizeof (display_command_t));
+    if (commands == NULL)
+      goto error;
+    dl->commands = commands;
+    dl->size_commands = size;
+  }
+
+  if (rtree_insert (dl->tree, &cmd->extents, dl->n_commands) < 0)
+    goto error;
+
+  dl->ink.x1 = cmd->extents.x1 < dl->ink.x1 ? cmd->extents.x1 : dl->ink.x1;
+  dl->ink.y1 = cmd->extents.y1 < dl->ink.y1 ? cmd->extents.y1 : dl->ink.y1;
+  dl->ink.x2 = cmd->extents.x2 > dl->ink.x2 ? cmd->extents.x2 : dl->ink.x2;
+  dl->ink.y2 = cmd->extents.y2 > dl->ink.y2 ? cmd->extents.y2 : dl->ink.y2;
+
+  dl->commands[dl->n_commands++] = *cmd;
+  return 0;
+
+error:
+  _display_command_fini (cmd);
+  PyErr_NoMemory ();
+  return -1;
+}
+
+/* The capture functions record the operation ctx is about to draw into
+ * dl, which has to come from display_list_begin() (NULL is fine). */
+int
+display_list_capture_paint (display_list_t *dl, cairo_t *ctx, double alpha) {
+  display_command_t cmd;
+  int res;
+
+  dl = _display_list_capturing (dl, ctx);
+  if (dl == NULL)
+    return 0;
+
+  res = _display_command_init (dl, &cmd, DISPLAY_PAINT, ctx);
+  if (res > 0) {
+    cmd.alpha = alpha;
+    res = _display_list_append (dl, &cmd, NULL);
+  }
+  return res < 0 ? -1 : 0;
+}
+
+int
+display_list_capture_mask (display_list_t *dl, cairo_t *ctx,
+                           cairo_pattern_t *mask) {
+  display_command_t cmd;
+  int res;
+
+  dl = _display_list_capturing (dl, ctx);
+  if (dl == NULL)
+    return 0;
+
+  res = _display_command_init (dl, &cmd, DISPLAY_MASK, ctx);
+  if (res > 0) {
+    cmd.mask = cairo_pattern_reference (mask);
+    res = _display_list_append (dl, &cmd, NULL);
+  }
+  return res < 0 ? -1 : 0;
+}
+
+static int
+_display_list_capture_path (display_list_t *dl, cairo_t *ctx,
+                            display_command_type_t type) {
+  display_command_t cmd;
+  pycairo_box_t shape;
+  double x1, y1, x2, y2;
+  int res;
+
+  dl = _display_list_capturing (dl, ctx);
+  if (dl == NULL)
+    return 0;
+
+  res = _display_command_init (dl, &cmd, type, ctx);
+  if (res <= 0)
+    goto done;
+
+  /* the control point bounds are cheap and good enough for culling */
+  cairo_path_extents (ctx, &x1, &y1, &x2, &y2);
+  if (type == DISPLAY_STROKE) {
+    double expand;
+
+    cmd.line_width = cairo_get_line_width (ctx);
+    cmd.miter_limit = cairo_get_miter_limit (ctx);
+    cmd.line_cap = cairo_get_line_cap (ctx);
+    cmd.line_join = cairo_get_line_join (ctx);
+    cmd.num_dashes = cairo_get_dash_count (ctx);
+    if (cmd.num_dashes > 0) {
+      cmd.dashes = malloc (cmd.num_dashes * sizeof (double));
+      if (cmd.dashes == NULL) {
+        _display_command_fini (&cmd);
+        PyErr_NoMemory ();
+        res = -1;
+        goto done;
+      }
+      cairo_get_dash (ctx, cmd.dashes, &cmd.dash_offset);
+    }
+
+    expand = cmd.line_width / 2 * SQRT2;
+    if (cmd.line_join == CAIRO_LINE_JOIN_MITER && cmd.miter_limit > SQRT2)
+      expand = cmd.line_width / 2 * cmd.miter_limit;
+    x1 -= expand; y1 -= expand; x2 += expand; y2 += expand;
+  } else {
+    cmd.fill_rule = cairo_get_fill_rule (ctx);
+    if (x1 == x2 || y1 == y2) {
+      /* nothing to fill */
+      _display_command_fini (&cmd);
+      res = 0;
+      goto done;
+    }
+  }
+
+  cmd.path = cairo_copy_path (ctx);
+  if (cmd.path->status != CAIRO_STATUS_SUCCESS) {
+    cairo_status_t status = cmd.path->status;
+    _display_command_fini (&cmd);
+    Pycairo_Check_Status (status);
+    res = -1;
+    goto done;
+  }
+
+  _box_from_user_rectangle (&shape, &cmd.ctm, x1, y1, x2, y2);
+  res = _display_list_append (dl, &cmd, &shape);
+
+done:
+  return res < 0 ? -1 : 0;
+}
+
+int
+display_list_capture_fill (display_list_t *dl, cairo_t *ctx) {
+  return _display_list_capture_path (dl, ctx, DISPLAY_FILL);
+}
+
+int
+display_list_capture_stroke (display_list_t *dl, cairo_t *ctx) {
+  return _display_list_capture_path (dl, ctx, DISPLAY_STROKE);
+}
+
+int
+display_list_capture_glyphs (display_list_t *dl, cairo_t *ctx,
+                             const cairo_glyph_t *glyphs, int num_glyphs) {
+  display_command_t cmd;
+  cairo_text_extents_t te;
+  pycairo_box_t shape;
+  int res;
+
+  dl = _display_list_capturing (dl, ctx);
+  if (dl == NULL || num_glyphs <= 0)
+    return 0;
+
+  res = _display_command_init (dl, &cmd, DISPLAY_GLYPHS, ctx);
+  if (res <= 0)
+    goto done;
+
+  cairo_glyph_extents (ctx, glyphs, num_glyphs, &te);
+  if (te.width == 0 || te.height == 0) {
+    _display_command_fini (&cmd);
+    res = 0;
+    goto done;
+  }
+
+  cmd.scaled_font = cairo_scaled_font_reference (cairo_get_scaled_font (ctx));
+  cmd.glyphs = malloc (num_glyphs * sizeof (cairo_glyph_t));
+  if (cmd.glyphs == NULL) {
+    _display_command_fini (&cmd);
+    PyErr_NoMemory ();
+    res = -1;
+    goto done;
+  }
+  memcpy (cmd.glyphs, glyphs, num_glyphs * sizeof (cairo_glyph_t));
+  cmd.num_glyphs = num_glyphs;
+
+  _box_from_user_rectangle (&shape, &cmd.ctm, te.x_bearing, te.y_bearing,
+                            te.x_bearing + te.width,
+                            te.y_bearing + te.height);
+  res = _display_list_append (dl, &cmd, &shape);
+
+done:
+  return res < 0 ? -1 : 0;
+}
+
+int
+display_list_capture_text (display_list_t *dl, cairo_t *ctx,
+                           const char *utf8) {
+  cairo_glyph_t *glyphs = NULL;
+  int num_glyphs = 0, res;
+  cairo_status_t status;
+  double x, y;
+
+  if (_display_list_capturing (dl, ctx) == NULL)
+    return 0;
+
+  cairo_get_current_point (ctx, &x, &y);
+  status = cairo_scaled_font_text_to_glyphs (
+    cairo_get_scaled_font (ctx), x, y, utf8, -1, &glyphs, &num_glyphs,
+    NULL, NULL, NULL);
+  if (status != CAIRO_STATUS_SUCCESS) {
+    /* show_text() will fail the same way and report the error */
+    return 0;
+  }
+
+  res = display_list_capture_glyphs (dl, ctx, glyphs, num_glyphs);
+  cairo_glyph_free (glyphs);
+  return res;
+}
+
+/* Returns a new reference to pattern, or to a copy of it using
+ * CAIRO_FILTER_FAST if it is a surface pattern. The command's own pattern
+ * can't be changed, other threads may be replaying it. */
+static cairo_pattern_t *
+_draft_pattern (cairo_pattern_t *pattern) {
+  cairo_pattern_t *copy;
+  cairo_surface_t *surface;
+  cairo_matrix_t matrix;
+
+  if (pattern == NULL ||
+      cairo_pattern_get_type (pattern) != CAIRO_PATTERN_TYPE_SURFACE ||
+      cairo_pattern_get_filter (pattern) == CAIRO_FILTER_FAST)
+    return cairo_pattern_reference (pattern);
+
+  cairo_pattern_get_surface (pattern, &surface);
+  copy = cairo_pattern_create_for_surface (surface);
+  cairo_pattern_get_matrix (pattern, &matrix);
+  cairo_pattern_set_matrix (copy, &matrix);
+  cairo_pattern_set_extend (copy, cairo_pattern_get_extend (pattern));
+  cairo_pattern_set_filter (copy, CAIRO_FILTER_FAST);
+  return copy;
+}
+
+/* Replays cmd on cr. In draft quality antialiasing, curve flattening and
+ * image filtering get traded for speed. */
+static void
+_display_command_replay (const display_command_t *cmd, cairo_t *cr,
+                         const cairo_matrix_t *base, int draft) {
+  cairo_pattern_t *source, *mask;
+  cairo_matrix_t matrix;
+  int i;
+
+  cairo_save (cr);
+
+  if (cmd->clip != NULL) {
+    for (i = 0; i < cmd->clip->num_rectangles; i++) {
+      cairo_rectangle_t *r = &cmd->clip->rectangles[i];
+      cairo_rectangle (cr, r->x, r->y, r->width, r->height);
+    }
+    cairo_clip (cr);
+  }
+
+  cairo_set_operator (cr, cmd->op);
+  if (draft) {
+    cairo_set_antialias (cr, cmd->antialias == CAIRO_ANTIALIAS_NONE ?
+                         CAIRO_ANTIALIAS_NONE : CAIRO_ANTIALIAS_FAST);
+    cairo_set_tolerance (cr, cmd->tolerance > DRAFT_TOLERANCE ?
+                         cmd->tolerance : DRAFT_TOLERANCE);
+    source = _draft_pattern (cmd->source);
+    mask = _draft_pattern (cmd->mask);
+  } else {
+    cairo_set_antialias (cr, cmd->antialias);
+    cairo_set_tolerance (cr, cmd->tolerance);
+    source = cairo_pattern_reference (cmd->source);
+    mask = cairo_pattern_reference (cmd->mask);
+  }
+
+  /* the source is locked to the user space it was set in */
+  if (memcmp (&cmd->source_ctm, &cmd->ctm, sizeof (cairo_matrix_t)) != 0) {
+    cairo_matrix_multiply (&matrix, &cmd->source_ctm, base);
+    cairo_set_matrix (cr, &matrix);
+  }
+  cairo_set_source (cr, source);
+  cairo_matrix_multiply (&matrix, &cmd->ctm, base);
+  cairo_set_matrix (cr, &matrix);
+
+  switch (cmd->type) {
+  case DISPLAY_PAINT:
+    if (cmd->alpha >= 1.0)
+      cairo_paint (cr);
+    else
+      cairo_paint_with_alpha (cr, cmd->alpha);
+    break;
+  case DISPLAY_MASK:
+    cairo_mask (cr, mask);
+    break;
+  case DISPLAY_FILL:
+    cairo_new_path (cr);
+    cairo_append_path (cr, cmd->path);
+    cairo_set_fill_rule (cr, cmd->fill_rule);
+    cairo_fill (cr);
+    break;
+  case DISPLAY_STROKE:
+    cairo_new_path (cr);
+    cairo_append_path (cr, cmd->path);
+    cairo_set_line_width (cr, cmd->line_width);
+    cairo_set_miter_limit (cr, cmd->miter_limit);
+    cairo_set_line_cap (cr, cmd->line_cap);
+    cairo_set_line_join (cr, cmd->line_join);
+    cairo_set_dash (cr, cmd->dashes, cmd->num_dashes, cmd->dash_offset);
+    cairo_stroke (cr);
+    break;
+  case DISPLAY_GLYPHS:
+    cairo_set_scaled_font (cr, cmd->scaled_font);
+    cairo_show_glyphs (cr, cmd->glyphs, cmd->num_glyphs);
+    break;
+  }
+
+  cairo_restore (cr);
+  cairo_pattern_destroy (source);
+  cairo_pattern_destroy (mask);
+}
+
+/* Falls back to the recording if it contains drawing we didn't capture.
+ * Needs the lock. Computing the ink extents replays the whole recording
+ * (without rasterizing), so it's only done once after each change. */
+static void
+_display_list_verify (display_list_t *dl) {
+  double x, y, width, height;
+
+  if (!dl->indexable || dl->verified)
+    return;
+  dl->verified = 1;
+
+  cairo_recording_surface_ink_extents (dl->surface, &x, &y, &width, &height);
+  if (width <= 0 || height <= 0)
+    return;
+
+  /* the captured extents are conservative, but cairo rounds out to whole
+   * pixels */
+  if (dl->ink.x1 > dl->ink.x2 ||
+      x < floor (dl->ink.x1) - 1 || y < floor (dl->ink.y1) - 1 ||
+      x + width > ceil (dl->ink.x2) + 1 || y + height > ceil (dl->ink.y2) + 1)
+    _display_list_set_unindexable (dl);
+}
+
+/* Paints the recording onto the clipped area of cr. cairo can't stop in the
+ * middle of that, so with cancel set it's done in bands of whole device
+ * pixels, checking cancel before each. */
+static cairo_status_t
+_paint_recording (cairo_t *cr, cairo_surface_t *recording,
+                  cancel_state_t *cancel) {
+  double x1, y1, x2, y2, xs[4], ys[4], top, bottom, left, right;
+  cairo_matrix_t matrix;
+  cairo_status_t status;
+  int i;
+
+  cairo_clip_extents (cr, &x1, &y1, &x2, &y2);
+  xs[0] = xs[2] = x1;
+  xs[1] = xs[3] = x2;
+  ys[0] = ys[1] = y1;
+  ys[2] = ys[3] = y2;
+  left = top = HUGE_VAL;
+  right = bottom = -HUGE_VAL;
+  for (i = 0; i < 4; i++) {
+    cairo_user_to_device (cr, &xs[i], &ys[i]);
+    left = xs[i] < left ? xs[i] : left;
+    right = xs[i] > right ? xs[i] : right;
+    top = ys[i] < top ? ys[i] : top;
+    bottom = ys[i] > bottom ? ys[i] : bottom;
+  }
+  left = floor (left);
+  top = floor (top);
+
+  if (cancel == NULL || !(bottom - top <= REPLAY_BAND_HEIGHT * 4096.0)) {
+    status = cancel_state_check (cancel);
+    if (status != CAIRO_STATUS_SUCCESS)
+      return status;
+    cairo_set_source_surface (cr, recording, 0, 0);
+    cairo_paint (cr);
+    return cairo_status (cr);
+  }
+
+  cairo_get_matrix (cr, &matrix);
+  for (; top < bottom; top += REPLAY_BAND_HEIGHT) {
+    status = cancel_state_check (cancel);
+    if (status != CAIRO_STATUS_SUCCESS)
+      return status;
+
+    cairo_save (cr);
+    cairo_identity_matrix (cr);
+    cairo_rectangle (cr, left, top, ceil (right) - left, REPLAY_BAND_HEIGHT);
+    cairo_clip (cr);
+    cairo_set_matrix (cr, &matrix);
+    cairo_set_source_surface (cr, recording, 0, 0);
+    cairo_paint (cr);
+    cairo_restore (cr);
+  }
+
+  return cairo_status (cr);
+}
+
+/* Replays all commands intersecting viewport (in the coordinates of the
+ * display list, everything if NULL) in their original order, using the
+ * current transformation of cr, in draft quality if draft is set. Stops
+ * early if cancel (can be NULL) gets cancelled. Doesn't need the GIL. */
+cairo_status_t
+display_list_replay (display_list_t *dl, cairo_t *cr,
+                     const pycairo_box_t *viewport, int draft,
+                     cancel_state_t *cancel, size_t *n_replayed) {
+  cairo_status_t status = CAIRO_STATUS_SUCCESS;
+  cairo_matrix_t base;
+  size_t *ids = NULL, n, i;
+
+  PyThread_acquire_lock (dl->lock, WAIT_LOCK);
+  _display_list_verify (dl);
+
+  cairo_get_matrix (cr, &base);
+  cairo_save (cr);
+  if (viewport != NULL) {
+    cairo_rectangle (cr, viewport->x1, viewport->y1,
+                     viewport->x2 - viewport->x1,
+                     viewport->y2 - viewport->y1);
+    cairo_clip (cr);
+  }
+
+  if (!dl->indexable) {
+    status = _paint_recording (cr, dl->surface, cancel);
+    n = 0;
+  } else if (viewport != NULL) {
+    if (rtree_query (dl->tree, viewport, &ids, &n) < 0) {
+      cairo_restore (cr);
+      PyThread_release_lock (dl->lock);
+      return CAIRO_STATUS_NO_MEMORY;
+    }
+    for (i = 0; i < n && status == CAIRO_STATUS_SUCCESS; i++) {
+      _display_command_replay (&dl->commands[ids[i]], cr, &base, draft);
+      status = cancel_state_check (cancel);
+    }
+    free (ids);
+  } else {
+    n = dl->n_commands;
+    for (i = 0; i < n && status == CAIRO_STATUS_SUCCESS; i++) {
+      _display_command_replay (&dl->commands[i], cr, &base, draft);
+      status = cancel_state_check (cancel);
+    }
+  }
+
+  cairo_restore (cr);
+  PyThread_release_lock (dl->lock);
+
+  if (n_replayed != NULL)
+    *n_replayed = n;
+  if (status != CAIRO_STATUS_SUCCESS)
+    return status;
+  return cairo_status (cr);
+}
+
+/* Blocks capturing until display_list_release(), for using the functions
+ * below from several threads at once. Doesn't need the GIL. */
+void
+display_list_acquire (display_list_t *dl) {
+  PyThread_acquire_lock (dl->lock, WAIT_LOCK);
+}
+
+void
+display_list_release (display_list_t *dl) {
+  PyThread_release_lock (dl->lock);
+}
+
+/* Has to be called between display_list_acquire() and
+ * display_list_release(). */
+int
+display_list_is_indexable (display_list_t *dl) {
+  _display_list_verify (dl);
+  return dl->indexable;
+}
+
+/* Frees all commands captured so far, for users which are done with them.
+ * What gets drawn afterwards is still indexed and checked against the whole
+ * recording. Has to be called between display_list_acquire() and
+ * display_list_release(). */
+void
+display_list_discard (display_list_t *dl) {
+  pycairo_box_t ink = dl->ink;
+
+  _display_list_clear (dl);
+  dl->ink = ink;
+}
+
+/* Like rtree_query(), but only returns commands starting with the index
+ * first. Not thread safe. */
+int
+display_list_query (display_list_t *dl, const pycairo_box_t *box,
+                    size_t first, size_t **ids, size_t *n_ids) {
+  size_t i, j;
+
+  if (rtree_query (dl->tree, box, ids, n_ids) < 0)
+    return -1;
+
+  for (i = j = 0; i < *n_ids; i++) {
+    if ((*ids)[i] >= first)
+      (*ids)[j++] = (*ids)[i];
+  }
+  *n_ids = j;
+  return 0;
+}
+
+static int
+_pattern_uses_surface (cairo_pattern_t *pattern) {
+  cairo_pattern_type_t type;
+
+  if (pattern == NULL)
+    return 0;
+  type = cairo_pattern_get_type (pattern);
+  return type == CAIRO_PATTERN_TYPE_SURFACE ||
+    type == CAIRO_PATTERN_TYPE_RASTER_SOURCE;
+}
+
+/* Replays the given commands using the current transformation of cr.
+ * cairo doesn't support reading a surface from several threads at once, so
+ * commands using one as source or mask are replayed holding source_lock,
+ * if given. Stops early if cancel (can be NULL) gets cancelled. Thread
+ * safe. */
+cairo_status_t
+display_list_replay_ids (display_list_t *dl, cairo_t *cr,
+                         const size_t *ids, size_t n_ids,
+                         PyThread_type_lock source_lock,
+                         cancel_state_t *cancel) {
+  cairo_status_t status;
+  cairo_matrix_t base;
+  size_t i;
+
+  cairo_get_matrix (cr, &base);
+  for (i = 0; i < n_ids; i++) {
+    display_command_t *cmd = &dl->commands[ids[i]];
+
+    status = cancel_state_check (cancel);
+    if (status != CAIRO_STATUS_SUCCESS)
+      return status;
+
+    if (source_lock != NULL && (_pattern_uses_surface (cmd->source) ||
+                                _pattern_uses_surface (cmd->mask))) {
+      PyThread_acquire_lock (source_lock, WAIT_LOCK);
+      _display_command_replay (cmd, cr, &base, 0);
+      PyThread_release_lock (source_lock);
+    } else {
+      _display_command_replay (cmd, cr, &base, 0);
+    }
+  }
+
+  return cairo_status (cr);
+}
+
+/* Sets box to the device space rectangle filled by cmd if its path is a
+ * single axis aligned rectangle. */
+static int
+_display_command_get_rectangle (const display_command_t *cmd,
+                                pycairo_box_t *box) {
+  cairo_path_t *path = cmd->path;
+  cairo_path_data_type_t last = CAIRO_PATH_MOVE_TO;
+  double xs[5], ys[5];
+  int i, n = 0;
+
+  if (cmd->ctm.xy != 0 || cmd->ctm.yx != 0)
+    return 0;
+
+  for (i = 0; i < path->num_data; i += path->data[i].header.length) {
+    cairo_path_data_t *data = &path->data[i];
+    switch (data->header.type) {
+    case CAIRO_PATH_MOVE_TO:
+      if (n != 0) {
+        /* cairo adds a move_to after close_path */
+        if (i + data->header.length < path->num_data ||
+            last != CAIRO_PATH_CLOSE_PATH)
+          return 0;
+        break;
+      }
+      /* fall through */
+    case CAIRO_PATH_LINE_TO:
+      if (n == 5)
+        return 0;
+      xs[n] = data[1].point.x;
+      ys[n] = data[1].point.y;
+      n++;
+      break;
+    case CAIRO_PATH_CLOSE_PATH:
+      break;
+    default:
+      return 0;
+    }
+    last = data->header.type;
+  }
+
+  if (n == 5) {
+    if (xs[4] != xs[0] || ys[4] != ys[0])
+      return 0;
+  } else if (n != 4) {
+    return 0;
+  }
+
+  if (!((ys[0] == ys[1] && xs[1] == xs[2] && ys[2] == ys[3] &&
+         xs[3] == xs[0]) ||
+        (xs[0] == xs[1] && ys[1] == ys[2] && xs[2] == xs[3] &&
+         ys[3] == ys[0])))
+    return 0;
+
+  _box_from_user_rectangle (box, &cmd->ctm, xs[0], ys[0], xs[2], ys[2]);
+  return 1;
+}
+
+/* Adds the pixels cmd replaces completely, regardless of what was below,
+ * to covered. */
+static cairo_status_t
+_display_command_add_cover (const display_command_t *cmd,
+                            cairo_region_t *covered) {
+  cairo_rectangle_int_t rect;
+  pycairo_box_t shape;
+  double red, green, blue, alpha;
+  int i;
+
+  if (cmd->type == DISPLAY_PAINT) {
+    if (cmd->alpha < 1.0)
+      return CAIRO_STATUS_SUCCESS;
+    shape = cmd->extents;
+  } else if (cmd->type == DISPLAY_FILL) {
+    if (!_display_command_get_rectangle (cmd, &shape))
+      return CAIRO_STATUS_SUCCESS;
+  } else {
+    return CAIRO_STATUS_SUCCESS;
+  }
+
+  switch (cmd->op) {
+  case CAIRO_OPERATOR_CLEAR:
+    break;
+  case CAIRO_OPERATOR_SOURCE:
+  case CAIRO_OPERATOR_OVER:
+    if (cairo_pattern_get_rgba (cmd->source, &red, &green, &blue, &alpha) !=
+        CAIRO_STATUS_SUCCESS)
+      return CAIRO_STATUS_SUCCESS;
+    if (cmd->op == CAIRO_OPERATOR_OVER && alpha < 1.0)
+      return CAIRO_STATUS_SUCCESS;
+    break;
+  default:
+    return CAIRO_STATUS_SUCCESS;
+  }
+
+  /* only pixels completely inside the shape, edges are antialiased */
+  for (i = 0; i < (cmd->clip != NULL ? cmd->clip->num_rectangles : 1); i++) {
+    pycairo_box_t box = shape;
+    double x1, y1, x2, y2;
+    cairo_status_t status;
+
+    if (cmd->clip != NULL) {
+      cairo_rectangle_t *r = &cmd->clip->rectangles[i];
+      pycairo_box_t clip_box = {r->x, r->y, r->x + r->width, r->y + r->height};
+      if (!_box_intersect (&box, &clip_box))
+        continue;
+    } else if (!_box_intersect (&box, &cmd->extents)) {
+      continue;
+    }
+
+    x1 = ceil (box.x1);
+    y1 = ceil (box.y1);
+    x2 = floor (box.x2);
+    y2 = floor (box.y2);
+    if (x1 >= x2 || y1 >= y2)
+      continue;
+
+    rect.x = (int)x1;
+    rect.y = (int)y1;
+    rect.width = (int)(x2 - x1);
+    rect.height = (int)(y2 - y1);
+    status = cairo_region_union_rectangle (covered, &rect);
+    if (status != CAIRO_STATUS_SUCCESS)
+      return status;
+  }
+
+  return CAIRO_STATUS_SUCCESS;
+}
+
+/* Removes all commands whose bounds get completely replaced by later
+ * commands painting opaque solid colors. Stores the number of removed
+ * commands in n_removed. */
+cairo_status_t
+display_list_cull_occluded (display_list_t *dl, size_t *n_removed) {
+  cairo_region_t *covered;
+  cairo_status_t status = CAIRO_STATUS_SUCCESS;
+  char *removed = NULL;
+  size_t i, j, n = 0;
+
+  *n_removed = 0;
+
+  _display_list_lock (dl);
+
+  if (!dl->indexable || dl->n_commands == 0)
+    goto done;
+
+  covered = cairo_region_create ();
+  removed = calloc (dl->n_commands, 1);
+  if (removed == NULL) {
+    cairo_region_destroy (covered);
+    status = CAIRO_STATUS_NO_MEMORY;
+    goto done;
+  }
+
+  for (i = dl->n_commands; i-- > 0; ) {
+    display_command_t *cmd = &dl->commands[i];
+    cairo_rectangle_int_t rect;
+
+    rect.x = (int)floor (cmd->extents.x1);
+    rect.y = (int)floor (cmd->extents.y1);
+    rect.width = (int)ceil (cmd->extents.x2) - rect.x;
+    rect.height = (int)ceil (cmd->extents.y2) - rect.y;
+    if (cairo_region_contains_rectangle (covered, &rect) ==
+        CAIRO_REGION_OVERLAP_IN) {
+      removed[i] = 1;
+      n++;
+      continue;
+    }
+
+    status = _display_command_add_cover (cmd, covered);
+    if (status != CAIRO_STATUS_SUCCESS)
+      break;
+  }
+  cairo_region_destroy (covered);
+
+  if (status != CAIRO_STATUS_SUCCESS || n == 0)
+    goto done;
+
+  rtree_clear (dl->tree);
+  for (i = j = 0; i < dl->n_commands; i++) {
+    if (removed[i]) {
+      _display_command_fini (&dl->commands[i]);
+      continue;
+    }
+    dl->commands[j] = dl->commands[i];
+    if (rtree_insert (dl->tree, &dl->commands[j].extents, j) < 0)
+      status = CAIRO_STATUS_NO_MEMORY;
+    j++;
+  }
+  dl->n_commands = j;
+  *n_removed = n;
+
+  /* without a complete index we can only fall back to the recording */
+  if (status != CAIRO_STATUS_SUCCESS)
+    _display_list_set_unindexable (dl);
+
+done:
+  free (removed);
+  PyThread_release_lock (dl->lock);
+  return status;
+}
@@ -67,8 +67,8 @@ int_enum_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     return PYCAIRO_PyLong_Type.tp_new(type, args, kwds);
 }
 
-PyObject *
-int_enum_create(PyTypeObject *type, long value) {
+static PyObject *
+int_enum_new_value(PyTypeObject *type, long value) {
     PyObject *args, *result;
 
     args = Py_BuildValue("(l)", value);
@@ -81,18 +81,54 @@ int_enum_create(PyTypeObject *type, long value) {
 
 static const char *map_name = "__map";
 
+/* key of the int->instance mapping of the registered values */
+static PyObject *members_key = NULL;
+
+/* Returns a new reference to the instance of type for value. Registered
+ * values share one instance, so getters returning enums don't allocate. */
+PyObject *
+int_enum_create(PyTypeObject *type, long value) {
+    PyObject *members, *int_obj, *en;
+
+    members = PyDict_GetItem(type->tp_dict, members_key);
+    if (members != NULL) {
+        int_obj = PYCAIRO_PyLong_FromLong(value);
+        if (int_obj == NULL)
+            return NULL;
+        en = PyDict_GetItem(members, int_obj);
+        Py_DECREF(int_obj);
+        if (en != NULL) {
+            Py_INCREF(en);
+            return en;
+        }
+    }
+
+    return int_enum_new_value(type, value);
+}
+
 static PyObject*
 enum_type_register_constant(PyTypeObject *type, const char* name, long value) {
     PyObject *value_map;
     PyObject *int_obj, *name_obj, *en;
+    PyObject *members;
 
-    /* Get/Create the int->name mapping */
+    /* Get/Create the int->name and int->instance mappings */
     value_map = PyDict_GetItemString(type->tp_dict, map_name);
     if (value_map == NULL) {
         value_map = PyDict_New();
         PyDict_SetItemString(type->tp_dict, map_name, value_map);
         Py_DECREF(value_map);
     }
+    members = PyDict_GetItem(type->tp_dict, members_key);
+    if (members == NULL) {
+        members = PyDict_New();
+        if (members == NULL ||
+                PyDict_SetItem(type->tp_dict, members_key, members) < 0) {
+            Py_XDECREF(members);
+            return NULL;
+        }
+        Py_DECREF(members);
+    }
 
     /* Add int->name pair to the mapping */
     int_obj = PYCAIRO_PyLong_FromLong(value);
@@ -106,10 +142,21 @@ enum_type_register_constant(PyTypeObject *type, const char* name, long value) {
     Py_DECREF(name_obj);
 
     /* Create a new enum instance of the right type and add to the class */
-    en = int_enum_create(type, value);
+    en = int_enum_new_value(type, value);
     if (en == NULL || PyDict_SetItemString(type->tp_dict, name, en) < 0)
         return NULL;
 
+    /* Aliases of a value keep the first instance */
+    int_obj = PYCAIRO_PyLong_FromLong(value);
+    if (int_obj == NULL)
+        return NULL;
+    if (PyDict_GetItem(members, int_obj) == NULL &&
+            PyDict_SetItem(members, int_obj, en) < 0) {
+        Py_DECREF(int_obj);
+        return NULL;
+    }
+    Py_DECREF(int_obj);
+
     return en;
 }
 
@@ -239,6 +286,15 @@ static PyMethodDef format_methods[] = {
   {NULL, NULL, 0, NULL},
 };
 
+#define ENUM(t) \
+    if (init_enum_type(module, #t, &Pycairo_##t##_Type) < 0) \
+        return -1;
+
+#define CONSTANT(t, a, b) \
+    ev = enum_type_register_constant(&Pycairo_##t##_Type, #b, CAIRO_##a##_##b); \
+    if (ev == NULL || PyModule_AddObject(module, #a "_" #b, ev) < 0) \
+        return -1;
+
 int
 init_enums (PyObject *module) {
     PyObject *ev;
@@ -252,14 +308,11 @@ init_enums (PyObject *module) {
     if (PyType_Ready(&Pycairo_IntEnum_Type) < 0)
         return -1;
 
-#define ENUM(t) \
-    if (init_enum_type(module, #t, &Pycairo_##t##_Type) < 0) \
-        return -1;
-
-#define CONSTANT(t, a, b) \
-    ev = enum_type_register_constant(&Pycairo_##t##_Type, #b, CAIRO_##a##_##b); \
-    if (ev == NULL || PyModule_AddObject(module, #a "_" #b, ev) < 0) \
-        return -1;
+    if (members_key == NULL) {
+        members_key = PYCAIRO_PyUnicode_InternFromString("__members");
+        if (members_key == NULL)
+            return -1;
+    }
 
     ENUM(Antialias);
     CONSTANT(Antialias, ANTIALIAS, DEFAULT);
@@ -406,6 +459,18 @@ init_enums (PyObject *module) {
     CONSTANT(Status, STATUS, DEVICE_FINISHED);
     CONSTANT(Status, STATUS, JBIG2_GLOBAL_MISSING);
     CONSTANT(Status, STATUS, LAST_STATUS);
+    /* pycairo's own, there are no module level constants for them */
+    ev = enum_type_register_constant(
+        &Pycairo_Status_Type, "CANCELLED", PYCAIRO_STATUS_CANCELLED);
+    if (ev == NULL)
+        return -1;
+    Py_DECREF(ev);
+    ev = enum_type_register_constant(
+        &Pycairo_Status_Type, "DEADLINE_EXCEEDED",
+        PYCAIRO_STATUS_DEADLINE_EXCEEDED);
+    if (ev == NULL)
+        return -1;
+    Py_DECREF(ev);
 
     ENUM(PathDataType);
     CONSTANT(PathDataType, PATH, MOVE_TO);
@@ -432,32 +497,66 @@ init_enums (PyObject *module) {
     CONSTANT(SurfaceObserverMode, SURFACE_OBSERVER, NORMAL);
     CONSTANT(SurfaceObserverMode, SURFACE_OBSERVER, RECORD_OPERATIONS);
 
+    return 0;
+}
+
+/* The backend enums get registered together with their surface types, see
+ * the lazy groups in cairomodule.c. Each list gets expanded twice, into the
+ * init function and into the names the lazy group adds to the module. */
+
+#define ENUM_NAME(t) #t,
+#define CONSTANT_NAME(t, a, b) #a "_" #b,
+
+#define BACKEND_ENUMS(backend, LIST) \
+int \
+init_##backend##_enums (PyObject *module) { \
+    PyObject *ev; \
+    LIST(ENUM, CONSTANT) \
+    return 0; \
+} \
+const char *const backend##_enum_names[] = { \
+    LIST(ENUM_NAME, CONSTANT_NAME) \
+    NULL \
+};
+
 #ifdef CAIRO_HAS_SVG_SURFACE
-    ENUM(SVGVersion);
-    CONSTANT(SVGVersion, SVG, VERSION_1_1);
-    CONSTANT(SVGVersion, SVG, VERSION_1_2);
+#define SVG_ENUMS(E, C) \
+    E(SVGVersion) \
+    C(SVGVersion, SVG, VERSION_1_1) \
+    C(SVGVersion, SVG, VERSION_1_2)
+
+BACKEND_ENUMS(svg, SVG_ENUMS)
 #endif
 
 #ifdef CAIRO_HAS_PDF_SURFACE
-    ENUM(PDFVersion);
-    CONSTANT(PDFVersion, PDF, VERSION_1_4);
-    CONSTANT(PDFVersion, PDF, VERSION_1_5);
+#define PDF_ENUMS(E, C) \
+    E(PDFVersion) \
+    C(PDFVersion, PDF, VERSION_1_4) \
+    C(PDFVersion, PDF, VERSION_1_5)
+
+BACKEND_ENUMS(pdf, PDF_ENUMS)
 #endif
 
 #ifdef CAIRO_HAS_PS_SURFACE
-    ENUM(PSLevel);
-    CONSTANT(PSLevel, PS, LEVEL_2);
-    CONSTANT(PSLevel, PS, LEVEL_3);
+#define PS_ENUMS(E, C) \
+    E(PSLevel) \
+    C(PSLevel, PS, LEVEL_2) \
+    C(PSLevel, PS, LEVEL_3)
+
+BACKEND_ENUMS(ps, PS_ENUMS)
 #endif
 
 #ifdef CAIRO_HAS_SCRIPT_SURFACE
-    ENUM(ScriptMode);
-    CONSTANT(ScriptMode, SCRIPT_MODE, ASCII);
-    CONSTANT(ScriptMode, SCRIPT_MODE, BINARY);
+#define SCRIPT_ENUMS(E, C) \
+    E(ScriptMode) \
+    C(ScriptMode, SCRIPT_MODE, ASCII) \
+    C(ScriptMode, SCRIPT_MODE, BINARY)
+
+BACKEND_ENUMS(script, SCRIPT_ENUMS)
 #endif
 
+#undef BACKEND_ENUMS
+#undef ENUM_NAME
+#undef CONSTANT_NAME
 #undef ENUM
 #undef CONSTANT
-
-    return 0;
-}
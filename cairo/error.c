@@ -33,8 +33,12 @@
 #include "private.h"
 
 static PyTypeObject PycairoError_Type;
-static PyObject *error_get_type_combined (
-    PyObject *error, PyObject *other, char *name);
+static PyObject *cancelled_error_type = NULL;
+static PyObject *deadline_error_type = NULL;
+static PyObject *memory_error_type = NULL;
+static PyObject *io_error_type = NULL;
+static PyObject *error_get_type_cached (
+    PyObject **cache, PyObject *other, char *name);
 
 /* Like cairo_status_to_string(), but translates some C function names to
  * Python function names.
@@ -46,6 +50,10 @@ status_to_string(cairo_status_t status)
         return "Context.restore() without matching Context.save()";
     else if (status == CAIRO_STATUS_INVALID_POP_GROUP)
         return "Context.pop_group() without matching Context.push_group()";
+    else if (status == PYCAIRO_STATUS_CANCELLED)
+        return "the operation was cancelled";
+    else if (status == PYCAIRO_STATUS_DEADLINE_EXCEEDED)
+        return "the deadline of the operation was exceeded";
     else
         return cairo_status_to_string(status);
 }
@@ -56,8 +64,13 @@ set_error (PyObject *error_type, cairo_status_t status)
 {
     PyObject *args, *v;
 
-    args = Py_BuildValue("(sO)", status_to_string(status),
+    if (error_type == NULL)
+        return;
+
+    args = Py_BuildValue("(sN)", status_to_string(status),
                          CREATE_INT_ENUM(Status, status));
+    if (args == NULL)
+        return;
     v = PyObject_Call(error_type, args, NULL);
     Py_DECREF(args);
     if (v != NULL) {
@@ -73,21 +86,37 @@ Pycairo_Check_Status (cairo_status_t status) {
     if (PyErr_Occurred() != NULL)
         return 1;
 
+    /* I/O aborted by the write or read callback because of a cancelled
+     * token */
+    if (status == CAIRO_STATUS_WRITE_ERROR ||
+            status == CAIRO_STATUS_READ_ERROR) {
+        cairo_status_t cancel_status = cancel_token_check_current ();
+        if (cancel_status != CAIRO_STATUS_SUCCESS)
+            status = cancel_status;
+    }
+
+    if (status == PYCAIRO_STATUS_CANCELLED && cancelled_error_type != NULL) {
+        set_error (cancelled_error_type, status);
+        return 1;
+    } else if (status == PYCAIRO_STATUS_DEADLINE_EXCEEDED &&
+               deadline_error_type != NULL) {
+        set_error (deadline_error_type, status);
+        return 1;
+    }
+
     switch (status) {
         case CAIRO_STATUS_SUCCESS:
             return 0;
         case CAIRO_STATUS_NO_MEMORY:
-            suberror = error_get_type_combined (
-                _Pycairo_Get_Error(), PyExc_MemoryError, "cairo.MemoryError");
+            suberror = error_get_type_cached (
+                &memory_error_type, PyExc_MemoryError, "cairo.MemoryError");
             set_error (suberror, status);
-            Py_DECREF (suberror);
             break;
         case CAIRO_STATUS_READ_ERROR:
         case CAIRO_STATUS_WRITE_ERROR:
-            suberror = error_get_type_combined (
-                _Pycairo_Get_Error(), PyExc_IOError, "cairo.IOError");
+            suberror = error_get_type_cached (
+                &io_error_type, PyExc_IOError, "cairo.IOError");
             set_error (suberror, status);
-            Py_DECREF (suberror);
             break;
         default:
             set_error (_Pycairo_Get_Error(), status);
@@ -244,5 +273,53 @@ error_get_type_combined (PyObject *error, PyObject *other, char* name) {
         return NULL;
 
     new_type = PyType_Type.tp_new (&PyType_Type, new_type_args, NULL);
+    Py_DECREF (new_type_args);
     return new_type;
 }
+
+/* Returns a borrowed reference to the combination of cairo.Error and
+ * other, created once and kept in cache. Returns NULL and sets an
+ * exception on error.
+ */
+static PyObject *
+error_get_type_cached (PyObject **cache, PyObject *other, char *name) {
+    if (*cache == NULL)
+        *cache = error_get_type_combined (_Pycairo_Get_Error(), other, name);
+    return *cache;
+}
+
+/* Creates cairo.CancelledError and its subclass
+ * cairo.DeadlineExceededError and adds them to module.
+ */
+int
+error_add_cancel_types (PyObject *module, PyObject *error) {
+    if (cancelled_error_type == NULL) {
+        cancelled_error_type = PyErr_NewException (
+            "cairo.CancelledError", error, NULL);
+        if (cancelled_error_type == NULL)
+            return -1;
+    }
+
+    if (deadline_error_type == NULL) {
+        deadline_error_type = PyErr_NewException (
+            "cairo.DeadlineExceededError", cancelled_error_type, NULL);
+        if (deadline_error_type == NULL)
+            return -1;
+    }
+
+    Py_INCREF (cancelled_error_type);
+    if (PyModule_AddObject (module, "CancelledError",
+                            cancelled_error_type) < 0) {
+        Py_DECREF (cancelled_error_type);
+        return -1;
+    }
+
+    Py_INCREF (deadline_error_type);
+    if (PyModule_AddObject (module, "DeadlineExceededError",
+                            deadline_error_type) < 0) {
+        Py_DECREF (deadline_error_type);
+        return -1;
+    }
+
+    return 0;
+}
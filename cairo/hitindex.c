@@ -0,0 +1,459 @@
+/* -*- mode: C; c-basic-offset: 2 -*-
+ *
+ * Pycairo - Python bindings for cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ */
+
+/* Hit testing against many paths. The extents of all paths are kept in an
+ * R-tree, so only the few candidates under the query point need exact
+ * in_fill/in_stroke tests, done on a private context.
+ *
+ * Removed paths stay in the R-tree and get skipped by queries until half of
+ * the entries are removed ones, at which point the entries get compacted
+ * and the tree refilled. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdlib.h>
+
+#include "config.h"
+#include "private.h"
+
+typedef struct {
+  PyObject *id;           /* NULL for removed entries */
+  PycairoPath *path;
+  int fill;
+  cairo_fill_rule_t fill_rule;
+  double line_width;      /* no stroke test if zero */
+  pycairo_box_t box;      /* what can be hit */
+} hit_entry_t;
+
+typedef struct {
+  PyObject_HEAD
+  PyObject *ids;          /* id -> entry index */
+  hit_entry_t *entries;   /* in z-order, topmost last */
+  Py_ssize_t n_entries;
+  Py_ssize_t size_entries;
+  Py_ssize_t n_removed;
+  rtree_t *tree;
+  cairo_t *ctx;
+} PycairoHitIndex;
+
+static void
+_entry_clear (hit_entry_t *entry) {
+  Py_CLEAR (entry->id);
+  Py_CLEAR (entry->path);
+}
+
+static void
+hit_index_clear_entries (PycairoHitIndex *o) {
+  Py_ssize_t i;
+
+  for (i = 0; i < o->n_entries; i++)
+    _entry_clear (&o->entries[i]);
+  PyMem_Free (o->entries);
+  o->entries = NULL;
+  o->n_entries = o->size_entries = o->n_removed = 0;
+  if (o->tree != NULL)
+    rtree_clear (o->tree);
+  if (o->ids != NULL)
+    PyDict_Clear (o->ids);
+}
+
+static void
+hit_index_dealloc (PycairoHitIndex *o) {
+  hit_index_clear_entries (o);
+  Py_CLEAR (o->ids);
+  if (o->tree != NULL) {
+    rtree_free (o->tree);
+    o->tree = NULL;
+  }
+  if (o->ctx != NULL) {
+    cairo_destroy (o->ctx);
+    o->ctx = NULL;
+  }
+
+  Py_TYPE(o)->tp_free(o);
+}
+
+static PyObject *
+hit_index_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
+  PycairoHitIndex *o;
+  cairo_surface_t *surface;
+
+  if (!PyArg_ParseTuple (args, ":HitIndex.__new__"))
+    return NULL;
+
+  o = (PycairoHitIndex *)type->tp_alloc (type, 0);
+  if (o == NULL)
+    return NULL;
+
+  o->ids = PyDict_New ();
+  if (o->ids == NULL) {
+    Py_DECREF (o);
+    return NULL;
+  }
+
+  o->tree = rtree_new ();
+  if (o->tree == NULL) {
+    Py_DECREF (o);
+    return PyErr_NoMemory ();
+  }
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_A8, 0, 0);
+  o->ctx = cairo_create (surface);
+  cairo_surface_destroy (surface);
+  if (Pycairo_Check_Status (cairo_status (o->ctx))) {
+    Py_DECREF (o);
+    return NULL;
+  }
+
+  return (PyObject *)o;
+}
+
+static int
+_hit_test (PycairoHitIndex *o, hit_entry_t *entry, double x, double y) {
+  int hit = 0;
+
+  cairo_new_path (o->ctx);
+  cairo_append_path (o->ctx, entry->path->path);
+  if (entry->fill) {
+    cairo_set_fill_rule (o->ctx, entry->fill_rule);
+    hit = cairo_in_fill (o->ctx, x, y);
+  }
+  if (!hit && entry->line_width > 0) {
+    cairo_set_line_width (o->ctx, entry->line_width);
+    hit = cairo_in_stroke (o->ctx, x, y);
+  }
+  cairo_new_path (o->ctx);
+  return hit;
+}
+
+/* Drops the removed entries, keeping the order of the others. Only fails
+ * on memory errors, which leave the index empty. */
+static int
+_compact (PycairoHitIndex *o) {
+  PyObject *index_obj;
+  Py_ssize_t i, j;
+
+  for (i = j = 0; i < o->n_entries; i++) {
+    if (o->entries[i].id != NULL)
+      o->entries[j++] = o->entries[i];
+  }
+  o->n_entries = j;
+  o->n_removed = 0;
+
+  rtree_clear (o->tree);
+  for (i = 0; i < o->n_entries; i++) {
+    index_obj = PyLong_FromSsize_t (i);
+    if (index_obj == NULL ||
+	PyDict_SetItem (o->ids, o->entries[i].id, index_obj) < 0) {
+      Py_XDECREF (index_obj);
+      hit_index_clear_entries (o);
+      return -1;
+    }
+    Py_DECREF (index_obj);
+    if (rtree_insert (o->tree, &o->entries[i].box, (size_t)i) < 0) {
+      hit_index_clear_entries (o);
+      PyErr_NoMemory ();
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int
+_remove_id (PycairoHitIndex *o, PyObject *id) {
+  PyObject *index_obj;
+  Py_ssize_t index;
+
+  index_obj = PyDict_GetItem (o->ids, id);
+  if (index_obj == NULL)
+    return 0;
+
+  index = PyLong_AsSsize_t (index_obj);
+  if (index == -1 && PyErr_Occurred ())
+    return -1;
+
+  /* the tree keeps the entry, queries skip it */
+  _entry_clear (&o->entries[index]);
+  o->n_removed++;
+  if (PyDict_DelItem (o->ids, id) < 0)
+    return -1;
+
+  if (o->n_removed > 64 && o->n_removed * 2 > o->n_entries)
+    return _compact (o);
+  return 0;
+}
+
+static PyObject *
+hit_index_add (PycairoHitIndex *o, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"id", "path", "fill", "stroke_width", "fill_rule",
+			   NULL};
+  PyObject *id, *fill_obj = Py_True, *index_obj;
+  PycairoPath *path;
+  double line_width = 0.0;
+  int fill, fill_rule = CAIRO_FILL_RULE_WINDING;
+  pycairo_box_t box, stroke_box;
+  hit_entry_t *entry;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OO!|Odi:HitIndex.add",
+				    kwlist, &id, &PycairoPath_Type, &path,
+				    &fill_obj, &line_width, &fill_rule))
+    return NULL;
+
+  fill = PyObject_IsTrue (fill_obj);
+  if (fill < 0)
+    return NULL;
+
+  if (line_width < 0) {
+    PyErr_SetString (PyExc_ValueError, "stroke_width must not be negative");
+    return NULL;
+  }
+
+  if (_remove_id (o, id) < 0)
+    return NULL;
+
+  /* the extents of what can be hit */
+  cairo_new_path (o->ctx);
+  cairo_append_path (o->ctx, path->path);
+  cairo_set_fill_rule (o->ctx, fill_rule);
+  cairo_fill_extents (o->ctx, &box.x1, &box.y1, &box.x2, &box.y2);
+  if (line_width > 0) {
+    cairo_set_line_width (o->ctx, line_width);
+    cairo_stroke_extents (o->ctx, &stroke_box.x1, &stroke_box.y1,
+			  &stroke_box.x2, &stroke_box.y2);
+    if (!fill) {
+      box = stroke_box;
+    } else {
+      box.x1 = stroke_box.x1 < box.x1 ? stroke_box.x1 : box.x1;
+      box.y1 = stroke_box.y1 < box.y1 ? stroke_box.y1 : box.y1;
+      box.x2 = stroke_box.x2 > box.x2 ? stroke_box.x2 : box.x2;
+      box.y2 = stroke_box.y2 > box.y2 ? stroke_box.y2 : box.y2;
+    }
+  }
+  cairo_new_path (o->ctx);
+  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR (o->ctx);
+
+  if (o->n_entries == o->size_entries) {
+    Py_ssize_t size = o->size_entries ? o->size_entries * 2 : 64;
+    hit_entry_t *tmp = PyMem_Realloc (o->entries, size * sizeof (hit_entry_t));
+    if (tmp == NULL)
+      return PyErr_NoMemory ();
+    o->entries = tmp;
+    o->size_entries = size;
+  }
+
+  index_obj = PyLong_FromSsize_t (o->n_entries);
+  if (index_obj == NULL)
+    return NULL;
+  if (PyDict_SetItem (o->ids, id, index_obj) < 0) {
+    Py_DECREF (index_obj);
+    return NULL;
+  }
+  Py_DECREF (index_obj);
+
+  if (rtree_insert (o->tree, &box, (size_t)o->n_entries) < 0) {
+    PyDict_DelItem (o->ids, id);
+    return PyErr_NoMemory ();
+  }
+
+  entry = &o->entries[o->n_entries++];
+  Py_INCREF (id);
+  entry->id = id;
+  Py_INCREF (path);
+  entry->path = path;
+  entry->fill = fill;
+  entry->fill_rule = fill_rule;
+  entry->line_width = line_width;
+  entry->box = box;
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+hit_index_remove (PycairoHitIndex *o, PyObject *args) {
+  PyObject *id;
+
+  if (!PyArg_ParseTuple (args, "O:HitIndex.remove", &id))
+    return NULL;
+
+  if (PyDict_GetItem (o->ids, id) == NULL) {
+    PyErr_SetObject (PyExc_KeyError, id);
+    return NULL;
+  }
+
+  if (_remove_id (o, id) < 0)
+    return NULL;
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+hit_index_clear (PycairoHitIndex *o) {
+  hit_index_clear_entries (o);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+hit_index_query (PycairoHitIndex *o, PyObject *args) {
+  pycairo_box_t box;
+  size_t *ids, n_ids, i;
+  double x, y;
+  PyObject *result = Py_None;
+
+  if (!PyArg_ParseTuple (args, "dd:HitIndex.query", &x, &y))
+    return NULL;
+
+  box.x1 = box.x2 = x;
+  box.y1 = box.y2 = y;
+  if (rtree_query (o->tree, &box, &ids, &n_ids) < 0)
+    return PyErr_NoMemory ();
+
+  /* ids are in z-order, so test the topmost first */
+  for (i = n_ids; i > 0; i--) {
+    hit_entry_t *entry = &o->entries[ids[i - 1]];
+    if (entry->id != NULL && _hit_test (o, entry, x, y)) {
+      result = entry->id;
+      break;
+    }
+  }
+  free (ids);
+
+  Py_INCREF (result);
+  return result;
+}
+
+static PyObject *
+hit_index_query_rect (PycairoHitIndex *o, PyObject *args) {
+  pycairo_box_t box;
+  size_t *ids, n_ids, i;
+  double x, y, width, height;
+  PyObject *list, *id;
+
+  if (!PyArg_ParseTuple (args, "(dddd):HitIndex.query_rect",
+			 &x, &y, &width, &height))
+    return NULL;
+
+  box.x1 = width < 0 ? x + width : x;
+  box.y1 = height < 0 ? y + height : y;
+  box.x2 = width < 0 ? x : x + width;
+  box.y2 = height < 0 ? y : y + height;
+  if (rtree_query (o->tree, &box, &ids, &n_ids) < 0)
+    return PyErr_NoMemory ();
+
+  list = PyList_New (0);
+  if (list == NULL) {
+    free (ids);
+    return NULL;
+  }
+
+  for (i = n_ids; i > 0; i--) {
+    id = o->entries[ids[i - 1]].id;
+    if (id != NULL && PyList_Append (list, id) < 0) {
+      Py_CLEAR (list);
+      break;
+    }
+  }
+  free (ids);
+
+  return list;
+}
+
+static Py_ssize_t
+hit_index_length (PycairoHitIndex *o) {
+  return PyDict_Size (o->ids);
+}
+
+static int
+hit_index_contains (PycairoHitIndex *o, PyObject *id) {
+  return PyDict_Contains (o->ids, id);
+}
+
+static PySequenceMethods hit_index_as_sequence = {
+  (lenfunc)hit_index_length,          /* sq_length */
+  0,                                  /* sq_concat */
+  0,                                  /* sq_repeat */
+  0,                                  /* sq_item */
+  0,                                  /* sq_slice */
+  0,                                  /* sq_ass_item */
+  0,                                  /* sq_ass_slice */
+  (objobjproc)hit_index_contains,     /* sq_contains */
+};
+
+static PyMethodDef hit_index_methods[] = {
+  {"add",         (PyCFunction)hit_index_add,
+   METH_VARARGS | METH_KEYWORDS},
+  {"remove",      (PyCFunction)hit_index_remove,     METH_VARARGS},
+  {"clear",       (PyCFunction)hit_index_clear,      METH_NOARGS},
+  {"query",       (PyCFunction)hit_index_query,      METH_VARARGS},
+  {"query_rect",  (PyCFunction)hit_index_query_rect, METH_VARARGS},
+  {NULL, NULL, 0, NULL},
+};
+
+PyTypeObject PycairoHitIndex_Type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "cairo.HitIndex",                   /* tp_name */
+  sizeof(PycairoHitIndex),            /* tp_basicsize */
+  0,                                  /* tp_itemsize */
+  (destructor)hit_index_dealloc,      /* tp_dealloc */
+  0,                                  /* tp_print */
+  0,                                  /* tp_getattr */
+  0,                                  /* tp_setattr */
+  0,                                  /* tp_compare */
+  0,                                  /* tp_repr */
+  0,                                  /* tp_as_number */
+  &hit_index_as_sequence,             /* tp_as_sequence */
+  0,                                  /* tp_as_mapping */
+  0,                                  /* tp_hash */
+  0,                                  /* tp_call */
+  0,                                  /* tp_str */
+  0,                                  /* tp_getattro */
+  0,                                  /* tp_setattro */
+  0,                                  /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+  0,                                  /* tp_doc */
+  0,                                  /* tp_traverse */
+  0,                                  /* tp_clear */
+  0,                                  /* tp_richcompare */
+  0,                                  /* tp_weaklistoffset */
+  0,                                  /* tp_iter */
+  0,                                  /* tp_iternext */
+  hit_index_methods,                  /* tp_methods */
+  0,                                  /* tp_members */
+  0,                                  /* tp_getset */
+  0,                                  /* tp_base */
+  0,                                  /* tp_dict */
+  0,                                  /* tp_descr_get */
+  0,                                  /* tp_descr_set */
+  0,                                  /* tp_dictoffset */
+  0,                                  /* tp_init */
+  0,                                  /* tp_alloc */
+  (newfunc)hit_index_new,             /* tp_new */
+  0,                                  /* tp_free */
+  0,                                  /* tp_is_gc */
+  0,                                  /* tp_bases */
+};
@@ -319,3 +319,148 @@ _conv_pyobject_to_ulong (PyObject *pyobj, unsigned long *result) {
     *result = temp;
     return 0;
 }
+
+static int
+_is_double_format (const char *format) {
+    if (format == NULL)
+        return 0;
+    if (*format == '@' || *format == '=')
+        format++;
+#ifdef WORDS_BIGENDIAN
+    else if (*format == '>' || *format == '!')
+        format++;
+#else
+    else if (*format == '<')
+        format++;
+#endif
+    return strcmp (format, "d") == 0;
+}
+
+/* Converts either a float64 buffer (like a numpy array or array.array("d"))
+ * or a sequence of equally long sequences of float to a row major array of
+ * doubles. Rows need to have cols_a or, if not 0, cols_b items. One
+ * dimensional buffers are read as rows of cols_a items, and if cols_a is 1
+ * the sequence can contain plain floats.
+ *
+ * Returns NULL on error. The result needs to be freed with PyMem_Free().
+ */
+double *
+_Pycairo_AsDoubleArray (PyObject *obj, const char *name, int cols_a,
+                        int cols_b, Py_ssize_t *n_rows, int *n_cols) {
+    PyObject *seq, *row;
+    double *data;
+    Py_ssize_t rows, i, j;
+    int cols;
+
+    if (PyObject_CheckBuffer (obj)) {
+        Py_buffer view;
+
+        if (PyObject_GetBuffer (obj, &view, PyBUF_RECORDS_RO) < 0)
+            return NULL;
+
+        if (view.itemsize != sizeof (double) ||
+                !_is_double_format (view.format) ||
+                view.ndim < 1 || view.ndim > 2) {
+            PyBuffer_Release (&view);
+            PyErr_Format (PyExc_TypeError,
+                          "%s must be a 1 or 2 dimensional float64 buffer",
+                          name);
+            return NULL;
+        }
+
+        cols = view.ndim == 2 ? (int)view.shape[1] : cols_a;
+        if (cols <= 0 || (cols != cols_a && cols != cols_b) ||
+                view.len % ((Py_ssize_t)cols * sizeof (double)) != 0) {
+            PyBuffer_Release (&view);
+            if (cols_b != 0)
+                PyErr_Format (PyExc_ValueError,
+                              "%s must have %d or %d columns",
+                              name, cols_a, cols_b);
+            else
+                PyErr_Format (PyExc_ValueError,
+                              "%s must have %d columns", name, cols_a);
+            return NULL;
+        }
+
+        rows = view.len / ((Py_ssize_t)cols * sizeof (double));
+        data = PyMem_Malloc (view.len > 0 ? (size_t)view.len : 1);
+        if (data == NULL) {
+            PyBuffer_Release (&view);
+            PyErr_NoMemory ();
+            return NULL;
+        }
+        if (PyBuffer_ToContiguous (data, &view, view.len, 'C') < 0) {
+            PyMem_Free (data);
+            PyBuffer_Release (&view);
+            return NULL;
+        }
+        PyBuffer_Release (&view);
+
+        *n_rows = rows;
+        *n_cols = cols;
+        return data;
+    }
+
+    seq = PySequence_Fast (obj, "");
+    if (seq == NULL) {
+        PyErr_Format (PyExc_TypeError,
+                      "%s must be a float64 buffer or a sequence", name);
+        return NULL;
+    }
+
+    rows = PySequence_Fast_GET_SIZE (seq);
+    cols = cols_a;
+    if (rows > 0) {
+        row = PySequence_Fast_GET_ITEM (seq, 0);
+        if (cols_b != 0 && PySequence_Check (row) &&
+                PySequence_Size (row) == cols_b)
+            cols = cols_b;
+        PyErr_Clear ();
+    }
+
+    data = PyMem_Malloc (sizeof (double) * (rows > 0 ? rows * cols : 1));
+    if (data == NULL) {
+        Py_DECREF (seq);
+        PyErr_NoMemory ();
+        return NULL;
+    }
+
+    for (i = 0; i < rows; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM (seq, i);
+
+        if (cols == 1 && !PySequence_Check (item)) {
+            data[i] = PyFloat_AsDouble (item);
+            if (PyErr_Occurred ())
+                goto error;
+            continue;
+        }
+
+        row = PySequence_Fast (item, "");
+        if (row == NULL || PySequence_Fast_GET_SIZE (row) != cols) {
+            Py_XDECREF (row);
+            PyErr_Format (PyExc_ValueError,
+                          "%s items must be sequences of %d float",
+                          name, cols);
+            goto error;
+        }
+        for (j = 0; j < cols; j++) {
+            data[i * cols + j] = PyFloat_AsDouble (
+                PySequence_Fast_GET_ITEM (row, j));
+            if (PyErr_Occurred ()) {
+                Py_DECREF (row);
+                goto error;
+            }
+        }
+        Py_DECREF (row);
+    }
+
+    Py_DECREF (seq);
+    *n_rows = rows;
+    *n_cols = cols;
+    return data;
+
+error:
+    PyMem_Free (data);
+    Py_DECREF (seq);
+    return NULL;
+}
@@ -31,6 +31,10 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "config.h"
 #include "private.h"
 
@@ -181,6 +185,839 @@ path_hash (PyObject *self)
   return PYCAIRO_Py_hash_t_FromVoidPtr (((PycairoPath *)self)->path);
 }
 
+/* Polyline simplification ------------------------------------------------ */
+
+typedef struct {
+  double *dev;          /* points in device space */
+  unsigned char *keep;
+  size_t *stack;
+  size_t size;
+} simplify_buffers_t;
+
+static int
+_simplify_buffers_reserve (simplify_buffers_t *buf, size_t n) {
+  double *dev;
+  unsigned char *keep;
+  size_t *stack;
+
+  if (n <= buf->size)
+    return 0;
+
+  dev = realloc (buf->dev, n * 2 * sizeof (double));
+  if (dev == NULL)
+    return -1;
+  buf->dev = dev;
+  keep = realloc (buf->keep, n);
+  if (keep == NULL)
+    return -1;
+  buf->keep = keep;
+  stack = realloc (buf->stack, n * 2 * sizeof (size_t));
+  if (stack == NULL)
+    return -1;
+  buf->stack = stack;
+  buf->size = n;
+  return 0;
+}
+
+static void
+_simplify_buffers_fini (simplify_buffers_t *buf) {
+  free (buf->dev);
+  free (buf->keep);
+  free (buf->stack);
+}
+
+static double
+_segment_distance_squared (const double *p, const double *a, const double *b) {
+  double dx = b[0] - a[0], dy = b[1] - a[1];
+  double px = p[0] - a[0], py = p[1] - a[1];
+  double len = dx * dx + dy * dy, t;
+
+  if (len > 0) {
+    t = (px * dx + py * dy) / len;
+    t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    px -= t * dx;
+    py -= t * dy;
+  }
+  return px * px + py * py;
+}
+
+/* Douglas-Peucker: marks the points of dev[0..n) which have to stay so
+ * that no dropped point is further than tolerance from the result. */
+static void
+_simplify_run (simplify_buffers_t *buf, size_t n, double tolerance) {
+  double tolerance2 = tolerance * tolerance;
+  size_t n_stack = 0, i;
+
+  memset (buf->keep, 0, n);
+  buf->keep[0] = buf->keep[n - 1] = 1;
+  if (n < 3)
+    return;
+
+  buf->stack[n_stack++] = 0;
+  buf->stack[n_stack++] = n - 1;
+  while (n_stack > 0) {
+    size_t last = buf->stack[--n_stack], first = buf->stack[--n_stack];
+    size_t index = 0;
+    double max = tolerance2;
+
+    for (i = first + 1; i < last; i++) {
+      double d = _segment_distance_squared (
+	buf->dev + i * 2, buf->dev + first * 2, buf->dev + last * 2);
+      if (d > max) {
+	max = d;
+	index = i;
+      }
+    }
+
+    if (index != 0) {
+      buf->keep[index] = 1;
+      buf->stack[n_stack++] = first;
+      buf->stack[n_stack++] = index;
+      buf->stack[n_stack++] = index;
+      buf->stack[n_stack++] = last;
+    }
+  }
+}
+
+/* Appends the simplified polyline pts[0..n) to the path of cr, starting
+ * with a move_to if move is set, otherwise the first point is taken to be
+ * the current point. Non-finite points split the polyline. */
+static cairo_status_t
+_append_simplified (cairo_t *cr, const double *pts, size_t n,
+		    const cairo_matrix_t *matrix, double tolerance, int move,
+		    simplify_buffers_t *buf) {
+  size_t start, end, i;
+
+  if (_simplify_buffers_reserve (buf, n) < 0)
+    return CAIRO_STATUS_NO_MEMORY;
+
+  for (i = 0; i < n; i++) {
+    buf->dev[i * 2] = pts[i * 2];
+    buf->dev[i * 2 + 1] = pts[i * 2 + 1];
+    cairo_matrix_transform_point (matrix, &buf->dev[i * 2],
+				  &buf->dev[i * 2 + 1]);
+  }
+
+  for (start = 0; start < n; start = end) {
+    simplify_buffers_t run;
+
+    for (; start < n; start++) {
+      if (Py_IS_FINITE (buf->dev[start * 2]) && Py_IS_FINITE (buf->dev[start * 2 + 1]))
+	break;
+      move = 1;
+    }
+    for (end = start; end < n; end++) {
+      if (!Py_IS_FINITE (buf->dev[end * 2]) || !Py_IS_FINITE (buf->dev[end * 2 + 1]))
+	break;
+    }
+    if (start == end)
+      break;
+
+    run.dev = buf->dev + start * 2;
+    run.keep = buf->keep + start;
+    run.stack = buf->stack;
+    _simplify_run (&run, end - start, tolerance);
+
+    if (move)
+      cairo_move_to (cr, pts[start * 2], pts[start * 2 + 1]);
+    for (i = start + 1; i < end; i++) {
+      if (buf->keep[i])
+	cairo_line_to (cr, pts[i * 2], pts[i * 2 + 1]);
+    }
+    move = 1;
+  }
+
+  return cairo_status (cr);
+}
+
+static cairo_t *
+_create_path_context (void) {
+  cairo_surface_t *surface = cairo_image_surface_create (CAIRO_FORMAT_A8, 0, 0);
+  cairo_t *cr = cairo_create (surface);
+  cairo_surface_destroy (surface);
+  return cr;
+}
+
+static int
+_parse_matrix (PyObject *matrix_obj, cairo_matrix_t *matrix) {
+  if (matrix_obj == Py_None) {
+    cairo_matrix_init_identity (matrix);
+  } else if (PyObject_TypeCheck (matrix_obj, &PycairoMatrix_Type)) {
+    *matrix = ((PycairoMatrix *)matrix_obj)->matrix;
+  } else {
+    PyErr_SetString (PyExc_TypeError, "matrix must be a cairo.Matrix or None");
+    return -1;
+  }
+  return 0;
+}
+
+static int
+_parse_tolerance_matrix (double tolerance, PyObject *matrix_obj,
+			 cairo_matrix_t *matrix) {
+  if (!(tolerance >= 0)) {
+    PyErr_SetString (PyExc_ValueError, "tolerance must not be negative");
+    return -1;
+  }
+
+  return _parse_matrix (matrix_obj, matrix);
+}
+
+PyObject *
+simplify_polyline (PyObject *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"points", "tolerance", "matrix", NULL};
+  PyObject *points_obj, *matrix_obj = Py_None;
+  simplify_buffers_t buf = {NULL, NULL, NULL, 0};
+  cairo_matrix_t matrix;
+  cairo_status_t status;
+  cairo_path_t *path;
+  Py_ssize_t n_points;
+  double tolerance, *points;
+  cairo_t *cr;
+  int cols;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "Od|O:simplify_polyline",
+				    kwlist, &points_obj, &tolerance,
+				    &matrix_obj))
+    return NULL;
+
+  if (_parse_tolerance_matrix (tolerance, matrix_obj, &matrix) < 0)
+    return NULL;
+
+  points = _Pycairo_AsDoubleArray (points_obj, "points", 2, 0,
+				   &n_points, &cols);
+  if (points == NULL)
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS;
+  cr = _create_path_context ();
+  status = _append_simplified (cr, points, (size_t)n_points, &matrix,
+			       tolerance, 1, &buf);
+  path = cairo_copy_path (cr);
+  cairo_destroy (cr);
+  _simplify_buffers_fini (&buf);
+  Py_END_ALLOW_THREADS;
+
+  PyMem_Free (points);
+  if (Pycairo_Check_Status (status)) {
+    cairo_path_destroy (path);
+    return NULL;
+  }
+  return PycairoPath_FromPath (path);
+}
+
+/* Min/max (M4) decimation ------------------------------------------------ */
+
+typedef struct {
+  Py_ssize_t first, last, min, max;
+  double min_y, max_y;
+} m4_column_t;
+
+static void
+_m4_append_column (cairo_t *cr, const double *x, const double *y,
+		   const m4_column_t *column, int *move) {
+  Py_ssize_t index[4], tmp;
+  int i, j;
+
+  index[0] = column->first;
+  index[1] = column->min;
+  index[2] = column->max;
+  index[3] = column->last;
+  for (i = 1; i < 4; i++) {
+    for (j = i; j > 0 && index[j - 1] > index[j]; j--) {
+      tmp = index[j];
+      index[j] = index[j - 1];
+      index[j - 1] = tmp;
+    }
+  }
+
+  for (i = 0; i < 4; i++) {
+    if (i > 0 && index[i] == index[i - 1])
+      continue;
+    if (*move)
+      cairo_move_to (cr, x[index[i]], y[index[i]]);
+    else
+      cairo_line_to (cr, x[index[i]], y[index[i]]);
+    *move = 0;
+  }
+}
+
+/* Keeps the first, last, lowest and highest sample for each pixel column
+ * [0, width). Samples left or right of that range are collected in one
+ * column each. Doesn't need the GIL. */
+static cairo_status_t
+_decimate_m4 (cairo_t *cr, const double *x, const double *y, Py_ssize_t n,
+	      int width, const cairo_matrix_t *matrix) {
+  m4_column_t column;
+  Py_ssize_t i;
+  long col, current = 0;
+  int have_column = 0, move = 1;
+
+  for (i = 0; i < n; i++) {
+    double dx = x[i], dy = y[i];
+
+    cairo_matrix_transform_point (matrix, &dx, &dy);
+    if (!Py_IS_FINITE (dx) || !Py_IS_FINITE (dy)) {
+      if (have_column)
+	_m4_append_column (cr, x, y, &column, &move);
+      have_column = 0;
+      move = 1;
+      continue;
+    }
+
+    if (dx < 0)
+      col = -1;
+    else if (dx >= width)
+      col = width;
+    else
+      col = (long)dx;
+
+    if (!have_column || col != current) {
+      if (have_column)
+	_m4_append_column (cr, x, y, &column, &move);
+      column.first = column.last = column.min = column.max = i;
+      column.min_y = column.max_y = dy;
+      current = col;
+      have_column = 1;
+    } else {
+      column.last = i;
+      if (dy < column.min_y) {
+	column.min_y = dy;
+	column.min = i;
+      } else if (dy > column.max_y) {
+	column.max_y = dy;
+	column.max = i;
+      }
+    }
+  }
+
+  if (have_column)
+    _m4_append_column (cr, x, y, &column, &move);
+
+  return cairo_status (cr);
+}
+
+PyObject *
+decimate_m4 (PyObject *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"x", "y", "width", "matrix", NULL};
+  PyObject *x_obj, *y_obj, *matrix_obj = Py_None;
+  cairo_matrix_t matrix;
+  cairo_status_t status;
+  cairo_path_t *path;
+  Py_ssize_t n_x, n_y;
+  double *x, *y = NULL;
+  cairo_t *cr;
+  int width, cols;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOi|O:decimate_m4",
+				    kwlist, &x_obj, &y_obj, &width,
+				    &matrix_obj))
+    return NULL;
+
+  if (width < 0) {
+    PyErr_SetString (PyExc_ValueError, "width must not be negative");
+    return NULL;
+  }
+
+  if (_parse_matrix (matrix_obj, &matrix) < 0)
+    return NULL;
+
+  x = _Pycairo_AsDoubleArray (x_obj, "x", 1, 0, &n_x, &cols);
+  if (x == NULL)
+    return NULL;
+  y = _Pycairo_AsDoubleArray (y_obj, "y", 1, 0, &n_y, &cols);
+  if (y == NULL) {
+    PyMem_Free (x);
+    return NULL;
+  }
+
+  if (n_x != n_y) {
+    PyMem_Free (x);
+    PyMem_Free (y);
+    PyErr_SetString (PyExc_ValueError, "x and y must have the same length");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  cr = _create_path_context ();
+  status = _decimate_m4 (cr, x, y, n_x, width, &matrix);
+  path = cairo_copy_path (cr);
+  cairo_destroy (cr);
+  Py_END_ALLOW_THREADS;
+
+  PyMem_Free (x);
+  PyMem_Free (y);
+  if (Pycairo_Check_Status (status)) {
+    cairo_path_destroy (path);
+    return NULL;
+  }
+  return PycairoPath_FromPath (path);
+}
+
+/* Copies path to cr with the line_to runs simplified. Doesn't need the
+ * GIL. */
+static cairo_status_t
+_path_append_simplified (cairo_t *cr, cairo_path_t *path,
+			 const cairo_matrix_t *matrix, double tolerance) {
+  simplify_buffers_t buf = {NULL, NULL, NULL, 0};
+  cairo_status_t status = CAIRO_STATUS_SUCCESS;
+  double *run = NULL;
+  size_t n_run = 0, size_run = 0;
+  int move = 0, i;
+
+  for (i = 0; i < path->num_data && status == CAIRO_STATUS_SUCCESS;
+       i += path->data[i].header.length) {
+    cairo_path_data_t *data = &path->data[i];
+    cairo_path_data_type_t type = data->header.type;
+
+    if (type != CAIRO_PATH_LINE_TO && n_run > 0) {
+      status = _append_simplified (cr, run, n_run, matrix, tolerance, move,
+				   &buf);
+      n_run = 0;
+    }
+
+    switch (type) {
+    case CAIRO_PATH_MOVE_TO:
+    case CAIRO_PATH_LINE_TO:
+      if (n_run == size_run) {
+	size_t size = size_run ? size_run * 2 : 64;
+	double *tmp = realloc (run, size * 2 * sizeof (double));
+	if (tmp == NULL) {
+	  status = CAIRO_STATUS_NO_MEMORY;
+	  break;
+	}
+	run = tmp;
+	size_run = size;
+      }
+      if (type == CAIRO_PATH_MOVE_TO)
+	move = 1;
+      run[n_run * 2] = data[1].point.x;
+      run[n_run * 2 + 1] = data[1].point.y;
+      n_run++;
+      break;
+    case CAIRO_PATH_CURVE_TO:
+      cairo_curve_to (cr, data[1].point.x, data[1].point.y,
+		      data[2].point.x, data[2].point.y,
+		      data[3].point.x, data[3].point.y);
+      /* following lines continue from the end of the curve */
+      run[0] = data[3].point.x;
+      run[1] = data[3].point.y;
+      n_run = 1;
+      move = 0;
+      break;
+    case CAIRO_PATH_CLOSE_PATH:
+      cairo_close_path (cr);
+      break;
+    }
+  }
+
+  if (status == CAIRO_STATUS_SUCCESS && n_run > 1)
+    status = _append_simplified (cr, run, n_run, matrix, tolerance, move,
+				 &buf);
+  else if (status == CAIRO_STATUS_SUCCESS && n_run == 1 && move)
+    cairo_move_to (cr, run[0], run[1]);
+
+  free (run);
+  _simplify_buffers_fini (&buf);
+  if (status != CAIRO_STATUS_SUCCESS)
+    return status;
+  return cairo_status (cr);
+}
+
+static PyObject *
+path_simplified (PycairoPath *p, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"tolerance", "matrix", NULL};
+  PyObject *matrix_obj = Py_None;
+  cairo_matrix_t matrix;
+  cairo_status_t status;
+  cairo_path_t *path;
+  double tolerance;
+  cairo_t *cr;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "d|O:Path.simplified",
+				    kwlist, &tolerance, &matrix_obj))
+    return NULL;
+
+  if (_parse_tolerance_matrix (tolerance, matrix_obj, &matrix) < 0)
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS;
+  cr = _create_path_context ();
+  status = _path_append_simplified (cr, p->path, &matrix, tolerance);
+  path = cairo_copy_path (cr);
+  cairo_destroy (cr);
+  Py_END_ALLOW_THREADS;
+
+  if (Pycairo_Check_Status (status)) {
+    cairo_path_destroy (path);
+    return NULL;
+  }
+  return PycairoPath_FromPath (path);
+}
+
+/* Path geometry ---------------------------------------------------------- */
+
+/* Creates a Path from what got drawn on cr, which gets destroyed. cairo
+ * frees the path data itself, so it has to come from cairo_copy_path(). */
+static PyObject *
+_path_from_context (cairo_t *cr) {
+  cairo_path_t *path;
+
+  Py_BEGIN_ALLOW_THREADS;
+  path = cairo_copy_path (cr);
+  cairo_destroy (cr);
+  Py_END_ALLOW_THREADS;
+
+  return PycairoPath_FromPath (path);
+}
+
+/* Called for each element of the flattened path with the end point for
+ * move_to and line_to and the subpath start for close_path. Returning
+ * non-zero stops the walk. */
+typedef int (*flatten_func_t) (void *closure, cairo_path_data_type_t type,
+			       double x, double y);
+
+static int
+_flatten_curve (const double *p, double tolerance, flatten_func_t func,
+		void *closure) {
+  double ddx1 = p[0] - 2 * p[2] + p[4], ddy1 = p[1] - 2 * p[3] + p[5];
+  double ddx2 = p[2] - 2 * p[4] + p[6], ddy2 = p[3] - 2 * p[5] + p[7];
+  double dd = sqrt (ddx1 * ddx1 + ddy1 * ddy1);
+  double n_f;
+  int i, n;
+
+  if (sqrt (ddx2 * ddx2 + ddy2 * ddy2) > dd)
+    dd = sqrt (ddx2 * ddx2 + ddy2 * ddy2);
+
+  /* n uniform steps keep the error below 3/4 * dd / n^2 */
+  n_f = ceil (sqrt (0.75 * dd / tolerance));
+  n = !(n_f >= 1) ? 1 : (n_f > 65536 ? 65536 : (int)n_f);
+
+  for (i = 1; i <= n; i++) {
+    double t = (double)i / n, u = 1 - t;
+    double a = u * u * u, b = 3 * u * u * t, c = 3 * u * t * t, d = t * t * t;
+
+    if (func (closure, CAIRO_PATH_LINE_TO,
+	      a * p[0] + b * p[2] + c * p[4] + d * p[6],
+	      a * p[1] + b * p[3] + c * p[5] + d * p[7]))
+      return 1;
+  }
+  return 0;
+}
+
+/* Returns non-zero if func stopped the walk. Doesn't need the GIL. */
+static int
+_path_flatten (cairo_path_t *path, double tolerance, flatten_func_t func,
+	       void *closure) {
+  double cur_x = 0, cur_y = 0, start_x = 0, start_y = 0, p[8];
+  cairo_path_data_t *data;
+  int i;
+
+  for (i = 0; i < path->num_data; i += path->data[i].header.length) {
+    data = &path->data[i];
+    switch (data->header.type) {
+    case CAIRO_PATH_MOVE_TO:
+      start_x = cur_x = data[1].point.x;
+      start_y = cur_y = data[1].point.y;
+      if (func (closure, CAIRO_PATH_MOVE_TO, cur_x, cur_y))
+	return 1;
+      break;
+    case CAIRO_PATH_LINE_TO:
+      cur_x = data[1].point.x;
+      cur_y = data[1].point.y;
+      if (func (closure, CAIRO_PATH_LINE_TO, cur_x, cur_y))
+	return 1;
+      break;
+    case CAIRO_PATH_CURVE_TO:
+      p[0] = cur_x;
+      p[1] = cur_y;
+      p[2] = data[1].point.x;
+      p[3] = data[1].point.y;
+      p[4] = data[2].point.x;
+      p[5] = data[2].point.y;
+      p[6] = cur_x = data[3].point.x;
+      p[7] = cur_y = data[3].point.y;
+      if (_flatten_curve (p, tolerance, func, closure))
+	return 1;
+      break;
+    case CAIRO_PATH_CLOSE_PATH:
+      cur_x = start_x;
+      cur_y = start_y;
+      if (func (closure, CAIRO_PATH_CLOSE_PATH, cur_x, cur_y))
+	return 1;
+      break;
+    }
+  }
+  return 0;
+}
+
+static int
+_parse_tolerance (double tolerance) {
+  if (!(tolerance > 0)) {
+    PyErr_SetString (PyExc_ValueError, "tolerance must be positive");
+    return -1;
+  }
+  return 0;
+}
+
+static PyObject *
+path_bounds (PycairoPath *p) {
+  cairo_path_t *path = p->path;
+  cairo_path_data_t *data;
+  double x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+  double cur[2] = {0, 0};
+  int i, j, k, have_point = 0;
+
+#define ADD_POINT(px, py) do {				\
+    if (!have_point) {					\
+      x1 = x2 = (px);					\
+      y1 = y2 = (py);					\
+      have_point = 1;					\
+    } else {						\
+      x1 = (px) < x1 ? (px) : x1;			\
+      y1 = (py) < y1 ? (py) : y1;			\
+      x2 = (px) > x2 ? (px) : x2;			\
+      y2 = (py) > y2 ? (py) : y2;			\
+    }							\
+  } while (0)
+
+  for (i = 0; i < path->num_data; i += path->data[i].header.length) {
+    data = &path->data[i];
+    switch (data->header.type) {
+    case CAIRO_PATH_MOVE_TO:
+    case CAIRO_PATH_LINE_TO:
+      cur[0] = data[1].point.x;
+      cur[1] = data[1].point.y;
+      ADD_POINT (cur[0], cur[1]);
+      break;
+    case CAIRO_PATH_CURVE_TO: {
+      double c[2][4], t[2], ext[2];
+
+      for (k = 0; k < 2; k++) {
+	c[k][0] = cur[k];
+	c[k][1] = k ? data[1].point.y : data[1].point.x;
+	c[k][2] = k ? data[2].point.y : data[2].point.x;
+	c[k][3] = k ? data[3].point.y : data[3].point.x;
+      }
+      ADD_POINT (c[0][3], c[1][3]);
+
+      /* the extrema where the derivative a t^2 + b t + c is zero */
+      for (k = 0; k < 2; k++) {
+	double a = -c[k][0] + 3 * c[k][1] - 3 * c[k][2] + c[k][3];
+	double b = 2 * (c[k][0] - 2 * c[k][1] + c[k][2]);
+	double cc = c[k][1] - c[k][0];
+	int n_t = 0;
+
+	if (fabs (a) < 1e-12) {
+	  if (b != 0)
+	    t[n_t++] = -cc / b;
+	} else {
+	  double disc = b * b - 4 * a * cc;
+	  if (disc >= 0) {
+	    t[n_t++] = (-b + sqrt (disc)) / (2 * a);
+	    t[n_t++] = (-b - sqrt (disc)) / (2 * a);
+	  }
+	}
+
+	for (j = 0; j < n_t; j++) {
+	  double tt = t[j], u = 1 - tt;
+	  int m;
+	  if (!(tt > 0 && tt < 1))
+	    continue;
+	  for (m = 0; m < 2; m++)
+	    ext[m] = u * u * u * c[m][0] + 3 * u * u * tt * c[m][1] +
+	      3 * u * tt * tt * c[m][2] + tt * tt * tt * c[m][3];
+	  ADD_POINT (ext[0], ext[1]);
+	}
+      }
+      cur[0] = c[0][3];
+      cur[1] = c[1][3];
+      break;
+    }
+    case CAIRO_PATH_CLOSE_PATH:
+      break;
+    }
+  }
+
+#undef ADD_POINT
+
+  return Py_BuildValue ("(dddd)", x1, y1, x2, y2);
+}
+
+static int
+_flattened_func (void *closure, cairo_path_data_type_t type,
+		 double x, double y) {
+  cairo_t *cr = closure;
+
+  if (type == CAIRO_PATH_MOVE_TO)
+    cairo_move_to (cr, x, y);
+  else if (type == CAIRO_PATH_LINE_TO)
+    cairo_line_to (cr, x, y);
+  else
+    cairo_close_path (cr);
+  return cairo_status (cr) != CAIRO_STATUS_SUCCESS;
+}
+
+static PyObject *
+path_flattened (PycairoPath *p, PyObject *args) {
+  double tolerance;
+  cairo_t *cr;
+
+  if (!PyArg_ParseTuple (args, "d:Path.flattened", &tolerance))
+    return NULL;
+
+  if (_parse_tolerance (tolerance) < 0)
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS;
+  cr = _create_path_context ();
+  _path_flatten (p->path, tolerance, _flattened_func, cr);
+  Py_END_ALLOW_THREADS;
+
+  return _path_from_context (cr);
+}
+
+typedef struct {
+  double x, y;          /* current point */
+  double length;        /* length walked so far */
+  double target;        /* where to stop, negative for no limit */
+  double tx, ty;        /* tangent at the current point */
+} path_walk_t;
+
+static int
+_walk_func (void *closure, cairo_path_data_type_t type, double x, double y) {
+  path_walk_t *walk = closure;
+  double dx = x - walk->x, dy = y - walk->y;
+  double len = sqrt (dx * dx + dy * dy);
+
+  if (type == CAIRO_PATH_MOVE_TO || len == 0) {
+    walk->x = x;
+    walk->y = y;
+    return 0;
+  }
+
+  walk->tx = dx / len;
+  walk->ty = dy / len;
+  if (walk->target >= 0 && walk->length + len >= walk->target) {
+    double t = (walk->target - walk->length) / len;
+    walk->x += t * dx;
+    walk->y += t * dy;
+    walk->length = walk->target;
+    return 1;
+  }
+
+  walk->x = x;
+  walk->y = y;
+  walk->length += len;
+  return 0;
+}
+
+static PyObject *
+path_length (PycairoPath *p, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"tolerance", NULL};
+  path_walk_t walk = {0, 0, 0, -1, 0, 0};
+  double tolerance = 0.1;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "|d:Path.length", kwlist,
+				    &tolerance))
+    return NULL;
+
+  if (_parse_tolerance (tolerance) < 0)
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS;
+  _path_flatten (p->path, tolerance, _walk_func, &walk);
+  Py_END_ALLOW_THREADS;
+
+  return PyFloat_FromDouble (walk.length);
+}
+
+static PyObject *
+path_point_at (PycairoPath *p, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"distance", "tolerance", NULL};
+  path_walk_t walk = {0, 0, 0, 0, 0, 0};
+  double distance, tolerance = 0.1;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "d|d:Path.point_at", kwlist,
+				    &distance, &tolerance))
+    return NULL;
+
+  if (_parse_tolerance (tolerance) < 0)
+    return NULL;
+
+  if (p->path->num_data == 0) {
+    PyErr_SetString (PyExc_ValueError, "path is empty");
+    return NULL;
+  }
+
+  walk.target = distance > 0 ? distance : 0;
+  if (p->path->data[0].header.length > 1) {
+    walk.x = p->path->data[1].point.x;
+    walk.y = p->path->data[1].point.y;
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  _path_flatten (p->path, tolerance, _walk_func, &walk);
+  Py_END_ALLOW_THREADS;
+
+  return Py_BuildValue ("(dddd)", walk.x, walk.y, walk.tx, walk.ty);
+}
+
+static PyObject *
+path_transformed (PycairoPath *p, PyObject *args) {
+  PycairoMatrix *matrix;
+  cairo_path_t *path = p->path;
+  cairo_t *cr;
+  int i;
+
+  if (!PyArg_ParseTuple (args, "O!:Path.transformed",
+			 &PycairoMatrix_Type, &matrix))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS;
+  cr = _create_path_context ();
+  for (i = 0; i < path->num_data; i += path->data[i].header.length) {
+    cairo_path_data_t *data = &path->data[i];
+    double points[6];
+    int j;
+
+    for (j = 1; j < data->header.length && j <= 3; j++) {
+      points[j * 2 - 2] = data[j].point.x;
+      points[j * 2 - 1] = data[j].point.y;
+      cairo_matrix_transform_point (&matrix->matrix, &points[j * 2 - 2],
+				    &points[j * 2 - 1]);
+    }
+
+    switch (data->header.type) {
+    case CAIRO_PATH_MOVE_TO:
+      cairo_move_to (cr, points[0], points[1]);
+      break;
+    case CAIRO_PATH_LINE_TO:
+      cairo_line_to (cr, points[0], points[1]);
+      break;
+    case CAIRO_PATH_CURVE_TO:
+      cairo_curve_to (cr, points[0], points[1], points[2], points[3],
+		      points[4], points[5]);
+      break;
+    case CAIRO_PATH_CLOSE_PATH:
+      cairo_close_path (cr);
+      break;
+    }
+  }
+  Py_END_ALLOW_THREADS;
+
+  return _path_from_context (cr);
+}
+
+static PyMethodDef path_methods[] = {
+  {"bounds",      (PyCFunction)path_bounds,      METH_NOARGS},
+  {"flattened",   (PyCFunction)path_flattened,   METH_VARARGS},
+  {"length",      (PyCFunction)path_length,      METH_VARARGS | METH_KEYWORDS},
+  {"point_at",    (PyCFunction)path_point_at,    METH_VARARGS | METH_KEYWORDS},
+  {"simplified",  (PyCFunction)path_simplified,  METH_VARARGS | METH_KEYWORDS},
+  {"transformed", (PyCFunction)path_transformed, METH_VARARGS},
+  {NULL, NULL, 0, NULL},
+};
+
 PyTypeObject PycairoPath_Type = {
   PyVarObject_HEAD_INIT(NULL, 0)
   "cairo.Path",			/* tp_name */
@@ -209,7 +1046,7 @@ PyTypeObject PycairoPath_Type = {
   0,					/* tp_weaklistoffset */
   (getiterfunc)path_iter,   		/* tp_iter */
   0,					/* tp_iternext */
-  0,			        	/* tp_methods */
+  path_methods,				/* tp_methods */
   0,					/* tp_members */
   0,					/* tp_getset */
   0,                                    /* tp_base */
@@ -73,6 +73,11 @@ PycairoPattern_FromPattern (cairo_pattern_t *pattern, PyObject *base) {
     break;
   }
 
+  if (_Pycairo_Lazy_Type_Ready (type) < 0) {
+    cairo_pattern_destroy (pattern);
+    return NULL;
+  }
+
   o = type->tp_alloc(type, 0);
   if (o == NULL) {
     cairo_pattern_destroy (pattern);
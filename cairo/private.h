@@ -38,6 +38,7 @@
 
 #define _INSIDE_PYCAIRO_
 #include <Python.h>
+#include <pythread.h>
 
 #include "pycairo.h"
 #include "compat.h"
@@ -55,7 +56,11 @@ int _PyTextCluster_AsTextCluster (PyObject *pyobj,
 
 int _conv_pyobject_to_ulong (PyObject *pyobj, unsigned long *result);
 
+double *_Pycairo_AsDoubleArray (PyObject *obj, const char *name, int cols_a,
+                                int cols_b, Py_ssize_t *n_rows, int *n_cols);
+
 PyObject *_Pycairo_Get_Error(void);
+int _Pycairo_Lazy_Type_Ready (PyTypeObject *type);
 
 PyObject* Pycairo_richcompare (void* a, void *b, int op);
 PyObject* Pycairo_tuple_getattro (PyObject *self, char **kwds, PyObject *name);
@@ -63,6 +68,10 @@ PyObject* Pycairo_tuple_getattro (PyObject *self, char **kwds, PyObject *name);
 extern PyTypeObject PycairoContext_Type;
 PyObject *PycairoContext_FromContext (cairo_t *ctx, PyTypeObject *type,
 				      PyObject *base);
+PyObject *_PycairoContext_FromForeignContext (cairo_t *ctx,
+                                              PyTypeObject *type,
+                                              PyObject *base);
+cairo_t *_PycairoContext_Get (PyObject *obj);
 
 extern PyTypeObject PycairoFontFace_Type;
 extern PyTypeObject PycairoToyFontFace_Type;
@@ -77,6 +86,8 @@ PyObject *PycairoMatrix_FromMatrix (const cairo_matrix_t *matrix);
 
 extern PyTypeObject PycairoPath_Type;
 PyObject *PycairoPath_FromPath (cairo_path_t *path);
+PyObject *simplify_polyline (PyObject *self, PyObject *args, PyObject *kwds);
+PyObject *decimate_m4 (PyObject *self, PyObject *args, PyObject *kwds);
 
 extern PyTypeObject PycairoPathiter_Type;
 
@@ -102,6 +113,12 @@ PyObject *PycairoRectangleInt_FromRectangleInt (
 extern PyTypeObject PycairoRegion_Type;
 PyObject *PycairoRegion_FromRegion (cairo_region_t *region);
 
+extern PyTypeObject PycairoHitIndex_Type;
+
+extern PyTypeObject PycairoStyle_Type;
+PyObject *style_capture (cairo_t *ctx);
+void style_apply (PyObject *style, cairo_t *ctx);
+
 extern PyTypeObject PycairoDevice_Type;
 PyObject *PycairoDevice_FromDevice (cairo_device_t *device);
 extern PyTypeObject PycairoScriptDevice_Type;
@@ -145,6 +162,10 @@ extern PyTypeObject PycairoPSSurface_Type;
 
 #if CAIRO_HAS_RECORDING_SURFACE
 extern PyTypeObject PycairoRecordingSurface_Type;
+extern PyTypeObject PycairoIndexedRecordingSurface_Type;
+extern PyTypeObject PycairoRasterCache_Type;
+extern PyTypeObject PycairoTiledSurface_Type;
+extern PyTypeObject PycairoProgressiveRenderer_Type;
 #endif
 
 #if CAIRO_HAS_SVG_SURFACE
@@ -197,6 +218,14 @@ int Pycairo_Check_Status (cairo_status_t status);
     }						   \
   } while (0)
 
+/* For path construction and state setting calls, which leave the check
+ * to the next drawing call if the Context defers errors. */
+#define RETURN_NULL_IF_UNDEFERRED_CONTEXT_ERROR(o)	   \
+  do {							   \
+    if (!(o)->defer_errors)				   \
+      RETURN_NULL_IF_CAIRO_CONTEXT_ERROR ((o)->ctx);	   \
+  } while (0)
+
 #define RETURN_NULL_IF_CAIRO_PATTERN_ERROR(pattern)             \
   do {								\
     cairo_status_t status = cairo_pattern_status (pattern);	\
@@ -259,9 +288,151 @@ int init_buffer_proxy(void);
 PyObject *buffer_proxy_create_view(PyObject *exporter, void *buf,
                                    Py_ssize_t len, int readonly);
 
+PyObject *rectangle_buffer_create_view(cairo_rectangle_list_t *list);
+
+/* cancellation */
+
+/* pseudo statuses for Pycairo_Check_Status(), never passed to cairo */
+#define PYCAIRO_STATUS_CANCELLED ((cairo_status_t)0x10000)
+#define PYCAIRO_STATUS_DEADLINE_EXCEEDED ((cairo_status_t)0x10001)
+
+typedef struct _cancel_state cancel_state_t;
+
+extern PyTypeObject PycairoCancelToken_Type;
+PyObject *cancel_token_acquire (cancel_state_t **state);
+cairo_status_t cancel_token_check_current (void);
+PyObject *surface_file_writer_begin (cairo_surface_t *surface);
+void surface_file_writer_end (cairo_surface_t *surface, PyObject *token);
+cairo_status_t cancel_state_check (cancel_state_t *state);
+cancel_state_t *cancel_state_new (void);
+void cancel_state_free (cancel_state_t *state);
+void cancel_state_cancel (cancel_state_t *state);
+double monotonic_time (void);
+
+int error_add_cancel_types (PyObject *module, PyObject *error);
+
+/* threads */
+
+typedef void (*parallel_job_func_t) (void *data, size_t job);
+
+void parallel_prepare (void);
+int parallel_run (size_t n_jobs, int n_threads, parallel_job_func_t func,
+                  void *data);
+
+/* R-tree */
+
+typedef struct {
+    double x1, y1, x2, y2;
+} pycairo_box_t;
+
+typedef struct _rtree rtree_t;
+
+rtree_t *rtree_new (void);
+void rtree_free (rtree_t *tree);
+void rtree_clear (rtree_t *tree);
+size_t rtree_get_size (rtree_t *tree);
+int rtree_insert (rtree_t *tree, const pycairo_box_t *box, size_t id);
+int rtree_query (rtree_t *tree, const pycairo_box_t *box,
+                 size_t **ids, size_t *n_ids);
+
+/* display lists */
+
+typedef struct _display_list display_list_t;
+
+display_list_t *display_list_attach (cairo_surface_t *surface,
+                                     const cairo_rectangle_t *extents);
+display_list_t *display_list_from_surface (cairo_surface_t *surface);
+void display_list_invalidate (display_list_t *dl);
+size_t display_list_get_size (display_list_t *dl);
+cairo_status_t display_list_replay (display_list_t *dl, cairo_t *cr,
+                                    const pycairo_box_t *viewport, int draft,
+                                    cancel_state_t *cancel,
+                                    size_t *n_replayed);
+cairo_status_t display_list_cull_occluded (display_list_t *dl,
+                                           size_t *n_removed);
+void display_list_acquire (display_list_t *dl);
+void display_list_release (display_list_t *dl);
+int display_list_is_indexable (display_list_t *dl);
+void display_list_discard (display_list_t *dl);
+int display_list_query (display_list_t *dl, const pycairo_box_t *box,
+                        size_t first, size_t **ids, size_t *n_ids);
+cairo_status_t display_list_replay_ids (display_list_t *dl, cairo_t *cr,
+                                        const size_t *ids, size_t n_ids,
+                                        PyThread_type_lock source_lock,
+                                        cancel_state_t *cancel);
+
+display_list_t *display_list_begin (cairo_t *ctx);
+void display_list_end (display_list_t *dl);
+int display_list_capture_paint (display_list_t *dl, cairo_t *ctx,
+                                double alpha);
+int display_list_capture_mask (display_list_t *dl, cairo_t *ctx,
+                               cairo_pattern_t *mask);
+int display_list_capture_fill (display_list_t *dl, cairo_t *ctx);
+int display_list_capture_stroke (display_list_t *dl, cairo_t *ctx);
+int display_list_capture_glyphs (display_list_t *dl, cairo_t *ctx,
+                                 const cairo_glyph_t *glyphs,
+                                 int num_glyphs);
+int display_list_capture_text (display_list_t *dl, cairo_t *ctx,
+                               const char *utf8);
+void display_list_note_source (cairo_t *ctx);
+void display_list_note_save (cairo_t *ctx);
+void display_list_note_restore (cairo_t *ctx);
+
+/* tiled surfaces */
+
+typedef struct _tile_grid tile_grid_t;
+
+tile_grid_t *tile_grid_attach (cairo_surface_t *surface, int width,
+                               int height, int tile_size, int threads);
+tile_grid_t *tile_grid_from_surface (cairo_surface_t *surface);
+void tile_grid_get_layout (tile_grid_t *grid, int *width, int *height,
+                           int *tile_size, int *cols, int *rows);
+cairo_status_t tile_grid_flush (tile_grid_t *grid, cancel_state_t *cancel);
+cairo_status_t tile_grid_get_tile (tile_grid_t *grid, int col, int row,
+                                   cairo_surface_t **tile);
+cairo_status_t tile_grid_write_png (tile_grid_t *grid,
+                                    cairo_write_func_t write_func,
+                                    void *closure, cancel_state_t *cancel);
+
+PyObject *render_tile_pyramid (PyObject *self, PyObject *args,
+                               PyObject *kwds);
+
+/* parallel tee surfaces */
+
+typedef struct _tee_fanout tee_fanout_t;
+
+tee_fanout_t *tee_fanout_attach (cairo_surface_t *tee,
+                                 cairo_surface_t *target);
+tee_fanout_t *tee_fanout_from_surface (cairo_surface_t *surface);
+cairo_status_t tee_fanout_add (tee_fanout_t *fanout, cairo_surface_t *target);
+cairo_status_t tee_fanout_remove (tee_fanout_t *fanout,
+                                  cairo_surface_t *target);
+cairo_surface_t *tee_fanout_get_target (tee_fanout_t *fanout,
+                                        unsigned int index);
+cairo_status_t tee_fanout_flush (tee_fanout_t *fanout);
+void tee_fanout_note_surface (cairo_t *cr);
+void tee_fanout_note_pattern (cairo_t *cr, cairo_pattern_t *pattern);
+int tee_fanout_check_page (cairo_surface_t *surface);
+
 /* int enums */
 
 int init_enums(PyObject *module);
+#ifdef CAIRO_HAS_SVG_SURFACE
+int init_svg_enums(PyObject *module);
+extern const char *const svg_enum_names[];
+#endif
+#ifdef CAIRO_HAS_PDF_SURFACE
+int init_pdf_enums(PyObject *module);
+extern const char *const pdf_enum_names[];
+#endif
+#ifdef CAIRO_HAS_PS_SURFACE
+int init_ps_enums(PyObject *module);
+extern const char *const ps_enum_names[];
+#endif
+#ifdef CAIRO_HAS_SCRIPT_SURFACE
+int init_script_enums(PyObject *module);
+extern const char *const script_enum_names[];
+#endif
 PyObject *int_enum_create(PyTypeObject *type, long value);
 
 #define DECL_ENUM(name) extern PyTypeObject Pycairo_##name##_Type;
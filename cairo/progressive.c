@@ -0,0 +1,426 @@
+/* -*- mode: C; c-basic-offset: 2 -*-
+ *
+ * Pycairo - Python bindings for cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ */
+
+/* Progressive rendering of an IndexedRecordingSurface for interactive
+ * viewers: a quick draft pass in the calling thread, followed by a full
+ * quality pass on a native thread into a private image, which gets
+ * cancelled as soon as the view changes again. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include "config.h"
+#include "private.h"
+
+#ifdef CAIRO_HAS_RECORDING_SURFACE
+
+#ifndef PYTHREAD_INVALID_THREAD_ID
+#define PYTHREAD_INVALID_THREAD_ID (-1)
+#endif
+
+typedef struct {
+  PyObject_HEAD
+  PycairoSurface *recording;
+  PyThread_type_lock done;  /* held while a refinement runs */
+  int running;              /* the fields below are owned by the worker */
+  cairo_surface_t *image;   /* the refinement, NULL if none */
+  cairo_matrix_t matrix;
+  pycairo_box_t viewport;
+  cancel_state_t *cancel;
+  cairo_status_t status;
+  double pass_time;
+  /* results of the last finished passes */
+  int refined;
+  cairo_status_t error;
+  double draft_time;
+  double refine_time;
+} PycairoProgressiveRenderer;
+
+static void
+_progressive_refine (void *data) {
+  PycairoProgressiveRenderer *o = data;
+  display_list_t *dl = display_list_from_surface (o->recording->surface);
+  double start = monotonic_time ();
+  cairo_t *cr;
+
+  cr = cairo_create (o->image);
+  cairo_set_matrix (cr, &o->matrix);
+  o->status = display_list_replay (dl, cr, &o->viewport, 0, o->cancel, NULL);
+  cairo_destroy (cr);
+  o->pass_time = monotonic_time () - start;
+
+  /* o may go away right after this */
+  PyThread_release_lock (o->done);
+}
+
+static void
+_progressive_drop (PycairoProgressiveRenderer *o) {
+  if (o->image != NULL) {
+    cairo_surface_destroy (o->image);
+    o->image = NULL;
+  }
+  o->refined = 0;
+}
+
+/* Called with done acquired once the worker has finished. */
+static void
+_progressive_collect (PycairoProgressiveRenderer *o) {
+  PyThread_release_lock (o->done);
+  o->running = 0;
+  cancel_state_free (o->cancel);
+  o->cancel = NULL;
+
+  if (o->status == CAIRO_STATUS_SUCCESS) {
+    o->refined = 1;
+    o->refine_time = o->pass_time;
+  } else {
+    _progressive_drop (o);
+    if (o->status != PYCAIRO_STATUS_CANCELLED)
+      o->error = o->status;
+  }
+}
+
+/* Returns whether a refinement is still running. */
+static int
+_progressive_poll (PycairoProgressiveRenderer *o) {
+  if (o->running && PyThread_acquire_lock (o->done, NOWAIT_LOCK))
+    _progressive_collect (o);
+  return o->running;
+}
+
+/* Waits for the running refinement, if any, after cancelling it if cancel
+ * is set. Needs the GIL, which gets released while waiting. */
+static void
+_progressive_join (PycairoProgressiveRenderer *o, int cancel) {
+  if (!o->running)
+    return;
+
+  if (cancel)
+    cancel_state_cancel (o->cancel);
+  Py_BEGIN_ALLOW_THREADS;
+  PyThread_acquire_lock (o->done, WAIT_LOCK);
+  Py_END_ALLOW_THREADS;
+  _progressive_collect (o);
+}
+
+static void
+progressive_renderer_dealloc (PycairoProgressiveRenderer *o) {
+  _progressive_join (o, 1);
+  _progressive_drop (o);
+  if (o->done != NULL) {
+    PyThread_free_lock (o->done);
+    o->done = NULL;
+  }
+  Py_CLEAR (o->recording);
+
+  Py_TYPE(o)->tp_free(o);
+}
+
+static PyObject *
+progressive_renderer_new (PyTypeObject *type, PyObject *args,
+                          PyObject *kwds) {
+  static char *kwlist[] = {"recording", NULL};
+  PycairoProgressiveRenderer *o;
+  PyObject *recording;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds,
+      "O!:ProgressiveRenderer.__new__", kwlist,
+      &PycairoIndexedRecordingSurface_Type, &recording))
+    return NULL;
+
+  o = (PycairoProgressiveRenderer *)type->tp_alloc (type, 0);
+  if (o == NULL)
+    return NULL;
+
+  o->done = PyThread_allocate_lock ();
+  if (o->done == NULL) {
+    Py_DECREF (o);
+    return PyErr_NoMemory ();
+  }
+  Py_INCREF (recording);
+  o->recording = (PycairoSurface *)recording;
+  o->error = CAIRO_STATUS_SUCCESS;
+
+  return (PyObject *)o;
+}
+
+static PyObject *
+progressive_renderer_cancel (PycairoProgressiveRenderer *o) {
+  _progressive_join (o, 1);
+  _progressive_drop (o);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+progressive_renderer_draft (PycairoProgressiveRenderer *o, PyObject *args,
+                            PyObject *kwds) {
+  static char *kwlist[] = {"target", "viewport", NULL};
+  PyObject *target, *viewport = Py_None, *res;
+  double start;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds,
+      "O|O:ProgressiveRenderer.draft", kwlist, &target, &viewport))
+    return NULL;
+
+  /* the view changed, the refinement in progress is useless now */
+  _progressive_join (o, 1);
+  _progressive_drop (o);
+
+  start = monotonic_time ();
+  res = PyObject_CallMethod ((PyObject *)o->recording, "replay", "(OOO)",
+                             target, viewport, Py_True);
+  if (res == NULL)
+    return NULL;
+  Py_DECREF (res);
+  o->draft_time = monotonic_time () - start;
+
+  return PyFloat_FromDouble (o->draft_time);
+}
+
+static PyObject *
+progressive_renderer_refine (PycairoProgressiveRenderer *o, PyObject *args,
+                             PyObject *kwds) {
+  static char *kwlist[] = {"target", "viewport", NULL};
+  PyObject *target, *viewport_obj = Py_None;
+  cairo_surface_t *surface;
+  cairo_matrix_t inverse, device;
+  cairo_status_t status;
+  int width, height, i;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds,
+      "O|O:ProgressiveRenderer.refine", kwlist, &target, &viewport_obj))
+    return NULL;
+
+  _progressive_join (o, 1);
+  _progressive_drop (o);
+
+  if (PyObject_TypeCheck (target, &PycairoContext_Type)) {
+    cairo_t *ctx = ((PycairoContext *)target)->ctx;
+    surface = cairo_get_target (ctx);
+    cairo_get_matrix (ctx, &o->matrix);
+  } else if (PyObject_TypeCheck (target, &PycairoSurface_Type)) {
+    surface = ((PycairoSurface *)target)->surface;
+    cairo_matrix_init_identity (&o->matrix);
+  } else {
+    PyErr_SetString (PyExc_TypeError,
+		     "target must be a cairo.Context or a cairo.Surface");
+    return NULL;
+  }
+  if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE) {
+    PyErr_SetString (PyExc_TypeError, "target must draw onto an ImageSurface");
+    return NULL;
+  }
+
+  /* the image has the pixels of the target, without its device transform */
+  cairo_matrix_init_identity (&device);
+  cairo_surface_get_device_scale (surface, &device.xx, &device.yy);
+  cairo_surface_get_device_offset (surface, &device.x0, &device.y0);
+  cairo_matrix_multiply (&o->matrix, &o->matrix, &device);
+
+  width = cairo_image_surface_get_width (surface);
+  height = cairo_image_surface_get_height (surface);
+
+  if (viewport_obj != Py_None) {
+    double x, y, w, h;
+    if (!PyArg_ParseTuple (viewport_obj, "dddd", &x, &y, &w, &h)) {
+      PyErr_SetString (PyExc_TypeError,
+		       "viewport must be a 4-tuple of float or None");
+      return NULL;
+    }
+    o->viewport.x1 = x;
+    o->viewport.y1 = y;
+    o->viewport.x2 = x + w;
+    o->viewport.y2 = y + h;
+  } else {
+    /* what is visible in the image, so only that gets replayed */
+    inverse = o->matrix;
+    status = cairo_matrix_invert (&inverse);
+    RETURN_NULL_IF_CAIRO_ERROR (status);
+    for (i = 0; i < 4; i++) {
+      double x = i & 1 ? width : 0, y = i & 2 ? height : 0;
+      cairo_matrix_transform_point (&inverse, &x, &y);
+      if (i == 0 || x < o->viewport.x1)
+        o->viewport.x1 = x;
+      if (i == 0 || y < o->viewport.y1)
+        o->viewport.y1 = y;
+      if (i == 0 || x > o->viewport.x2)
+        o->viewport.x2 = x;
+      if (i == 0 || y > o->viewport.y2)
+        o->viewport.y2 = y;
+    }
+  }
+
+  o->image = cairo_image_surface_create (
+    cairo_image_surface_get_format (surface), width, height);
+  status = cairo_surface_status (o->image);
+  if (status != CAIRO_STATUS_SUCCESS) {
+    _progressive_drop (o);
+    Pycairo_Check_Status (status);
+    return NULL;
+  }
+
+  o->cancel = cancel_state_new ();
+  if (o->cancel == NULL) {
+    _progressive_drop (o);
+    return PyErr_NoMemory ();
+  }
+
+  parallel_prepare ();
+  PyThread_acquire_lock (o->done, WAIT_LOCK);
+  if (PyThread_start_new_thread (_progressive_refine, o) ==
+      PYTHREAD_INVALID_THREAD_ID) {
+    PyThread_release_lock (o->done);
+    cancel_state_free (o->cancel);
+    o->cancel = NULL;
+    _progressive_drop (o);
+    PyErr_SetString (PyExc_RuntimeError, "can't start new thread");
+    return NULL;
+  }
+  o->running = 1;
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+progressive_renderer_get_refined (PycairoProgressiveRenderer *o,
+                                  PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"wait", NULL};
+  PyObject *wait_obj = Py_False;
+  cairo_status_t status;
+  int wait;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds,
+      "|O:ProgressiveRenderer.get_refined", kwlist, &wait_obj))
+    return NULL;
+
+  wait = PyObject_IsTrue (wait_obj);
+  if (wait < 0)
+    return NULL;
+
+  if (wait)
+    _progressive_join (o, 0);
+  else if (_progressive_poll (o))
+    Py_RETURN_NONE;
+
+  if (o->error != CAIRO_STATUS_SUCCESS) {
+    status = o->error;
+    o->error = CAIRO_STATUS_SUCCESS;
+    Pycairo_Check_Status (status);
+    return NULL;
+  }
+
+  if (!o->refined)
+    Py_RETURN_NONE;
+
+  return PycairoSurface_FromSurface (cairo_surface_reference (o->image),
+                                     NULL);
+}
+
+static PyObject *
+progressive_renderer_get_refining (PycairoProgressiveRenderer *o,
+                                   void *closure) {
+  return PyBool_FromLong (_progressive_poll (o));
+}
+
+static PyObject *
+progressive_renderer_get_draft_time (PycairoProgressiveRenderer *o,
+                                     void *closure) {
+  return PyFloat_FromDouble (o->draft_time);
+}
+
+static PyObject *
+progressive_renderer_get_refine_time (PycairoProgressiveRenderer *o,
+                                      void *closure) {
+  _progressive_poll (o);
+  return PyFloat_FromDouble (o->refine_time);
+}
+
+static PyGetSetDef progressive_renderer_getset[] = {
+  {"draft_time",  (getter)progressive_renderer_get_draft_time},
+  {"refine_time", (getter)progressive_renderer_get_refine_time},
+  {"refining",    (getter)progressive_renderer_get_refining},
+  {NULL,},
+};
+
+static PyMethodDef progressive_renderer_methods[] = {
+  {"cancel",      (PyCFunction)progressive_renderer_cancel,      METH_NOARGS},
+  {"draft",       (PyCFunction)progressive_renderer_draft,
+   METH_VARARGS | METH_KEYWORDS},
+  {"get_refined", (PyCFunction)progressive_renderer_get_refined,
+   METH_VARARGS | METH_KEYWORDS},
+  {"refine",      (PyCFunction)progressive_renderer_refine,
+   METH_VARARGS | METH_KEYWORDS},
+  {NULL, NULL, 0, NULL},
+};
+
+PyTypeObject PycairoProgressiveRenderer_Type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "cairo.ProgressiveRenderer",        /* tp_name */
+  sizeof(PycairoProgressiveRenderer), /* tp_basicsize */
+  0,                                  /* tp_itemsize */
+  (destructor)progressive_renderer_dealloc, /* tp_dealloc */
+  0,                                  /* tp_print */
+  0,                                  /* tp_getattr */
+  0,                                  /* tp_setattr */
+  0,                                  /* tp_compare */
+  0,                                  /* tp_repr */
+  0,                                  /* tp_as_number */
+  0,                                  /* tp_as_sequence */
+  0,                                  /* tp_as_mapping */
+  0,                                  /* tp_hash */
+  0,                                  /* tp_call */
+  0,                                  /* tp_str */
+  0,                                  /* tp_getattro */
+  0,                                  /* tp_setattro */
+  0,                                  /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+  0,                                  /* tp_doc */
+  0,                                  /* tp_traverse */
+  0,                                  /* tp_clear */
+  0,                                  /* tp_richcompare */
+  0,                                  /* tp_weaklistoffset */
+  0,                                  /* tp_iter */
+  0,                                  /* tp_iternext */
+  progressive_renderer_methods,       /* tp_methods */
+  0,                                  /* tp_members */
+  progressive_renderer_getset,        /* tp_getset */
+  0,                                  /* tp_base */
+  0,                                  /* tp_dict */
+  0,                                  /* tp_descr_get */
+  0,                                  /* tp_descr_set */
+  0,                                  /* tp_dictoffset */
+  0,                                  /* tp_init */
+  0,                                  /* tp_alloc */
+  (newfunc)progressive_renderer_new,  /* tp_new */
+  0,                                  /* tp_free */
+  0,                                  /* tp_is_gc */
+  0,                                  /* tp_bases */
+};
+
+#endif  /* CAIRO_HAS_RECORDING_SURFACE */
@@ -41,6 +41,9 @@ typedef struct {
   PyObject_HEAD
   cairo_t *ctx;
   PyObject *base; /* base object used to create context, or NULL */
+  /* private, primitive calls skip the status check. Added in 1.16, C
+   * subclasses embedding this struct need a rebuild. */
+  int defer_errors;
 } PycairoContext;
 
 typedef struct {
@@ -108,8 +111,11 @@ typedef struct {
 #define PycairoXCBSurface           PycairoSurface
 #define PycairoXlibSurface          PycairoSurface
 
-/* get C object out of the Python wrapper */
+/* get C object out of the Python wrapper, see Context_Get below for
+ * modules using the C API */
+#ifdef _INSIDE_PYCAIRO_
 #define PycairoContext_GET(obj)    (((PycairoContext *)(obj))->ctx)
+#endif
 
 /* Define structure for C API. */
 typedef struct {
@@ -161,6 +167,9 @@ typedef struct {
   PyObject *(*Region_FromRegion)(cairo_region_t *region);
 
   PyTypeObject *RecordingSurface_Type;
+
+  /* added in 1.16, keep new entries at the end */
+  cairo_t *(*Context_Get)(PyObject *obj);
 } Pycairo_CAPI_t;
 
 
@@ -169,6 +178,7 @@ typedef struct {
 /* Macros for accessing the C API */
 #define PycairoContext_Type         *(Pycairo_CAPI->Context_Type)
 #define PycairoContext_FromContext   (Pycairo_CAPI->Context_FromContext)
+#define PycairoContext_GET(obj)      (Pycairo_CAPI->Context_Get ((PyObject *)(obj)))
 #define PycairoFontFace_Type        *(Pycairo_CAPI->FontFace_Type)
 #define PycairoToyFontFace_Type     *(Pycairo_CAPI->ToyFontFace_Type)
 #define PycairoFontFace_FromFontFace (Pycairo_CAPI->FontFace_FromFontFace)
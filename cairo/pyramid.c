@@ -0,0 +1,423 @@
+/* -*- mode: C; c-basic-offset: 2 -*-
+ *
+ * Pycairo - Python bindings for cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ */
+
+/* Renders a recording as z/x/y web map tiles.
+ *
+ * At zoom level z the square enclosing the recording is split into 2^z by
+ * 2^z tiles. Only tiles intersecting the ink extents get rendered, in
+ * batches which are rasterized and PNG encoded on a thread pool and then
+ * passed to the Python writer from the calling thread.
+ *
+ * Recordings with a display list replay only the commands intersecting
+ * each tile and can be rasterized in parallel. Replaying a plain recording
+ * isn't thread safe, so for those only the encoding runs in parallel.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "private.h"
+
+#if defined(CAIRO_HAS_RECORDING_SURFACE) && defined(CAIRO_HAS_PNG_FUNCTIONS)
+
+#define PYRAMID_BATCH_SIZE 256
+#define PYRAMID_MAX_ZOOM 30
+
+typedef struct {
+  int z, x, y;
+  size_t *ids;
+  size_t n_ids;
+  unsigned char *png; /* NULL for empty tiles */
+  size_t png_length;
+  size_t png_size;
+  cairo_status_t status;
+} pyramid_tile_t;
+
+typedef struct {
+  cairo_surface_t *recording;
+  display_list_t *dl; /* NULL or not indexable: replay the recording */
+  int indexed;
+  double x0, y0, side;
+  int tile_size;
+  pyramid_tile_t tiles[PYRAMID_BATCH_SIZE];
+  int n_tiles;
+  PyThread_type_lock replay_lock;
+  cancel_state_t *cancel;
+} pyramid_t;
+
+static double
+_pyramid_get_scale (pyramid_t *pyr, int z) {
+  return pyr->tile_size * ldexp (1.0, z) / pyr->side;
+}
+
+static cairo_status_t
+_pyramid_write_func (void *closure, const unsigned char *data,
+                     unsigned int length) {
+  pyramid_tile_t *tile = closure;
+
+  if (tile->png_length + length > tile->png_size) {
+    size_t size = tile->png_size ? tile->png_size : 4096;
+    unsigned char *png;
+
+    while (size < tile->png_length + length)
+      size *= 2;
+    png = realloc (tile->png, size);
+    if (png == NULL)
+      return CAIRO_STATUS_NO_MEMORY;
+    tile->png = png;
+    tile->png_size = size;
+  }
+
+  memcpy (tile->png + tile->png_length, data, length);
+  tile->png_length += length;
+  return CAIRO_STATUS_SUCCESS;
+}
+
+static int
+_image_is_clear (cairo_surface_t *image) {
+  unsigned char *data = cairo_image_surface_get_data (image);
+  int stride = cairo_image_surface_get_stride (image);
+  int width = cairo_image_surface_get_width (image);
+  int height = cairo_image_surface_get_height (image);
+  int x, y;
+
+  for (y = 0; y < height; y++) {
+    const uint32_t *row = (const uint32_t *)(data + (size_t)y * stride);
+    for (x = 0; x < width; x++) {
+      if (row[x] != 0)
+        return 0;
+    }
+  }
+  return 1;
+}
+
+static void
+_pyramid_render_job (void *data, size_t job) {
+  pyramid_t *pyr = data;
+  pyramid_tile_t *tile = &pyr->tiles[job];
+  double scale = _pyramid_get_scale (pyr, tile->z);
+  cairo_surface_t *image;
+  cairo_t *cr;
+
+  tile->status = cancel_state_check (pyr->cancel);
+  if (tile->status != CAIRO_STATUS_SUCCESS)
+    return;
+
+  image = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                      pyr->tile_size, pyr->tile_size);
+  cr = cairo_create (image);
+  cairo_translate (cr, -(double)tile->x * pyr->tile_size,
+                   -(double)tile->y * pyr->tile_size);
+  cairo_scale (cr, scale, scale);
+  cairo_translate (cr, -pyr->x0, -pyr->y0);
+
+  if (pyr->indexed) {
+    tile->status = display_list_replay_ids (pyr->dl, cr, tile->ids,
+                                            tile->n_ids, pyr->replay_lock,
+                                            pyr->cancel);
+  } else {
+    PyThread_acquire_lock (pyr->replay_lock, WAIT_LOCK);
+    cairo_set_source_surface (cr, pyr->recording, 0, 0);
+    cairo_paint (cr);
+    PyThread_release_lock (pyr->replay_lock);
+    tile->status = cairo_status (cr);
+  }
+  cairo_destroy (cr);
+
+  if (tile->status == CAIRO_STATUS_SUCCESS) {
+    cairo_surface_flush (image);
+    if (!_image_is_clear (image))
+      tile->status = cairo_surface_write_to_png_stream (
+        image, _pyramid_write_func, tile);
+  }
+  cairo_surface_destroy (image);
+}
+
+/* Finds the commands for each tile of the batch, drops tiles without any.
+ * Needs the display list to be acquired. */
+static cairo_status_t
+_pyramid_query (pyramid_t *pyr) {
+  int i, j;
+
+  for (i = j = 0; i < pyr->n_tiles; i++) {
+    pyramid_tile_t *tile = &pyr->tiles[i];
+    double size = pyr->tile_size / _pyramid_get_scale (pyr, tile->z);
+    pycairo_box_t box;
+
+    box.x1 = pyr->x0 + tile->x * size;
+    box.y1 = pyr->y0 + tile->y * size;
+    box.x2 = box.x1 + size;
+    box.y2 = box.y1 + size;
+    if (display_list_query (pyr->dl, &box, 0, &tile->ids, &tile->n_ids) < 0)
+      return CAIRO_STATUS_NO_MEMORY;
+    if (tile->n_ids == 0) {
+      free (tile->ids);
+      tile->ids = NULL;
+      continue;
+    }
+    if (i != j) {
+      pyr->tiles[j] = *tile;
+      tile->ids = NULL;
+    }
+    j++;
+  }
+  pyr->n_tiles = j;
+  return CAIRO_STATUS_SUCCESS;
+}
+
+/* Renders the current batch and passes the results to writer. Returns -1
+ * with an exception set on error. */
+static int
+_pyramid_run_batch (pyramid_t *pyr, int threads, PyObject *writer,
+                    long *n_written) {
+  cairo_status_t status = CAIRO_STATUS_SUCCESS;
+  int i, ret = 0;
+
+  for (i = 0; i < pyr->n_tiles; i++) {
+    pyr->tiles[i].ids = NULL;
+    pyr->tiles[i].n_ids = 0;
+    pyr->tiles[i].png = NULL;
+    pyr->tiles[i].png_length = pyr->tiles[i].png_size = 0;
+    pyr->tiles[i].status = CAIRO_STATUS_SUCCESS;
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  if (pyr->dl != NULL) {
+    display_list_acquire (pyr->dl);
+    pyr->indexed = display_list_is_indexable (pyr->dl);
+    if (pyr->indexed)
+      status = _pyramid_query (pyr);
+  }
+  if (status == CAIRO_STATUS_SUCCESS &&
+      parallel_run ((size_t)pyr->n_tiles, threads, _pyramid_render_job,
+                    pyr) < 0)
+    status = CAIRO_STATUS_NO_MEMORY;
+  if (pyr->dl != NULL)
+    display_list_release (pyr->dl);
+  Py_END_ALLOW_THREADS;
+
+  for (i = 0; i < pyr->n_tiles && status == CAIRO_STATUS_SUCCESS; i++)
+    status = pyr->tiles[i].status;
+  if (Pycairo_Check_Status (status))
+    ret = -1;
+
+  for (i = 0; i < pyr->n_tiles; i++) {
+    pyramid_tile_t *tile = &pyr->tiles[i];
+
+    if (ret == 0 && tile->png != NULL) {
+      PyObject *res = PyObject_CallFunction (
+        writer, "(iii" PYCAIRO_DATA_FORMAT "#)", tile->z, tile->x, tile->y,
+        tile->png, (Py_ssize_t)tile->png_length);
+      if (res == NULL)
+        ret = -1;
+      else
+        (*n_written)++;
+      Py_XDECREF (res);
+    }
+    free (tile->ids);
+    free (tile->png);
+  }
+
+  pyr->n_tiles = 0;
+  return ret;
+}
+
+static int
+_pyramid_get_zooms (PyObject *zoom_range, int **zooms, Py_ssize_t *n_zooms) {
+  PyObject *seq;
+  Py_ssize_t i;
+
+  seq = PySequence_Fast (zoom_range, "zoom_range must be an iterable of int");
+  if (seq == NULL)
+    return -1;
+
+  *n_zooms = PySequence_Fast_GET_SIZE (seq);
+  *zooms = PyMem_Malloc (sizeof (int) * (*n_zooms > 0 ? *n_zooms : 1));
+  if (*zooms == NULL) {
+    Py_DECREF (seq);
+    PyErr_NoMemory ();
+    return -1;
+  }
+
+  for (i = 0; i < *n_zooms; i++) {
+    long z = PYCAIRO_PyLong_AsLong (PySequence_Fast_GET_ITEM (seq, i));
+    if (PyErr_Occurred ())
+      goto error;
+    if (z < 0 || z > PYRAMID_MAX_ZOOM) {
+      PyErr_Format (PyExc_ValueError,
+                    "zoom levels must be in the range 0..%d",
+                    PYRAMID_MAX_ZOOM);
+      goto error;
+    }
+    (*zooms)[i] = (int)z;
+  }
+
+  Py_DECREF (seq);
+  return 0;
+
+error:
+  PyMem_Free (*zooms);
+  Py_DECREF (seq);
+  return -1;
+}
+
+PyObject *
+render_tile_pyramid (PyObject *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"recording", "zoom_range", "tile_size", "writer",
+                           "threads", NULL};
+  PycairoSurface *recording;
+  PyObject *zoom_range, *writer;
+  int tile_size, threads = 1, *zooms;
+  Py_ssize_t n_zooms, i;
+  double ink_x, ink_y, ink_width, ink_height;
+  cairo_rectangle_t extents;
+  pyramid_t *pyr;
+  PyObject *token;
+  long n_written = 0;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds,
+      "O!OiO|i:render_tile_pyramid", kwlist,
+      &PycairoRecordingSurface_Type, &recording, &zoom_range, &tile_size,
+      &writer, &threads))
+    return NULL;
+
+  if (tile_size <= 0 || tile_size > 32767) {
+    PyErr_SetString (PyExc_ValueError,
+                     "tile_size must be in the range 1..32767");
+    return NULL;
+  }
+  if (threads <= 0) {
+    PyErr_SetString (PyExc_ValueError, "threads must be positive");
+    return NULL;
+  }
+  if (!PyCallable_Check (writer)) {
+    PyErr_SetString (PyExc_TypeError, "writer must be callable");
+    return NULL;
+  }
+
+  if (_pyramid_get_zooms (zoom_range, &zooms, &n_zooms) < 0)
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS;
+  cairo_recording_surface_ink_extents (recording->surface, &ink_x, &ink_y,
+                                       &ink_width, &ink_height);
+  Py_END_ALLOW_THREADS;
+
+  if (!cairo_recording_surface_get_extents (recording->surface, &extents)) {
+    extents.x = ink_x;
+    extents.y = ink_y;
+    extents.width = ink_width;
+    extents.height = ink_height;
+  }
+
+  if (ink_width <= 0 || ink_height <= 0 ||
+      extents.width <= 0 || extents.height <= 0) {
+    PyMem_Free (zooms);
+    return PYCAIRO_PyLong_FromLong (0);
+  }
+
+  pyr = PyMem_Malloc (sizeof (pyramid_t));
+  if (pyr == NULL) {
+    PyMem_Free (zooms);
+    return PyErr_NoMemory ();
+  }
+  pyr->recording = recording->surface;
+  pyr->dl = display_list_from_surface (recording->surface);
+  pyr->indexed = 0;
+  pyr->x0 = extents.x;
+  pyr->y0 = extents.y;
+  pyr->side = extents.width > extents.height ? extents.width :
+    extents.height;
+  pyr->tile_size = tile_size;
+  pyr->n_tiles = 0;
+  pyr->replay_lock = PyThread_allocate_lock ();
+  if (pyr->replay_lock == NULL) {
+    PyMem_Free (pyr);
+    PyMem_Free (zooms);
+    return PyErr_NoMemory ();
+  }
+
+  parallel_prepare ();
+  token = cancel_token_acquire (&pyr->cancel);
+
+  for (i = 0; i < n_zooms; i++) {
+    int z = zooms[i];
+    double scale = _pyramid_get_scale (pyr, z) / tile_size;
+    double n = ldexp (1.0, z);
+    double x1 = floor ((ink_x - pyr->x0) * scale);
+    double y1 = floor ((ink_y - pyr->y0) * scale);
+    double x2 = ceil ((ink_x + ink_width - pyr->x0) * scale);
+    double y2 = ceil ((ink_y + ink_height - pyr->y0) * scale);
+    double x, y;
+
+    /* tiles [x1, x2) x [y1, y2) within [0, n) */
+    x1 = x1 < 0 ? 0 : x1;
+    y1 = y1 < 0 ? 0 : y1;
+    x2 = x2 > n ? n : x2;
+    y2 = y2 > n ? n : y2;
+
+    for (y = y1; y < y2; y++) {
+      for (x = x1; x < x2; x++) {
+        pyramid_tile_t *tile = &pyr->tiles[pyr->n_tiles++];
+
+        tile->z = z;
+        tile->x = (int)x;
+        tile->y = (int)y;
+        if (pyr->n_tiles == PYRAMID_BATCH_SIZE &&
+            _pyramid_run_batch (pyr, threads, writer, &n_written) < 0)
+          goto error;
+      }
+    }
+  }
+
+  if (pyr->n_tiles > 0 &&
+      _pyramid_run_batch (pyr, threads, writer, &n_written) < 0)
+    goto error;
+
+  Py_XDECREF (token);
+  PyThread_free_lock (pyr->replay_lock);
+  PyMem_Free (pyr);
+  PyMem_Free (zooms);
+  return PYCAIRO_PyLong_FromLong (n_written);
+
+error:
+  Py_XDECREF (token);
+  PyThread_free_lock (pyr->replay_lock);
+  PyMem_Free (pyr);
+  PyMem_Free (zooms);
+  return NULL;
+}
+
+#endif  /* CAIRO_HAS_RECORDING_SURFACE && CAIRO_HAS_PNG_FUNCTIONS */
@@ -0,0 +1,494 @@
+/* -*- mode: C; c-basic-offset: 2 -*-
+ *
+ * Pycairo - Python bindings for cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "structmember.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "private.h"
+
+#ifdef CAIRO_HAS_RECORDING_SURFACE
+
+/* subpixel offsets get rounded to multiples of 1/RASTER_CACHE_SUBPIXEL */
+#define RASTER_CACHE_SUBPIXEL 4
+#define RASTER_CACHE_DEFAULT_MAX_SIZE (64 * 1024 * 1024)
+
+typedef struct _raster_cache_entry raster_cache_entry_t;
+
+struct _raster_cache_entry {
+  raster_cache_entry_t *prev, *next;
+  PyObject *key;
+  cairo_surface_t *recording;
+  cairo_surface_t *image;
+  Py_ssize_t size;
+};
+
+typedef struct {
+  PyObject_HEAD
+  PyObject *entries; /* key -> capsule of raster_cache_entry_t */
+  raster_cache_entry_t *head, *tail; /* most to least recently used */
+  Py_ssize_t size;
+  Py_ssize_t max_size;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+} PycairoRasterCache;
+
+static const cairo_user_data_key_t raster_cache_ink_key;
+
+static void
+_entry_unlink (PycairoRasterCache *o, raster_cache_entry_t *entry) {
+  if (entry->prev != NULL)
+    entry->prev->next = entry->next;
+  else
+    o->head = entry->next;
+  if (entry->next != NULL)
+    entry->next->prev = entry->prev;
+  else
+    o->tail = entry->prev;
+  entry->prev = entry->next = NULL;
+}
+
+static void
+_entry_push_front (PycairoRasterCache *o, raster_cache_entry_t *entry) {
+  entry->prev = NULL;
+  entry->next = o->head;
+  if (o->head != NULL)
+    o->head->prev = entry;
+  o->head = entry;
+  if (o->tail == NULL)
+    o->tail = entry;
+}
+
+/* Unlinks and frees entry, the caller has to remove it from the dict */
+static void
+_entry_free (PycairoRasterCache *o, raster_cache_entry_t *entry) {
+  _entry_unlink (o, entry);
+  o->size -= entry->size;
+  Py_DECREF (entry->key);
+  cairo_surface_destroy (entry->recording);
+  cairo_surface_destroy (entry->image);
+  PyMem_Free (entry);
+}
+
+static int
+_entry_remove (PycairoRasterCache *o, raster_cache_entry_t *entry) {
+  PyObject *key = entry->key;
+  int res;
+
+  Py_INCREF (key);
+  _entry_free (o, entry);
+  res = PyDict_DelItem (o->entries, key);
+  Py_DECREF (key);
+  return res;
+}
+
+static void
+raster_cache_clear_entries (PycairoRasterCache *o) {
+  while (o->head != NULL)
+    _entry_free (o, o->head);
+  if (o->entries != NULL)
+    PyDict_Clear (o->entries);
+}
+
+static void
+raster_cache_dealloc (PycairoRasterCache *o) {
+  raster_cache_clear_entries (o);
+  Py_CLEAR (o->entries);
+
+  Py_TYPE(o)->tp_free(o);
+}
+
+static PyObject *
+raster_cache_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"max_size", NULL};
+  Py_ssize_t max_size = RASTER_CACHE_DEFAULT_MAX_SIZE;
+  PycairoRasterCache *o;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "|n:RasterCache.__new__",
+				    kwlist, &max_size))
+    return NULL;
+
+  if (max_size < 0) {
+    PyErr_SetString (PyExc_ValueError, "max_size must not be negative");
+    return NULL;
+  }
+
+  o = (PycairoRasterCache *)type->tp_alloc (type, 0);
+  if (o == NULL)
+    return NULL;
+
+  o->entries = PyDict_New ();
+  if (o->entries == NULL) {
+    Py_DECREF (o);
+    return NULL;
+  }
+  o->max_size = max_size;
+
+  return (PyObject *)o;
+}
+
+/* Gets the area of the recording to rasterize: the clip if given, otherwise
+ * the extents of a bounded recording or the (remembered) ink extents. */
+static int
+_get_recording_area (cairo_surface_t *recording, PyObject *clip,
+                     cairo_rectangle_t *area) {
+  cairo_rectangle_t *ink;
+  cairo_status_t status;
+
+  if (clip != Py_None) {
+    if (!PyArg_ParseTuple (clip, "dddd", &area->x, &area->y,
+			   &area->width, &area->height)) {
+      PyErr_SetString (PyExc_TypeError,
+		       "clip must be a 4-tuple of float or None");
+      return -1;
+    }
+    return 0;
+  }
+
+  if (cairo_recording_surface_get_extents (recording, area))
+    return 0;
+
+  ink = cairo_surface_get_user_data (recording, &raster_cache_ink_key);
+  if (ink == NULL) {
+    ink = malloc (sizeof (cairo_rectangle_t));
+    if (ink == NULL) {
+      PyErr_NoMemory ();
+      return -1;
+    }
+    Py_BEGIN_ALLOW_THREADS;
+    cairo_recording_surface_ink_extents (recording, &ink->x, &ink->y,
+					 &ink->width, &ink->height);
+    Py_END_ALLOW_THREADS;
+    status = cairo_surface_set_user_data (recording, &raster_cache_ink_key,
+					  ink, free);
+    if (status != CAIRO_STATUS_SUCCESS) {
+      free (ink);
+      Pycairo_Check_Status (status);
+      return -1;
+    }
+  }
+
+  *area = *ink;
+  return 0;
+}
+
+static cairo_surface_t *
+_rasterize (cairo_surface_t *recording, const cairo_rectangle_t *area,
+            double sx, double sy, double fx, double fy,
+            int width, int height) {
+  cairo_surface_t *image;
+  cairo_format_t format;
+  cairo_t *cr;
+
+  if (cairo_surface_get_content (recording) == CAIRO_CONTENT_ALPHA)
+    format = CAIRO_FORMAT_A8;
+  else
+    format = CAIRO_FORMAT_ARGB32;
+
+  image = cairo_image_surface_create (format, width, height);
+  cr = cairo_create (image);
+  cairo_translate (cr, fx, fy);
+  cairo_scale (cr, sx, sy);
+  cairo_translate (cr, -area->x, -area->y);
+  cairo_rectangle (cr, area->x, area->y, area->width, area->height);
+  cairo_clip (cr);
+  cairo_set_source_surface (cr, recording, 0, 0);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+  cairo_surface_flush (image);
+
+  return image;
+}
+
+static PyObject *
+raster_cache_set_source (PycairoRasterCache *o, PyObject *args,
+                         PyObject *kwds) {
+  static char *kwlist[] = {"ctx", "recording", "x", "y", "clip", NULL};
+  PycairoContext *ctx;
+  PycairoSurface *recording;
+  double x = 0.0, y = 0.0, dx, dy, fx, fy, width, height;
+  PyObject *clip = Py_None, *key, *capsule;
+  cairo_rectangle_t area;
+  cairo_matrix_t ctm, matrix, device;
+  cairo_surface_t *target;
+  cairo_pattern_t *pattern;
+  cairo_surface_t *image;
+  raster_cache_entry_t *entry;
+  int ix, iy;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds,
+      "O!O!|ddO:RasterCache.set_source", kwlist,
+      &PycairoContext_Type, &ctx, &PycairoRecordingSurface_Type, &recording,
+      &x, &y, &clip))
+    return NULL;
+
+  if (_get_recording_area (recording->surface, clip, &area) < 0)
+    return NULL;
+
+  /* The image has to match the pixels of the target, which for HiDPI
+   * targets differ from device units by the device scale. */
+  target = cairo_get_group_target (ctx->ctx);
+  cairo_matrix_init_identity (&device);
+  cairo_surface_get_device_scale (target, &device.xx, &device.yy);
+  cairo_surface_get_device_offset (target, &device.x0, &device.y0);
+  cairo_get_matrix (ctx->ctx, &ctm);
+  cairo_matrix_multiply (&ctm, &ctm, &device);
+  matrix = ctm;
+  cairo_matrix_translate (&matrix, x, y);
+
+  /* only pure scales and translations map onto the pixel grid */
+  if (matrix.xy != 0 || matrix.yx != 0 || matrix.xx <= 0 || matrix.yy <= 0)
+    goto bypass;
+
+  dx = matrix.x0 + matrix.xx * area.x;
+  dy = matrix.y0 + matrix.yy * area.y;
+  ix = (int)floor (dx);
+  iy = (int)floor (dy);
+  fx = floor ((dx - ix) * RASTER_CACHE_SUBPIXEL + 0.5) / RASTER_CACHE_SUBPIXEL;
+  fy = floor ((dy - iy) * RASTER_CACHE_SUBPIXEL + 0.5) / RASTER_CACHE_SUBPIXEL;
+  if (fx >= 1.0) {
+    ix += 1;
+    fx = 0.0;
+  }
+  if (fy >= 1.0) {
+    iy += 1;
+    fy = 0.0;
+  }
+
+  width = ceil (fx + matrix.xx * area.width);
+  height = ceil (fy + matrix.yy * area.height);
+  if (width <= 0 || height <= 0 || width > 32767 || height > 32767)
+    goto bypass;
+
+  key = Py_BuildValue ("(Nddddddddd)",
+		       PyLong_FromVoidPtr (recording->surface),
+		       matrix.xx, matrix.yy, fx, fy,
+		       area.x, area.y, area.width, area.height,
+		       width, height);
+  if (key == NULL)
+    return NULL;
+
+  capsule = PyDict_GetItem (o->entries, key);
+  if (capsule != NULL) {
+    entry = PyCapsule_GetPointer (capsule, NULL);
+    Py_DECREF (key);
+    o->hits++;
+    _entry_unlink (o, entry);
+    _entry_push_front (o, entry);
+    image = cairo_surface_reference (entry->image);
+  } else {
+    Py_ssize_t size;
+
+    o->misses++;
+    Py_BEGIN_ALLOW_THREADS;
+    image = _rasterize (recording->surface, &area, matrix.xx, matrix.yy,
+			fx, fy, (int)width, (int)height);
+    Py_END_ALLOW_THREADS;
+
+    if (Pycairo_Check_Status (cairo_surface_status (image))) {
+      cairo_surface_destroy (image);
+      Py_DECREF (key);
+      return NULL;
+    }
+
+    size = (Py_ssize_t)cairo_image_surface_get_stride (image) *
+      cairo_image_surface_get_height (image);
+
+    /* another thread might have rasterized the same while we didn't hold
+     * the GIL, keep its entry */
+    capsule = PyDict_GetItem (o->entries, key);
+    if (capsule != NULL) {
+      entry = PyCapsule_GetPointer (capsule, NULL);
+      Py_DECREF (key);
+      _entry_unlink (o, entry);
+      _entry_push_front (o, entry);
+    } else if (size <= o->max_size) {
+      while (o->size + size > o->max_size && o->tail != NULL) {
+        o->evictions++;
+        if (_entry_remove (o, o->tail) < 0) {
+          cairo_surface_destroy (image);
+          Py_DECREF (key);
+          return NULL;
+        }
+      }
+
+      entry = PyMem_Malloc (sizeof (raster_cache_entry_t));
+      if (entry == NULL) {
+        cairo_surface_destroy (image);
+        Py_DECREF (key);
+        return PyErr_NoMemory ();
+      }
+      capsule = PyCapsule_New (entry, NULL, NULL);
+      if (capsule == NULL || PyDict_SetItem (o->entries, key, capsule) < 0) {
+        Py_XDECREF (capsule);
+        PyMem_Free (entry);
+        cairo_surface_destroy (image);
+        Py_DECREF (key);
+        return NULL;
+      }
+      Py_DECREF (capsule);
+
+      entry->key = key;
+      entry->recording = cairo_surface_reference (recording->surface);
+      entry->image = cairo_surface_reference (image);
+      entry->size = size;
+      o->size += size;
+      _entry_push_front (o, entry);
+    } else {
+      Py_DECREF (key);
+    }
+  }
+
+  /* the image is aligned to the device pixel grid */
+  pattern = cairo_pattern_create_for_surface (image);
+  cairo_surface_destroy (image);
+  cairo_matrix_init_translate (&matrix, -ix, -iy);
+  cairo_matrix_multiply (&matrix, &ctm, &matrix);
+  cairo_pattern_set_matrix (pattern, &matrix);
+  cairo_set_source (ctx->ctx, pattern);
+  display_list_note_source (ctx->ctx);
+  cairo_pattern_destroy (pattern);
+  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR (ctx->ctx);
+  Py_RETURN_NONE;
+
+bypass:
+  cairo_set_source_surface (ctx->ctx, recording->surface, x, y);
+  display_list_note_source (ctx->ctx);
+  RETURN_NULL_IF_CAIRO_CONTEXT_ERROR (ctx->ctx);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+raster_cache_invalidate (PycairoRasterCache *o, PyObject *args) {
+  PycairoSurface *recording;
+  raster_cache_entry_t *entry, *next;
+
+  if (!PyArg_ParseTuple (args, "O!:RasterCache.invalidate",
+			 &PycairoRecordingSurface_Type, &recording))
+    return NULL;
+
+  for (entry = o->head; entry != NULL; entry = next) {
+    next = entry->next;
+    if (entry->recording == recording->surface &&
+        _entry_remove (o, entry) < 0)
+      return NULL;
+  }
+
+  cairo_surface_set_user_data (recording->surface, &raster_cache_ink_key,
+			       NULL, NULL);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+raster_cache_clear (PycairoRasterCache *o) {
+  raster_cache_clear_entries (o);
+  Py_RETURN_NONE;
+}
+
+static Py_ssize_t
+raster_cache_length (PycairoRasterCache *o) {
+  return PyDict_Size (o->entries);
+}
+
+static PySequenceMethods raster_cache_as_sequence = {
+  (lenfunc)raster_cache_length,       /* sq_length */
+};
+
+static PyMethodDef raster_cache_methods[] = {
+  {"set_source",  (PyCFunction)raster_cache_set_source,
+   METH_VARARGS | METH_KEYWORDS},
+  {"invalidate",  (PyCFunction)raster_cache_invalidate,  METH_VARARGS},
+  {"clear",       (PyCFunction)raster_cache_clear,       METH_NOARGS},
+  {NULL, NULL, 0, NULL},
+};
+
+static PyMemberDef raster_cache_members[] = {
+  {"max_size", T_PYSSIZET, offsetof (PycairoRasterCache, max_size), READONLY,
+   "the memory budget in bytes"},
+  {"size", T_PYSSIZET, offsetof (PycairoRasterCache, size), READONLY,
+   "the memory used by the cached images in bytes"},
+  {"hits", T_ULONG, offsetof (PycairoRasterCache, hits), READONLY,
+   "the number of lookups served from the cache"},
+  {"misses", T_ULONG, offsetof (PycairoRasterCache, misses), READONLY,
+   "the number of lookups which needed rasterizing"},
+  {"evictions", T_ULONG, offsetof (PycairoRasterCache, evictions), READONLY,
+   "the number of images dropped to stay within the budget"},
+  {NULL}
+};
+
+PyTypeObject PycairoRasterCache_Type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "cairo.RasterCache",                /* tp_name */
+  sizeof(PycairoRasterCache),         /* tp_basicsize */
+  0,                                  /* tp_itemsize */
+  (destructor)raster_cache_dealloc,   /* tp_dealloc */
+  0,                                  /* tp_print */
+  0,                                  /* tp_getattr */
+  0,                                  /* tp_setattr */
+  0,                                  /* tp_compare */
+  0,                                  /* tp_repr */
+  0,                                  /* tp_as_number */
+  &raster_cache_as_sequence,          /* tp_as_sequence */
+  0,                                  /* tp_as_mapping */
+  0,                                  /* tp_hash */
+  0,                                  /* tp_call */
+  0,                                  /* tp_str */
+  0,                                  /* tp_getattro */
+  0,                                  /* tp_setattro */
+  0,                                  /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+  0,                                  /* tp_doc */
+  0,                                  /* tp_traverse */
+  0,                                  /* tp_clear */
+  0,                                  /* tp_richcompare */
+  0,                                  /* tp_weaklistoffset */
+  0,                                  /* tp_iter */
+  0,                                  /* tp_iternext */
+  raster_cache_methods,               /* tp_methods */
+  raster_cache_members,               /* tp_members */
+  0,                                  /* tp_getset */
+  0,                                  /* tp_base */
+  0,                                  /* tp_dict */
+  0,                                  /* tp_descr_get */
+  0,                                  /* tp_descr_set */
+  0,                                  /* tp_dictoffset */
+  0,                                  /* tp_init */
+  0,                                  /* tp_alloc */
+  (newfunc)raster_cache_new,          /* tp_new */
+  0,                                  /* tp_free */
+  0,                                  /* tp_is_gc */
+  0,                                  /* tp_bases */
+};
+
+#endif /* CAIRO_HAS_RECORDING_SURFACE */
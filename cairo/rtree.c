@@ -0,0 +1,324 @@
+/* -*- mode: C; c-basic-offset: 2 -*-
+ *
+ * Pycairo - Python bindings for cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ */
+
+/* A static, packed R-tree over axis aligned boxes.
+ *
+ * Items are appended in any order and identified by a caller chosen id. The
+ * tree itself is (re)built lazily with Sort-Tile-Recursive bulk loading the
+ * first time it gets queried after a modification, which is a good fit for
+ * the record-once, query-often access pattern of the users in pycairo.
+ * Items appended after that are scanned linearly until there are enough of
+ * them to make rebuilding worth it, so interleaving inserts and queries
+ * doesn't rebuild the whole tree each time.
+ *
+ * Only plain C memory functions are used so that queries can run with the
+ * GIL released.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "private.h"
+
+#define RTREE_FANOUT 16
+
+/* the minimum number of items scanned linearly before rebuilding */
+#define RTREE_MIN_PENDING (RTREE_FANOUT * 4)
+
+typedef struct {
+  pycairo_box_t box;
+  size_t index;  /* item id for items, first child for nodes */
+  size_t count;  /* number of children, 0 for items */
+  int leaf;      /* children are items */
+} rtree_entry_t;
+
+struct _rtree {
+  rtree_entry_t *items;
+  size_t n_items;
+  size_t size_items;
+  rtree_entry_t *nodes;
+  size_t n_nodes;
+  size_t n_indexed; /* items covered by nodes, the rest is pending */
+  int dirty;
+};
+
+rtree_t *
+rtree_new (void) {
+  rtree_t *tree = calloc (1, sizeof (rtree_t));
+  return tree;
+}
+
+void
+rtree_clear (rtree_t *tree) {
+  free (tree->items);
+  free (tree->nodes);
+  tree->items = NULL;
+  tree->nodes = NULL;
+  tree->n_items = tree->size_items = tree->n_nodes = tree->n_indexed = 0;
+  tree->dirty = 0;
+}
+
+void
+rtree_free (rtree_t *tree) {
+  if (tree == NULL)
+    return;
+  rtree_clear (tree);
+  free (tree);
+}
+
+size_t
+rtree_get_size (rtree_t *tree) {
+  return tree->n_items;
+}
+
+int
+rtree_insert (rtree_t *tree, const pycairo_box_t *box, size_t id) {
+  rtree_entry_t *entry;
+
+  if (tree->n_items == tree->size_items) {
+    size_t size = tree->size_items ? tree->size_items * 2 : 64;
+    rtree_entry_t *items = realloc (tree->items, size * sizeof (rtree_entry_t));
+    if (items == NULL)
+      return -1;
+    tree->items = items;
+    tree->size_items = size;
+  }
+
+  entry = &tree->items[tree->n_items++];
+  entry->box = *box;
+  entry->index = id;
+  entry->count = 0;
+  entry->leaf = 0;
+  return 0;
+}
+
+/* Rebuilding costs O(n log n), scanning the pending items O(pending) per
+ * query, so allow about sqrt(n) of them. */
+static int
+_rtree_needs_build (rtree_t *tree) {
+  size_t pending = tree->n_items - tree->n_indexed;
+
+  if (tree->dirty)
+    return 1;
+  return pending > RTREE_MIN_PENDING &&
+    pending > 4 * (size_t)sqrt ((double)tree->n_items);
+}
+
+static int
+_compare_center_x (const void *a, const void *b) {
+  const pycairo_box_t *ba = &((const rtree_entry_t *)a)->box;
+  const pycairo_box_t *bb = &((const rtree_entry_t *)b)->box;
+  double ca = ba->x1 + ba->x2, cb = bb->x1 + bb->x2;
+  return (ca > cb) - (ca < cb);
+}
+
+static int
+_compare_center_y (const void *a, const void *b) {
+  const pycairo_box_t *ba = &((const rtree_entry_t *)a)->box;
+  const pycairo_box_t *bb = &((const rtree_entry_t *)b)->box;
+  double ca = ba->y1 + ba->y2, cb = bb->y1 + bb->y2;
+  return (ca > cb) - (ca < cb);
+}
+
+static int
+_compare_size (const void *a, const void *b) {
+  size_t ia = *(const size_t *)a, ib = *(const size_t *)b;
+  return (ia > ib) - (ia < ib);
+}
+
+static void
+_box_union (pycairo_box_t *dst, const pycairo_box_t *src) {
+  if (src->x1 < dst->x1) dst->x1 = src->x1;
+  if (src->y1 < dst->y1) dst->y1 = src->y1;
+  if (src->x2 > dst->x2) dst->x2 = src->x2;
+  if (src->y2 > dst->y2) dst->y2 = src->y2;
+}
+
+static int
+_rtree_build (rtree_t *tree) {
+  size_t n = tree->n_items, total, start, level_start, level_size, i;
+  size_t n_leaves, n_slices, slice_size;
+  rtree_entry_t *nodes;
+  int leaf;
+
+  free (tree->nodes);
+  tree->nodes = NULL;
+  tree->n_nodes = tree->n_indexed = 0;
+  tree->dirty = 0;
+
+  if (n == 0)
+    return 0;
+
+  /* Sort-Tile-Recursive: sort by x, cut into vertical slices and sort each
+   * slice by y, so consecutive runs of RTREE_FANOUT items are compact. */
+  n_leaves = (n + RTREE_FANOUT - 1) / RTREE_FANOUT;
+  n_slices = (size_t)ceil (sqrt ((double)n_leaves));
+  slice_size = n_slices * RTREE_FANOUT;
+  qsort (tree->items, n, sizeof (rtree_entry_t), _compare_center_x);
+  for (start = 0; start < n; start += slice_size) {
+    size_t len = n - start < slice_size ? n - start : slice_size;
+    qsort (tree->items + start, len, sizeof (rtree_entry_t),
+           _compare_center_y);
+  }
+
+  total = 0;
+  for (level_size = n; level_size > 1; ) {
+    level_size = (level_size + RTREE_FANOUT - 1) / RTREE_FANOUT;
+    total += level_size;
+  }
+  if (total == 0)
+    total = 1;
+
+  nodes = malloc (total * sizeof (rtree_entry_t));
+  if (nodes == NULL) {
+    tree->dirty = 1;
+    return -1;
+  }
+
+  leaf = 1;
+  level_start = 0;
+  level_size = n;
+  start = 0;
+  do {
+    rtree_entry_t *children = leaf ? tree->items : nodes + level_start;
+    size_t count = (level_size + RTREE_FANOUT - 1) / RTREE_FANOUT;
+
+    for (i = 0; i < count; i++) {
+      rtree_entry_t *node = &nodes[start + i];
+      size_t first = i * RTREE_FANOUT, j;
+
+      node->index = (leaf ? 0 : level_start) + first;
+      node->count = level_size - first < RTREE_FANOUT ?
+        level_size - first : RTREE_FANOUT;
+      node->leaf = leaf;
+      node->box = children[first].box;
+      for (j = 1; j < node->count; j++)
+        _box_union (&node->box, &children[first + j].box);
+    }
+
+    level_start = start;
+    start += count;
+    level_size = count;
+    leaf = 0;
+  } while (level_size > 1);
+
+  tree->nodes = nodes;
+  tree->n_nodes = start;
+  tree->n_indexed = n;
+  return 0;
+}
+
+static int
+_append_id (size_t **result, size_t *n_result, size_t *size_result,
+            size_t id) {
+  if (*n_result == *size_result) {
+    size_t size = *size_result ? *size_result * 2 : 64;
+    size_t *tmp = realloc (*result, size * sizeof (size_t));
+    if (tmp == NULL)
+      return -1;
+    *result = tmp;
+    *size_result = size;
+  }
+  (*result)[(*n_result)++] = id;
+  return 0;
+}
+
+static int
+_box_intersects (const pycairo_box_t *a, const pycairo_box_t *b) {
+  return a->x1 <= b->x2 && b->x1 <= a->x2 && a->y1 <= b->y2 && b->y1 <= a->y2;
+}
+
+/* Stores the ids of all items intersecting box in ascending order in a newly
+ * allocated array, which the caller has to free(). Returns -1 on memory
+ * error. */
+int
+rtree_query (rtree_t *tree, const pycairo_box_t *box,
+             size_t **ids, size_t *n_ids) {
+  size_t *result = NULL, n_result = 0, size_result = 0;
+  size_t *stack, n_stack = 0, size_stack, i;
+
+  *ids = NULL;
+  *n_ids = 0;
+
+  if (_rtree_needs_build (tree) && _rtree_build (tree) < 0)
+    return -1;
+
+  if (tree->n_items == 0)
+    return 0;
+
+  /* each level pushes at most RTREE_FANOUT entries, 64 levels is plenty */
+  size_stack = RTREE_FANOUT * 64;
+  stack = malloc (size_stack * sizeof (size_t));
+  if (stack == NULL)
+    return -1;
+
+  if (tree->n_nodes > 0)
+    stack[n_stack++] = tree->n_nodes - 1;
+  while (n_stack > 0) {
+    rtree_entry_t *node = &tree->nodes[stack[--n_stack]];
+
+    if (!_box_intersects (&node->box, box))
+      continue;
+
+    for (i = 0; i < node->count; i++) {
+      if (node->leaf) {
+        rtree_entry_t *item = &tree->items[node->index + i];
+        if (!_box_intersects (&item->box, box))
+          continue;
+        if (_append_id (&result, &n_result, &size_result, item->index) < 0) {
+          free (result);
+          free (stack);
+          return -1;
+        }
+      } else {
+        stack[n_stack++] = node->index + i;
+      }
+    }
+  }
+  free (stack);
+
+  for (i = tree->n_indexed; i < tree->n_items; i++) {
+    rtree_entry_t *item = &tree->items[i];
+    if (!_box_intersects (&item->box, box))
+      continue;
+    if (_append_id (&result, &n_result, &size_result, item->index) < 0) {
+      free (result);
+      return -1;
+    }
+  }
+
+  qsort (result, n_result, sizeof (size_t), _compare_size);
+  *ids = result;
+  *n_ids = n_result;
+  return 0;
+}
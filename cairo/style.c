@@ -0,0 +1,308 @@
+/* -*- mode: C; c-basic-offset: 2 -*-
+ *
+ * Pycairo - Python bindings for cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ */
+
+/* An immutable snapshot of the drawing state used for stroking and
+ * filling, which can be applied to a context with a single call. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <string.h>
+
+#include "config.h"
+#include "private.h"
+
+typedef struct {
+  PyObject_HEAD
+  cairo_pattern_t *source;  /* NULL leaves the source alone */
+  double line_width;
+  cairo_line_cap_t line_cap;
+  cairo_line_join_t line_join;
+  double miter_limit;
+  double *dashes;
+  int num_dashes;
+  double dash_offset;
+  cairo_operator_t op;
+} PycairoStyle;
+
+static void
+style_dealloc (PycairoStyle *o) {
+  if (o->source != NULL) {
+    cairo_pattern_destroy (o->source);
+    o->source = NULL;
+  }
+  PyMem_Free (o->dashes);
+  o->dashes = NULL;
+
+  Py_TYPE(o)->tp_free(o);
+}
+
+static PyObject *
+style_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"source", "line_width", "line_cap", "line_join",
+			   "dash", "dash_offset", "miter_limit", "operator",
+			   NULL};
+  PyObject *source = Py_None, *dash = NULL, *seq;
+  double line_width = 2.0, dash_offset = 0.0, miter_limit = 10.0;
+  int line_cap = CAIRO_LINE_CAP_BUTT, line_join = CAIRO_LINE_JOIN_MITER;
+  int op = CAIRO_OPERATOR_OVER, i;
+  double r, g, b, a = 1.0;
+  PycairoStyle *o;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "|OdiiOddi:Style.__new__",
+				    kwlist, &source, &line_width, &line_cap,
+				    &line_join, &dash, &dash_offset,
+				    &miter_limit, &op))
+    return NULL;
+
+  o = (PycairoStyle *)type->tp_alloc (type, 0);
+  if (o == NULL)
+    return NULL;
+
+  o->line_width = line_width;
+  o->line_cap = line_cap;
+  o->line_join = line_join;
+  o->dash_offset = dash_offset;
+  o->miter_limit = miter_limit;
+  o->op = op;
+
+  if (PyObject_TypeCheck (source, &PycairoPattern_Type)) {
+    o->source = cairo_pattern_reference (((PycairoPattern *)source)->pattern);
+  } else if (source != Py_None) {
+    if (!PyArg_ParseTuple (source, "ddd|d", &r, &g, &b, &a)) {
+      PyErr_Clear ();
+      PyErr_SetString (PyExc_TypeError, "source must be a cairo.Pattern, "
+		       "a tuple of 3 or 4 float or None");
+      Py_DECREF (o);
+      return NULL;
+    }
+    o->source = cairo_pattern_create_rgba (r, g, b, a);
+  }
+
+  if (dash != NULL && dash != Py_None) {
+    seq = PySequence_Fast (dash, "dash must be a sequence");
+    if (seq == NULL) {
+      Py_DECREF (o);
+      return NULL;
+    }
+    o->num_dashes = (int)PySequence_Fast_GET_SIZE (seq);
+    o->dashes = PyMem_Malloc (sizeof (double) *
+			      (o->num_dashes > 0 ? o->num_dashes : 1));
+    if (o->dashes == NULL) {
+      Py_DECREF (seq);
+      Py_DECREF (o);
+      return PyErr_NoMemory ();
+    }
+    for (i = 0; i < o->num_dashes; i++) {
+      o->dashes[i] = PyFloat_AsDouble (PySequence_Fast_GET_ITEM (seq, i));
+      if (PyErr_Occurred ()) {
+	Py_DECREF (seq);
+	Py_DECREF (o);
+	return NULL;
+      }
+    }
+    Py_DECREF (seq);
+  }
+
+  return (PyObject *)o;
+}
+
+/* Returns a new Style with the current state of ctx */
+PyObject *
+style_capture (cairo_t *ctx) {
+  PycairoStyle *o;
+
+  o = (PycairoStyle *)PycairoStyle_Type.tp_alloc (&PycairoStyle_Type, 0);
+  if (o == NULL)
+    return NULL;
+
+  o->source = cairo_pattern_reference (cairo_get_source (ctx));
+  o->line_width = cairo_get_line_width (ctx);
+  o->line_cap = cairo_get_line_cap (ctx);
+  o->line_join = cairo_get_line_join (ctx);
+  o->miter_limit = cairo_get_miter_limit (ctx);
+  o->op = cairo_get_operator (ctx);
+  o->num_dashes = cairo_get_dash_count (ctx);
+  o->dashes = PyMem_Malloc (sizeof (double) *
+			    (o->num_dashes > 0 ? o->num_dashes : 1));
+  if (o->dashes == NULL) {
+    Py_DECREF (o);
+    return PyErr_NoMemory ();
+  }
+  cairo_get_dash (ctx, o->dashes, &o->dash_offset);
+
+  return (PyObject *)o;
+}
+
+/* Sets all fields of style on ctx which differ from the current state */
+void
+style_apply (PyObject *style, cairo_t *ctx) {
+  PycairoStyle *o = (PycairoStyle *)style;
+  double current[16], offset;
+  int count;
+
+  if (o->source != NULL && cairo_get_source (ctx) != o->source) {
+    cairo_set_source (ctx, o->source);
+    display_list_note_source (ctx);
+  }
+  if (cairo_get_line_width (ctx) != o->line_width)
+    cairo_set_line_width (ctx, o->line_width);
+  if (cairo_get_line_cap (ctx) != o->line_cap)
+    cairo_set_line_cap (ctx, o->line_cap);
+  if (cairo_get_line_join (ctx) != o->line_join)
+    cairo_set_line_join (ctx, o->line_join);
+  if (cairo_get_miter_limit (ctx) != o->miter_limit)
+    cairo_set_miter_limit (ctx, o->miter_limit);
+  if (cairo_get_operator (ctx) != o->op)
+    cairo_set_operator (ctx, o->op);
+
+  /* longer patterns are rare, just set them */
+  count = cairo_get_dash_count (ctx);
+  if (count == o->num_dashes && count <= 16) {
+    cairo_get_dash (ctx, current, &offset);
+    if (offset == o->dash_offset &&
+	(count == 0 ||
+	 memcmp (current, o->dashes, count * sizeof (double)) == 0))
+      return;
+  }
+  cairo_set_dash (ctx, o->dashes, o->num_dashes, o->dash_offset);
+}
+
+static PyObject *
+style_get_source (PycairoStyle *o, void *closure) {
+  if (o->source == NULL)
+    Py_RETURN_NONE;
+  return PycairoPattern_FromPattern (cairo_pattern_reference (o->source),
+				     NULL);
+}
+
+static PyObject *
+style_get_line_width (PycairoStyle *o, void *closure) {
+  return PyFloat_FromDouble (o->line_width);
+}
+
+static PyObject *
+style_get_line_cap (PycairoStyle *o, void *closure) {
+  RETURN_INT_ENUM (LineCap, o->line_cap);
+}
+
+static PyObject *
+style_get_line_join (PycairoStyle *o, void *closure) {
+  RETURN_INT_ENUM (LineJoin, o->line_join);
+}
+
+static PyObject *
+style_get_dash (PycairoStyle *o, void *closure) {
+  PyObject *dash, *item;
+  int i;
+
+  dash = PyTuple_New (o->num_dashes);
+  if (dash == NULL)
+    return NULL;
+
+  for (i = 0; i < o->num_dashes; i++) {
+    item = PyFloat_FromDouble (o->dashes[i]);
+    if (item == NULL) {
+      Py_DECREF (dash);
+      return NULL;
+    }
+    PyTuple_SET_ITEM (dash, i, item);
+  }
+  return dash;
+}
+
+static PyObject *
+style_get_dash_offset (PycairoStyle *o, void *closure) {
+  return PyFloat_FromDouble (o->dash_offset);
+}
+
+static PyObject *
+style_get_miter_limit (PycairoStyle *o, void *closure) {
+  return PyFloat_FromDouble (o->miter_limit);
+}
+
+static PyObject *
+style_get_operator (PycairoStyle *o, void *closure) {
+  RETURN_INT_ENUM (Operator, o->op);
+}
+
+static PyGetSetDef style_getset[] = {
+  {"source", (getter)style_get_source},
+  {"line_width", (getter)style_get_line_width},
+  {"line_cap", (getter)style_get_line_cap},
+  {"line_join", (getter)style_get_line_join},
+  {"dash", (getter)style_get_dash},
+  {"dash_offset", (getter)style_get_dash_offset},
+  {"miter_limit", (getter)style_get_miter_limit},
+  {"operator", (getter)style_get_operator},
+  {NULL,},
+};
+
+PyTypeObject PycairoStyle_Type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "cairo.Style",                      /* tp_name */
+  sizeof(PycairoStyle),               /* tp_basicsize */
+  0,                                  /* tp_itemsize */
+  (destructor)style_dealloc,          /* tp_dealloc */
+  0,                                  /* tp_print */
+  0,                                  /* tp_getattr */
+  0,                                  /* tp_setattr */
+  0,                                  /* tp_compare */
+  0,                                  /* tp_repr */
+  0,                                  /* tp_as_number */
+  0,                                  /* tp_as_sequence */
+  0,                                  /* tp_as_mapping */
+  0,                                  /* tp_hash */
+  0,                                  /* tp_call */
+  0,                                  /* tp_str */
+  0,                                  /* tp_getattro */
+  0,                                  /* tp_setattro */
+  0,                                  /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+  0,                                  /* tp_doc */
+  0,                                  /* tp_traverse */
+  0,                                  /* tp_clear */
+  0,                                  /* tp_richcompare */
+  0,                                  /* tp_weaklistoffset */
+  0,                                  /* tp_iter */
+  0,                                  /* tp_iternext */
+  0,                                  /* tp_methods */
+  0,                                  /* tp_members */
+  style_getset,                       /* tp_getset */
+  0,                                  /* tp_base */
+  0,                                  /* tp_dict */
+  0,                                  /* tp_descr_get */
+  0,                                  /* tp_descr_set */
+  0,                                  /* tp_dictoffset */
+  0,                                  /* tp_init */
+  0,                                  /* tp_alloc */
+  (newfunc)style_new,                 /* tp_new */
+  0,                                  /* tp_free */
+  0,                                  /* tp_is_gc */
+  0,                                  /* tp_bases */
+};
@@ -68,7 +68,12 @@ PycairoSurface_FromSurface (cairo_surface_t *surface, PyObject *base) {
 #endif
 #if CAIRO_HAS_RECORDING_SURFACE
   case CAIRO_SURFACE_TYPE_RECORDING:
-    type = &PycairoRecordingSurface_Type;
+    if (tile_grid_from_surface (surface) != NULL)
+      type = &PycairoTiledSurface_Type;
+    else if (display_list_from_surface (surface) != NULL)
+      type = &PycairoIndexedRecordingSurface_Type;
+    else
+      type = &PycairoRecordingSurface_Type;
     break;
 #endif
 #if CAIRO_HAS_SVG_SURFACE
@@ -108,6 +113,10 @@ PycairoSurface_FromSurface (cairo_surface_t *surface, PyObject *base) {
     type = &PycairoSurface_Type;
     break;
   }
+  if (_Pycairo_Lazy_Type_Ready (type) < 0) {
+    cairo_surface_destroy (surface);
+    return NULL;
+  }
   o = type->tp_alloc (type, 0);
   if (o == NULL) {
     cairo_surface_destroy (surface);
@@ -126,8 +135,16 @@ PycairoSurface_FromSurface (cairo_surface_t *surface, PyObject *base) {
 static cairo_status_t
 _write_func (void *closure, const unsigned char *data, unsigned int length) {
   PyGILState_STATE gstate = PyGILState_Ensure();
-  PyObject *res = PyObject_CallMethod ((PyObject *)closure, "write", "(" PYCAIRO_DATA_FORMAT "#)",
-				       data, (Py_ssize_t)length);
+  PyObject *res;
+
+  /* turned into the cancellation error by Pycairo_Check_Status() */
+  if (cancel_token_check_current () != CAIRO_STATUS_SUCCESS) {
+    PyGILState_Release(gstate);
+    return CAIRO_STATUS_WRITE_ERROR;
+  }
+
+  res = PyObject_CallMethod ((PyObject *)closure, "write", "(" PYCAIRO_DATA_FORMAT "#)",
+			     data, (Py_ssize_t)length);
   if (res == NULL) {
     PyErr_Clear();
     /* an exception has occurred, it will be picked up later by
@@ -141,6 +158,99 @@ _write_func (void *closure, const unsigned char *data, unsigned int length) {
   return CAIRO_STATUS_SUCCESS;
 }
 
+/* Files given by name get opened by us instead of cairo, so that writing
+ * them can be cancelled like writing to Python file objects. */
+typedef struct {
+  FILE *fp;
+  cancel_state_t *cancel; /* token to check, set for the duration of calls */
+} file_writer_t;
+
+static cairo_status_t
+_write_file_func (void *closure, const unsigned char *data,
+                  unsigned int length) {
+  file_writer_t *writer = closure;
+  cairo_status_t status = cancel_state_check (writer->cancel);
+
+  /* turned into the cancellation error by Pycairo_Check_Status() */
+  if (status != CAIRO_STATUS_SUCCESS || writer->fp == NULL ||
+      fwrite (data, 1, length, writer->fp) != length)
+    return CAIRO_STATUS_WRITE_ERROR;
+  return CAIRO_STATUS_SUCCESS;
+}
+
+static const cairo_user_data_key_t surface_file_writer_key;
+
+static void
+_file_writer_destroy (void *data) {
+  file_writer_t *writer = data;
+
+  if (writer->fp != NULL)
+    fclose (writer->fp);
+  free (writer);
+}
+
+/* Makes the file writer of surface, if it has one, check the token active
+ * in the current thread until surface_file_writer_end(), so that writing
+ * doesn't need the GIL. Returns the reference to the token to pass there,
+ * can be NULL. Needs the GIL. */
+PyObject *
+surface_file_writer_begin (cairo_surface_t *surface) {
+  file_writer_t *writer = cairo_surface_get_user_data (
+    surface, &surface_file_writer_key);
+  cancel_state_t *cancel;
+  PyObject *token;
+
+  if (writer == NULL)
+    return NULL;
+  token = cancel_token_acquire (&cancel);
+  writer->cancel = cancel;
+  return token;
+}
+
+void
+surface_file_writer_end (cairo_surface_t *surface, PyObject *token) {
+  file_writer_t *writer = cairo_surface_get_user_data (
+    surface, &surface_file_writer_key);
+
+  if (writer != NULL)
+    writer->cancel = NULL;
+  Py_XDECREF (token);
+}
+
+/* Opens name for a surface to write to. Returns NULL on error, without
+ * setting an exception. Doesn't need the GIL. */
+static file_writer_t *
+_file_writer_open (const char *name) {
+  file_writer_t *writer = malloc (sizeof (file_writer_t));
+
+  if (writer == NULL)
+    return NULL;
+  writer->cancel = NULL;
+  writer->fp = fopen (name, "wb");
+  if (writer->fp == NULL) {
+    free (writer);
+    return NULL;
+  }
+  return writer;
+}
+
+/* Closes the file a surface created with _surface_create_with_file() wrote
+ * to, once it's finished. Returns CAIRO_STATUS_WRITE_ERROR if the file
+ * couldn't be written completely. */
+static cairo_status_t
+_surface_close_file (cairo_surface_t *surface) {
+  file_writer_t *writer = cairo_surface_get_user_data (
+    surface, &surface_file_writer_key);
+  cairo_status_t status = CAIRO_STATUS_SUCCESS;
+
+  if (writer != NULL && writer->fp != NULL) {
+    if (fclose (writer->fp) != 0)
+      status = CAIRO_STATUS_WRITE_ERROR;
+    writer->fp = NULL;
+  }
+  return status;
+}
+
 static const cairo_user_data_key_t surface_base_object_key;
 static const cairo_user_data_key_t surface_is_mapped_image;
 
@@ -189,6 +299,30 @@ _surface_create_with_object(cairo_surface_t *surface, PyObject *base) {
   return pysurface;
 }
 
+/* Like _surface_create_with_object(), for surfaces writing to a file
+ * opened with _file_writer_open(), which gets closed when the surface is
+ * finished. writer being NULL means opening the file failed. */
+static PyObject *
+_surface_create_with_file (cairo_surface_t *surface, file_writer_t *writer) {
+  cairo_status_t status;
+
+  if (writer == NULL) {
+    Pycairo_Check_Status (CAIRO_STATUS_WRITE_ERROR);
+    return NULL;
+  }
+
+  status = cairo_surface_set_user_data (
+    surface, &surface_file_writer_key, writer, _file_writer_destroy);
+  if (status != CAIRO_STATUS_SUCCESS) {
+    _file_writer_destroy (writer);
+    cairo_surface_destroy (surface);
+    Pycairo_Check_Status (status);
+    return NULL;
+  }
+
+  return PycairoSurface_FromSurface (surface, NULL);
+}
+
 static PyObject *
 surface_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
   PyErr_SetString(PyExc_TypeError,
@@ -198,9 +332,16 @@ surface_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
 
 static PyObject *
 surface_copy_page (PycairoSurface *o) {
+  PyObject *token;
+
+  if (tee_fanout_check_page (o->surface) < 0)
+    return NULL;
+
+  token = surface_file_writer_begin (o->surface);
   Py_BEGIN_ALLOW_THREADS;
   cairo_surface_copy_page (o->surface);
   Py_END_ALLOW_THREADS;
+  surface_file_writer_end (o->surface, token);
   RETURN_NULL_IF_CAIRO_SURFACE_ERROR(o->surface);
   Py_RETURN_NONE;
 }
@@ -220,17 +361,30 @@ surface_create_similar (PycairoSurface *o, PyObject *args) {
 
 static PyObject *
 surface_finish (PycairoSurface *o) {
+  cairo_status_t status;
+  PyObject *token;
+
+  /* lets other threads cancel writing the output */
+  token = surface_file_writer_begin (o->surface);
+  Py_BEGIN_ALLOW_THREADS;
   cairo_surface_finish (o->surface);
+  status = _surface_close_file (o->surface);
+  Py_END_ALLOW_THREADS;
+  surface_file_writer_end (o->surface, token);
   Py_CLEAR(o->base);
   RETURN_NULL_IF_CAIRO_SURFACE_ERROR(o->surface);
+  RETURN_NULL_IF_CAIRO_ERROR(status);
   Py_RETURN_NONE;
 }
 
 static PyObject *
 surface_flush (PycairoSurface *o) {
+  PyObject *token = surface_file_writer_begin (o->surface);
+
   Py_BEGIN_ALLOW_THREADS;
   cairo_surface_flush (o->surface);
   Py_END_ALLOW_THREADS;
+  surface_file_writer_end (o->surface, token);
   RETURN_NULL_IF_CAIRO_SURFACE_ERROR(o->surface);
   Py_RETURN_NONE;
 }
@@ -359,9 +513,16 @@ surface_create_for_rectangle (PycairoSurface *o, PyObject *args) {
 
 static PyObject *
 surface_show_page (PycairoSurface *o) {
+  PyObject *token;
+
+  if (tee_fanout_check_page (o->surface) < 0)
+    return NULL;
+
+  token = surface_file_writer_begin (o->surface);
   Py_BEGIN_ALLOW_THREADS;
   cairo_surface_show_page (o->surface);
   Py_END_ALLOW_THREADS;
+  surface_file_writer_end (o->surface, token);
   RETURN_NULL_IF_CAIRO_SURFACE_ERROR(o->surface);
   Py_RETURN_NONE;
 }
@@ -386,9 +547,11 @@ surface_create_similar_image (PycairoSurface *o, PyObject *args) {
 #ifdef CAIRO_HAS_PNG_FUNCTIONS
 static PyObject *
 surface_write_to_png (PycairoSurface *o, PyObject *args) {
+  cancel_state_t *cancel;
   cairo_status_t status;
   char *name = NULL;
-  PyObject *file;
+  PyObject *file, *token;
+  file_writer_t *writer;
 
   if (!PyArg_ParseTuple (args, "O:Surface.write_to_png", &file))
     return NULL;
@@ -397,9 +560,22 @@ surface_write_to_png (PycairoSurface *o, PyObject *args) {
     if (!PyArg_ParseTuple (args, "O&:Surface.write_to_png",
                            Pycairo_fspath_converter, &name))
       return NULL;
+    token = cancel_token_acquire (&cancel);
     Py_BEGIN_ALLOW_THREADS;
-    status = cairo_surface_write_to_png (o->surface, name);
+    writer = _file_writer_open (name);
+    if (writer == NULL) {
+      status = CAIRO_STATUS_WRITE_ERROR;
+    } else {
+      writer->cancel = cancel;
+      status = cairo_surface_write_to_png_stream (o->surface,
+                                                  _write_file_func, writer);
+      if (fclose (writer->fp) != 0 && status == CAIRO_STATUS_SUCCESS)
+        status = CAIRO_STATUS_WRITE_ERROR;
+      writer->fp = NULL;
+      _file_writer_destroy (writer);
+    }
     Py_END_ALLOW_THREADS;
+    Py_XDECREF (token);
     PyMem_Free (name);
   } else {
     if (PyArg_ParseTuple (args, "O&:Surface.write_to_png",
@@ -1185,7 +1361,8 @@ static PyObject *
 pdf_surface_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
   double width_in_points, height_in_points;
   PyObject *file;
-  cairo_surface_t *sfc;
+  cairo_surface_t *sfc = NULL;
+  file_writer_t *writer;
   char *name;
 
   if (!PyArg_ParseTuple (args, "Odd:PDFSurface.__new__",
@@ -1198,11 +1375,20 @@ pdf_surface_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
                            &width_in_points, &height_in_points))
       return NULL;
 
+    if (name == NULL) {
+      sfc = cairo_pdf_surface_create (NULL, width_in_points,
+                                      height_in_points);
+      return PycairoSurface_FromSurface (sfc, NULL);
+    }
+
     Py_BEGIN_ALLOW_THREADS;
-    sfc = cairo_pdf_surface_create (name, width_in_points, height_in_points);
+    writer = _file_writer_open (name);
+    if (writer != NULL)
+      sfc = cairo_pdf_surface_create_for_stream (
+        _write_file_func, writer, width_in_points, height_in_points);
     Py_END_ALLOW_THREADS;
     PyMem_Free(name);
-    return PycairoSurface_FromSurface (sfc, NULL);
+    return _surface_create_with_file (sfc, writer);
   } else {
     if (PyArg_ParseTuple (args, "O&dd:PDFSurface.__new__",
                           Pycairo_writer_converter, &file,
@@ -1448,7 +1634,8 @@ static PyObject *
 ps_surface_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
   double width_in_points, height_in_points;
   PyObject *file;
-  cairo_surface_t *sfc;
+  cairo_surface_t *sfc = NULL;
+  file_writer_t *writer;
   char *name;
 
   if (!PyArg_ParseTuple (args, "Odd:PSSurface.__new__",
@@ -1461,11 +1648,20 @@ ps_surface_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
                            &width_in_points, &height_in_points))
       return NULL;
 
+    if (name == NULL) {
+      sfc = cairo_ps_surface_create (NULL, width_in_points,
+                                      height_in_points);
+      return PycairoSurface_FromSurface (sfc, NULL);
+    }
+
     Py_BEGIN_ALLOW_THREADS;
-    sfc = cairo_ps_surface_create (name, width_in_points, height_in_points);
+    writer = _file_writer_open (name);
+    if (writer != NULL)
+      sfc = cairo_ps_surface_create_for_stream (
+        _write_file_func, writer, width_in_points, height_in_points);
     Py_END_ALLOW_THREADS;
     PyMem_Free(name);
-    return PycairoSurface_FromSurface (sfc, NULL);
+    return _surface_create_with_file (sfc, writer);
   } else {
     if (PyArg_ParseTuple (args, "O&dd:PSSurface.__new__",
                           Pycairo_writer_converter, &file,
@@ -1772,6 +1968,443 @@ PyTypeObject PycairoRecordingSurface_Type = {
   0,                                  /* tp_is_gc */
   0,                                  /* tp_bases */
 };
+
+/* Class IndexedRecordingSurface(RecordingSurface) ------------------------- */
+
+static PyObject *
+indexed_recording_surface_new (PyTypeObject *type, PyObject *args,
+                               PyObject *kwds) {
+  int content;
+  cairo_rectangle_t extents;
+  cairo_surface_t *sfc;
+  PyObject *o;
+
+  if (!PyArg_ParseTuple(args, "i(dddd):IndexedRecordingSurface.__new__",
+			&content, &extents.x, &extents.y,
+			&extents.width, &extents.height))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS;
+  sfc = cairo_recording_surface_create (content, &extents);
+  Py_END_ALLOW_THREADS;
+
+  if (Pycairo_Check_Status (cairo_surface_status (sfc))) {
+    cairo_surface_destroy (sfc);
+    return NULL;
+  }
+
+  if (display_list_attach (sfc, &extents) == NULL) {
+    cairo_surface_destroy (sfc);
+    return NULL;
+  }
+
+  o = type->tp_alloc (type, 0);
+  if (o == NULL) {
+    cairo_surface_destroy (sfc);
+    return NULL;
+  }
+  ((PycairoSurface *)o)->surface = sfc;
+  return o;
+}
+
+static PyObject *
+indexed_recording_surface_replay (PycairoRecordingSurface *o, PyObject *args,
+                                  PyObject *kwds) {
+  static char *kwlist[] = {"target", "viewport", "draft", NULL};
+  PyObject *target, *viewport_obj = Py_None, *draft_obj = Py_False;
+  pycairo_box_t viewport, *viewport_ptr = NULL;
+  display_list_t *dl, *target_dl;
+  cancel_state_t *cancel;
+  PyObject *token;
+  cairo_status_t status;
+  size_t n_replayed;
+  cairo_t *cr;
+  int draft;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds,
+      "O|OO:IndexedRecordingSurface.replay", kwlist, &target, &viewport_obj,
+      &draft_obj))
+    return NULL;
+
+  draft = PyObject_IsTrue (draft_obj);
+  if (draft < 0)
+    return NULL;
+
+  if (viewport_obj != Py_None) {
+    double x, y, width, height;
+    if (!PyArg_ParseTuple (viewport_obj, "dddd", &x, &y, &width, &height)) {
+      PyErr_SetString (PyExc_TypeError,
+		       "viewport must be a 4-tuple of float or None");
+      return NULL;
+    }
+    viewport.x1 = x;
+    viewport.y1 = y;
+    viewport.x2 = x + width;
+    viewport.y2 = y + height;
+    viewport_ptr = &viewport;
+  }
+
+  if (PyObject_TypeCheck (target, &PycairoContext_Type)) {
+    cr = cairo_reference (((PycairoContext *)target)->ctx);
+  } else if (PyObject_TypeCheck (target, &PycairoSurface_Type)) {
+    cr = cairo_create (((PycairoSurface *)target)->surface);
+    status = cairo_status (cr);
+    if (status != CAIRO_STATUS_SUCCESS) {
+      cairo_destroy (cr);
+      Pycairo_Check_Status (status);
+      return NULL;
+    }
+  } else {
+    PyErr_SetString (PyExc_TypeError,
+		     "target must be a cairo.Context or a cairo.Surface");
+    return NULL;
+  }
+
+  dl = display_list_from_surface (o->surface);
+  if (cairo_get_group_target (cr) == o->surface) {
+    cairo_destroy (cr);
+    PyErr_SetString (PyExc_ValueError, "can't replay onto itself");
+    return NULL;
+  }
+
+  /* the replayed commands bypass the target's own index */
+  target_dl = display_list_from_surface (cairo_get_group_target (cr));
+  if (target_dl != NULL)
+    display_list_invalidate (target_dl);
+
+  token = cancel_token_acquire (&cancel);
+  Py_BEGIN_ALLOW_THREADS;
+  status = display_list_replay (dl, cr, viewport_ptr, draft, cancel,
+                                &n_replayed);
+  Py_END_ALLOW_THREADS;
+  Py_XDECREF (token);
+
+  cairo_destroy (cr);
+  RETURN_NULL_IF_CAIRO_ERROR (status);
+
+  return PYCAIRO_PyLong_FromLong ((long)n_replayed);
+}
+
+static PyObject *
+indexed_recording_surface_cull_occluded (PycairoRecordingSurface *o) {
+  cairo_status_t status;
+  size_t n_removed;
+
+  status = display_list_cull_occluded (
+    display_list_from_surface (o->surface), &n_removed);
+  RETURN_NULL_IF_CAIRO_ERROR (status);
+
+  return PYCAIRO_PyLong_FromLong ((long)n_removed);
+}
+
+static PyMethodDef indexed_recording_surface_methods[] = {
+  {"replay", (PyCFunction)indexed_recording_surface_replay,
+   METH_VARARGS | METH_KEYWORDS },
+  {"cull_occluded", (PyCFunction)indexed_recording_surface_cull_occluded,
+   METH_NOARGS },
+  {NULL, NULL, 0, NULL},
+};
+
+PyTypeObject PycairoIndexedRecordingSurface_Type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "cairo.IndexedRecordingSurface",    /* tp_name */
+  sizeof(PycairoRecordingSurface),    /* tp_basicsize */
+  0,                                  /* tp_itemsize */
+  0,                                  /* tp_dealloc */
+  0,                                  /* tp_print */
+  0,                                  /* tp_getattr */
+  0,                                  /* tp_setattr */
+  0,                                  /* tp_compare */
+  0,                                  /* tp_repr */
+  0,                                  /* tp_as_number */
+  0,                                  /* tp_as_sequence */
+  0,                                  /* tp_as_mapping */
+  0,                                  /* tp_hash */
+  0,                                  /* tp_call */
+  0,                                  /* tp_str */
+  0,                                  /* tp_getattro */
+  0,                                  /* tp_setattro */
+  0,                                  /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+  0,                                  /* tp_doc */
+  0,                                  /* tp_traverse */
+  0,                                  /* tp_clear */
+  0,                                  /* tp_richcompare */
+  0,                                  /* tp_weaklistoffset */
+  0,                                  /* tp_iter */
+  0,                                  /* tp_iternext */
+  indexed_recording_surface_methods,  /* tp_methods */
+  0,                                  /* tp_members */
+  0,                                  /* tp_getset */
+  &PycairoRecordingSurface_Type,      /* tp_base */
+  0,                                  /* tp_dict */
+  0,                                  /* tp_descr_get */
+  0,                                  /* tp_descr_set */
+  0,                                  /* tp_dictoffset */
+  0,                                  /* tp_init */
+  0,                                  /* tp_alloc */
+  (newfunc)indexed_recording_surface_new, /* tp_new */
+  0,                                  /* tp_free */
+  0,                                  /* tp_is_gc */
+  0,                                  /* tp_bases */
+};
+
+/* Class TiledSurface(Surface) -------------------------------------------- */
+
+static PyObject *
+tiled_surface_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"width", "height", "tile", "threads", NULL};
+  int width, height, tile_size = 1024, threads = 1;
+  cairo_rectangle_t extents;
+  cairo_surface_t *sfc;
+  PyObject *o;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds,
+      "ii|ii:TiledSurface.__new__", kwlist,
+      &width, &height, &tile_size, &threads))
+    return NULL;
+
+  if (width <= 0 || height <= 0) {
+    PyErr_SetString (PyExc_ValueError, "width and height must be positive");
+    return NULL;
+  }
+  if (tile_size <= 0 || tile_size > 32767) {
+    PyErr_SetString (PyExc_ValueError, "tile must be in the range 1..32767");
+    return NULL;
+  }
+  if (threads <= 0) {
+    PyErr_SetString (PyExc_ValueError, "threads must be positive");
+    return NULL;
+  }
+
+  extents.x = 0;
+  extents.y = 0;
+  extents.width = width;
+  extents.height = height;
+
+  Py_BEGIN_ALLOW_THREADS;
+  sfc = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, &extents);
+  Py_END_ALLOW_THREADS;
+
+  if (Pycairo_Check_Status (cairo_surface_status (sfc))) {
+    cairo_surface_destroy (sfc);
+    return NULL;
+  }
+
+  if (display_list_attach (sfc, &extents) == NULL ||
+      tile_grid_attach (sfc, width, height, tile_size, threads) == NULL) {
+    cairo_surface_destroy (sfc);
+    return NULL;
+  }
+
+  o = type->tp_alloc (type, 0);
+  if (o == NULL) {
+    cairo_surface_destroy (sfc);
+    return NULL;
+  }
+  ((PycairoSurface *)o)->surface = sfc;
+  return o;
+}
+
+static PyObject *
+tiled_surface_flush (PycairoSurface *o) {
+  tile_grid_t *grid = tile_grid_from_surface (o->surface);
+  cancel_state_t *cancel;
+  cairo_status_t status;
+  PyObject *token;
+
+  parallel_prepare ();
+  token = cancel_token_acquire (&cancel);
+  Py_BEGIN_ALLOW_THREADS;
+  status = tile_grid_flush (grid, cancel);
+  Py_END_ALLOW_THREADS;
+  Py_XDECREF (token);
+
+  RETURN_NULL_IF_CAIRO_ERROR (status);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+tiled_surface_get_tile (PycairoSurface *o, PyObject *args) {
+  tile_grid_t *grid = tile_grid_from_surface (o->surface);
+  int col, row, width, height, tile_size, cols, rows;
+  cairo_surface_t *tile = NULL;
+  cancel_state_t *cancel;
+  cairo_status_t status;
+  PyObject *token;
+
+  if (!PyArg_ParseTuple (args, "ii:TiledSurface.get_tile", &col, &row))
+    return NULL;
+
+  tile_grid_get_layout (grid, &width, &height, &tile_size, &cols, &rows);
+  if (col < 0 || col >= cols || row < 0 || row >= rows) {
+    PyErr_SetString (PyExc_IndexError, "tile index out of range");
+    return NULL;
+  }
+
+  parallel_prepare ();
+  token = cancel_token_acquire (&cancel);
+  Py_BEGIN_ALLOW_THREADS;
+  status = tile_grid_flush (grid, cancel);
+  if (status == CAIRO_STATUS_SUCCESS)
+    status = tile_grid_get_tile (grid, col, row, &tile);
+  Py_END_ALLOW_THREADS;
+  Py_XDECREF (token);
+
+  RETURN_NULL_IF_CAIRO_ERROR (status);
+  return PycairoSurface_FromSurface (tile, NULL);
+}
+
+static PyObject *
+tiled_surface_get_width (PycairoSurface *o) {
+  int width, height, tile_size, cols, rows;
+
+  tile_grid_get_layout (tile_grid_from_surface (o->surface),
+                        &width, &height, &tile_size, &cols, &rows);
+  return PYCAIRO_PyLong_FromLong (width);
+}
+
+static PyObject *
+tiled_surface_get_height (PycairoSurface *o) {
+  int width, height, tile_size, cols, rows;
+
+  tile_grid_get_layout (tile_grid_from_surface (o->surface),
+                        &width, &height, &tile_size, &cols, &rows);
+  return PYCAIRO_PyLong_FromLong (height);
+}
+
+static PyObject *
+tiled_surface_get_tile_size (PycairoSurface *o) {
+  int width, height, tile_size, cols, rows;
+
+  tile_grid_get_layout (tile_grid_from_surface (o->surface),
+                        &width, &height, &tile_size, &cols, &rows);
+  return PYCAIRO_PyLong_FromLong (tile_size);
+}
+
+static PyObject *
+tiled_surface_get_tile_count (PycairoSurface *o) {
+  int width, height, tile_size, cols, rows;
+
+  tile_grid_get_layout (tile_grid_from_surface (o->surface),
+                        &width, &height, &tile_size, &cols, &rows);
+  return Py_BuildValue ("(ii)", cols, rows);
+}
+
+static PyObject *
+tiled_surface_write_to_png (PycairoSurface *o, PyObject *args) {
+  tile_grid_t *grid = tile_grid_from_surface (o->surface);
+  cancel_state_t *cancel;
+  cairo_status_t status;
+  char *name = NULL;
+  PyObject *file, *token;
+
+  if (!PyArg_ParseTuple (args, "O:TiledSurface.write_to_png", &file))
+    return NULL;
+
+  parallel_prepare ();
+
+  if (Pycairo_is_fspath (file)) {
+    if (!PyArg_ParseTuple (args, "O&:TiledSurface.write_to_png",
+                           Pycairo_fspath_converter, &name))
+      return NULL;
+    token = cancel_token_acquire (&cancel);
+    Py_BEGIN_ALLOW_THREADS;
+    status = tile_grid_flush (grid, cancel);
+    if (status == CAIRO_STATUS_SUCCESS) {
+      file_writer_t *writer = _file_writer_open (name);
+      if (writer == NULL) {
+        status = CAIRO_STATUS_WRITE_ERROR;
+      } else {
+        writer->cancel = cancel;
+        status = tile_grid_write_png (grid, _write_file_func, writer, cancel);
+        if (fclose (writer->fp) != 0 && status == CAIRO_STATUS_SUCCESS)
+          status = CAIRO_STATUS_WRITE_ERROR;
+        writer->fp = NULL;
+        _file_writer_destroy (writer);
+      }
+    }
+    Py_END_ALLOW_THREADS;
+    Py_XDECREF (token);
+    PyMem_Free (name);
+  } else {
+    if (PyArg_ParseTuple (args, "O&:TiledSurface.write_to_png",
+                          Pycairo_writer_converter, &file)) {
+      token = cancel_token_acquire (&cancel);
+      Py_BEGIN_ALLOW_THREADS;
+      status = tile_grid_flush (grid, cancel);
+      if (status == CAIRO_STATUS_SUCCESS)
+        status = tile_grid_write_png (grid, _write_func, file, cancel);
+      Py_END_ALLOW_THREADS;
+      Py_XDECREF (token);
+    } else {
+      PyErr_Clear ();
+      PyErr_SetString (PyExc_TypeError,
+                       "TiledSurface.write_to_png takes one argument which "
+                       "must be a filename, file object, or a file-like "
+                       "object which has a \"write\" method (like StringIO)");
+      return NULL;
+    }
+  }
+
+  RETURN_NULL_IF_CAIRO_ERROR (status);
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef tiled_surface_methods[] = {
+  {"flush",          (PyCFunction)tiled_surface_flush,          METH_NOARGS},
+  {"get_height",     (PyCFunction)tiled_surface_get_height,     METH_NOARGS},
+  {"get_tile",       (PyCFunction)tiled_surface_get_tile,       METH_VARARGS},
+  {"get_tile_count", (PyCFunction)tiled_surface_get_tile_count, METH_NOARGS},
+  {"get_tile_size",  (PyCFunction)tiled_surface_get_tile_size,  METH_NOARGS},
+  {"get_width",      (PyCFunction)tiled_surface_get_width,      METH_NOARGS},
+  {"write_to_png",   (PyCFunction)tiled_surface_write_to_png,   METH_VARARGS},
+  {NULL, NULL, 0, NULL},
+};
+
+PyTypeObject PycairoTiledSurface_Type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "cairo.TiledSurface",               /* tp_name */
+  sizeof(PycairoSurface),             /* tp_basicsize */
+  0,                                  /* tp_itemsize */
+  0,                                  /* tp_dealloc */
+  0,                                  /* tp_print */
+  0,                                  /* tp_getattr */
+  0,                                  /* tp_setattr */
+  0,                                  /* tp_compare */
+  0,                                  /* tp_repr */
+  0,                                  /* tp_as_number */
+  0,                                  /* tp_as_sequence */
+  0,                                  /* tp_as_mapping */
+  0,                                  /* tp_hash */
+  0,                                  /* tp_call */
+  0,                                  /* tp_str */
+  0,                                  /* tp_getattro */
+  0,                                  /* tp_setattro */
+  0,                                  /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+  0,                                  /* tp_doc */
+  0,                                  /* tp_traverse */
+  0,                                  /* tp_clear */
+  0,                                  /* tp_richcompare */
+  0,                                  /* tp_weaklistoffset */
+  0,                                  /* tp_iter */
+  0,                                  /* tp_iternext */
+  tiled_surface_methods,              /* tp_methods */
+  0,                                  /* tp_members */
+  0,                                  /* tp_getset */
+  &PycairoSurface_Type,               /* tp_base */
+  0,                                  /* tp_dict */
+  0,                                  /* tp_descr_get */
+  0,                                  /* tp_descr_set */
+  0,                                  /* tp_dictoffset */
+  0,                                  /* tp_init */
+  0,                                  /* tp_alloc */
+  (newfunc)tiled_surface_new,         /* tp_new */
+  0,                                  /* tp_free */
+  0,                                  /* tp_is_gc */
+  0,                                  /* tp_bases */
+};
 #endif /* CAIRO_HAS_RECORDING_SURFACE */
 
 
@@ -1783,7 +2416,8 @@ static PyObject *
 svg_surface_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
   double width_in_points, height_in_points;
   PyObject *file;
-  cairo_surface_t *sfc;
+  cairo_surface_t *sfc = NULL;
+  file_writer_t *writer;
   char *name;
 
   if (!PyArg_ParseTuple (args, "Odd:SVGSurface.__new__",
@@ -1796,11 +2430,20 @@ svg_surface_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
                            &width_in_points, &height_in_points))
       return NULL;
 
+    if (name == NULL) {
+      sfc = cairo_svg_surface_create (NULL, width_in_points,
+                                      height_in_points);
+      return PycairoSurface_FromSurface (sfc, NULL);
+    }
+
     Py_BEGIN_ALLOW_THREADS;
-    sfc = cairo_svg_surface_create (name, width_in_points, height_in_points);
+    writer = _file_writer_open (name);
+    if (writer != NULL)
+      sfc = cairo_svg_surface_create_for_stream (
+        _write_file_func, writer, width_in_points, height_in_points);
     Py_END_ALLOW_THREADS;
     PyMem_Free(name);
-    return PycairoSurface_FromSurface (sfc, NULL);
+    return _surface_create_with_file (sfc, writer);
   } else {
     if (PyArg_ParseTuple (args, "O&dd:SVGSurface.__new__",
                           Pycairo_writer_converter, &file,
@@ -2304,25 +2947,72 @@ PyTypeObject PycairoXlibSurface_Type = {
 
 static PyObject *
 tee_surface_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
-  PyObject *pysurface;
+  static char *kwlist[] = {"master", "parallel", NULL};
+  PyObject *pysurface, *parallel_obj = Py_False;
+  cairo_surface_t *master, *sfc;
+  int parallel;
 
-  if (!PyArg_ParseTuple (args, "O!:TeeSurface.__new__",
-      &PycairoSurface_Type, &pysurface))
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "O!|O:TeeSurface.__new__",
+      kwlist, &PycairoSurface_Type, &pysurface, &parallel_obj))
     return NULL;
 
-  return PycairoSurface_FromSurface (
-    cairo_tee_surface_create(((PycairoSurface*)pysurface)->surface),
-    NULL);
+  parallel = PyObject_IsTrue (parallel_obj);
+  if (parallel < 0)
+    return NULL;
+
+  master = ((PycairoSurface*)pysurface)->surface;
+  if (!parallel)
+    return PycairoSurface_FromSurface (cairo_tee_surface_create (master),
+                                       NULL);
+
+#ifdef CAIRO_HAS_RECORDING_SURFACE
+  {
+    cairo_surface_t *recording = cairo_recording_surface_create (
+      cairo_surface_get_content (master), NULL);
+    sfc = cairo_tee_surface_create (recording);
+    cairo_surface_destroy (recording);
+  }
+  if (Pycairo_Check_Status (cairo_surface_status (sfc))) {
+    cairo_surface_destroy (sfc);
+    return NULL;
+  }
+  if (tee_fanout_attach (sfc, master) == NULL) {
+    cairo_surface_destroy (sfc);
+    return NULL;
+  }
+  return PycairoSurface_FromSurface (sfc, NULL);
+#else
+  PyErr_SetString (PyExc_RuntimeError,
+                   "parallel mode needs cairo with recording surfaces");
+  return NULL;
+#endif
+}
+
+static tee_fanout_t *
+_tee_surface_get_fanout (PycairoTeeSurface *obj) {
+#ifdef CAIRO_HAS_RECORDING_SURFACE
+  return tee_fanout_from_surface (obj->surface);
+#else
+  return NULL;
+#endif
 }
 
 static PyObject *
 tee_surface_add (PycairoTeeSurface *obj, PyObject *args) {
+  tee_fanout_t *fanout = _tee_surface_get_fanout (obj);
+  cairo_status_t status;
   PyObject *pysurface;
 
   if (!PyArg_ParseTuple(args, "O!:TeeSurface.add",
       &PycairoSurface_Type, &pysurface))
     return NULL;
 
+  if (fanout != NULL) {
+    status = tee_fanout_add (fanout, ((PycairoSurface*)pysurface)->surface);
+    RETURN_NULL_IF_CAIRO_ERROR (status);
+    Py_RETURN_NONE;
+  }
+
   cairo_tee_surface_add (obj->surface, ((PycairoSurface*)pysurface)->surface);
   RETURN_NULL_IF_CAIRO_SURFACE_ERROR (obj->surface);
 
@@ -2331,12 +3021,24 @@ tee_surface_add (PycairoTeeSurface *obj, PyObject *args) {
 
 static PyObject *
 tee_surface_remove (PycairoTeeSurface *obj, PyObject *args) {
+  tee_fanout_t *fanout = _tee_surface_get_fanout (obj);
+  cairo_status_t status;
   PyObject *pysurface;
 
   if (!PyArg_ParseTuple(args, "O!:TeeSurface.remove",
       &PycairoSurface_Type, &pysurface))
     return NULL;
 
+  if (fanout != NULL) {
+    /* the target still gets what was drawn while it was part of the tee */
+    status = tee_fanout_flush (fanout);
+    if (status == CAIRO_STATUS_SUCCESS)
+      status = tee_fanout_remove (fanout,
+                                  ((PycairoSurface*)pysurface)->surface);
+    RETURN_NULL_IF_CAIRO_ERROR (status);
+    Py_RETURN_NONE;
+  }
+
   cairo_tee_surface_remove (obj->surface, ((PycairoSurface*)pysurface)->surface);
   RETURN_NULL_IF_CAIRO_SURFACE_ERROR (obj->surface);
 
@@ -2345,20 +3047,66 @@ tee_surface_remove (PycairoTeeSurface *obj, PyObject *args) {
 
 static PyObject *
 tee_surface_index (PycairoTeeSurface *obj, PyObject *args) {
+  tee_fanout_t *fanout = _tee_surface_get_fanout (obj);
   unsigned int index;
 
   if (!PyArg_ParseTuple(args, "I:TeeSurface.index", &index))
     return NULL;
 
+  if (fanout != NULL) {
+    cairo_surface_t *target = tee_fanout_get_target (fanout, index);
+    if (target == NULL) {
+      Pycairo_Check_Status (CAIRO_STATUS_INVALID_INDEX);
+      return NULL;
+    }
+    return PycairoSurface_FromSurface (cairo_surface_reference (target),
+                                       NULL);
+  }
+
   return PycairoSurface_FromSurface (
     cairo_surface_reference (cairo_tee_surface_index (obj->surface, index)),
     NULL);
 }
 
+static PyObject *
+tee_surface_flush (PycairoTeeSurface *obj) {
+  tee_fanout_t *fanout = _tee_surface_get_fanout (obj);
+  cairo_status_t status;
+
+  if (fanout != NULL) {
+    status = tee_fanout_flush (fanout);
+    RETURN_NULL_IF_CAIRO_ERROR (status);
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  cairo_surface_flush (obj->surface);
+  Py_END_ALLOW_THREADS;
+  RETURN_NULL_IF_CAIRO_SURFACE_ERROR (obj->surface);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+tee_surface_finish (PycairoTeeSurface *obj) {
+  tee_fanout_t *fanout = _tee_surface_get_fanout (obj);
+  cairo_status_t status;
+
+  if (fanout != NULL) {
+    status = tee_fanout_flush (fanout);
+    RETURN_NULL_IF_CAIRO_ERROR (status);
+  }
+
+  cairo_surface_finish (obj->surface);
+  Py_CLEAR(obj->base);
+  RETURN_NULL_IF_CAIRO_SURFACE_ERROR (obj->surface);
+  Py_RETURN_NONE;
+}
+
 static PyMethodDef tee_surface_methods[] = {
   {"add",    (PyCFunction)tee_surface_add,    METH_VARARGS },
   {"remove", (PyCFunction)tee_surface_remove, METH_VARARGS },
   {"index",  (PyCFunction)tee_surface_index,  METH_VARARGS },
+  {"flush",  (PyCFunction)tee_surface_flush,  METH_NOARGS },
+  {"finish", (PyCFunction)tee_surface_finish, METH_NOARGS },
   {NULL, NULL, 0, NULL},
 };
 
@@ -0,0 +1,353 @@
+/* -*- mode: C; c-basic-offset: 2 -*-
+ *
+ * Pycairo - Python bindings for cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ */
+
+/* Parallel fan-out for TeeSurface. Instead of the targets themselves the
+ * cairo tee surface forwards to one recording surface per target, which
+ * queues the drawing. On flush each queue gets replayed onto its target on
+ * its own thread and replaced by an empty one, so the targets render in
+ * parallel instead of one after the other.
+ *
+ * The tee needs a master which can't be removed, an unbounded recording
+ * surface which gets cleared on every flush.
+ *
+ * cairo doesn't support reading a surface from several threads at once.
+ * Contexts note every drawing call reading a surface onto the tee, and the
+ * next flush then replays the queues holding a lock. Whatever is still queued
+ * when the tee gets destroyed is replayed on the spot, one target after
+ * the other. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include <stdlib.h>
+
+#include "config.h"
+#include "private.h"
+
+#if defined(CAIRO_HAS_TEE_SURFACE) && defined(CAIRO_HAS_RECORDING_SURFACE)
+#include <cairo-tee.h>
+
+struct _tee_fanout {
+  cairo_surface_t *tee; /* borrowed, the surface owns us */
+  cairo_surface_t *master; /* borrowed */
+  cairo_surface_t **targets;
+  cairo_surface_t **queues;
+  int n_targets;
+  int size_targets;
+  /* something drew from a surface since the last flush */
+  int uses_surfaces;
+};
+
+typedef struct {
+  cairo_surface_t **targets;
+  cairo_surface_t **queues;
+  cairo_status_t *status;
+  PyThread_type_lock source_lock; /* NULL if no queue reads a surface */
+} tee_replay_t;
+
+static const cairo_user_data_key_t tee_fanout_key;
+
+static cairo_status_t
+_tee_replay_queue (cairo_surface_t *target, cairo_surface_t *queue) {
+  cairo_status_t status;
+  cairo_t *cr;
+
+  cr = cairo_create (target);
+  cairo_set_source_surface (cr, queue, 0, 0);
+  cairo_paint (cr);
+  status = cairo_status (cr);
+  cairo_destroy (cr);
+  cairo_surface_flush (target);
+  return status;
+}
+
+static void
+_tee_fanout_destroy (void *data) {
+  tee_fanout_t *fanout = data;
+  int i;
+
+  /* the tee is gone and with it any thread safety guarantees, so no
+   * threads here. Errors have nobody to go to. */
+  for (i = 0; i < fanout->n_targets; i++)
+    _tee_replay_queue (fanout->targets[i], fanout->queues[i]);
+
+  for (i = 0; i < fanout->n_targets; i++) {
+    cairo_surface_destroy (fanout->targets[i]);
+    cairo_surface_destroy (fanout->queues[i]);
+  }
+  free (fanout->targets);
+  free (fanout->queues);
+  free (fanout);
+}
+
+/* Sets up tee, a tee surface with an unbounded recording surface as
+ * master, for parallel mode with target as the first target. Returns NULL
+ * and sets a Python exception on error. */
+tee_fanout_t *
+tee_fanout_attach (cairo_surface_t *tee, cairo_surface_t *target) {
+  tee_fanout_t *fanout;
+  cairo_status_t status;
+
+  fanout = calloc (1, sizeof (tee_fanout_t));
+  if (fanout == NULL) {
+    PyErr_NoMemory ();
+    return NULL;
+  }
+  fanout->tee = tee;
+  fanout->master = cairo_tee_surface_index (tee, 0);
+
+  status = tee_fanout_add (fanout, target);
+  if (status == CAIRO_STATUS_SUCCESS)
+    status = cairo_surface_set_user_data (
+      tee, &tee_fanout_key, fanout, _tee_fanout_destroy);
+  if (status != CAIRO_STATUS_SUCCESS) {
+    _tee_fanout_destroy (fanout);
+    Pycairo_Check_Status (status);
+    return NULL;
+  }
+
+  return fanout;
+}
+
+tee_fanout_t *
+tee_fanout_from_surface (cairo_surface_t *surface) {
+  return cairo_surface_get_user_data (surface, &tee_fanout_key);
+}
+
+cairo_status_t
+tee_fanout_add (tee_fanout_t *fanout, cairo_surface_t *target) {
+  cairo_surface_t *queue;
+  cairo_status_t status;
+
+  if (fanout->n_targets == fanout->size_targets) {
+    int size = fanout->size_targets ? fanout->size_targets * 2 : 4;
+    cairo_surface_t **targets, **queues;
+
+    targets = realloc (fanout->targets, size * sizeof (cairo_surface_t *));
+    if (targets == NULL)
+      return CAIRO_STATUS_NO_MEMORY;
+    fanout->targets = targets;
+    queues = realloc (fanout->queues, size * sizeof (cairo_surface_t *));
+    if (queues == NULL)
+      return CAIRO_STATUS_NO_MEMORY;
+    fanout->queues = queues;
+    fanout->size_targets = size;
+  }
+
+  queue = cairo_recording_surface_create (
+    cairo_surface_get_content (target), NULL);
+  status = cairo_surface_status (queue);
+  if (status != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy (queue);
+    return status;
+  }
+
+  cairo_tee_surface_add (fanout->tee, queue);
+  fanout->targets[fanout->n_targets] = cairo_surface_reference (target);
+  fanout->queues[fanout->n_targets] = queue;
+  fanout->n_targets++;
+  return CAIRO_STATUS_SUCCESS;
+}
+
+/* Drops target without replaying what is queued for it. */
+cairo_status_t
+tee_fanout_remove (tee_fanout_t *fanout, cairo_surface_t *target) {
+  int i;
+
+  for (i = 0; i < fanout->n_targets; i++) {
+    if (fanout->targets[i] == target)
+      break;
+  }
+  if (i == fanout->n_targets)
+    return CAIRO_STATUS_INVALID_INDEX;
+
+  cairo_tee_surface_remove (fanout->tee, fanout->queues[i]);
+  cairo_surface_destroy (fanout->targets[i]);
+  cairo_surface_destroy (fanout->queues[i]);
+  fanout->n_targets--;
+  for (; i < fanout->n_targets; i++) {
+    fanout->targets[i] = fanout->targets[i + 1];
+    fanout->queues[i] = fanout->queues[i + 1];
+  }
+  return CAIRO_STATUS_SUCCESS;
+}
+
+/* Returns the target at index (borrowed), or NULL if out of range. */
+cairo_surface_t *
+tee_fanout_get_target (tee_fanout_t *fanout, unsigned int index) {
+  if (index >= (unsigned int)fanout->n_targets)
+    return NULL;
+  return fanout->targets[index];
+}
+
+/* Remembers that cr, if it targets a parallel tee, is about to draw from
+ * a surface. Has to be called for every drawing call, as the next flush
+ * forgets about it. */
+void
+tee_fanout_note_surface (cairo_t *cr) {
+  tee_fanout_t *fanout = tee_fanout_from_surface (cairo_get_target (cr));
+
+  if (fanout != NULL)
+    fanout->uses_surfaces = 1;
+}
+
+void
+tee_fanout_note_pattern (cairo_t *cr, cairo_pattern_t *pattern) {
+  cairo_pattern_type_t type = cairo_pattern_get_type (pattern);
+
+  if (type == CAIRO_PATTERN_TYPE_SURFACE ||
+      type == CAIRO_PATTERN_TYPE_RASTER_SOURCE)
+    tee_fanout_note_surface (cr);
+}
+
+/* Pages would end up in the master recording surface and get dropped on
+ * the next flush. Returns -1 and sets an exception if surface is a tee in
+ * parallel mode. */
+int
+tee_fanout_check_page (cairo_surface_t *surface) {
+  if (tee_fanout_from_surface (surface) == NULL)
+    return 0;
+
+  PyErr_SetString (PyExc_RuntimeError,
+                   "pages aren't supported in parallel mode, flush() and "
+                   "call show_page() on the targets instead");
+  return -1;
+}
+
+static void
+_tee_replay_job (void *data, size_t job) {
+  tee_replay_t *replay = data;
+
+  if (replay->source_lock != NULL) {
+    PyThread_acquire_lock (replay->source_lock, WAIT_LOCK);
+    replay->status[job] = _tee_replay_queue (replay->targets[job],
+                                             replay->queues[job]);
+    PyThread_release_lock (replay->source_lock);
+  } else {
+    replay->status[job] = _tee_replay_queue (replay->targets[job],
+                                             replay->queues[job]);
+  }
+}
+
+/* Replays the queued drawing onto all targets, each on its own thread.
+ * Needs the GIL, which gets released while replaying. */
+cairo_status_t
+tee_fanout_flush (tee_fanout_t *fanout) {
+  cairo_status_t status = CAIRO_STATUS_SUCCESS;
+  int n = fanout->n_targets, i;
+  tee_replay_t replay;
+  cairo_t *cr;
+
+  if (n == 0)
+    return CAIRO_STATUS_SUCCESS;
+
+  replay.targets = malloc (n * sizeof (cairo_surface_t *));
+  replay.queues = malloc (n * sizeof (cairo_surface_t *));
+  replay.status = calloc (n, sizeof (cairo_status_t));
+  replay.source_lock = NULL;
+  if (replay.targets == NULL || replay.queues == NULL ||
+      replay.status == NULL) {
+    status = CAIRO_STATUS_NO_MEMORY;
+    goto DONE;
+  }
+  if (fanout->uses_surfaces) {
+    replay.source_lock = PyThread_allocate_lock ();
+    if (replay.source_lock == NULL) {
+      status = CAIRO_STATUS_NO_MEMORY;
+      goto DONE;
+    }
+  }
+
+  /* swap in empty queues, so drawing can go on while we replay. Drawing
+   * from now on is noted for the next flush */
+  for (i = 0; i < n; i++) {
+    replay.queues[i] = cairo_recording_surface_create (
+      cairo_surface_get_content (fanout->targets[i]), NULL);
+    status = cairo_surface_status (replay.queues[i]);
+    if (status != CAIRO_STATUS_SUCCESS) {
+      for (; i >= 0; i--)
+        cairo_surface_destroy (replay.queues[i]);
+      goto DONE;
+    }
+  }
+  for (i = 0; i < n; i++) {
+    cairo_surface_t *queue = fanout->queues[i];
+
+    cairo_tee_surface_remove (fanout->tee, queue);
+    cairo_tee_surface_add (fanout->tee, replay.queues[i]);
+    fanout->queues[i] = replay.queues[i];
+    replay.queues[i] = queue;
+    replay.targets[i] = cairo_surface_reference (fanout->targets[i]);
+  }
+  fanout->uses_surfaces = 0;
+
+  /* an unbounded clear makes cairo drop everything recorded so far */
+  cr = cairo_create (fanout->master);
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+
+  parallel_prepare ();
+  Py_BEGIN_ALLOW_THREADS;
+  if (parallel_run ((size_t)n, n, _tee_replay_job, &replay) < 0)
+    status = CAIRO_STATUS_NO_MEMORY;
+  Py_END_ALLOW_THREADS;
+
+  for (i = 0; i < n; i++) {
+    if (status == CAIRO_STATUS_SUCCESS)
+      status = replay.status[i];
+    cairo_surface_destroy (replay.queues[i]);
+    cairo_surface_destroy (replay.targets[i]);
+  }
+
+DONE:
+  if (replay.source_lock != NULL)
+    PyThread_free_lock (replay.source_lock);
+  free (replay.targets);
+  free (replay.queues);
+  free (replay.status);
+  return status;
+}
+
+#else
+
+void
+tee_fanout_note_surface (cairo_t *cr) {
+}
+
+void
+tee_fanout_note_pattern (cairo_t *cr, cairo_pattern_t *pattern) {
+}
+
+int
+tee_fanout_check_page (cairo_surface_t *surface) {
+  return 0;
+}
+
+#endif  /* CAIRO_HAS_TEE_SURFACE && CAIRO_HAS_RECORDING_SURFACE */
@@ -0,0 +1,152 @@
+/* -*- mode: C; c-basic-offset: 2 -*-
+ *
+ * Pycairo - Python bindings for cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ */
+
+/* Runs a number of independent jobs on short lived native threads. The jobs
+ * must not touch Python objects without taking the GIL, which the caller
+ * has to release while waiting. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include <stdlib.h>
+
+#include "config.h"
+#include "private.h"
+
+#ifndef PYTHREAD_INVALID_THREAD_ID
+#define PYTHREAD_INVALID_THREAD_ID (-1)
+#endif
+
+typedef struct {
+  parallel_job_func_t func;
+  void *data;
+  size_t n_jobs;
+  size_t next_job;
+  int running;
+  PyThread_type_lock lock;
+  PyThread_type_lock done;
+} parallel_run_t;
+
+static void
+_parallel_work (parallel_run_t *run) {
+  size_t job;
+
+  for (;;) {
+    PyThread_acquire_lock (run->lock, WAIT_LOCK);
+    job = run->next_job++;
+    PyThread_release_lock (run->lock);
+    if (job >= run->n_jobs)
+      break;
+    run->func (run->data, job);
+  }
+}
+
+static void
+_parallel_worker (void *data) {
+  parallel_run_t *run = data;
+  int last;
+
+  _parallel_work (run);
+
+  PyThread_acquire_lock (run->lock, WAIT_LOCK);
+  last = --run->running == 0;
+  PyThread_release_lock (run->lock);
+  if (last)
+    PyThread_release_lock (run->done);
+}
+
+/* Must be called with the GIL held before releasing it for
+ * parallel_run(). */
+void
+parallel_prepare (void) {
+#if PY_VERSION_HEX < 0x03070000
+  PyEval_InitThreads ();
+#endif
+}
+
+/* Calls func(data, i) for all i in [0, n_jobs) using up to n_threads
+ * threads, including the calling one, and returns once all are done.
+ * Doesn't need the GIL. Returns -1 if the needed locks couldn't be
+ * created. */
+int
+parallel_run (size_t n_jobs, int n_threads, parallel_job_func_t func,
+              void *data) {
+  parallel_run_t run;
+  int i;
+
+  if (n_threads <= 1 || n_jobs <= 1) {
+    size_t job;
+    for (job = 0; job < n_jobs; job++)
+      func (data, job);
+    return 0;
+  }
+
+  if ((size_t)n_threads > n_jobs)
+    n_threads = (int)n_jobs;
+
+  run.func = func;
+  run.data = data;
+  run.n_jobs = n_jobs;
+  run.next_job = 0;
+  run.running = 0;
+  run.lock = PyThread_allocate_lock ();
+  run.done = PyThread_allocate_lock ();
+  if (run.lock == NULL || run.done == NULL) {
+    if (run.lock != NULL)
+      PyThread_free_lock (run.lock);
+    if (run.done != NULL)
+      PyThread_free_lock (run.done);
+    return -1;
+  }
+
+  /* done gets released by the last worker */
+  PyThread_acquire_lock (run.done, WAIT_LOCK);
+
+  PyThread_acquire_lock (run.lock, WAIT_LOCK);
+  for (i = 1; i < n_threads; i++) {
+    run.running++;
+    if (PyThread_start_new_thread (_parallel_worker, &run) ==
+        PYTHREAD_INVALID_THREAD_ID) {
+      /* we'll do the remaining work ourselves */
+      run.running--;
+      break;
+    }
+  }
+  PyThread_release_lock (run.lock);
+
+  _parallel_work (&run);
+
+  /* the last worker releases done as the very last thing touching run */
+  if (i > 1)
+    PyThread_acquire_lock (run.done, WAIT_LOCK);
+
+  PyThread_free_lock (run.lock);
+  PyThread_free_lock (run.done);
+  return 0;
+}
@@ -0,0 +1,683 @@
+/* -*- mode: C; c-basic-offset: 2 -*-
+ *
+ * Pycairo - Python bindings for cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ */
+
+/* A grid of ARGB32 image tiles backing a recording surface with a display
+ * list, used for canvases larger than what a single image surface allows.
+ *
+ * Drawing goes into the recording and its display list. On flush all
+ * commands added since the last flush get replayed onto the tiles they
+ * intersect, one job per tile, so tiles can be rasterized in parallel, and
+ * then get dropped from the display list. Only the recording keeps them,
+ * for repainting the tiles if the display list stops being indexable.
+ * Tiles which never got drawn on aren't allocated.
+ *
+ * Nothing in here touches Python objects; everything except
+ * tile_grid_attach() can be used with the GIL released.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "private.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef CAIRO_HAS_RECORDING_SURFACE
+
+struct _tile_grid {
+  cairo_surface_t *surface; /* borrowed, the surface owns us */
+  int width;
+  int height;
+  int tile_size;
+  int cols;
+  int rows;
+  int threads;
+  cairo_surface_t **tiles; /* cols * rows, row major, NULL if empty */
+  int damaged; /* a cancelled flush left the tiles half drawn */
+};
+
+static const cairo_user_data_key_t tile_grid_key;
+
+static void
+_tile_grid_destroy (void *data) {
+  tile_grid_t *grid = data;
+  int i;
+
+  for (i = 0; i < grid->cols * grid->rows; i++) {
+    if (grid->tiles[i] != NULL)
+      cairo_surface_destroy (grid->tiles[i]);
+  }
+  free (grid->tiles);
+  free (grid);
+}
+
+/* Creates a tile grid for the area (0, 0, width, height) of surface, which
+ * needs to have a display list for it. Returns NULL and sets a Python
+ * exception on error. */
+tile_grid_t *
+tile_grid_attach (cairo_surface_t *surface, int width, int height,
+                  int tile_size, int threads) {
+  tile_grid_t *grid;
+  cairo_status_t status;
+
+  grid = calloc (1, sizeof (tile_grid_t));
+  if (grid == NULL) {
+    PyErr_NoMemory ();
+    return NULL;
+  }
+
+  grid->surface = surface;
+  grid->width = width;
+  grid->height = height;
+  grid->tile_size = tile_size;
+  grid->cols = (int)(((long)width + tile_size - 1) / tile_size);
+  grid->rows = (int)(((long)height + tile_size - 1) / tile_size);
+  grid->threads = threads;
+  grid->tiles = calloc ((size_t)grid->cols * grid->rows,
+                        sizeof (cairo_surface_t *));
+  if (grid->tiles == NULL) {
+    free (grid);
+    PyErr_NoMemory ();
+    return NULL;
+  }
+
+  status = cairo_surface_set_user_data (
+    surface, &tile_grid_key, grid, _tile_grid_destroy);
+  if (status != CAIRO_STATUS_SUCCESS) {
+    _tile_grid_destroy (grid);
+    Pycairo_Check_Status (status);
+    return NULL;
+  }
+
+  return grid;
+}
+
+tile_grid_t *
+tile_grid_from_surface (cairo_surface_t *surface) {
+  return cairo_surface_get_user_data (surface, &tile_grid_key);
+}
+
+void
+tile_grid_get_layout (tile_grid_t *grid, int *width, int *height,
+                      int *tile_size, int *cols, int *rows) {
+  *width = grid->width;
+  *height = grid->height;
+  *tile_size = grid->tile_size;
+  *cols = grid->cols;
+  *rows = grid->rows;
+}
+
+static void
+_tile_grid_get_rectangle (tile_grid_t *grid, int index,
+                          cairo_rectangle_int_t *rect) {
+  int col = index % grid->cols, row = index / grid->cols;
+
+  rect->x = col * grid->tile_size;
+  rect->y = row * grid->tile_size;
+  rect->width = grid->width - rect->x < grid->tile_size ?
+    grid->width - rect->x : grid->tile_size;
+  rect->height = grid->height - rect->y < grid->tile_size ?
+    grid->height - rect->y : grid->tile_size;
+}
+
+static cairo_status_t
+_tile_grid_ensure_tile (tile_grid_t *grid, int index) {
+  cairo_rectangle_int_t rect;
+  cairo_surface_t *tile;
+  cairo_status_t status;
+
+  if (grid->tiles[index] != NULL)
+    return CAIRO_STATUS_SUCCESS;
+
+  _tile_grid_get_rectangle (grid, index, &rect);
+  tile = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                     rect.width, rect.height);
+  status = cairo_surface_status (tile);
+  if (status != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy (tile);
+    return status;
+  }
+
+  grid->tiles[index] = tile;
+  return CAIRO_STATUS_SUCCESS;
+}
+
+typedef struct {
+  int index;
+  size_t *ids;
+  size_t n_ids;
+  cairo_status_t status;
+} tile_job_t;
+
+typedef struct {
+  tile_grid_t *grid;
+  display_list_t *dl;
+  tile_job_t *jobs;
+  PyThread_type_lock source_lock;
+  cancel_state_t *cancel;
+} tile_flush_t;
+
+static void
+_tile_grid_render_job (void *data, size_t job_index) {
+  tile_flush_t *flush = data;
+  tile_job_t *job = &flush->jobs[job_index];
+  cairo_rectangle_int_t rect;
+  cairo_t *cr;
+
+  _tile_grid_get_rectangle (flush->grid, job->index, &rect);
+  cr = cairo_create (flush->grid->tiles[job->index]);
+  cairo_translate (cr, -rect.x, -rect.y);
+  job->status = display_list_replay_ids (flush->dl, cr, job->ids, job->n_ids,
+                                         flush->source_lock, flush->cancel);
+  cairo_destroy (cr);
+}
+
+/* Rasterizes the commands of the display list, one job per tile, and drops
+ * them once they are on the tiles. */
+static cairo_status_t
+_tile_grid_flush_commands (tile_grid_t *grid, display_list_t *dl,
+                           cancel_state_t *cancel) {
+  int n_tiles = grid->cols * grid->rows, i, n_jobs = 0;
+  cairo_status_t status = CAIRO_STATUS_SUCCESS;
+  tile_flush_t flush;
+
+  if (display_list_get_size (dl) == 0)
+    return CAIRO_STATUS_SUCCESS;
+
+  flush.grid = grid;
+  flush.dl = dl;
+  flush.cancel = cancel;
+  flush.jobs = calloc ((size_t)n_tiles, sizeof (tile_job_t));
+  flush.source_lock = PyThread_allocate_lock ();
+  if (flush.jobs == NULL || flush.source_lock == NULL) {
+    status = CAIRO_STATUS_NO_MEMORY;
+    goto DONE;
+  }
+
+  /* the index gets (re)built lazily, so query it from this thread only */
+  for (i = 0; i < n_tiles; i++) {
+    tile_job_t *job = &flush.jobs[n_jobs];
+    cairo_rectangle_int_t rect;
+    pycairo_box_t box;
+
+    _tile_grid_get_rectangle (grid, i, &rect);
+    box.x1 = rect.x;
+    box.y1 = rect.y;
+    box.x2 = rect.x + rect.width;
+    box.y2 = rect.y + rect.height;
+    if (display_list_query (dl, &box, 0, &job->ids, &job->n_ids) < 0) {
+      status = CAIRO_STATUS_NO_MEMORY;
+      goto DONE;
+    }
+    if (job->n_ids == 0) {
+      free (job->ids);
+      job->ids = NULL;
+      continue;
+    }
+
+    n_jobs++;
+    job->index = i;
+    status = _tile_grid_ensure_tile (grid, i);
+    if (status != CAIRO_STATUS_SUCCESS)
+      goto DONE;
+  }
+
+  if (parallel_run ((size_t)n_jobs, grid->threads, _tile_grid_render_job,
+                    &flush) < 0) {
+    status = CAIRO_STATUS_NO_MEMORY;
+    goto DONE;
+  }
+
+  for (i = 0; i < n_jobs; i++) {
+    if (flush.jobs[i].status != CAIRO_STATUS_SUCCESS) {
+      status = flush.jobs[i].status;
+      /* some tiles may have gotten part of the commands */
+      if (status == PYCAIRO_STATUS_CANCELLED ||
+          status == PYCAIRO_STATUS_DEADLINE_EXCEEDED)
+        grid->damaged = 1;
+      goto DONE;
+    }
+  }
+  display_list_discard (dl);
+
+DONE:
+  if (flush.jobs != NULL) {
+    for (i = 0; i < n_jobs; i++)
+      free (flush.jobs[i].ids);
+    free (flush.jobs);
+  }
+  if (flush.source_lock != NULL)
+    PyThread_free_lock (flush.source_lock);
+  return status;
+}
+
+/* Without a usable index the tiles get redrawn from the recording. Replaying
+ * a recording isn't thread safe, so this is serial. */
+static cairo_status_t
+_tile_grid_repaint (tile_grid_t *grid, cancel_state_t *cancel) {
+  double x, y, width, height;
+  int i;
+
+  cairo_recording_surface_ink_extents (grid->surface, &x, &y, &width, &height);
+
+  for (i = 0; i < grid->cols * grid->rows; i++) {
+    cairo_rectangle_int_t rect;
+    cairo_status_t status;
+    cairo_t *cr;
+    int inked;
+
+    /* every tile gets cleared first, so stopping here is fine */
+    status = cancel_state_check (cancel);
+    if (status != CAIRO_STATUS_SUCCESS)
+      return status;
+
+    _tile_grid_get_rectangle (grid, i, &rect);
+    inked = width > 0 && height > 0 &&
+      x < rect.x + rect.width && rect.x < x + width &&
+      y < rect.y + rect.height && rect.y < y + height;
+    if (!inked && grid->tiles[i] == NULL)
+      continue;
+
+    status = _tile_grid_ensure_tile (grid, i);
+    if (status != CAIRO_STATUS_SUCCESS)
+      return status;
+
+    cr = cairo_create (grid->tiles[i]);
+    cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint (cr);
+    if (inked) {
+      cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+      cairo_set_source_surface (cr, grid->surface, -rect.x, -rect.y);
+      cairo_paint (cr);
+    }
+    status = cairo_status (cr);
+    cairo_destroy (cr);
+    if (status != CAIRO_STATUS_SUCCESS)
+      return status;
+  }
+
+  return CAIRO_STATUS_SUCCESS;
+}
+
+/* Brings the tiles up to date with what got drawn on the surface, unless
+ * cancel (can be NULL) gets cancelled first. Doesn't need the GIL, but
+ * parallel_prepare() has to be called before releasing it. */
+cairo_status_t
+tile_grid_flush (tile_grid_t *grid, cancel_state_t *cancel) {
+  display_list_t *dl = display_list_from_surface (grid->surface);
+  cairo_status_t status;
+
+  display_list_acquire (dl);
+  if (display_list_is_indexable (dl) && !grid->damaged) {
+    status = _tile_grid_flush_commands (grid, dl, cancel);
+  } else {
+    status = _tile_grid_repaint (grid, cancel);
+    if (status == CAIRO_STATUS_SUCCESS) {
+      grid->damaged = 0;
+      display_list_discard (dl);
+    }
+  }
+  display_list_release (dl);
+
+  return status;
+}
+
+/* Returns a new reference to the tile at (col, row), allocating an empty
+ * one if needed. Doesn't need the GIL. */
+cairo_status_t
+tile_grid_get_tile (tile_grid_t *grid, int col, int row,
+                    cairo_surface_t **tile) {
+  display_list_t *dl = display_list_from_surface (grid->surface);
+  int index = row * grid->cols + col;
+  cairo_status_t status;
+
+  display_list_acquire (dl);
+  status = _tile_grid_ensure_tile (grid, index);
+  if (status == CAIRO_STATUS_SUCCESS)
+    *tile = cairo_surface_reference (grid->tiles[index]);
+  display_list_release (dl);
+
+  return status;
+}
+
+/* Streaming PNG encoder -------------------------------------------------- */
+
+/* The image gets encoded one row at a time, so the whole canvas never needs
+ * to exist in one piece. Without zlib the pixel data is written in stored
+ * (uncompressed) deflate blocks, giving files of about the size of the
+ * pixel data, which the docs warn about. */
+
+#define PNG_CHUNK_SIZE (256 * 1024)
+#define PNG_STORED_BLOCK_SIZE 65535
+
+typedef struct {
+  cairo_write_func_t write_func;
+  void *closure;
+  cairo_status_t status;
+  uint32_t crc_table[256];
+  unsigned char *chunk; /* length and type, then data */
+  size_t length;
+#ifdef HAVE_ZLIB
+  z_stream zstream;
+  unsigned char *deflated;
+#else
+  uint32_t adler;
+#endif
+} png_writer_t;
+
+static void
+_png_writer_init_crc (png_writer_t *writer) {
+  uint32_t c;
+  int n, k;
+
+  for (n = 0; n < 256; n++) {
+    c = (uint32_t)n;
+    for (k = 0; k < 8; k++)
+      c = c & 1 ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+    writer->crc_table[n] = c;
+  }
+}
+
+static uint32_t
+_png_writer_crc (png_writer_t *writer, const unsigned char *data,
+                 size_t length) {
+  uint32_t c = 0xffffffffUL;
+  size_t i;
+
+  for (i = 0; i < length; i++)
+    c = writer->crc_table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+  return c ^ 0xffffffffUL;
+}
+
+static void
+_put_uint32 (unsigned char *p, uint32_t value) {
+  p[0] = (unsigned char)(value >> 24);
+  p[1] = (unsigned char)(value >> 16);
+  p[2] = (unsigned char)(value >> 8);
+  p[3] = (unsigned char)value;
+}
+
+static void
+_png_writer_write (png_writer_t *writer, const unsigned char *data,
+                   size_t length) {
+  if (writer->status != CAIRO_STATUS_SUCCESS)
+    return;
+  writer->status = writer->write_func (writer->closure, data,
+                                       (unsigned int)length);
+}
+
+/* Writes a chunk whose data is at writer->chunk + 8. */
+static void
+_png_writer_write_chunk (png_writer_t *writer, const char *type,
+                         size_t length) {
+  unsigned char *chunk = writer->chunk;
+
+  _put_uint32 (chunk, (uint32_t)length);
+  memcpy (chunk + 4, type, 4);
+  _put_uint32 (chunk + 8 + length,
+               _png_writer_crc (writer, chunk + 4, length + 4));
+  _png_writer_write (writer, chunk, length + 12);
+}
+
+static void
+_png_writer_flush_idat (png_writer_t *writer) {
+  if (writer->length > 0)
+    _png_writer_write_chunk (writer, "IDAT", writer->length);
+  writer->length = 0;
+}
+
+/* Appends compressed data to the pending IDAT chunk. */
+static void
+_png_writer_append (png_writer_t *writer, const unsigned char *data,
+                    size_t length) {
+  while (length > 0 && writer->status == CAIRO_STATUS_SUCCESS) {
+    size_t n = PNG_CHUNK_SIZE - writer->length;
+    if (n > length)
+      n = length;
+    memcpy (writer->chunk + 8 + writer->length, data, n);
+    writer->length += n;
+    data += n;
+    length -= n;
+    if (writer->length == PNG_CHUNK_SIZE)
+      _png_writer_flush_idat (writer);
+  }
+}
+
+#ifdef HAVE_ZLIB
+
+static int
+_png_writer_begin_stream (png_writer_t *writer) {
+  memset (&writer->zstream, 0, sizeof (z_stream));
+  writer->deflated = malloc (PNG_CHUNK_SIZE);
+  if (writer->deflated == NULL)
+    return -1;
+  if (deflateInit (&writer->zstream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+    free (writer->deflated);
+    writer->deflated = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+static void
+_png_writer_deflate (png_writer_t *writer, const unsigned char *data,
+                     size_t length, int last) {
+  z_stream *zs = &writer->zstream;
+  int ret;
+
+  zs->next_in = (Bytef *)data;
+  zs->avail_in = (uInt)length;
+  do {
+    zs->next_out = writer->deflated;
+    zs->avail_out = PNG_CHUNK_SIZE;
+    ret = deflate (zs, last ? Z_FINISH : Z_NO_FLUSH);
+    if (ret == Z_STREAM_ERROR) {
+      writer->status = CAIRO_STATUS_NO_MEMORY;
+      return;
+    }
+    _png_writer_append (writer, writer->deflated,
+                        PNG_CHUNK_SIZE - zs->avail_out);
+  } while (zs->avail_out == 0 || (last && ret != Z_STREAM_END));
+}
+
+static void
+_png_writer_end_stream (png_writer_t *writer) {
+  deflateEnd (&writer->zstream);
+  free (writer->deflated);
+}
+
+#else  /* HAVE_ZLIB */
+
+static int
+_png_writer_begin_stream (png_writer_t *writer) {
+  static const unsigned char header[2] = {0x78, 0x01};
+
+  writer->adler = 1;
+  _png_writer_append (writer, header, sizeof (header));
+  return 0;
+}
+
+static void
+_png_writer_deflate (png_writer_t *writer, const unsigned char *data,
+                     size_t length, int last) {
+  unsigned char block[5];
+  uint32_t a = writer->adler & 0xffff, b = writer->adler >> 16;
+  size_t i;
+
+  for (i = 0; i < length; i++) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  writer->adler = (b << 16) | a;
+
+  while (length > 0 || last) {
+    size_t n = length < PNG_STORED_BLOCK_SIZE ? length :
+      PNG_STORED_BLOCK_SIZE;
+    int final = last && n == length;
+
+    block[0] = final ? 1 : 0;
+    block[1] = (unsigned char)n;
+    block[2] = (unsigned char)(n >> 8);
+    block[3] = (unsigned char)~n;
+    block[4] = (unsigned char)(~n >> 8);
+    _png_writer_append (writer, block, sizeof (block));
+    _png_writer_append (writer, data, n);
+    data += n;
+    length -= n;
+    if (final) {
+      _put_uint32 (block, writer->adler);
+      _png_writer_append (writer, block, 4);
+      break;
+    }
+  }
+}
+
+static void
+_png_writer_end_stream (png_writer_t *writer) {
+}
+
+#endif  /* HAVE_ZLIB */
+
+/* Converts one premultiplied ARGB32 row to straight RGBA. */
+static void
+_unpremultiply_row (const uint32_t *src, unsigned char *dst, int width) {
+  int i;
+
+  for (i = 0; i < width; i++) {
+    uint32_t pixel = src[i];
+    unsigned int alpha = pixel >> 24;
+
+    if (alpha == 0) {
+      dst[0] = dst[1] = dst[2] = dst[3] = 0;
+    } else {
+      dst[0] = (unsigned char)((((pixel >> 16) & 0xff) * 255 + alpha / 2) /
+                               alpha);
+      dst[1] = (unsigned char)((((pixel >> 8) & 0xff) * 255 + alpha / 2) /
+                               alpha);
+      dst[2] = (unsigned char)(((pixel & 0xff) * 255 + alpha / 2) / alpha);
+      dst[3] = (unsigned char)alpha;
+    }
+    dst += 4;
+  }
+}
+
+/* Writes the tiles as one RGBA PNG image, stopping early if cancel (can be
+ * NULL) gets cancelled. Needs a flushed grid. Doesn't need the GIL. */
+cairo_status_t
+tile_grid_write_png (tile_grid_t *grid, cairo_write_func_t write_func,
+                     void *closure, cancel_state_t *cancel) {
+  static const unsigned char signature[8] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  display_list_t *dl = display_list_from_surface (grid->surface);
+  size_t row_size = 1 + (size_t)grid->width * 4;
+  png_writer_t writer;
+  unsigned char *row;
+  int y;
+
+  writer.write_func = write_func;
+  writer.closure = closure;
+  writer.status = CAIRO_STATUS_SUCCESS;
+  writer.length = 0;
+  _png_writer_init_crc (&writer);
+
+  writer.chunk = malloc (PNG_CHUNK_SIZE + 12);
+  row = malloc (row_size);
+  if (writer.chunk == NULL || row == NULL) {
+    free (writer.chunk);
+    free (row);
+    return CAIRO_STATUS_NO_MEMORY;
+  }
+
+  _png_writer_write (&writer, signature, sizeof (signature));
+
+  _put_uint32 (writer.chunk + 8, (uint32_t)grid->width);
+  _put_uint32 (writer.chunk + 12, (uint32_t)grid->height);
+  writer.chunk[16] = 8; /* bit depth */
+  writer.chunk[17] = 6; /* RGBA */
+  writer.chunk[18] = 0; /* deflate */
+  writer.chunk[19] = 0; /* adaptive filtering */
+  writer.chunk[20] = 0; /* no interlace */
+  _png_writer_write_chunk (&writer, "IHDR", 13);
+
+  if (_png_writer_begin_stream (&writer) < 0) {
+    free (writer.chunk);
+    free (row);
+    return CAIRO_STATUS_NO_MEMORY;
+  }
+
+  /* keep drawing threads from adding tiles while we read them */
+  display_list_acquire (dl);
+  row[0] = 0; /* filter type None */
+  for (y = 0; y < grid->height && writer.status == CAIRO_STATUS_SUCCESS;
+       y++) {
+    int tile_row = y / grid->tile_size, col;
+
+    for (col = 0; col < grid->cols; col++) {
+      cairo_surface_t *tile = grid->tiles[tile_row * grid->cols + col];
+      int x = col * grid->tile_size;
+      int width = grid->width - x < grid->tile_size ?
+        grid->width - x : grid->tile_size;
+      unsigned char *dst = row + 1 + (size_t)x * 4;
+
+      if (tile == NULL) {
+        memset (dst, 0, (size_t)width * 4);
+      } else {
+        unsigned char *data;
+
+        if (y % grid->tile_size == 0)
+          cairo_surface_flush (tile);
+        data = cairo_image_surface_get_data (tile) +
+          (size_t)(y % grid->tile_size) * cairo_image_surface_get_stride (tile);
+        _unpremultiply_row ((const uint32_t *)data, dst, width);
+      }
+    }
+
+    _png_writer_deflate (&writer, row, row_size, y == grid->height - 1);
+    if (writer.status == CAIRO_STATUS_SUCCESS)
+      writer.status = cancel_state_check (cancel);
+  }
+  display_list_release (dl);
+
+  _png_writer_flush_idat (&writer);
+  _png_writer_write_chunk (&writer, "IEND", 0);
+  _png_writer_end_stream (&writer);
+
+  free (writer.chunk);
+  free (row);
+  return writer.status;
+}
+
+#endif  /* CAIRO_HAS_RECORDING_SURFACE */
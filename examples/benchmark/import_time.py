@@ -0,0 +1,55 @@
+#!/usr/bin/env python
+
+"""Measures how long 'import cairo' takes in a fresh interpreter.
+
+The types of rarely used backends (PDF, PS, SVG, script, tee, raster
+source) get registered on first access, so a plain import only pays for
+the core types. The second measurement accesses just those right after the
+import.
+
+For a comparison with registering everything on import, run this once
+against a normal build and once against one built with
+CFLAGS=-DPYCAIRO_EAGER_TYPES.
+"""
+
+from __future__ import print_function
+
+import sys
+import subprocess
+import timeit
+
+LAZY = ["PDFSurface", "PSSurface", "SVGSurface", "ScriptDevice",
+        "ScriptSurface", "TeeSurface", "RasterSourcePattern"]
+
+PLAIN = "import cairo"
+
+ACCESS = """\
+import cairo
+for name in %r:
+    getattr(cairo._cairo, name, None)
+""" % LAZY
+
+
+def measure(code, repeat):
+    times = []
+    for i in range(repeat):
+        start = timeit.default_timer()
+        subprocess.check_call([sys.executable, "-c", code])
+        times.append(timeit.default_timer() - start)
+    return min(times)
+
+
+def main(argv):
+    repeat = int(argv[1]) if len(argv) > 1 else 20
+
+    # the interpreter startup is the same in both, subtract it
+    base = measure("pass", repeat)
+    plain = measure(PLAIN, repeat) - base
+    access = measure(ACCESS, repeat) - base
+
+    print("import cairo:                  %.2f ms" % (plain * 1000))
+    print("import cairo + backend types:  %.2f ms" % (access * 1000))
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,109 @@
+#!/usr/bin/env python
+
+"""Training workload for profile guided builds ('setup.py build_ext --pgo').
+
+Renders all cairo snippets to the available backends and runs a few loops
+over the hot paths of the bindings: many small Context calls, display list
+recording/replay and PNG encoding. It should cover what real programs do,
+not be fast.
+"""
+
+from __future__ import print_function
+
+import io
+import os
+import sys
+
+import cairo
+
+sys.path.insert(0, os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), "..", "cairo_snippets"))
+
+from snippets import get_snippets  # noqa: E402
+
+
+WIDTH, HEIGHT = 256, 256
+
+
+def draw_snippet(snippet, surface):
+    cr = cairo.Context(surface)
+    cr.save()
+    snippet.draw_func(cr, WIDTH, HEIGHT)
+    cr.restore()
+    cr.show_page()
+
+
+def run_snippets(snippets):
+    for snippet in snippets:
+        surface = cairo.ImageSurface(cairo.FORMAT_ARGB32, WIDTH, HEIGHT)
+        draw_snippet(snippet, surface)
+        surface.write_to_png(io.BytesIO())
+
+        if cairo.HAS_RECORDING_SURFACE:
+            recording = cairo.RecordingSurface(
+                cairo.CONTENT_COLOR_ALPHA, (0, 0, WIDTH, HEIGHT))
+            cr = cairo.Context(recording)
+            snippet.draw_func(cr, WIDTH, HEIGHT)
+            target = cairo.ImageSurface(cairo.FORMAT_RGB24, WIDTH, HEIGHT)
+            cr = cairo.Context(target)
+            cr.set_source_surface(recording)
+            cr.paint()
+
+        for has, type_ in [("HAS_PDF_SURFACE", "PDFSurface"),
+                           ("HAS_PS_SURFACE", "PSSurface"),
+                           ("HAS_SVG_SURFACE", "SVGSurface")]:
+            if getattr(cairo, has):
+                surface = getattr(cairo, type_)(io.BytesIO(), WIDTH, HEIGHT)
+                draw_snippet(snippet, surface)
+                surface.finish()
+
+
+def run_context_calls(n):
+    surface = cairo.ImageSurface(cairo.FORMAT_ARGB32, WIDTH, HEIGHT)
+    cr = cairo.Context(surface)
+    for i in range(n):
+        x, y = i % WIDTH, (i * 7) % HEIGHT
+        cr.save()
+        cr.translate(x, y)
+        cr.set_source_rgba(i % 3 / 2.0, 0.5, 0.25, 0.8)
+        cr.set_line_width(1 + i % 4)
+        cr.move_to(0, 0)
+        cr.line_to(10, 5)
+        cr.curve_to(12, 8, 4, 10, 0, 10)
+        cr.close_path()
+        cr.fill_preserve()
+        cr.stroke()
+        cr.restore()
+    cr.get_matrix()
+    cr.get_operator()
+    cr.copy_path_flat()
+
+
+def run_display_list(n):
+    if not cairo.HAS_RECORDING_SURFACE:
+        return
+    surface = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 1024, 1024))
+    cr = cairo.Context(surface)
+    for i in range(n):
+        cr.rectangle((i * 37) % 1000, (i * 91) % 1000, 12, 12)
+        cr.fill()
+    target = cairo.ImageSurface(cairo.FORMAT_ARGB32, 1024, 1024)
+    for i in range(16):
+        x, y = (i % 4) * 256, (i // 4) * 256
+        surface.replay(target, (x, y, 256, 256))
+    surface.replay(target)
+
+
+def main(argv):
+    rounds = int(argv[1]) if len(argv) > 1 else 3
+    snippets = [s for n, s in sorted(get_snippets().items())]
+
+    for i in range(rounds):
+        run_snippets(snippets)
+        run_context_calls(20000)
+        run_display_list(5000)
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -5,7 +5,10 @@ import subprocess
 import sys
 import os
 import errno
+import glob
+import shutil
 from distutils.core import Extension, setup, Command, Distribution
+from distutils.ccompiler import get_default_compiler
 from distutils import sysconfig
 
 
@@ -31,6 +34,18 @@ def _check_output(command):
         raise SystemExit(e)
 
 
+def _compiler_is_clang(compiler_so):
+    # the name says nothing if clang is installed as "cc" or behind ccache,
+    # so ask the compiler itself
+    command = []
+    for arg in compiler_so:
+        if arg.startswith("-"):
+            break
+        command.append(arg)
+    output = _check_output(command + ["--version"])
+    return b"clang" in output.lower()
+
+
 def pkg_config_version_check(pkg, version):
     command = [
         "pkg-config",
@@ -42,6 +57,15 @@ def pkg_config_version_check(pkg, version):
     _check_output(command)
 
 
+def pkg_config_exists(pkg):
+    command = ["pkg-config", "--exists", pkg]
+
+    try:
+        return subprocess.call(command) == 0
+    except OSError:
+        return False
+
+
 def pkg_config_parse(opt, pkg):
     command = ["pkg-config", opt, pkg]
     ret = _check_output(command)
@@ -162,11 +186,14 @@ class build_ext(du_build_ext):
 
     user_options = du_build_ext.user_options + [
         ("enable-xpyb", None, "Build with xpyb support (default=disabled)"),
+        ("pgo", None, "Build with profile guided optimization and LTO "
+                      "(GCC/Clang only, default=disabled)"),
     ]
 
     def initialize_options(self):
         du_build_ext.initialize_options(self)
         self.enable_xpyb = None
+        self.pgo = None
 
     def finalize_options(self):
         du_build_ext.finalize_options(self)
@@ -174,6 +201,7 @@ class build_ext(du_build_ext):
         self.set_undefined_options(
             'build',
             ('enable_xpyb', 'enable_xpyb'),
+            ('pgo', 'pgo'),
         )
 
     def run(self):
@@ -190,12 +218,95 @@ class build_ext(du_build_ext):
             ext.library_dirs += pkg_config_parse('--libs-only-L', 'xpyb')
             ext.libraries += pkg_config_parse('--libs-only-l', 'xpyb')
 
+        # zlib is optional, used for compressing ScriptDevice output
+        if pkg_config_exists("zlib"):
+            ext = self.extensions[0]
+            ext.define_macros += [("HAVE_ZLIB", None)]
+            ext.include_dirs += pkg_config_parse('--cflags-only-I', 'zlib')
+            ext.library_dirs += pkg_config_parse('--libs-only-L', 'zlib')
+            ext.libraries += pkg_config_parse('--libs-only-l', 'zlib')
+
         script_dir = os.path.dirname(os.path.realpath(__file__))
         target = os.path.join(script_dir, "cairo", "config.h")
         write_config_file(target, PYCAIRO_VERSION)
 
+        if self.pgo:
+            self.run_pgo(script_dir)
+        else:
+            du_build_ext.run(self)
+
+    def run_pgo(self, script_dir):
+        """Builds an instrumented extension, runs the training workload
+        with it and rebuilds using the collected profile and LTO.
+        """
+
+        compiler = self.compiler
+        if (compiler or get_default_compiler()) not in (
+                "unix", "mingw32", "cygwin"):
+            raise SystemExit("--pgo is only supported with GCC and Clang")
+
+        ext = self.extensions[0]
+        compile_args = list(ext.extra_compile_args or [])
+        link_args = list(ext.extra_link_args or [])
+
+        profile_dir = os.path.abspath(os.path.join(self.build_temp, "pgo"))
+        shutil.rmtree(profile_dir, ignore_errors=True)
+        self.mkpath(profile_dir)
+
+        # everything has to be rebuilt in both steps
+        self.force = True
+
+        generate = ["-fprofile-generate=" + profile_dir]
+        ext.extra_compile_args = compile_args + generate
+        ext.extra_link_args = link_args + generate
         du_build_ext.run(self)
 
+        is_clang = _compiler_is_clang(self.compiler.compiler_so)
+        self.run_pgo_training(script_dir)
+
+        if is_clang:
+            # clang writes raw profiles which need to be merged first
+            profdata = os.path.join(profile_dir, "pycairo.profdata")
+            _check_output(
+                ["llvm-profdata", "merge", "-output=" + profdata] +
+                glob.glob(os.path.join(profile_dir, "*.profraw")))
+            use = ["-fprofile-use=" + profdata]
+        else:
+            # the threaded code paths make the counters slightly inexact
+            use = ["-fprofile-use=" + profile_dir, "-fprofile-correction"]
+
+        # build_ext.run() replaces the compiler name with an instance
+        self.compiler = compiler
+        ext.extra_compile_args = compile_args + use + ["-flto"]
+        ext.extra_link_args = link_args + use + ["-flto"]
+        try:
+            du_build_ext.run(self)
+        finally:
+            ext.extra_compile_args = compile_args
+            ext.extra_link_args = link_args
+
+    def run_pgo_training(self, script_dir):
+        ext_path = self.get_ext_fullpath(self.extensions[0].name)
+        package_dir = os.path.dirname(ext_path)
+        if not self.inplace:
+            # build_py hasn't run yet, the package needs to be importable
+            self.copy_file(
+                os.path.join(script_dir, "cairo", "__init__.py"),
+                package_dir)
+
+        env = dict(os.environ)
+        paths = [os.path.abspath(os.path.dirname(package_dir))]
+        if env.get("PYTHONPATH"):
+            paths.append(env["PYTHONPATH"])
+        env["PYTHONPATH"] = os.pathsep.join(paths)
+
+        script = os.path.join(
+            script_dir, "examples", "benchmark", "pgo_training.py")
+        try:
+            subprocess.check_call([sys.executable, script], env=env)
+        except subprocess.CalledProcessError as e:
+            raise SystemExit(e)
+
 
 du_build = get_command_class("build")
 
@@ -204,15 +315,19 @@ class build(du_build):
 
     user_options = du_build.user_options + [
         ("enable-xpyb", None, "Build with xpyb support (default=disabled)"),
+        ("pgo", None, "Build with profile guided optimization and LTO "
+                      "(GCC/Clang only, default=disabled)"),
     ]
 
     def initialize_options(self):
         du_build.initialize_options(self)
         self.enable_xpyb = False
+        self.pgo = False
 
     def finalize_options(self):
         du_build.finalize_options(self)
         self.enable_xpyb = bool(self.enable_xpyb)
+        self.pgo = bool(self.pgo)
 
 
 du_install_data = get_command_class("install_data")
@@ -255,6 +370,17 @@ def main():
             'cairo/rectangle.c',
             'cairo/textcluster.c',
             'cairo/textextents.c',
+            'cairo/rtree.c',
+            'cairo/displaylist.c',
+            'cairo/rastercache.c',
+            'cairo/hitindex.c',
+            'cairo/style.c',
+            'cairo/cancel.c',
+            'cairo/threadpool.c',
+            'cairo/tiles.c',
+            'cairo/pyramid.c',
+            'cairo/progressive.c',
+            'cairo/tee.c',
         ],
         include_dirs=pkg_config_parse('--cflags-only-I', 'cairo'),
         library_dirs=pkg_config_parse('--libs-only-L', 'cairo'),
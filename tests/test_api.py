@@ -22,6 +22,43 @@ def test_version():
     cairo.cairo_version_string()
 
 
+def test_lazy_types():
+    names = dir(cairo)
+    for name in ["PDFSurface", "PSSurface", "SVGSurface", "ScriptSurface",
+                 "RasterSourcePattern", "PDFVersion", "PS_LEVEL_2"]:
+        if not hasattr(cairo._cairo, name):
+            continue
+        assert name in names
+        assert name in cairo.__all__
+        assert getattr(cairo, name) is getattr(cairo._cairo, name)
+
+    if cairo.HAS_PDF_SURFACE:
+        assert cairo.PDF_VERSION_1_4 is cairo.PDFVersion.VERSION_1_4
+        assert cairo.PDFSurface.__name__ == "PDFSurface"
+
+    with pytest.raises(AttributeError):
+        cairo.DoesNotExist
+
+
+@pytest.mark.skipif(sys.version_info < (3, 7),
+                    reason="needs module __getattr__")
+def test_lazy_types_registered_on_access():
+    import subprocess
+
+    code = """
+import cairo
+assert "RasterSourcePattern" not in vars(cairo._cairo)
+assert "RasterSourcePattern" not in vars(cairo)
+cairo.RasterSourcePattern
+assert "RasterSourcePattern" in vars(cairo._cairo)
+assert "RasterSourcePattern" in vars(cairo)
+"""
+    # the cairo under test, not whatever else might be installed
+    path = os.path.dirname(os.path.dirname(os.path.abspath(cairo.__file__)))
+    env = dict(os.environ, PYTHONPATH=path)
+    subprocess.check_call([sys.executable, "-c", code], env=env)
+
+
 def test_show_unicode_text():
     width, height = 300, 300
     surface = cairo.ImageSurface(cairo.FORMAT_ARGB32, width, height)
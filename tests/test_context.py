@@ -1,3 +1,6 @@
+import array
+import struct
+
 import cairo
 import pytest
 
@@ -80,6 +83,160 @@ def test_append_path(context):
         context.append_path(object())
 
 
+def test_append_path_cull():
+    import math
+
+    # a spiral around the visible area with a part of it crossing it
+    points = []
+    for i in range(2000):
+        a = i * 0.05
+        r = 60 + 30 * math.sin(i * 0.3) - (40 if 600 < i < 700 else 0)
+        points.append((21 + r * math.cos(a), 21 + r * math.sin(a)))
+
+    def render(cull, operation):
+        surface = cairo.ImageSurface(cairo.FORMAT_ARGB32, 42, 42)
+        ctx = cairo.Context(surface)
+        ctx.move_to(*points[0])
+        for x, y in points[1:]:
+            ctx.line_to(x, y)
+        ctx.close_path()
+        path = ctx.copy_path()
+        ctx.new_path()
+        ctx.set_line_width(3)
+        culled = ctx.append_path(path, cull=cull)
+        operation(ctx)
+        surface.flush()
+        return bytes(surface.get_data()), culled
+
+    for operation in [cairo.Context.fill, cairo.Context.stroke]:
+        data, culled = render(False, operation)
+        assert culled is None
+        culled_data, culled = render(True, operation)
+        assert culled > 1000
+        assert culled_data == data
+
+    context = cairo.Context(cairo.ImageSurface(cairo.FORMAT_ARGB32, 42, 42))
+    context.line_to(100, 100)
+    context.line_to(200, 100)
+    p = context.copy_path()
+    context.new_path()
+    assert context.append_path(p, True) == 1
+    assert context.append_path(path=p, cull=False) is None
+
+    context.new_path()
+    context.set_dash([1])
+    assert context.append_path(p, cull=True) == 0
+    assert str(context.copy_path()) == str(p)
+
+
+def test_copy_clip_rectangle_buffer(context):
+    context.rectangle(1, 2, 10, 20)
+    context.rectangle(20, 2, 5, 5)
+    context.clip()
+    buf = context.copy_clip_rectangle_buffer()
+    assert buf.format == "d"
+    assert buf.readonly
+    assert buf.shape == (2, 4)
+    rects = sorted(tuple(r) for r in buf.tolist())
+    assert rects == sorted(tuple(r) for r in
+                           context.copy_clip_rectangle_list())
+    assert rects == [(1, 2, 10, 20), (20, 2, 5, 5)]
+    del buf
+
+    context.reset_clip()
+    context.rectangle(0, 0, 0, 0)
+    context.clip()
+    buf = context.copy_clip_rectangle_buffer()
+    assert buf.shape == (0, 4)
+    assert buf.tolist() == []
+
+    context.reset_clip()
+    context.arc(10, 10, 5, 0, 1)
+    context.clip()
+    with pytest.raises(cairo.Error):
+        context.copy_clip_rectangle_buffer()
+
+
+def test_copy_clip_region(context):
+    context.rectangle(1, 2, 10, 20)
+    context.clip()
+    region = context.copy_clip_region()
+    assert isinstance(region, cairo.Region)
+    assert region.get_extents() == cairo.RectangleInt(1, 2, 10, 20)
+
+    context.reset_clip()
+    context.rectangle(0.5, 2, 10, 20)
+    context.clip()
+    with pytest.raises(ValueError):
+        context.copy_clip_region()
+
+
+def test_style(context):
+    style = cairo.Style()
+    assert style.source is None
+    assert style.line_width == 2.0
+    assert style.line_cap == cairo.LINE_CAP_BUTT
+    assert isinstance(style.line_cap, cairo.LineCap)
+    assert style.line_join == cairo.LINE_JOIN_MITER
+    assert style.dash == ()
+    assert style.dash_offset == 0
+    assert style.miter_limit == 10
+    assert style.operator == cairo.OPERATOR_OVER
+
+    with pytest.raises(AttributeError):
+        style.line_width = 3
+
+    style = cairo.Style(
+        source=(1, 0, 0), line_width=5, line_cap=cairo.LINE_CAP_ROUND,
+        line_join=cairo.LINE_JOIN_BEVEL, dash=[1, 2], dash_offset=0.5,
+        miter_limit=3, operator=cairo.OPERATOR_ADD)
+    assert isinstance(style.source, cairo.SolidPattern)
+    assert style.source.get_rgba() == (1, 0, 0, 1)
+
+    default = context.capture_style()
+    assert isinstance(default.source, cairo.SolidPattern)
+    assert default.dash == ()
+
+    context.apply_style(style)
+    assert context.get_source().get_rgba() == (1, 0, 0, 1)
+    assert context.get_line_width() == 5
+    assert context.get_line_cap() == cairo.LINE_CAP_ROUND
+    assert context.get_line_join() == cairo.LINE_JOIN_BEVEL
+    assert context.get_dash() == ((1, 2), 0.5)
+    assert context.get_miter_limit() == 3
+    assert context.get_operator() == cairo.OPERATOR_ADD
+
+    captured = context.capture_style()
+    assert captured.line_width == 5
+    assert captured.dash == (1, 2)
+    assert captured.dash_offset == 0.5
+
+    context.apply_style(default)
+    assert context.get_line_width() == 2
+    assert context.get_dash() == ((), 0)
+    assert context.get_operator() == cairo.OPERATOR_OVER
+    assert context.get_source().get_rgba() == (0, 0, 0, 1)
+
+    # a style without source keeps the current one
+    pattern = cairo.SolidPattern(0, 1, 0)
+    context.set_source(pattern)
+    context.apply_style(cairo.Style(line_width=7))
+    assert context.get_source().get_rgba() == (0, 1, 0, 1)
+    assert context.get_line_width() == 7
+
+    context.apply_style(cairo.Style(source=pattern, dash=None))
+    assert context.get_source() == pattern
+
+    with pytest.raises(TypeError):
+        cairo.Style(source=object())
+
+    with pytest.raises(TypeError):
+        context.apply_style(object())
+
+    with pytest.raises(cairo.Error):
+        context.apply_style(cairo.Style(dash=[-1]))
+
+
 def test_arc(context):
     assert not list(context.copy_path())
     context.arc(0, 0, 0, 0, 0)
@@ -290,6 +447,39 @@ def test_save_restore(context):
     context.restore()
 
 
+def test_defer_errors():
+    surface = cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10)
+    context = cairo.Context(surface)
+    assert not context.get_defer_errors()
+    context.check()
+
+    context.set_defer_errors(True)
+    assert context.get_defer_errors()
+    context.move_to(0, 0)
+    context.line_to(5, 5)
+    context.restore()
+    context.scale(2, 2)
+    context.set_source_rgb(1, 0, 0)
+    with pytest.raises(cairo.Error) as excinfo:
+        context.check()
+    assert excinfo.value.status == cairo.Status.INVALID_RESTORE
+    with pytest.raises(cairo.Error) as excinfo:
+        context.stroke()
+    assert excinfo.value.status == cairo.Status.INVALID_RESTORE
+
+    context.set_defer_errors(False)
+    with pytest.raises(cairo.Error):
+        context.set_defer_errors(True)
+    with pytest.raises(cairo.Error):
+        context.line_to(1, 1)
+
+    # argument errors are still raised right away
+    context = cairo.Context(surface)
+    context.set_defer_errors(True)
+    with pytest.raises(TypeError):
+        context.line_to(object(), 0)
+
+
 def test_scale(context):
     context.scale(2, 2)
     with pytest.raises(TypeError):
@@ -506,3 +696,254 @@ def test_simple(context):
     assert isinstance(context.get_tolerance(), float)
     assert isinstance(context.get_miter_limit(), float)
     assert isinstance(context.get_matrix(), cairo.Matrix)
+
+
+def test_fill_instances(context):
+    context.rectangle(0, 0, 2, 2)
+    path = context.copy_path()
+    context.new_path()
+    context.translate(1, 1)
+
+    transforms = array.array("d", [0, 0, 10, 0, 20, 20])
+    colors = [(1, 0, 0, 1), (0, 1, 0, 1), (0, 0, 1, 0.5)]
+    context.fill_instances(path, transforms, colors)
+    assert not context.has_current_point()
+    assert context.get_matrix() == cairo.Matrix(x0=1, y0=1)
+
+    surface = context.get_target()
+    surface.flush()
+    data = surface.get_data()
+    stride = surface.get_stride()
+
+    def pixel(x, y):
+        offset = y * stride + x * 4
+        return struct.unpack("=I", bytes(data[offset:offset + 4]))[0]
+
+    assert pixel(1, 1) == 0xffff0000
+    assert pixel(11, 1) == 0xff00ff00
+    assert pixel(21, 21) >> 24 in (0x7f, 0x80)
+    assert pixel(5, 5) == 0
+
+    # full matrices, scaling the path up
+    context.fill_instances(path, [(2, 0, 0, 2, 30, 0)])
+    assert pixel(34, 4) != 0
+
+    context.stroke_instances(path, [(0, 30)], colors=[(1, 1, 1, 1)])
+    assert pixel(1, 31) == 0xffffffff
+
+    with pytest.raises(ValueError):
+        context.fill_instances(path, [(1, 2, 3)])
+
+    with pytest.raises(ValueError):
+        context.fill_instances(path, [(1, 2)], [(1, 1, 1, 1)] * 2)
+
+    with pytest.raises(TypeError):
+        context.fill_instances(path, array.array("i", [1, 2]))
+
+    with pytest.raises(TypeError):
+        context.fill_instances(object(), [(1, 2)])
+
+
+def test_stamp(context):
+    context.arc(0, 0, 2, 0, 6.3)
+    dot = context.copy_path()
+    context.new_path()
+
+    surface = context.get_target()
+    stride = surface.get_stride()
+
+    def alpha(x, y):
+        surface.flush()
+        return bytearray(bytes(surface.get_data()))[y * stride + x * 4 + 3]
+
+    context.set_source_rgb(1, 0, 0)
+    context.stamp(dot, [(5, 5), (20.25, 5), (35.5, 5)])
+    assert alpha(5, 5) == 255
+    assert alpha(20, 5) == 255
+    assert alpha(35, 5) == 255
+    assert alpha(12, 5) == 0
+    assert not context.has_current_point()
+
+    # scaled positions and marker, per position colors
+    context.save()
+    context.scale(2, 2)
+    context.stamp(dot, array.array("d", [5, 10]), [(0, 0, 1, 1)])
+    context.restore()
+    assert alpha(10, 20) == 255
+    assert alpha(12, 20) == 255
+
+    sprite = cairo.ImageSurface(cairo.FORMAT_ARGB32, 2, 2)
+    cairo.Context(sprite).paint()
+    context.stamp(sprite, [(30, 30)])
+    assert alpha(30, 30) == 255
+    assert alpha(32, 30) == 0
+    context.stamp(sprite, [(30, 35)], colors=[(0, 1, 0, 1)])
+    assert alpha(31, 36) == 255
+
+    with pytest.raises(TypeError):
+        context.stamp(object(), [(1, 2)])
+
+    with pytest.raises(ValueError):
+        context.stamp(dot, [(1, 2, 3)])
+
+    with pytest.raises(ValueError):
+        context.stamp(dot, [(1, 2)], colors=[])
+
+
+def test_stamp_surface_bounded(context):
+    surface = context.get_target()
+    stride = surface.get_stride()
+
+    def alpha(x, y):
+        surface.flush()
+        return bytearray(bytes(surface.get_data()))[y * stride + x * 4 + 3]
+
+    sprite = cairo.ImageSurface(cairo.FORMAT_ARGB32, 2, 2)
+    cairo.Context(sprite).paint()
+
+    # every stamp only replaces the pixels below the marker
+    context.move_to(1, 1)
+    context.set_operator(cairo.OPERATOR_SOURCE)
+    context.stamp(sprite, [(10, 10), (20, 20)])
+    assert alpha(10, 10) == 255
+    assert alpha(21, 21) == 255
+    assert alpha(15, 15) == 0
+    assert context.get_current_point() == (1, 1)
+
+
+def test_fill_rectangles(context):
+    surface = context.get_target()
+    stride = surface.get_stride()
+
+    def pixel(x, y):
+        surface.flush()
+        offset = y * stride + x * 4
+        return struct.unpack(
+            "=I", bytes(surface.get_data()[offset:offset + 4]))[0]
+
+    rects = array.array("d", [0, 0, 10, 10, 5, 5, 10, 10, 30, 30, -5, -5])
+    colors = [(0, 0, 0.5, 0.5), (0, 0, 0.5, 0.5), (1, 0, 0, 1)]
+    context.set_fill_rule(cairo.FILL_RULE_EVEN_ODD)
+    context.fill_rectangles(rects, colors)
+    assert context.get_fill_rule() == cairo.FILL_RULE_EVEN_ODD
+    assert not context.has_current_point()
+
+    # translucent overlaps are painted twice, like with separate fills
+    assert pixel(2, 2) == pixel(12, 12)
+    assert pixel(2, 2) >> 24 in (0x7f, 0x80)
+    assert pixel(7, 7) >> 24 in (0xbf, 0xc0)
+    assert pixel(27, 27) == 0xffff0000
+    assert pixel(20, 20) == 0
+
+    context.set_source_rgb(0, 1, 0)
+    context.fill_rectangles([(0.5, 35, 2, 2)])
+    assert pixel(1, 35) == 0xff00ff00
+    assert pixel(0, 35) >> 24 in (0x7f, 0x80)
+
+    # whole user space pixels aren't whole target pixels
+    surface.set_device_scale(0.5, 0.5)
+    context = cairo.Context(surface)
+    context.set_source_rgb(0, 0, 1)
+    context.fill_rectangles([(1, 80, 2, 2)])
+    assert pixel(0, 40) >> 24 in (0x7f, 0x80)
+    assert pixel(1, 40) >> 24 in (0x7f, 0x80)
+
+    with pytest.raises(ValueError):
+        context.fill_rectangles([(1, 2)])
+
+    with pytest.raises(ValueError):
+        context.fill_rectangles([(1, 2, 3, 4)], colors=[])
+
+
+def test_stroke_segments(context):
+    surface = context.get_target()
+    stride = surface.get_stride()
+
+    def pixel(x, y):
+        surface.flush()
+        offset = y * stride + x * 4
+        return struct.unpack(
+            "=I", bytes(surface.get_data()[offset:offset + 4]))[0]
+
+    segments = array.array("d", [0, 1, 10, 1, 0, 5, 10, 5, 0, 9, 10, 9])
+    colors = [(1, 0, 0, 1), (0, 1, 0, 1), (1, 0, 0, 1)]
+    context.set_line_width(5)
+    context.stroke_segments(segments, colors, widths=[2, 2, 4])
+    assert context.get_line_width() == 5
+    assert not context.has_current_point()
+
+    assert pixel(5, 0) == 0xffff0000
+    assert pixel(5, 2) == 0
+    assert pixel(5, 4) == 0xff00ff00
+    assert pixel(5, 7) == 0xffff0000
+    assert pixel(5, 10) == 0xffff0000
+
+    context.set_source_rgb(0, 0, 1)
+    context.stroke_segments([(20, 20, 30, 20)])
+    assert pixel(25, 20) != 0
+
+    # later segments end up on top, even with a style used before
+    context.set_line_width(2)
+    context.stroke_segments(
+        [(25, 30, 35, 30), (30, 22, 30, 38), (30, 27, 30, 33)],
+        [(1, 0, 0, 1), (0, 1, 0, 1), (1, 0, 0, 1)])
+    assert pixel(30, 30) == 0xffff0000
+    assert pixel(30, 24) == 0xff00ff00
+
+    # translucent overlaps get blended twice, like with separate strokes
+    context.stroke_segments(
+        [(0, 14, 20, 14), (10, 14, 30, 14)], [(0, 0, 1, 0.5)] * 2)
+    assert pixel(5, 14) >> 24 in (0x7f, 0x80)
+    assert pixel(15, 14) >> 24 in (0xbf, 0xc0)
+
+    context.set_source_rgba(0, 0, 1, 0.5)
+    context.stroke_segments([(0, 17, 20, 17), (10, 17, 30, 17)])
+    assert pixel(5, 17) >> 24 in (0x7f, 0x80)
+    assert pixel(15, 17) >> 24 in (0xbf, 0xc0)
+
+    with pytest.raises(ValueError):
+        context.stroke_segments([(1, 2, 3)])
+
+    with pytest.raises(ValueError):
+        context.stroke_segments([(1, 2, 3, 4)], widths=[1, 2])
+
+    with pytest.raises(TypeError):
+        context.stroke_segments([(1, 2, 3, 4)], widths=["x"])
+
+
+def test_show_texts(context):
+    context.set_font_size(10)
+    context.show_texts(["a", u"\xe4b", ""], [(2, 10), (20, 10), (0, 0)])
+    assert not context.has_current_point()
+
+    surface = context.get_target()
+    surface.flush()
+    data = bytes(surface.get_data())
+    assert data.count(b"\x00") != len(data)
+
+    # right aligned texts end at their position
+    def render(func):
+        surface = cairo.ImageSurface(cairo.FORMAT_A8, 40, 20)
+        ctx = cairo.Context(surface)
+        ctx.set_font_size(10)
+        func(ctx)
+        surface.flush()
+        return bytes(surface.get_data())
+
+    def show_text(ctx):
+        ctx.move_to(35 - ctx.text_extents("ab").x_advance, 15)
+        ctx.show_text("ab")
+
+    def show_texts(ctx):
+        ctx.show_texts(["ab"], array.array("d", [35, 15]), align=1)
+
+    assert render(show_texts) == render(show_text)
+
+    with pytest.raises(ValueError):
+        context.show_texts(["a", "b"], [(0, 0)])
+
+    with pytest.raises(TypeError):
+        context.show_texts([object()], [(0, 0)])
+
+    with pytest.raises(TypeError):
+        context.show_texts(42, [(0, 0)])
@@ -3,6 +3,8 @@
 import os
 import io
 import tempfile
+import gzip
+import zlib
 
 import cairo
 import pytest
@@ -115,3 +117,60 @@ def test_script_device_to_path():
         cairo.ScriptDevice(fname).finish()
     finally:
         os.unlink(fname)
+
+
+def test_script_device_buffered():
+    f = io.BytesIO()
+    dev = cairo.ScriptDevice(f)
+    dev.write_comment("pycairo buffered")
+    dev.flush()
+    assert b"pycairo buffered" in f.getvalue()
+    dev.finish()
+    dev.finish()
+    # a no-op after finishing, which doesn't put the device into an error
+    # state
+    dev.flush()
+    dev.flush()
+    dev.finish()
+
+
+def test_script_device_compress():
+    f = io.BytesIO()
+    try:
+        dev = cairo.ScriptDevice(f, compress=True)
+    except NotImplementedError:
+        pytest.skip("built without zlib")
+    dev.write_comment("pycairo compressed")
+    dev.flush()
+    partial = zlib.decompressobj(16 + zlib.MAX_WBITS).decompress(f.getvalue())
+    assert b"pycairo compressed" in partial
+    dev.finish()
+    assert b"pycairo compressed" in gzip.GzipFile(
+        fileobj=io.BytesIO(f.getvalue())).read()
+
+
+def test_script_device_compress_to_path():
+    fd, fname = tempfile.mkstemp()
+    os.close(fd)
+    try:
+        try:
+            dev = cairo.ScriptDevice(fname, compress=True)
+        except NotImplementedError:
+            pytest.skip("built without zlib")
+        dev.write_comment("pycairo path")
+        dev.finish()
+        with gzip.open(fname, "rb") as h:
+            assert b"pycairo path" in h.read()
+    finally:
+        os.unlink(fname)
+
+
+def test_script_device_write_error():
+    class Broken(object):
+        def write(self, data):
+            raise ValueError
+
+    dev = cairo.ScriptDevice(Broken())
+    dev.write_comment("pycairo")
+    with pytest.raises(IOError):
+        dev.flush()
@@ -34,6 +34,14 @@ def test_type():
     assert isinstance(cairo.ANTIALIAS_DEFAULT, t)
 
 
+def test_shared_instances():
+    surface = cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10)
+    ctx = cairo.Context(surface)
+    assert ctx.get_operator() is cairo.Operator.OVER
+    assert ctx.get_operator() is ctx.get_operator()
+    assert cairo.Antialias(0) is not cairo.Antialias.DEFAULT
+
+
 def test_misc():
     cairo.Status.JBIG2_GLOBAL_MISSING
 
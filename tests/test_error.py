@@ -43,6 +43,21 @@ def test_error_check_status():
     str(cairo.Error())
 
 
+def test_error_combined_types_cached():
+    check_status = cairo.Error._check_status
+
+    types_ = []
+    for status in [cairo.Status.READ_ERROR, cairo.Status.WRITE_ERROR,
+                   cairo.Status.NO_MEMORY, cairo.Status.NO_MEMORY]:
+        with pytest.raises(cairo.Error) as e:
+            check_status(status)
+        assert e.value.status is status
+        types_.append(type(e.value))
+    assert types_[0] is types_[1]
+    assert types_[2] is types_[3]
+    assert types_[0] is not types_[2]
+
+
 def test_error_context():
     surface = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
     ctx = cairo.Context(surface)
@@ -1,3 +1,5 @@
+import math
+
 import cairo
 import pytest
 
@@ -71,3 +73,262 @@ def test_path_iter(context):
         (3, ()),
         (0, (1.0, 2.0)),
     ]
+
+
+def test_simplify_polyline():
+    points = [(0, 0), (1, 0.01), (2, -0.01), (3, 0)]
+    p = cairo.simplify_polyline(points, 0.1)
+    assert isinstance(p, cairo.Path)
+    assert list(p) == [(0, (0.0, 0.0)), (1, (3.0, 0.0))]
+
+    m = cairo.Matrix(xx=100, yy=100)
+    p = cairo.simplify_polyline(points, 0.1, m)
+    assert len(list(p)) == 4
+    p = cairo.simplify_polyline(points, tolerance=0.1, matrix=None)
+    assert len(list(p)) == 2
+
+    nan = float("nan")
+    p = cairo.simplify_polyline([(0, 0), (1, 0), (nan, 0), (2, 2), (3, 3)], 0)
+    assert list(p) == [
+        (0, (0.0, 0.0)), (1, (1.0, 0.0)), (0, (2.0, 2.0)), (1, (3.0, 3.0))]
+
+    assert list(cairo.simplify_polyline([], 1)) == []
+
+    with pytest.raises(ValueError):
+        cairo.simplify_polyline(points, -1)
+
+    with pytest.raises(TypeError):
+        cairo.simplify_polyline(points, 1, object())
+
+    with pytest.raises(ValueError):
+        cairo.simplify_polyline([(1, 2, 3)], 1)
+
+
+def test_path_simplified(context):
+    context.move_to(0, 0)
+    for i in range(1, 11):
+        context.line_to(i, (i % 2) * 0.01)
+    context.curve_to(11, 1, 12, 1, 13, 0)
+    context.line_to(14, 0.01)
+    context.line_to(15, 0)
+    context.close_path()
+    p = context.copy_path()
+
+    s = p.simplified(0.1)
+    assert isinstance(s, cairo.Path)
+    assert list(s) == [
+        (0, (0.0, 0.0)),
+        (1, (10.0, 0.0)),
+        (2, (11.0, 1.0, 12.0, 1.0, 13.0, 0.0)),
+        (1, (15.0, 0.0)),
+        (3, ()),
+        (0, (0.0, 0.0)),
+    ]
+
+    assert list(p.simplified(0)) == list(p)
+    assert len(list(p.simplified(
+        0.1, matrix=cairo.Matrix(xx=100, yy=100)))) == len(list(p))
+
+    with pytest.raises(ValueError):
+        p.simplified(-1)
+
+    with pytest.raises(TypeError):
+        p.simplified(0.1, object())
+
+
+def test_decimate_m4():
+    x = [i / 10.0 for i in range(30)]
+    y = [float(i % 7) for i in range(30)]
+    p = cairo.decimate_m4(x, y, 3)
+    assert isinstance(p, cairo.Path)
+    items = list(p)
+    assert items[0] == (0, (0.0, 0.0))
+    assert all(t == 1 for t, _ in items[1:])
+    assert len(items) <= 3 * 4
+    points = [pt for _, pt in items]
+    for col in range(3):
+        col_y = [b for a, b in zip(x, y) if int(a) == col]
+        in_col = [pt[1] for pt in points if int(pt[0]) == col]
+        assert min(in_col) == min(col_y)
+        assert max(in_col) == max(col_y)
+    assert points[-1][0] == pytest.approx(x[-1], abs=0.01)
+    assert points[-1][1] == y[-1]
+
+    m = cairo.Matrix(xx=10)
+    assert len(list(cairo.decimate_m4(x, y, 30, m))) == 30
+
+    # everything right of width ends up in a single column
+    assert len(list(cairo.decimate_m4(x, y, 0))) <= 4
+
+    nan = float("nan")
+    p = cairo.decimate_m4([0, 1, nan, 2], [0, 0, 0, 0], 10)
+    assert [t for t, _ in p] == [0, 1, 0]
+
+    assert list(cairo.decimate_m4([], [], 10)) == []
+
+    with pytest.raises(ValueError):
+        cairo.decimate_m4([1, 2], [1], 10)
+
+    with pytest.raises(ValueError):
+        cairo.decimate_m4([1], [1], -1)
+
+
+def test_path_transformed(context):
+    context.move_to(1, 2)
+    context.line_to(3, 4)
+    p = context.copy_path()
+    t = p.transformed(cairo.Matrix(xx=2, yy=3, x0=1))
+    assert isinstance(t, cairo.Path)
+    assert list(t) == [(0, (3.0, 6.0)), (1, (7.0, 12.0))]
+    assert list(p) == [(0, (1.0, 2.0)), (1, (3.0, 4.0))]
+
+    with pytest.raises(TypeError):
+        p.transformed(object())
+
+
+def test_path_flattened(context):
+    context.arc(20, 20, 10, 0, 2 * math.pi)
+    context.close_path()
+    p = context.copy_path()
+    f = p.flattened(0.1)
+    items = list(f)
+    assert len(items) > 10
+    assert set(t for t, _ in items) == {0, 1, 3}
+    for t, points in items:
+        if points:
+            x, y = points
+            assert abs(math.hypot(x - 20, y - 20) - 10) < 0.2
+
+    with pytest.raises(ValueError):
+        p.flattened(0)
+
+
+def test_path_length(context):
+    assert context.copy_path().length() == 0
+
+    context.move_to(0, 0)
+    context.line_to(3, 4)
+    assert context.copy_path().length() == 5
+
+    context.new_path()
+    context.rectangle(0, 0, 10, 10)
+    assert context.copy_path().length() == 40
+
+    context.new_path()
+    context.arc(20, 20, 10, 0, 2 * math.pi)
+    p = context.copy_path()
+    assert abs(p.length() - 20 * math.pi) < 0.5
+    assert abs(p.length(tolerance=0.001) - 20 * math.pi) < 0.05
+
+    with pytest.raises(ValueError):
+        p.length(-1)
+
+
+def test_path_point_at(context):
+    with pytest.raises(ValueError):
+        context.copy_path().point_at(0)
+
+    context.move_to(0, 0)
+    context.line_to(10, 0)
+    context.line_to(10, 10)
+    p = context.copy_path()
+    assert p.point_at(2.5) == (2.5, 0, 1, 0)
+    assert p.point_at(-1) == (0, 0, 1, 0)
+    assert p.point_at(15) == (10, 5, 0, 1)
+    assert p.point_at(100) == (10, 10, 0, 1)
+    assert p.point_at(distance=15, tolerance=1) == (10, 5, 0, 1)
+
+
+def test_path_bounds(context):
+    assert context.copy_path().bounds() == (0, 0, 0, 0)
+
+    context.move_to(0, 0)
+    context.curve_to(0, 10, 10, 10, 10, 0)
+    assert context.copy_path().bounds() == (0, 0, 10, 7.5)
+
+    context.new_path()
+    context.rectangle(1, 2, 3, 4)
+    assert context.copy_path().bounds() == (1, 2, 4, 6)
+
+
+def test_hit_index(context):
+    index = cairo.HitIndex()
+    assert len(index) == 0
+    assert index.query(5, 5) is None
+
+    context.rectangle(0, 0, 10, 10)
+    square = context.copy_path()
+    context.new_path()
+    context.arc(5, 5, 5, 0, 2 * math.pi)
+    circle = context.copy_path()
+    context.new_path()
+    context.move_to(0, 20)
+    context.line_to(30, 20)
+    line = context.copy_path()
+
+    index.add("square", square)
+    index.add("circle", circle)
+    index.add("line", line, fill=False, stroke_width=4)
+    assert len(index) == 3
+    assert "circle" in index
+
+    # the topmost hit wins
+    assert index.query(5, 5) == "circle"
+    # inside the extents of the circle, but not the circle itself
+    assert index.query(0.5, 0.5) == "square"
+    assert index.query(15, 21) == "line"
+    assert index.query(15, 23) is None
+    assert index.query(50, 50) is None
+
+    assert index.query_rect((0, 0, 1, 1)) == ["circle", "square"]
+    assert index.query_rect((20, 25, 5, -10)) == ["line"]
+
+    # adding again replaces and moves to the top
+    index.add("square", square)
+    assert len(index) == 3
+    assert index.query(5, 5) == "square"
+
+    index.remove("square")
+    assert "square" not in index
+    assert index.query(0.5, 0.5) is None
+    assert index.query(5, 5) == "circle"
+    with pytest.raises(KeyError):
+        index.remove("square")
+
+    index.add(42, square, fill_rule=cairo.FILL_RULE_EVEN_ODD)
+    assert index.query(1, 1) == 42
+
+    index.clear()
+    assert len(index) == 0
+    assert index.query(5, 5) is None
+
+    with pytest.raises(TypeError):
+        index.add("x", object())
+
+    with pytest.raises(ValueError):
+        index.add("x", square, stroke_width=-1)
+
+
+def test_hit_index_churn(context):
+    index = cairo.HitIndex()
+    for i in range(300):
+        context.rectangle(i, 0, 2, 10)
+        index.add(i, context.copy_path())
+        context.new_path()
+        # queries in between only scan the new ones
+        assert index.query(i + 1.5, 5) == i
+
+    # removing most of them compacts the entries, keeping the order
+    for i in range(0, 300, 3):
+        index.remove(i)
+        index.remove(i + 1)
+    assert len(index) == 100
+    assert index.query(1.5, 5) is None
+    assert index.query(5.5, 5) == 5
+    assert index.query_rect((2, 0, 4, 1)) == [5, 2]
+
+    context.rectangle(0, 0, 300, 10)
+    index.add("top", context.copy_path())
+    assert index.query(5.5, 5) == "top"
+    index.remove("top")
+    assert index.query(5.5, 5) == 5
@@ -6,6 +6,7 @@ import sys
 import array
 import tempfile
 import struct
+import math
 
 import cairo
 import pytest
@@ -108,6 +109,93 @@ def test_tee_surface():
     tee.remove(s1)
 
 
+def test_tee_surface_parallel():
+    main = cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10)
+    other = cairo.ImageSurface(cairo.FORMAT_ARGB32, 20, 20)
+    tee = cairo.TeeSurface(main, parallel=True)
+    tee.add(other)
+    assert tee.index(0) == main
+    assert tee.index(1) == other
+    with pytest.raises(cairo.Error):
+        tee.index(2)
+
+    ctx = cairo.Context(tee)
+    ctx.rectangle(0, 0, 5, 5)
+    ctx.fill()
+    # queued until flushed
+    assert main.get_data().tobytes()[3:4] == b"\x00"
+    tee.flush()
+    assert main.get_data().tobytes()[3:4] == b"\xff"
+    assert other.get_data().tobytes()[3:4] == b"\xff"
+
+    # a removed target gets what was drawn before
+    ctx.rectangle(5, 5, 5, 5)
+    ctx.fill()
+    tee.remove(other)
+    assert other.get_data().tobytes()[(6 * 20 + 6) * 4 + 3:][:1] == b"\xff"
+    with pytest.raises(cairo.Error):
+        tee.remove(other)
+
+    ctx.paint()
+    tee.finish()
+    assert other.get_data().tobytes()[(15 * 20 + 15) * 4 + 3:][:1] == \
+        b"\x00"
+    assert main.get_data().tobytes()[(9 * 10) * 4 + 3:][:1] == b"\xff"
+
+
+def test_tee_surface_parallel_pages():
+    main = cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10)
+    tee = cairo.TeeSurface(main, parallel=True)
+    ctx = cairo.Context(tee)
+    with pytest.raises(RuntimeError):
+        tee.show_page()
+    with pytest.raises(RuntimeError):
+        tee.copy_page()
+    with pytest.raises(RuntimeError):
+        ctx.show_page()
+    with pytest.raises(RuntimeError):
+        ctx.copy_page()
+
+
+def test_tee_surface_parallel_sources():
+    source = cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10)
+    cairo.Context(source).paint()
+    targets = [cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10)
+               for i in range(4)]
+    tee = cairo.TeeSurface(targets[0], parallel=True)
+    for target in targets[1:]:
+        tee.add(target)
+    ctx = cairo.Context(tee)
+    ctx.set_source_surface(source)
+    ctx.paint()
+    tee.flush()
+    # the source stays set across flushes and gets noted again
+    ctx.paint_with_alpha(0.5)
+    tee.flush()
+    for target in targets:
+        assert target.get_data().tobytes()[3:4] == b"\xff"
+
+    # flushes without surface sources go parallel again
+    ctx.set_source_rgb(0, 0, 0)
+    ctx.paint()
+    tee.flush()
+    ctx.stamp(source, [(0, 0)])
+    tee.flush()
+    for target in targets:
+        assert target.get_data().tobytes()[3:4] == b"\xff"
+
+
+def test_tee_surface_parallel_dealloc():
+    main = cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10)
+    tee = cairo.TeeSurface(main, parallel=True)
+    ctx = cairo.Context(tee)
+    ctx.paint()
+    del ctx
+    del tee
+    main.flush()
+    assert main.get_data().tobytes()[3:4] == b"\xff"
+
+
 def test_image_surface_get_data_refcount():
     surface = cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10)
     assert sys.getrefcount(surface) == 2
@@ -497,6 +585,7 @@ def test_script_surface_create_for_target():
     ctx = cairo.Context(script)
     ctx.set_source_rgb(0.25, 0.5, 1.0)
     ctx.paint()
+    dev.flush()
     assert b"paint" in f.getvalue()
     surface.flush()
     image_data = bytes(surface.get_data())
@@ -621,3 +710,640 @@ def test_recording_surface():
 
     surface = cairo.RecordingSurface(cairo.CONTENT_COLOR, None)
     assert surface.ink_extents() == (0.0, 0.0, 0.0, 0.0)
+
+
+def test_indexed_recording_surface():
+    with pytest.raises(TypeError):
+        cairo.IndexedRecordingSurface(cairo.CONTENT_COLOR, None)
+
+    surface = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 100, 100))
+    assert isinstance(surface, cairo.RecordingSurface)
+    assert surface.get_extents() == (0, 0, 100, 100)
+    ctx = cairo.Context(surface)
+    assert isinstance(ctx.get_target(), cairo.IndexedRecordingSurface)
+
+    with pytest.raises(ValueError):
+        surface.replay(ctx)
+
+    with pytest.raises(TypeError):
+        surface.replay(object())
+
+    with pytest.raises(TypeError):
+        surface.replay(ctx, object())
+
+
+def test_indexed_recording_surface_replay():
+    surface = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 1000, 1000))
+    ctx = cairo.Context(surface)
+    for i in range(10):
+        ctx.rectangle(i * 100, 0, 10, 10)
+        ctx.fill()
+    ctx.move_to(500, 500)
+    ctx.line_to(600, 500)
+    ctx.stroke()
+
+    target = cairo.ImageSurface(cairo.FORMAT_ARGB32, 1000, 1000)
+    assert surface.replay(target) == 11
+    assert surface.replay(target, (0, 0, 50, 50)) == 1
+    assert surface.replay(target, (450, 450, 100, 100)) == 1
+    assert surface.replay(target, (20, 20, 50, 50)) == 0
+
+    # same result as painting the recording
+    expected = cairo.ImageSurface(cairo.FORMAT_ARGB32, 200, 50)
+    ctx = cairo.Context(expected)
+    ctx.set_source_surface(surface, -50, 0)
+    ctx.paint()
+
+    result = cairo.ImageSurface(cairo.FORMAT_ARGB32, 200, 50)
+    ctx = cairo.Context(result)
+    ctx.translate(-50, 0)
+    assert surface.replay(ctx, (50, 0, 200, 50)) == 2
+    result.flush()
+    assert result.get_data().tobytes() == expected.get_data().tobytes()
+
+
+def test_indexed_recording_surface_replay_draft():
+    surface = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 100, 100))
+    ctx = cairo.Context(surface)
+    ctx.arc(50, 50, 40, 0, 2 * math.pi)
+    ctx.fill()
+    image = cairo.ImageSurface(cairo.FORMAT_ARGB32, 8, 8)
+    ctx.set_source_surface(image)
+    ctx.get_source().set_filter(cairo.FILTER_BEST)
+    ctx.paint_with_alpha(0.5)
+
+    target = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    assert surface.replay(target, draft=True) == 2
+    # the recorded pattern stays untouched
+    assert ctx.get_source().get_filter() == cairo.FILTER_BEST
+    data = target.get_data().tobytes()
+    assert data[(50 * 100 + 50) * 4 + 3:][:1] == b"\xff"
+
+
+def test_progressive_renderer():
+    recording = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 200, 200))
+    ctx = cairo.Context(recording)
+    for i in range(20):
+        ctx.arc(i * 10, 100, 20, 0, 2 * math.pi)
+        ctx.fill()
+
+    renderer = cairo.ProgressiveRenderer(recording)
+    assert not renderer.refining
+    assert renderer.get_refined() is None
+
+    target = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    ctx = cairo.Context(target)
+    ctx.scale(0.5, 0.5)
+    assert renderer.draft(ctx) >= 0
+    assert renderer.draft_time >= 0
+
+    renderer.refine(ctx)
+    image = renderer.get_refined(wait=True)
+    assert not renderer.refining
+    assert isinstance(image, cairo.ImageSurface)
+    assert (image.get_width(), image.get_height()) == (100, 100)
+    assert renderer.refine_time >= 0
+
+    expected = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    ctx = cairo.Context(expected)
+    ctx.scale(0.5, 0.5)
+    recording.replay(ctx)
+    assert image.get_data().tobytes() == expected.get_data().tobytes()
+
+    # a new draft drops the stale refinement
+    renderer.draft(expected)
+    assert renderer.get_refined() is None
+    renderer.refine(expected)
+    renderer.cancel()
+    assert not renderer.refining
+    assert renderer.get_refined(wait=True) is None
+
+    with pytest.raises(TypeError):
+        renderer.refine(cairo.RecordingSurface(cairo.CONTENT_COLOR, None))
+
+    with pytest.raises(TypeError):
+        cairo.ProgressiveRenderer(target)
+
+    # the refined image is in pixels of the target, including its device
+    # scale
+    target.set_device_scale(0.5, 0.5)
+    renderer.refine(cairo.Context(target))
+    image = renderer.get_refined(wait=True)
+    expected = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    expected.set_device_scale(0.5, 0.5)
+    recording.replay(cairo.Context(expected))
+    assert image.get_data().tobytes() == expected.get_data().tobytes()
+
+
+def test_progressive_renderer_draw_while_refining():
+    recording = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 200, 200))
+    ctx = cairo.Context(recording)
+    for i in range(2000):
+        ctx.arc(i % 200, (i * 7) % 200, 10, 0, 2 * math.pi)
+        ctx.fill()
+
+    renderer = cairo.ProgressiveRenderer(recording)
+    target = cairo.ImageSurface(cairo.FORMAT_ARGB32, 200, 200)
+    for j in range(5):
+        renderer.refine(cairo.Context(target))
+        # blocks while the refinement reads the recording
+        for i in range(50):
+            ctx.rectangle(i * 4, j * 10, 2, 2)
+            ctx.fill()
+            ctx.set_source_rgba(1, 0, 0, 0.5)
+            ctx.paint_with_alpha(0.01)
+            ctx.set_source_rgb(0, 0, 0)
+        assert isinstance(renderer.get_refined(wait=True), cairo.ImageSurface)
+
+    result = cairo.ImageSurface(cairo.FORMAT_ARGB32, 200, 200)
+    recording.replay(result)
+    expected = cairo.ImageSurface(cairo.FORMAT_ARGB32, 200, 200)
+    ctx = cairo.Context(expected)
+    ctx.set_source_surface(recording)
+    ctx.paint()
+    result.flush()
+    assert result.get_data().tobytes() == expected.get_data().tobytes()
+
+
+def test_indexed_recording_surface_fallback():
+    surface = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 100, 100))
+    ctx = cairo.Context(surface)
+    ctx.arc(50, 50, 20, 0, 6.3)
+    ctx.clip()
+    ctx.paint()
+
+    target = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    assert surface.replay(target, (0, 0, 100, 100)) == 0
+    target.flush()
+    assert target.get_data().tobytes()[50 * 400 + 50 * 4 + 3] in (255, b"\xff")
+
+
+def test_indexed_recording_surface_source_matrix():
+    surface = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 100, 100))
+    ctx = cairo.Context(surface)
+    gradient = cairo.LinearGradient(0, 0, 50, 0)
+    gradient.add_color_stop_rgb(0, 1, 0, 0)
+    gradient.add_color_stop_rgb(1, 0, 0, 1)
+    ctx.set_source(gradient)
+    ctx.save()
+    ctx.translate(30, 20)
+    ctx.scale(2, 1)
+    ctx.set_source_rgb(0, 1, 0)
+    ctx.restore()
+    # the gradient stays in the user space it was set in
+    ctx.translate(10, 10)
+    ctx.rectangle(0, 0, 50, 50)
+    ctx.fill()
+
+    expected = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    ctx = cairo.Context(expected)
+    ctx.set_source_surface(surface)
+    ctx.paint()
+
+    result = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    assert surface.replay(result, (0, 0, 100, 100)) == 1
+    result.flush()
+    assert result.get_data().tobytes() == expected.get_data().tobytes()
+
+
+@pytest.mark.skipif(not hasattr(cairo, "TeeSurface"), reason="no tee")
+def test_indexed_recording_surface_foreign_drawing():
+    surface = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 100, 100))
+    ctx = cairo.Context(surface)
+    ctx.rectangle(0, 0, 10, 10)
+    ctx.fill()
+
+    # drawing which doesn't go through a Context on the surface
+    tee = cairo.TeeSurface(cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100))
+    tee.add(surface)
+    ctx = cairo.Context(tee)
+    ctx.rectangle(50, 50, 10, 10)
+    ctx.fill()
+
+    target = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    # falls back to painting the whole recording
+    assert surface.replay(target, (40, 40, 30, 30)) == 0
+    target.flush()
+    assert target.get_data().tobytes()[55 * 400 + 55 * 4 + 3] in (255, b"\xff")
+
+
+@pytest.mark.skipif(sys.version_info[0] < 3, reason="no capsule")
+def test_indexed_recording_surface_c_api():
+    ctypes = pytest.importorskip("ctypes")
+
+    surface = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 100, 100))
+    ctx = cairo.Context(surface)
+    ctx.rectangle(0, 0, 10, 10)
+    ctx.fill()
+    assert surface.replay(
+        cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10), (0, 0, 10, 10)) == 1
+
+    # PycairoContext_GET() of another extension, which could draw with the
+    # returned cairo_t from now on
+    get_pointer = ctypes.pythonapi.PyCapsule_GetPointer
+    get_pointer.restype = ctypes.c_void_p
+    get_pointer.argtypes = [ctypes.py_object, ctypes.c_char_p]
+    capi = ctypes.cast(get_pointer(cairo.CAPI, b"cairo.CAPI"),
+                       ctypes.POINTER(ctypes.c_void_p))
+    context_get = ctypes.PYFUNCTYPE(ctypes.c_void_p, ctypes.py_object)(
+        capi[36])
+    assert context_get(ctx)
+
+    ctx.rectangle(50, 50, 10, 10)
+    ctx.fill()
+
+    target = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    # falls back to painting the whole recording
+    assert surface.replay(target, (0, 0, 100, 100)) == 0
+    target.flush()
+    data = target.get_data().tobytes()
+    assert data[5 * 400 + 5 * 4 + 3] in (255, b"\xff")
+    assert data[55 * 400 + 55 * 4 + 3] in (255, b"\xff")
+
+
+def test_indexed_recording_surface_cull_occluded():
+    surface = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 100, 100))
+    ctx = cairo.Context(surface)
+    assert surface.cull_occluded() == 0
+
+    ctx.set_source_rgb(1, 0, 0)
+    ctx.paint()
+    ctx.rectangle(10, 10, 20, 20)
+    ctx.fill()
+    ctx.move_to(60, 60)
+    ctx.line_to(90, 90)
+    ctx.stroke()
+    # covers the first two
+    ctx.set_source_rgba(0, 0, 1, 0.5)
+    ctx.rectangle(0, 0, 100, 50)
+    ctx.fill()
+    ctx.set_source_rgb(0, 0, 1)
+    ctx.set_operator(cairo.OPERATOR_SOURCE)
+    ctx.rectangle(0, 0, 50, 100)
+    ctx.fill()
+    ctx.set_operator(cairo.OPERATOR_OVER)
+    ctx.rectangle(50, 0, 50, 100)
+    ctx.fill()
+
+    expected = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    ctx = cairo.Context(expected)
+    ctx.set_source_surface(surface)
+    ctx.paint()
+
+    assert surface.cull_occluded() == 4
+    assert surface.cull_occluded() == 0
+
+    result = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    assert surface.replay(result) == 2
+    result.flush()
+    assert result.get_data().tobytes() == expected.get_data().tobytes()
+
+
+def test_raster_cache():
+    with pytest.raises(ValueError):
+        cairo.RasterCache(-1)
+
+    recording = cairo.RecordingSurface(cairo.CONTENT_COLOR_ALPHA, None)
+    ctx = cairo.Context(recording)
+    ctx.rectangle(0, 0, 10, 10)
+    ctx.fill()
+
+    cache = cairo.RasterCache()
+    assert len(cache) == 0
+    target = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    ctx = cairo.Context(target)
+    ctx.scale(2, 2)
+
+    cache.set_source(ctx, recording, 5, 5)
+    ctx.paint()
+    assert (cache.hits, cache.misses) == (0, 1)
+    cache.set_source(ctx, recording, 20, 5)
+    ctx.paint()
+    assert (cache.hits, cache.misses) == (1, 1)
+    assert len(cache) == 1
+    assert cache.size == 20 * 20 * 4
+
+    target.flush()
+    data = target.get_data().tobytes()
+    assert data[(10 * 100 + 10) * 4 + 3:][:1] == b"\xff"
+    assert data[(10 * 100 + 45) * 4 + 3:][:1] == b"\xff"
+    assert data[(40 * 100 + 40) * 4 + 3:][:1] == b"\x00"
+
+    # different scale and rotated, which isn't cached
+    ctx.scale(2, 2)
+    cache.set_source(ctx, recording)
+    ctx.rotate(1)
+    cache.set_source(ctx, recording)
+    assert (cache.hits, cache.misses) == (1, 2)
+    assert len(cache) == 2
+
+    cache.invalidate(recording)
+    assert len(cache) == 0
+    assert cache.size == 0
+
+    with pytest.raises(TypeError):
+        cache.set_source(ctx, target)
+
+    with pytest.raises(TypeError):
+        cache.set_source(ctx, recording, clip=object())
+
+
+def test_raster_cache_budget():
+    recording = cairo.RecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 10, 10))
+    # room for two 10x9 images
+    cache = cairo.RasterCache(10 * 9 * 4 * 2)
+    ctx = cairo.Context(cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10))
+    for x in [0.25, 0.5, 0.25, 0.75, 0.5]:
+        cache.set_source(ctx, recording, x, 0, (0, 0, 9, 9))
+    assert (cache.hits, cache.misses, cache.evictions) == (1, 4, 2)
+    assert len(cache) == 2
+    assert cache.size <= cache.max_size
+    cache.clear()
+    assert len(cache) == 0
+
+
+def test_raster_cache_device_scale():
+    recording = cairo.RecordingSurface(cairo.CONTENT_COLOR_ALPHA, None)
+    ctx = cairo.Context(recording)
+    ctx.rectangle(0, 0, 10, 10)
+    ctx.fill()
+
+    cache = cairo.RasterCache()
+    target = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    ctx = cairo.Context(target)
+    cache.set_source(ctx, recording)
+    assert cache.size == 10 * 10 * 4
+
+    # HiDPI targets get rasters in their own pixel size
+    target.set_device_scale(2, 2)
+    ctx = cairo.Context(target)
+    cache.set_source(ctx, recording)
+    ctx.paint()
+    assert (cache.hits, cache.misses) == (0, 2)
+    assert cache.size == (10 * 10 + 20 * 20) * 4
+
+    target.flush()
+    data = target.get_data().tobytes()
+    assert data[(19 * 100 + 19) * 4 + 3:][:1] == b"\xff"
+    assert data[(21 * 100 + 21) * 4 + 3:][:1] == b"\x00"
+
+
+def test_tiled_surface():
+    surface = cairo.TiledSurface(250, 100, 64, threads=3)
+    assert isinstance(surface, cairo.Surface)
+    assert surface.get_width() == 250
+    assert surface.get_height() == 100
+    assert surface.get_tile_size() == 64
+    assert surface.get_tile_count() == (4, 2)
+
+    ctx = cairo.Context(surface)
+    assert isinstance(ctx.get_target(), cairo.TiledSurface)
+    ctx.set_source_rgb(1, 0, 0)
+    ctx.rectangle(60, 10, 10, 10)
+    ctx.fill()
+
+    tile = surface.get_tile(0, 0)
+    assert isinstance(tile, cairo.ImageSurface)
+    assert (tile.get_width(), tile.get_height()) == (64, 64)
+    data = tile.get_data().tobytes()
+    assert data[(15 * 64 + 62) * 4 + 3:][:1] == b"\xff"
+    assert data[(15 * 64 + 58) * 4 + 3:][:1] == b"\x00"
+
+    tile = surface.get_tile(1, 0)
+    data = tile.get_data().tobytes()
+    assert data[(15 * 64 + 2) * 4 + 3:][:1] == b"\xff"
+    assert data[(15 * 64 + 8) * 4 + 3:][:1] == b"\x00"
+
+    # the last column is smaller, new drawing gets added on flush
+    ctx.paint_with_alpha(0.5)
+    tile = surface.get_tile(3, 1)
+    assert (tile.get_width(), tile.get_height()) == (250 - 3 * 64, 100 - 64)
+    assert tile.get_data().tobytes()[3:4] != b"\x00"
+
+    with pytest.raises(IndexError):
+        surface.get_tile(4, 0)
+
+    with pytest.raises(ValueError):
+        cairo.TiledSurface(0, 10)
+
+    with pytest.raises(ValueError):
+        cairo.TiledSurface(10, 10, 40000)
+
+
+def test_tiled_surface_source_matrix():
+    surface = cairo.TiledSurface(100, 100, 32, threads=2)
+    ctx = cairo.Context(surface)
+    ctx.rectangle(0, 0, 10, 10)
+    ctx.fill()
+    surface.flush()
+
+    # rasterized commands are gone, later ones still use their own source
+    # user space
+    gradient = cairo.LinearGradient(0, 0, 50, 0)
+    gradient.add_color_stop_rgb(0, 1, 0, 0)
+    gradient.add_color_stop_rgb(1, 0, 0, 1)
+    ctx.set_source(gradient)
+    ctx.translate(10, 10)
+    ctx.rectangle(0, 0, 50, 50)
+    ctx.fill()
+
+    expected = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 100)
+    ctx = cairo.Context(expected)
+    ctx.rectangle(0, 0, 10, 10)
+    ctx.fill()
+    ctx.set_source(gradient)
+    ctx.translate(10, 10)
+    ctx.rectangle(0, 0, 50, 50)
+    ctx.fill()
+    expected.flush()
+
+    tile = surface.get_tile(1, 1)
+    data = tile.get_data().tobytes()
+    for y in range(32):
+        offset = ((32 + y) * 100 + 32) * 4
+        assert data[y * tile.get_stride():][:32 * 4] == \
+            expected.get_data().tobytes()[offset:offset + 32 * 4]
+
+
+def test_tiled_surface_write_to_png(tmpdir):
+    surface = cairo.TiledSurface(130, 70, 32)
+    ctx = cairo.Context(surface)
+    ctx.set_source_rgb(0, 0, 1)
+    ctx.rectangle(30, 30, 40, 20)
+    ctx.fill()
+
+    fileobj = io.BytesIO()
+    surface.write_to_png(fileobj)
+    fileobj.seek(0)
+    image = cairo.ImageSurface.create_from_png(fileobj)
+    assert (image.get_width(), image.get_height()) == (130, 70)
+    data = image.get_data().tobytes()
+    offset = (40 * 130 + 50) * 4
+    assert struct.unpack("=I", data[offset:offset + 4])[0] == 0xff0000ff
+    assert data[(10 * 130 + 10) * 4 + 3:][:1] == b"\x00"
+
+    path = os.path.join(str(tmpdir), "tiled.png")
+    surface.write_to_png(path)
+    assert cairo.ImageSurface.create_from_png(path).get_width() == 130
+
+
+@pytest.mark.parametrize("indexed", [False, True])
+def test_render_tile_pyramid(indexed):
+    if indexed:
+        recording = cairo.IndexedRecordingSurface(
+            cairo.CONTENT_COLOR_ALPHA, (0, 0, 400, 200))
+    else:
+        recording = cairo.RecordingSurface(
+            cairo.CONTENT_COLOR_ALPHA, (0, 0, 400, 200))
+    ctx = cairo.Context(recording)
+    ctx.rectangle(10, 10, 80, 80)
+    ctx.fill()
+
+    tiles = {}
+
+    def writer(z, x, y, data):
+        assert (z, x, y) not in tiles
+        tiles[(z, x, y)] = data
+
+    count = cairo.render_tile_pyramid(recording, range(0, 3), 32, writer,
+                                      threads=2)
+    assert count == len(tiles)
+    # the square is in the top left quarter of the top half of the world
+    assert sorted(tiles) == [
+        (0, 0, 0), (1, 0, 0), (2, 0, 0)]
+    image = cairo.ImageSurface.create_from_png(io.BytesIO(tiles[(0, 0, 0)]))
+    assert (image.get_width(), image.get_height()) == (32, 32)
+
+    def failing_writer(z, x, y, data):
+        raise KeyError
+
+    with pytest.raises(KeyError):
+        cairo.render_tile_pyramid(recording, [2], 32, failing_writer)
+
+    with pytest.raises(ValueError):
+        cairo.render_tile_pyramid(recording, [31], 32, writer)
+
+    with pytest.raises(TypeError):
+        cairo.render_tile_pyramid(object(), [0], 32, writer)
+
+    empty = cairo.RecordingSurface(cairo.CONTENT_COLOR_ALPHA, None)
+    assert cairo.render_tile_pyramid(empty, [0, 1], 32, writer) == 0
+
+
+def test_cancel_token():
+    token = cairo.CancelToken()
+    assert not token.cancelled
+    token.check()
+    token.cancel()
+    assert token.cancelled
+    with pytest.raises(cairo.CancelledError) as excinfo:
+        token.check()
+    assert isinstance(excinfo.value, cairo.Error)
+    token.reset()
+    assert not token.cancelled
+
+    token.set_timeout(0)
+    assert token.cancelled
+    with pytest.raises(cairo.DeadlineExceededError):
+        token.check()
+    assert issubclass(cairo.DeadlineExceededError, cairo.CancelledError)
+    token.set_timeout(None)
+    assert not token.cancelled
+    assert not cairo.CancelToken(timeout=1000).cancelled
+
+    with pytest.raises(ValueError):
+        cairo.CancelToken(-1)
+
+    image = cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10)
+    token.cancel()
+    with token:
+        with pytest.raises(cairo.CancelledError):
+            image.write_to_png(io.BytesIO())
+    # only active within the with statement
+    image.write_to_png(io.BytesIO())
+
+    surface = cairo.TiledSurface(100, 100, 32)
+    ctx = cairo.Context(surface)
+    ctx.rectangle(10, 10, 50, 50)
+    ctx.fill()
+    with cairo.CancelToken(timeout=0):
+        with pytest.raises(cairo.DeadlineExceededError):
+            surface.flush()
+    # an interrupted flush gets redone completely
+    data = surface.get_tile(0, 0).get_data().tobytes()
+    assert data[(20 * 32 + 20) * 4 + 3:][:1] == b"\xff"
+
+    recording = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 100, 100))
+    ctx = cairo.Context(recording)
+    ctx.paint()
+    with token:
+        with pytest.raises(cairo.CancelledError):
+            cairo.render_tile_pyramid(
+                recording, [0], 32, lambda *args: None)
+        with pytest.raises(cairo.CancelledError):
+            recording.replay(cairo.ImageSurface(cairo.FORMAT_ARGB32, 1, 1))
+
+
+def test_cancel_token_files(tmpdir):
+    token = cairo.CancelToken()
+    token.cancel()
+
+    image = cairo.ImageSurface(cairo.FORMAT_ARGB32, 10, 10)
+    path = os.path.join(str(tmpdir), "image.png")
+    with token:
+        with pytest.raises(cairo.CancelledError) as excinfo:
+            image.write_to_png(path)
+    assert excinfo.value.status == cairo.Status.CANCELLED
+    image.write_to_png(path)
+    assert cairo.ImageSurface.create_from_png(path).get_width() == 10
+
+    if hasattr(cairo, "PDFSurface"):
+        path = os.path.join(str(tmpdir), "doc.pdf")
+        pdf = cairo.PDFSurface(path, 10, 10)
+        cairo.Context(pdf).paint()
+        with token:
+            with pytest.raises(cairo.CancelledError):
+                pdf.finish()
+
+        # the token active when finishing counts, not the one when drawing
+        pdf = cairo.PDFSurface(path, 10, 10)
+        with token:
+            cairo.Context(pdf).paint()
+        pdf.finish()
+        with open(path, "rb") as h:
+            assert h.read().rstrip().endswith(b"%%EOF")
+
+    # recordings which can't be indexed are painted in bands
+    recording = cairo.IndexedRecordingSurface(
+        cairo.CONTENT_COLOR_ALPHA, (0, 0, 100, 1000))
+    ctx = cairo.Context(recording)
+    ctx.arc(50, 50, 40, 0, 2 * math.pi)
+    ctx.clip()
+    ctx.paint()
+    target = cairo.ImageSurface(cairo.FORMAT_ARGB32, 100, 1000)
+    with token:
+        with pytest.raises(cairo.CancelledError):
+            recording.replay(target)
+    assert recording.replay(target) == 0
+    target.flush()
+    assert target.get_data().tobytes()[(50 * 100 + 50) * 4 + 3:][:1] == \
+        b"\xff"
+
+
+def test_status_pseudo_members():
+    assert cairo.Status.CANCELLED != cairo.Status.LAST_STATUS
+    assert repr(cairo.Status.DEADLINE_EXCEEDED) == \
+        "cairo.Status.DEADLINE_EXCEEDED"
+    assert not hasattr(cairo, "STATUS_CANCELLED")